@@ -0,0 +1,15 @@
+#!/bin/sh
+#
+# Shortcut for running the host-side control loop benchmarks of the pbio library.
+#
+# Prints one CSV row per benchmark case. Pass a case name (or part of it) as the
+# first argument to run only matching cases. Set PBIO_BENCH_BUDGET_NS to fail
+# when the 99th percentile update time of any case exceeds that many ns.
+#
+
+set -e
+
+SCRIPT_DIR=$(dirname "$0")
+
+make -s -C "${SCRIPT_DIR}/lib/pbio/test" bench
+"${SCRIPT_DIR}/lib/pbio/test/build-bench/bench-pbio" "$@"
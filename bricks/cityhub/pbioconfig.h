@@ -7,6 +7,8 @@
 #define PBIO_CONFIG_LIGHT                   (1)
 #define PBIO_CONFIG_TACHO                   (1)
 
+#define PBIO_CONFIG_OBSERVER_FIX16          (1)
+
 #define PBIO_CONFIG_UARTDEV                 (1)
 #define PBIO_CONFIG_UARTDEV_NUM_DEV         (2)
 
@@ -10,13 +10,17 @@
 #include <unistd.h>
 
 #include <sys/time.h>
-#include <sys/timerfd.h>
 
 #include <contiki.h>
 
 #include <glib.h>
 #include <grx-3.0.h>
 
+#include <ev3dev_stretch/lego_sensor.h>
+#include <ev3dev_stretch/nxtcolor.h>
+#include <ev3dev_stretch/sampler.h>
+
+#include <pbdrv/control_timer.h>
 #include <pbio/color.h>
 #include <pbio/config.h>
 #include <pbio/control.h>
@@ -28,27 +32,17 @@
 
 #include "pbinit.h"
 
-// Flag that indicates whether we are busy stopping the thread
-static volatile bool stopping_thread = false;
-static pthread_t task_caller_thread;
-
-// The background thread that keeps firing the task handler
-static void *task_caller(void *arg) {
-    struct timespec ts;
-    ts.tv_sec = 0;
-    ts.tv_nsec = PBIO_CONTROL_LOOP_TIME_MS * 1000000;
-
-    while (!stopping_thread) {
-        MP_THREAD_GIL_ENTER();
-        while (pbio_do_one_event()) {
-        }
-        MP_THREAD_GIL_EXIT();
+// The background thread that keeps firing the task handler. The motors are
+// not updated here, but by the control timer thread, which does not have to
+// wait for the GIL.
+static sampler_t task_caller;
 
-        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
-        etimer_request_poll();
+static void task_caller_poll(void) {
+    etimer_request_poll();
+    MP_THREAD_GIL_ENTER();
+    while (pbio_do_one_event()) {
     }
-
-    return NULL;
+    MP_THREAD_GIL_EXIT();
 }
 
 // Pybricks initialization tasks
@@ -100,14 +94,20 @@ void pybricks_init(void) {
     pbio_init();
     extern void ev3dev_status_light_init(void);
     ev3dev_status_light_init();
-    pthread_create(&task_caller_thread, NULL, task_caller, NULL);
+    sampler_start(&task_caller, PBIO_CONTROL_LOOP_TIME_MS * 1000, task_caller_poll);
 }
 
 // Pybricks deinitialization tasks
 void pybricks_deinit(void) {
-    // Signal motor thread to stop and wait for it to do so.
-    stopping_thread = true;
-    pthread_join(task_caller_thread, NULL);
+    // Stop the task handler thread and wait for it to do so.
+    sampler_stop(&task_caller);
+
+    // Stop the control loop, which runs in a thread of its own
+    pbdrv_control_timer_stop();
+
+    // Stop reading sensors in the background
+    lego_sensor_sampler_stop();
+    nxtcolor_sampler_stop();
 }
 
 void pybricks_unhandled_exception(void) {
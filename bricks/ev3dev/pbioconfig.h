@@ -6,3 +6,5 @@
 #define PBIO_CONFIG_LIGHT                   (1)
 #define PBIO_CONFIG_SERIAL                  (1)
 #define PBIO_CONFIG_TACHO                   (1)
+
+#define PBIO_CONFIG_CONTROL_LOOP_TIMER      (1)
@@ -4,6 +4,7 @@
 #define PBIO_CONFIG_IOPORT_LPF2             (1)
 
 #define PBIO_CONFIG_DCMOTOR                 (1)
+#define PBIO_CONFIG_IMU                     (1)
 #define PBIO_CONFIG_LIGHT                   (1)
 #define PBIO_CONFIG_LIGHT_MATRIX              (1)
 #define PBIO_CONFIG_TACHO                   (1)
@@ -12,3 +13,5 @@
 #define PBIO_CONFIG_UARTDEV_NUM_DEV         (6)
 
 #define PBIO_CONFIG_ENABLE_SYS              (1)
+
+#define PBIO_CONFIG_CONTROL_LOOP_TIMER      (1)
@@ -1,12 +1,16 @@
 // SPDX-License-Identifier: MIT
 // Copyright (c) 2018-2020 The Pybricks Authors
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <contiki.h>
 
+#include <pbdrv/bluetooth.h>
+#include <pbdrv/config.h>
+#include <pbdrv/flash.h>
 #include <pbio/button.h>
 #include <pbio/main.h>
 #include <pbio/light.h>
@@ -67,6 +71,24 @@ static pbio_error_t wait_for_button_release(void) {
     return PBIO_SUCCESS;
 }
 
+// Returns PBIO_ERROR_CANCELED once the button is pressed and released
+static pbio_error_t check_button_cancel(void) {
+    pbio_button_flags_t btn;
+    pbio_error_t err = pbio_button_is_pressed(&btn);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    if (btn & PBIO_BUTTON_CENTER) {
+        // Wait for release before cancelling
+        err = wait_for_button_release();
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        return PBIO_ERROR_CANCELED;
+    }
+    return PBIO_SUCCESS;
+}
+
 // Wait for data from an IDE
 static pbio_error_t get_message(uint8_t *buf, uint32_t rx_len, int32_t time_out) {
     // Maximum time between two bytes/chunks
@@ -82,24 +104,14 @@ static pbio_error_t get_message(uint8_t *buf, uint32_t rx_len, int32_t time_out)
     uint32_t rx_count = 0;
     mp_uint_t time_start = mp_hal_ticks_ms();
     mp_uint_t time_now;
-    pbio_button_flags_t btn;
 
     while (true) {
 
-        // Check if button is pressed
-        err = pbio_button_is_pressed(&btn);
+        // Cancel waiting for message if button is pressed
+        err = check_button_cancel();
         if (err != PBIO_SUCCESS) {
             return err;
         }
-        if (btn & PBIO_BUTTON_CENTER) {
-            // If so, wait for release
-            err = wait_for_button_release();
-            if (err != PBIO_SUCCESS) {
-                return err;
-            }
-            // Cancel waiting for message
-            return PBIO_ERROR_CANCELED;
-        }
 
         // Current time
         time_now = mp_hal_ticks_ms();
@@ -147,6 +159,392 @@ static pbio_error_t get_message(uint8_t *buf, uint32_t rx_len, int32_t time_out)
     }
 }
 
+// Programs can also be downloaded in chunks that are each checked with a
+// CRC32, so that only bad chunks have to be sent again. The host selects this
+// by sending DOWNLOAD_MAGIC ("PBDL") instead of the program length, followed
+// by these frames. All numbers are little-endian.
+//
+//   'H' len:u32 crc:u32 crc32(len, crc):u32    Start or resume a download.
+//                                              crc is the CRC32 of the program.
+//   'D' index:u16 data crc32(index, data):u32  Chunk of DOWNLOAD_CHUNK_SIZE
+//                                              bytes. The last may be shorter.
+//   'S' "PBDL"                                 Status request.
+//
+// The hub replies to 'H' and 'S' with 'S' next:u16 bitmap:u32, where next is
+// the first missing chunk and bit i of bitmap tells whether chunk next + i was
+// received. The host sends a window of missing chunks and then asks for the
+// status again, until next equals the number of chunks. Sending 'H' with the
+// same length and CRC again keeps the chunks that were already received, so a
+// host can resume after reconnecting. If the hub still has the program from an
+// earlier download, it replies to 'H' with next equal to the number of chunks
+// and runs the program without downloading it.
+#define DOWNLOAD_MAGIC (0x4C444250)
+#define DOWNLOAD_CHUNK_SIZE (128)
+#define DOWNLOAD_WINDOW (32)
+
+// Incomplete frames are discarded after this time (ms) without data, so that
+// the next frame is parsed from the start again
+#define DOWNLOAD_FRAME_TIMEOUT (100)
+// The download is aborted after this time (ms) without data
+#define DOWNLOAD_TIMEOUT (5000)
+
+typedef enum {
+    DOWNLOAD_FRAME_HEADER = 'H',
+    DOWNLOAD_FRAME_DATA = 'D',
+    DOWNLOAD_FRAME_STATUS = 'S',
+} download_frame_type_t;
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t crc;
+    uint8_t *received;
+    uint16_t num_chunks;
+    uint16_t next;
+    const uint8_t *cached;
+} download_t;
+
+// Same as zlib crc32(), so that hosts can use a standard implementation
+static uint32_t download_crc32(uint32_t crc, const uint8_t *data, uint32_t size) {
+    crc = ~crc;
+    while (size--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t get_u32_le(const uint8_t *data) {
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint32_t download_chunk_size(const download_t *dl, uint16_t index) {
+    return MIN(DOWNLOAD_CHUNK_SIZE, dl->len - index * DOWNLOAD_CHUNK_SIZE);
+}
+
+static bool download_has_chunk(const download_t *dl, uint16_t index) {
+    return dl->received[index / 8] & (1 << (index % 8));
+}
+
+static void download_send_status(const download_t *dl) {
+    uint32_t bitmap = 0;
+    for (uint32_t i = 0; i < DOWNLOAD_WINDOW && dl->next + i < dl->num_chunks; i++) {
+        if (download_has_chunk(dl, dl->next + i)) {
+            bitmap |= (uint32_t)1 << i;
+        }
+    }
+    const uint8_t status[] = {
+        DOWNLOAD_FRAME_STATUS, dl->next, dl->next >> 8,
+        bitmap, bitmap >> 8, bitmap >> 16, bitmap >> 24,
+    };
+    mp_hal_stdout_tx_strn((const char *)status, sizeof(status));
+}
+
+static void download_free(download_t *dl) {
+    m_free(dl->buf);
+    m_free(dl->received);
+    dl->buf = NULL;
+    dl->received = NULL;
+}
+
+#if PBDRV_CONFIG_FLASH
+
+// Defined in linker script
+extern uint8_t _pb_program_cache_start;
+extern uint8_t _pb_program_cache_size;
+
+// The most recently downloaded program is kept in flash, keyed by its length
+// and CRC32, so that running it again does not require a download, not even
+// after a reboot. The header is written last, so a program that was not
+// written completely is never used.
+#define PROGRAM_CACHE_MAGIC (0x48434250) // "PBCH"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    uint32_t crc;
+    uint32_t reserved;
+} program_cache_header_t;
+
+// Gets the cached program with the given length and CRC32, or NULL
+static const uint8_t *program_cache_find(uint32_t len, uint32_t crc) {
+    const program_cache_header_t *header = (const program_cache_header_t *)&_pb_program_cache_start;
+    const uint8_t *data = (const uint8_t *)(header + 1);
+
+    if ((uint32_t)&_pb_program_cache_size < sizeof(*header) + len) {
+        return NULL;
+    }
+    if (header->magic != PROGRAM_CACHE_MAGIC || header->len != len || header->crc != crc) {
+        return NULL;
+    }
+    if (download_crc32(0, data, len) != crc) {
+        return NULL;
+    }
+    return data;
+}
+
+// Stores the program in flash. This masks all interrupts for 1 to 2 s, see
+// program_cache_store_pending().
+static void program_cache_store(const uint8_t *buf, uint32_t len, uint32_t crc) {
+    uint32_t start = (uint32_t)&_pb_program_cache_start;
+    uint32_t size = (uint32_t)&_pb_program_cache_size;
+    program_cache_header_t header = {
+        .magic = PROGRAM_CACHE_MAGIC,
+        .len = len,
+        .crc = crc,
+        .reserved = 0xFFFFFFFF,
+    };
+
+    if (size < sizeof(header) + len || pbdrv_flash_erase(start, size) != PBIO_SUCCESS) {
+        return;
+    }
+
+    // Write all whole words, then the remaining bytes padded with erased bytes
+    uint32_t data = start + sizeof(header);
+    uint32_t aligned = len & ~3;
+    if (pbdrv_flash_write(data, (const uint32_t *)buf, aligned) != PBIO_SUCCESS) {
+        return;
+    }
+    if (aligned != len) {
+        uint32_t tail = 0xFFFFFFFF;
+        memcpy(&tail, &buf[aligned], len - aligned);
+        if (pbdrv_flash_write(data + aligned, &tail, sizeof(tail)) != PBIO_SUCCESS) {
+            return;
+        }
+    }
+
+    pbdrv_flash_write(start, (const uint32_t *)&header, sizeof(header));
+}
+
+// Maximum time to wait for stdout to be sent before storing a program (ms)
+#define PROGRAM_CACHE_STDOUT_TIMEOUT (1000)
+
+// Downloaded program that still has to be stored, by its CRC32
+static bool program_cache_pending;
+static uint32_t program_cache_pending_crc;
+
+// Marks a downloaded program to be stored once it has ended. Returns true if
+// so, in which case its buffer has to be kept until then.
+static bool program_cache_defer(uint32_t crc) {
+    program_cache_pending = true;
+    program_cache_pending_crc = crc;
+    return true;
+}
+
+// Stores the program that was downloaded last, if any. Erasing the cache
+// sector masks all interrupts for 1 to 2 s. This is why it is only done after
+// the program has ended and the motors have stopped, and after stdout has been
+// sent, including the download status for the host. Bluetooth stays connected
+// because the Bluetooth chip is held off by UART flow control. Sensors may
+// have to sync again and the system clock falls behind by the erase time.
+static void program_cache_store_pending(const uint8_t *buf, uint32_t len) {
+    if (!program_cache_pending) {
+        return;
+    }
+    program_cache_pending = false;
+
+    mp_uint_t start = mp_hal_ticks_ms();
+    while (!pbdrv_bluetooth_tx_is_idle() && mp_hal_ticks_ms() - start < PROGRAM_CACHE_STDOUT_TIMEOUT) {
+        pbio_do_one_event();
+    }
+
+    program_cache_store(buf, len, program_cache_pending_crc);
+}
+
+#else // PBDRV_CONFIG_FLASH
+
+static const uint8_t *program_cache_find(uint32_t len, uint32_t crc) {
+    return NULL;
+}
+
+static bool program_cache_defer(uint32_t crc) {
+    return false;
+}
+
+static void program_cache_store_pending(const uint8_t *buf, uint32_t len) {
+}
+
+#endif // PBDRV_CONFIG_FLASH
+
+static pbio_error_t download_handle_header(download_t *dl, const uint8_t *frame) {
+    if (get_u32_le(&frame[9]) != download_crc32(0, &frame[1], 8)) {
+        // Corrupted, so wait for the host to send it again
+        return PBIO_SUCCESS;
+    }
+
+    uint32_t len = get_u32_le(&frame[1]);
+    uint32_t crc = get_u32_le(&frame[5]);
+
+    // Same program as before, so keep the chunks we already have
+    if (dl->buf && len == dl->len && crc == dl->crc) {
+        download_send_status(dl);
+        return PBIO_SUCCESS;
+    }
+
+    if (len == 0 || len > MPY_MAX_BYTES) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (dl->buf) {
+        download_free(dl);
+    }
+    dl->len = len;
+    dl->crc = crc;
+    dl->num_chunks = (len + DOWNLOAD_CHUNK_SIZE - 1) / DOWNLOAD_CHUNK_SIZE;
+
+    // Tell the host that we are done if we already have this program
+    dl->cached = program_cache_find(len, crc);
+    if (dl->cached) {
+        dl->next = dl->num_chunks;
+        download_send_status(dl);
+        return PBIO_SUCCESS;
+    }
+
+    dl->next = 0;
+    dl->buf = m_malloc(len);
+    dl->received = m_malloc((dl->num_chunks + 7) / 8);
+    memset(dl->received, 0, (dl->num_chunks + 7) / 8);
+
+    download_send_status(dl);
+    return PBIO_SUCCESS;
+}
+
+static void download_handle_data(download_t *dl, const uint8_t *frame, uint32_t frame_size) {
+    uint16_t index = frame[1] | frame[2] << 8;
+    uint32_t size = frame_size - 7;
+
+    if (!dl->buf || index >= dl->num_chunks || size != download_chunk_size(dl, index)) {
+        return;
+    }
+
+    // Drop corrupted chunks and chunks that were already received
+    if (get_u32_le(&frame[3 + size]) != download_crc32(0, &frame[1], size + 2) || download_has_chunk(dl, index)) {
+        return;
+    }
+
+    memcpy(&dl->buf[index * DOWNLOAD_CHUNK_SIZE], &frame[3], size);
+    dl->received[index / 8] |= 1 << (index % 8);
+
+    while (dl->next < dl->num_chunks && download_has_chunk(dl, dl->next)) {
+        dl->next++;
+    }
+
+    // All chunks passed their own check, so this only fails if the host
+    // sent chunks of some other program. Start over if it does.
+    if (dl->next == dl->num_chunks && download_crc32(0, dl->buf, dl->len) != dl->crc) {
+        memset(dl->received, 0, (dl->num_chunks + 7) / 8);
+        dl->next = 0;
+    }
+}
+
+// Gets the size of the frame that starts with the given bytes, or 0 if more
+// bytes are needed to tell
+static uint32_t download_frame_size(const download_t *dl, const uint8_t *frame, uint32_t pos) {
+    switch (frame[0]) {
+        case DOWNLOAD_FRAME_HEADER:
+            return 13;
+        case DOWNLOAD_FRAME_STATUS:
+            return 5;
+        case DOWNLOAD_FRAME_DATA: {
+            if (pos < 3) {
+                return 0;
+            }
+            uint16_t index = frame[1] | frame[2] << 8;
+            if (!dl->buf || index >= dl->num_chunks) {
+                // Not a valid chunk, so skip what we have
+                return pos;
+            }
+            return 7 + download_chunk_size(dl, index);
+        }
+        default:
+            // Not a frame, so skip this byte
+            return 1;
+    }
+}
+
+// Receives a program with the chunked download protocol. The program is
+// allocated on the heap, unless it was already cached in flash. free_len is 0
+// if the program is not freed after loading it.
+static pbio_error_t download_program(uint8_t **buf, uint32_t *len, uint32_t *free_len) {
+    static uint8_t frame[7 + DOWNLOAD_CHUNK_SIZE];
+    download_t dl = { 0 };
+    uint32_t pos = 0;
+    uint32_t frame_size = 0;
+    mp_uint_t time_last = mp_hal_ticks_ms();
+    pbio_error_t err;
+
+    while (true) {
+        err = check_button_cancel();
+        if (err != PBIO_SUCCESS) {
+            break;
+        }
+
+        mp_uint_t time_now = mp_hal_ticks_ms();
+
+        // Parse everything that was received so far
+        while (pbsys_stdin_get_char(&frame[pos]) == PBIO_SUCCESS) {
+            time_last = time_now;
+            pos++;
+
+            if (frame_size == 0) {
+                frame_size = download_frame_size(&dl, frame, pos);
+            }
+            if (frame_size == 0 || pos < frame_size) {
+                continue;
+            }
+
+            if (frame[0] == DOWNLOAD_FRAME_HEADER) {
+                err = download_handle_header(&dl, frame);
+                if (err != PBIO_SUCCESS) {
+                    goto out;
+                }
+                if (dl.cached) {
+                    *buf = (uint8_t *)dl.cached;
+                    *len = dl.len;
+                    *free_len = 0;
+                    return PBIO_SUCCESS;
+                }
+            } else if (frame[0] == DOWNLOAD_FRAME_DATA) {
+                download_handle_data(&dl, frame, frame_size);
+            } else if (frame[0] == DOWNLOAD_FRAME_STATUS && get_u32_le(&frame[1]) == DOWNLOAD_MAGIC && dl.buf) {
+                download_send_status(&dl);
+                if (dl.next == dl.num_chunks) {
+                    // The status is only queued here, so it can't be stored
+                    // yet. The buffer is kept while the program runs.
+                    m_free(dl.received);
+                    *buf = dl.buf;
+                    *len = dl.len;
+                    *free_len = program_cache_defer(dl.crc) ? 0 : dl.len;
+                    return PBIO_SUCCESS;
+                }
+            }
+            pos = 0;
+            frame_size = 0;
+        }
+
+        // Start over with the next frame if this one is not completed in time
+        if (pos > 0 && time_now - time_last > DOWNLOAD_FRAME_TIMEOUT) {
+            pos = 0;
+            frame_size = 0;
+        }
+
+        if (time_now - time_last > DOWNLOAD_TIMEOUT) {
+            err = PBIO_ERROR_TIMEDOUT;
+            break;
+        }
+
+        pb_stm32_poll();
+    }
+
+out:
+    if (dl.buf) {
+        download_free(&dl);
+    }
+    return err;
+}
+
 // Defined in linker script
 extern uint32_t _pb_user_mpy_size;
 extern uint8_t _pb_user_mpy_data;
@@ -187,6 +585,15 @@ static uint32_t get_user_program(uint8_t **buf, uint32_t *free_len) {
         return REPL_LEN;
     }
 
+    // Get the program in chunks
+    if (len == DOWNLOAD_MAGIC) {
+        err = download_program(buf, &len, free_len);
+        if (err != PBIO_SUCCESS) {
+            return 0;
+        }
+        return len;
+    }
+
     // Assert that the length is allowed
     if (len > MPY_MAX_BYTES) {
         return 0;
@@ -320,6 +727,9 @@ soft_reset:
     mp_deinit();
     pbsys_unprepare_user_program();
 
+    // Keep a downloaded program in flash, now that it has ended
+    program_cache_store_pending(program, len);
+
     goto soft_reset;
 
     return 0;
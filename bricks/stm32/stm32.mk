@@ -237,6 +237,7 @@ PYBRICKS_PYBRICKS_SRC_C = $(addprefix pybricks/,\
 	pybricks.c \
 	robotics/pb_module_robotics.c \
 	robotics/pb_type_drivebase.c \
+	robotics/pb_type_motorgroup.c \
 	tools/pb_module_tools.c \
 	tools/pb_type_stopwatch.c \
 	util_mp/pb_obj_helper.c \
@@ -399,9 +400,11 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	drv/button/button_adc.c \
 	drv/button/button_gpio.c \
 	drv/clock/clock_stm32.c \
+	drv/control_timer/control_timer_stm32_tim.c \
 	drv/core.c \
 	drv/counter/counter_core.c \
 	drv/counter/counter_stm32f0_gpio_quad_enc.c \
+	drv/flash/flash_stm32f4.c \
 	drv/gpio/gpio_stm32f0.c \
 	drv/gpio/gpio_stm32f4.c \
 	drv/gpio/gpio_stm32l4.c \
@@ -424,10 +427,12 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	platform/$(PBIO_PLATFORM)/platform.c \
 	platform/$(PBIO_PLATFORM)/sys.c \
 	src/color/conversion.c \
+	src/command.c \
 	src/control.c \
 	src/dcmotor.c \
 	src/drivebase.c \
 	src/error.c \
+	src/imu.c \
 	src/integrator.c \
 	src/iodev.c \
 	src/light/animation.c \
@@ -436,6 +441,7 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	src/logger.c \
 	src/main.c \
 	src/math.c \
+	src/motor_group.c \
 	src/motor_process.c \
 	src/observer.c \
 	src/servo.c \
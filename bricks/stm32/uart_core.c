@@ -23,13 +23,20 @@ int mp_hal_stdin_rx_chr(void) {
 
 // Send string of given length
 void mp_hal_stdout_tx_strn(const char *str, mp_uint_t len) {
-    uint8_t c;
+    size_t written;
 
-    while (len--) {
-        c = *str++;
-        while (pbsys_stdout_put_char(c) == PBIO_ERROR_AGAIN) {
+    while (len) {
+        pbio_error_t err = pbsys_stdout_put_buf((const uint8_t *)str, len, &written);
+        if (err == PBIO_ERROR_AGAIN) {
             // only run pbio events here - don't want keyboard interrupt in middle of printf()
             MICROPY_VM_HOOK_LOOP
+            continue;
+        }
+        if (err != PBIO_SUCCESS) {
+            // drop output if there is nowhere to send it
+            return;
         }
+        str += written;
+        len -= written;
     }
 }
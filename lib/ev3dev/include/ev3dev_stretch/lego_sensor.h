@@ -61,4 +61,8 @@ pbio_error_t lego_sensor_get_mode(lego_sensor_t *sensor, uint8_t *mode);
 
 pbio_error_t lego_sensor_set_mode(lego_sensor_t *sensor, uint8_t mode);
 
+pbio_error_t lego_sensor_sampler_start(uint32_t rate);
+
+void lego_sensor_sampler_stop(void);
+
 #endif // _PBIO_LEGO_SENSOR_H_
@@ -11,4 +11,8 @@
 
 pbio_error_t nxtcolor_get_values_at_mode(pbio_port_t port, uint8_t mode, void *values);
 
+pbio_error_t nxtcolor_sampler_start(uint32_t rate);
+
+void nxtcolor_sampler_stop(void);
+
 #endif // _PBIO_NXTCOLOR_H_
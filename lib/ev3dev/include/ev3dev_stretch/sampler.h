@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#ifndef _PBIO_EV3DEVSAMPLER_H_
+#define _PBIO_EV3DEVSAMPLER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pbio/error.h>
+
+// Background thread that calls a function at a fixed period
+typedef struct {
+    pthread_t thread;
+    bool running;
+    volatile bool stopping;
+    uint32_t period_us;
+    void (*poll)(void);
+} sampler_t;
+
+uint32_t sampler_time_us(void);
+
+pbio_error_t sampler_start(sampler_t *sampler, uint32_t period_us, void (*poll)(void));
+
+void sampler_stop(sampler_t *sampler);
+
+bool sampler_is_recent(const sampler_t *sampler, uint32_t time);
+
+void sampler_snapshot_write(uint32_t *seq, void *snapshot, const void *data, size_t size);
+
+uint32_t sampler_snapshot_read(const uint32_t *seq, const void *snapshot, void *data, size_t size);
+
+#endif // _PBIO_EV3DEVSAMPLER_H_
@@ -27,5 +27,30 @@ pbio_error_t sysfs_read_int(FILE *file, int *dest);
 
 pbio_error_t sysfs_write_int(FILE *file, int val);
 
+/**
+ * Statistics of the raw file descriptor reads and writes.
+ */
+typedef struct {
+    uint32_t reads;     /**< Number of reads */
+    uint32_t writes;    /**< Number of writes */
+    uint32_t time_sum;  /**< Total time spent in reads and writes (us) */
+    uint32_t time_max;  /**< Longest read or write (us) */
+} sysfs_stats_t;
+
+pbio_error_t sysfs_open_fd(int *fd, const char *pathpat, int n, const char *attribute, int flags);
+
+pbio_error_t sysfs_open_sensor_attr_fd(int *fd, int n, const char *attribute, int flags);
+
+pbio_error_t sysfs_open_tacho_motor_attr_fd(int *fd, int n, const char *attribute, int flags);
+
+pbio_error_t sysfs_open_dc_motor_attr_fd(int *fd, int n, const char *attribute, int flags);
+
+pbio_error_t sysfs_pread_int(int fd, int32_t *dest);
+
+pbio_error_t sysfs_pwrite_int(int fd, int32_t val);
+
+void sysfs_get_stats(sysfs_stats_t *stats);
+
+void sysfs_reset_stats(void);
 
 #endif // _PBIO_EV3DEVSYSFS_H_
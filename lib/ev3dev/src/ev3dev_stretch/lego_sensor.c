@@ -2,12 +2,15 @@
 // Copyright (c) 2018-2020 The Pybricks Authors
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ev3dev_stretch/lego_port.h>
 #include <ev3dev_stretch/lego_sensor.h>
+#include <ev3dev_stretch/sampler.h>
 #include <ev3dev_stretch/sysfs.h>
 
 #include <pbio/iodev.h>
@@ -18,17 +21,35 @@
 #define MAX_READ_LENGTH "60"
 #define BIN_DATA_SIZE   32 // size of bin_data sysfs attribute
 
+// Sample by the sampler thread
+typedef struct {
+    uint32_t time;
+    uint8_t data[BIN_DATA_SIZE];
+} lego_sensor_snapshot_t;
+
 struct _lego_sensor_t {
     int n_sensor;
     int n_modes;
     FILE *f_mode;
     FILE *f_driver_name;
-    FILE *f_bin_data;
+    int fd_bin_data;
     FILE *f_num_values;
     FILE *f_bin_data_format;
     char modes[12][17];
     uint8_t bin_data[PBIO_IODEV_MAX_DATA_SIZE]  __attribute__((aligned(32)));
+    // Whether the sampler thread reads this sensor
+    bool sampled;
+    // Snapshots older than this are from before the last mode change (us)
+    uint32_t not_before;
+    bool mode_changed;
+    // Latest sample by the sampler thread and its sequence count
+    uint32_t snapshot_seq;
+    lego_sensor_snapshot_t snapshot;
 };
+
+// Background thread that reads the bin_data of all sensors at a fixed rate
+static sampler_t sampler;
+
 // Initialize an ev3dev sensor by opening the relevant sysfs attributes
 static pbio_error_t ev3_sensor_init(lego_sensor_t *sensor, pbio_port_t port) {
     pbio_error_t err;
@@ -58,7 +79,7 @@ static pbio_error_t ev3_sensor_init(lego_sensor_t *sensor, pbio_port_t port) {
         return err;
     }
 
-    err = sysfs_open_sensor_attr(&sensor->f_bin_data, sensor->n_sensor, "bin_data", "rb");
+    err = sysfs_open_sensor_attr_fd(&sensor->fd_bin_data, sensor->n_sensor, "bin_data", O_RDONLY);
     if (err != PBIO_SUCCESS) {
         return err;
     }
@@ -168,6 +189,9 @@ pbio_error_t lego_sensor_get(lego_sensor_t **sensor, pbio_port_t port, pbio_iode
 
     *sensor = &sensors[port - PBIO_PORT_1];
 
+    // Stop sampling this port while it is being set up
+    __atomic_store_n(&(*sensor)->sampled, false, __ATOMIC_RELEASE);
+
     pbio_error_t err;
 
     // Initialize port if needed for this ID
@@ -195,6 +219,10 @@ pbio_error_t lego_sensor_get(lego_sensor_t **sensor, pbio_port_t port, pbio_iode
     if (err != PBIO_SUCCESS) {
         return err;
     }
+
+    // The sampler may read it from now on
+    (*sensor)->mode_changed = true;
+    __atomic_store_n(&(*sensor)->sampled, true, __ATOMIC_RELEASE);
     return PBIO_SUCCESS;
 }
 
@@ -288,20 +316,76 @@ pbio_error_t lego_sensor_set_mode(lego_sensor_t *sensor, uint8_t mode) {
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    // Samples taken so far are from the old mode
+    sensor->mode_changed = true;
+
     return sysfs_write_str(sensor->f_mode, sensor->modes[mode]);
 }
 
-// Read 32 bytes from bin_data attribute
-pbio_error_t lego_sensor_get_bin_data(lego_sensor_t *sensor, uint8_t **bin_data) {
-    if (fseek(sensor->f_bin_data, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
+// Copy the latest sample of the sampler thread, if there is a recent one
+// that was taken after the last direct read
+static bool lego_sensor_get_snapshot(lego_sensor_t *sensor) {
+    if (!sampler.running || !sensor->sampled || sensor->mode_changed) {
+        return false;
     }
 
-    if (fread(sensor->bin_data, 1, BIN_DATA_SIZE, sensor->f_bin_data) < BIN_DATA_SIZE) {
-        return PBIO_ERROR_IO;
+    lego_sensor_snapshot_t snapshot;
+    if (sampler_snapshot_read(&sensor->snapshot_seq, &sensor->snapshot, &snapshot, sizeof(snapshot)) == 0) {
+        return false;
     }
+    memcpy(sensor->bin_data, snapshot.data, BIN_DATA_SIZE);
+
+    // Also reject samples that are late because the sampler has stalled
+    return (int32_t)(snapshot.time - sensor->not_before) >= 0 && sampler_is_recent(&sampler, snapshot.time);
+}
 
+// Read 32 bytes from bin_data attribute. If the sampler thread is running,
+// this is usually a copy of its latest sample.
+pbio_error_t lego_sensor_get_bin_data(lego_sensor_t *sensor, uint8_t **bin_data) {
     *bin_data = sensor->bin_data;
 
+    if (lego_sensor_get_snapshot(sensor)) {
+        return PBIO_SUCCESS;
+    }
+
+    // Read it now. From here on, only samples that started after this read
+    // can be used, so that data from before a mode change does not come back.
+    sensor->not_before = sampler_time_us();
+    sensor->mode_changed = false;
+
+    if (pread(sensor->fd_bin_data, sensor->bin_data, BIN_DATA_SIZE, 0) < BIN_DATA_SIZE) {
+        return PBIO_ERROR_IO;
+    }
+
     return PBIO_SUCCESS;
 }
+
+// Reads all sensors that are set up for it
+static void lego_sensor_sampler_poll(void) {
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(sensors); i++) {
+        lego_sensor_t *sensor = &sensors[i];
+        if (!__atomic_load_n(&sensor->sampled, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        lego_sensor_snapshot_t snapshot;
+        snapshot.time = sampler_time_us();
+        if (pread(sensor->fd_bin_data, snapshot.data, BIN_DATA_SIZE, 0) < BIN_DATA_SIZE) {
+            continue;
+        }
+        sampler_snapshot_write(&sensor->snapshot_seq, &sensor->snapshot, &snapshot, sizeof(snapshot));
+    }
+}
+
+// Start reading all sensors in the background at the given rate (Hz)
+pbio_error_t lego_sensor_sampler_start(uint32_t rate) {
+    if (rate == 0 || rate > 1000) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    return sampler_start(&sampler, 1000000 / rate, lego_sensor_sampler_poll);
+}
+
+// Stop reading sensors in the background
+void lego_sensor_sampler_stop(void) {
+    sampler_stop(&sampler);
+}
@@ -2,22 +2,54 @@
 // Copyright (c) 2019-2020 The Pybricks Authors
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 
 #include <contiki.h>
 
 #include <ev3dev_stretch/lego_sensor.h>
+#include <ev3dev_stretch/nxtcolor.h>
+#include <ev3dev_stretch/sampler.h>
 #include <ev3dev_stretch/sysfs.h>
 
 #include <pbio/color.h>
 #include <pbio/port.h>
 #include <pbio/iodev.h>
+#include <pbio/util.h>
 
 #define IN (0)
 #define OUT (1)
 
+// Minimum time between two changes of the clock or data pins (us). The
+// faster pin drivers would otherwise go faster than the sensor can follow.
+#define EDGE_DELAY_US (10)
+
+// Time for the lamp and the analog output to settle after the lamp color
+// changes, before it is sampled (us). With the sysfs pin driver, file access
+// alone used to take about this long. This is an estimate that has not yet
+// been measured on a real sensor with the faster pin drivers.
+#define LAMP_SETTLE_US (300)
+
+// The faster pin drivers are off until LAMP_SETTLE_US has been measured
+#ifndef PB_NXTCOLOR_FAST_PINS
+#define PB_NXTCOLOR_FAST_PINS (0)
+#endif
+
+// GPIO controller registers of the AM1808, for the bank pair with GPIO 0-31
+#define GPIO_REG_BASE (0x01E26000)
+#define GPIO_REG_SIZE (0x1000)
+#define GPIO_REG_SET_DATA01 (0x18 / 4)
+#define GPIO_REG_CLR_DATA01 (0x1C / 4)
+#define GPIO_REG_IN_DATA01 (0x20 / 4)
+
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #define max(a, b) ((a) > (b) ? (a) : (b))
 
@@ -62,7 +94,27 @@ typedef enum {
     NXT_LAMP_OFF
 } nxtcolor_color_state;
 
-typedef struct _nxtcolor_t {
+typedef struct _nxtcolor_t nxtcolor_t;
+
+// Measurement by the sampler thread, with the times it started and ended (us)
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint32_t rgba[4];
+} nxtcolor_snapshot_t;
+
+// Ways to drive the digital pins, from fastest to slowest
+typedef struct {
+    // Takes the pins, with digi0 and digi1 as low outputs
+    pbio_error_t (*open)(nxtcolor_t *nxtcolor);
+    // Makes digi1 an input or an output
+    pbio_error_t (*set_digi1_dir)(nxtcolor_t *nxtcolor, bool dir);
+    // Sets digi0, and digi1 if it is an output, to the values in nxtcolor
+    pbio_error_t (*set)(nxtcolor_t *nxtcolor);
+    pbio_error_t (*get_digi1)(nxtcolor_t *nxtcolor, bool *val);
+} nxtcolor_gpio_funcs_t;
+
+struct _nxtcolor_t {
     bool ready;
     bool fs_initialized;
     bool waiting;
@@ -75,16 +127,49 @@ typedef struct _nxtcolor_t {
     uint16_t crc;
     uint32_t wait_start;
     const nxtcolor_pininfo_t *pins;
+    const nxtcolor_gpio_funcs_t *funcs;
+    bool digi0;
+    bool digi1;
+    bool digi1_dir;
+    uint32_t edge_time;
+    // GPIO character device
+    int chip;
+    uint32_t digi0_offset;
+    uint32_t digi1_offset;
+    int fd_out;
+    int fd_in;
+    // sysfs GPIO
     FILE *f_digi0_val;
     FILE *f_digi0_dir;
     FILE *f_digi1_val;
     FILE *f_digi1_dir;
-    bool digi1_dir;
+    bool digi0_written;
+    bool digi1_written;
     FILE *f_adc_val;
     FILE *f_adc_con;
-} nxtcolor_t;
+    // Held while the pins are in use, by the sampler or by the user
+    pthread_mutex_t lock;
+    // Whether the sampler should measure, which is only the case while the
+    // user reads colors and not while a steady lamp color is set
+    bool measuring;
+    // Snapshots older than this are from before the last direct read (us)
+    uint32_t not_before;
+    // Latest measurement by the sampler and its sequence count
+    uint32_t snapshot_seq;
+    nxtcolor_snapshot_t snapshot;
+};
 
-nxtcolor_t nxtcolorsensors[4];
+nxtcolor_t nxtcolorsensors[4] = {
+    [0 ... 3] = { .lock = PTHREAD_MUTEX_INITIALIZER },
+};
+
+// Background thread that measures the colors of all NXT Color Sensors
+static sampler_t sampler;
+
+#if PB_NXTCOLOR_FAST_PINS
+// Mapped GPIO registers, shared by all sensors
+static volatile uint32_t *gpio_regs;
+#endif
 
 // Simplistic nonbusy wait. May be called only once per blocking operation.
 pbio_error_t nxtcolor_wait(nxtcolor_t *nxtcolor, uint32_t ms) {
@@ -109,41 +194,307 @@ pbio_error_t nxtcolor_wait(nxtcolor_t *nxtcolor, uint32_t ms) {
     }
 }
 
-static pbio_error_t nxtcolor_set_digi0(nxtcolor_t *nxtcolor, bool val) {
-    return sysfs_write_int(nxtcolor->f_digi0_val, val);
+#if PB_NXTCOLOR_FAST_PINS
+
+// GPIO character device. Both pins are requested as one line handle while
+// they are outputs, so they can be set with a single call.
+
+// Finds the chip and line offset of a GPIO by its global number
+static pbio_error_t nxtcolor_chardev_find(int gpio, int *chip, uint32_t *offset) {
+    DIR *dir = opendir("/sys/class/gpio");
+    if (!dir) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    pbio_error_t err = PBIO_ERROR_NO_DEV;
+    struct dirent *entry;
+    while (err == PBIO_ERROR_NO_DEV && (entry = readdir(dir))) {
+        int base, ngpio;
+        char label[64];
+        if (sscanf(entry->d_name, "gpiochip%d", &base) != 1 || gpio < base) {
+            continue;
+        }
+
+        // Get the size and label of this chip
+        FILE *f;
+        if (sysfs_open(&f, "/sys/class/gpio/gpiochip%d/%s", base, "ngpio", "r") != PBIO_SUCCESS) {
+            continue;
+        }
+        bool ok = sysfs_read_int(f, &ngpio) == PBIO_SUCCESS;
+        fclose(f);
+        if (!ok || gpio >= base + ngpio ||
+            sysfs_open(&f, "/sys/class/gpio/gpiochip%d/%s", base, "label", "r") != PBIO_SUCCESS) {
+            continue;
+        }
+        ok = sysfs_read_str(f, label) == PBIO_SUCCESS;
+        fclose(f);
+        if (!ok) {
+            continue;
+        }
+
+        // Find the character device of the same chip
+        for (int n = 0; n < 16; n++) {
+            char path[32];
+            snprintf(path, sizeof(path), "/dev/gpiochip%d", n);
+            int fd = open(path, O_RDWR | O_CLOEXEC);
+            if (fd == -1) {
+                continue;
+            }
+            struct gpiochip_info info;
+            if (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0 &&
+                info.lines == (uint32_t)ngpio && !strncmp(info.label, label, sizeof(info.label))) {
+                *chip = fd;
+                *offset = gpio - base;
+                err = PBIO_SUCCESS;
+                break;
+            }
+            close(fd);
+        }
+    }
+    closedir(dir);
+
+    return err;
 }
 
-static pbio_error_t nxtcolor_set_digi1(nxtcolor_t *nxtcolor, bool val) {
+// Requests the lines for the current direction of digi1
+static pbio_error_t nxtcolor_chardev_request(nxtcolor_t *nxtcolor, bool dir) {
+    if (nxtcolor->fd_out != -1) {
+        close(nxtcolor->fd_out);
+        nxtcolor->fd_out = -1;
+    }
+    if (nxtcolor->fd_in != -1) {
+        close(nxtcolor->fd_in);
+        nxtcolor->fd_in = -1;
+    }
+
+    struct gpiohandle_request req = {
+        .flags = GPIOHANDLE_REQUEST_OUTPUT,
+        .consumer_label = "pbio-nxtcolor",
+        .lineoffsets = { nxtcolor->digi0_offset, nxtcolor->digi1_offset },
+        .default_values = { nxtcolor->digi0, nxtcolor->digi1 },
+        .lines = dir == OUT ? 2 : 1,
+    };
+    if (ioctl(nxtcolor->chip, GPIO_GET_LINEHANDLE_IOCTL, &req) == -1) {
+        return PBIO_ERROR_IO;
+    }
+    nxtcolor->fd_out = req.fd;
+
+    if (dir == OUT) {
+        return PBIO_SUCCESS;
+    }
+
+    req = (struct gpiohandle_request) {
+        .flags = GPIOHANDLE_REQUEST_INPUT,
+        .consumer_label = "pbio-nxtcolor",
+        .lineoffsets = { nxtcolor->digi1_offset },
+        .lines = 1,
+    };
+    if (ioctl(nxtcolor->chip, GPIO_GET_LINEHANDLE_IOCTL, &req) == -1) {
+        return PBIO_ERROR_IO;
+    }
+    nxtcolor->fd_in = req.fd;
+
+    return PBIO_SUCCESS;
+}
 
+static pbio_error_t nxtcolor_chardev_open(nxtcolor_t *nxtcolor) {
     pbio_error_t err;
+    int chip;
 
-    // First, ensure it is set as a digital out
-    if (nxtcolor->digi1_dir == IN) {
-        err = sysfs_write_str(nxtcolor->f_digi1_dir, "out");
-        if (err != PBIO_SUCCESS) {
-            return err;
-        }
-        nxtcolor->digi1_dir = OUT;
+    nxtcolor->fd_out = -1;
+    nxtcolor->fd_in = -1;
+
+    err = nxtcolor_chardev_find(nxtcolor->pins->digi0, &nxtcolor->chip, &nxtcolor->digi0_offset);
+    if (err != PBIO_SUCCESS) {
+        return err;
     }
-    // Set the requested state
-    return sysfs_write_int(nxtcolor->f_digi1_val, val);
+    err = nxtcolor_chardev_find(nxtcolor->pins->digi1, &chip, &nxtcolor->digi1_offset);
+    if (err != PBIO_SUCCESS) {
+        close(nxtcolor->chip);
+        return err;
+    }
+    close(chip);
+
+    // This fails if the lines are in use, such as when they are exported
+    // through sysfs
+    err = nxtcolor_chardev_request(nxtcolor, OUT);
+    if (err != PBIO_SUCCESS) {
+        close(nxtcolor->chip);
+    }
+    return err;
 }
 
-static pbio_error_t nxtcolor_get_digi1(nxtcolor_t *nxtcolor, bool *val) {
+static pbio_error_t nxtcolor_chardev_set(nxtcolor_t *nxtcolor) {
+    struct gpiohandle_data data = {
+        .values = { nxtcolor->digi0, nxtcolor->digi1 },
+    };
+    if (ioctl(nxtcolor->fd_out, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) == -1) {
+        return PBIO_ERROR_IO;
+    }
+    return PBIO_SUCCESS;
+}
 
+static pbio_error_t nxtcolor_chardev_get_digi1(nxtcolor_t *nxtcolor, bool *val) {
+    struct gpiohandle_data data;
+    if (ioctl(nxtcolor->fd_in, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == -1) {
+        return PBIO_ERROR_IO;
+    }
+    *val = data.values[0];
+    return PBIO_SUCCESS;
+}
+
+static const nxtcolor_gpio_funcs_t nxtcolor_chardev_funcs = {
+    .open = nxtcolor_chardev_open,
+    .set_digi1_dir = nxtcolor_chardev_request,
+    .set = nxtcolor_chardev_set,
+    .get_digi1 = nxtcolor_chardev_get_digi1,
+};
+
+// Memory mapped GPIO registers, for lines that are exported through sysfs,
+// which makes the character device refuse them. This needs access to
+// /dev/mem. Only the set, clear and input registers are used, since those
+// don't affect other pins. The direction register also holds pins that the
+// kernel uses, so the direction is changed through sysfs instead.
+
+static pbio_error_t nxtcolor_mmap_open(nxtcolor_t *nxtcolor) {
     pbio_error_t err;
 
-    // First, ensure it is set as a digital in
+    // All sensor pins are in the first bank pair
+    if (nxtcolor->pins->digi0 >= 32 || nxtcolor->pins->digi1 >= 32) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    // This fails if the lines were not exported
+    err = sysfs_open(&nxtcolor->f_digi0_dir, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi0, "direction", "w");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = sysfs_open(&nxtcolor->f_digi1_dir, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi1, "direction", "w");
+    if (err != PBIO_SUCCESS) {
+        fclose(nxtcolor->f_digi0_dir);
+        return err;
+    }
+
+    if (!gpio_regs) {
+        void *regs = MAP_FAILED;
+        int fd = open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC);
+        if (fd != -1) {
+            regs = mmap(NULL, GPIO_REG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, GPIO_REG_BASE);
+            close(fd);
+        }
+        if (regs == MAP_FAILED) {
+            fclose(nxtcolor->f_digi0_dir);
+            fclose(nxtcolor->f_digi1_dir);
+            return PBIO_ERROR_NOT_SUPPORTED;
+        }
+        gpio_regs = regs;
+    }
+
+    // Setting the direction to "low" makes it a low output
+    err = sysfs_write_str(nxtcolor->f_digi0_dir, "low");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    return sysfs_write_str(nxtcolor->f_digi1_dir, "low");
+}
+
+static pbio_error_t nxtcolor_mmap_set_digi1_dir(nxtcolor_t *nxtcolor, bool dir) {
+    // Like above, this makes it low when it becomes an output
+    return sysfs_write_str(nxtcolor->f_digi1_dir, dir == OUT ? "low" : "in");
+}
+
+static pbio_error_t nxtcolor_mmap_set(nxtcolor_t *nxtcolor) {
+    uint32_t high = 0, low = 0;
+    *(nxtcolor->digi0 ? &high : &low) |= 1 << nxtcolor->pins->digi0;
     if (nxtcolor->digi1_dir == OUT) {
-        err = sysfs_write_str(nxtcolor->f_digi1_dir, "in");
+        *(nxtcolor->digi1 ? &high : &low) |= 1 << nxtcolor->pins->digi1;
+    }
+    gpio_regs[GPIO_REG_SET_DATA01] = high;
+    gpio_regs[GPIO_REG_CLR_DATA01] = low;
+    return PBIO_SUCCESS;
+}
+
+static pbio_error_t nxtcolor_mmap_get_digi1(nxtcolor_t *nxtcolor, bool *val) {
+    *val = (gpio_regs[GPIO_REG_IN_DATA01] >> nxtcolor->pins->digi1) & 1;
+    return PBIO_SUCCESS;
+}
+
+static const nxtcolor_gpio_funcs_t nxtcolor_mmap_funcs = {
+    .open = nxtcolor_mmap_open,
+    .set_digi1_dir = nxtcolor_mmap_set_digi1_dir,
+    .set = nxtcolor_mmap_set,
+    .get_digi1 = nxtcolor_mmap_get_digi1,
+};
+
+#endif // PB_NXTCOLOR_FAST_PINS
+
+// sysfs GPIO, with one file write or read for each pin change
+
+static pbio_error_t nxtcolor_sysfs_open(nxtcolor_t *nxtcolor) {
+    pbio_error_t err;
+
+    err = sysfs_open(&nxtcolor->f_digi0_val, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi0, "value", "w");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = sysfs_open(&nxtcolor->f_digi0_dir, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi0, "direction", "w");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = sysfs_open(&nxtcolor->f_digi1_val, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi1, "value", "r+");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = sysfs_open(&nxtcolor->f_digi1_dir, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi1, "direction", "w");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    // Setting the direction to "low" makes it a low output
+    err = sysfs_write_str(nxtcolor->f_digi0_dir, "low");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = sysfs_write_str(nxtcolor->f_digi1_dir, "low");
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    nxtcolor->digi0_written = false;
+    nxtcolor->digi1_written = false;
+
+    return PBIO_SUCCESS;
+}
+
+static pbio_error_t nxtcolor_sysfs_set_digi1_dir(nxtcolor_t *nxtcolor, bool dir) {
+    // Like above, this makes it low when it becomes an output
+    nxtcolor->digi1_written = false;
+    return sysfs_write_str(nxtcolor->f_digi1_dir, dir == OUT ? "low" : "in");
+}
+
+static pbio_error_t nxtcolor_sysfs_set(nxtcolor_t *nxtcolor) {
+    pbio_error_t err;
+
+    // Only write the pins that change
+    if (nxtcolor->digi0 != nxtcolor->digi0_written) {
+        err = sysfs_write_int(nxtcolor->f_digi0_val, nxtcolor->digi0);
         if (err != PBIO_SUCCESS) {
             return err;
         }
-        nxtcolor->digi1_dir = IN;
+        nxtcolor->digi0_written = nxtcolor->digi0;
     }
-    // Get the state
+    if (nxtcolor->digi1_dir == OUT && nxtcolor->digi1 != nxtcolor->digi1_written) {
+        err = sysfs_write_int(nxtcolor->f_digi1_val, nxtcolor->digi1);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        nxtcolor->digi1_written = nxtcolor->digi1;
+    }
+    return PBIO_SUCCESS;
+}
+
+static pbio_error_t nxtcolor_sysfs_get_digi1(nxtcolor_t *nxtcolor, bool *val) {
     int bit;
-    err = sysfs_read_int(nxtcolor->f_digi1_val, &bit);
+    pbio_error_t err = sysfs_read_int(nxtcolor->f_digi1_val, &bit);
     if (err != PBIO_SUCCESS) {
         return err;
     }
@@ -151,17 +502,90 @@ static pbio_error_t nxtcolor_get_digi1(nxtcolor_t *nxtcolor, bool *val) {
     return PBIO_SUCCESS;
 }
 
-static pbio_error_t nxtcolor_get_adc(nxtcolor_t *nxtcolor, uint32_t *analog) {
+static const nxtcolor_gpio_funcs_t nxtcolor_sysfs_funcs = {
+    .open = nxtcolor_sysfs_open,
+    .set_digi1_dir = nxtcolor_sysfs_set_digi1_dir,
+    .set = nxtcolor_sysfs_set,
+    .get_digi1 = nxtcolor_sysfs_get_digi1,
+};
 
-    pbio_error_t err;
+static const nxtcolor_gpio_funcs_t *const nxtcolor_gpio_funcs[] = {
+    #if PB_NXTCOLOR_FAST_PINS
+    &nxtcolor_chardev_funcs,
+    &nxtcolor_mmap_funcs,
+    #endif
+    &nxtcolor_sysfs_funcs,
+};
+
+// Waits until enough time has passed since the previous pin change
+static void nxtcolor_edge_delay(nxtcolor_t *nxtcolor) {
+    uint32_t now;
+    while ((now = sampler_time_us()) - nxtcolor->edge_time < EDGE_DELAY_US) {
+        ;
+    }
+    nxtcolor->edge_time = now;
+}
+
+static pbio_error_t nxtcolor_set_digi1_dir(nxtcolor_t *nxtcolor, bool dir) {
+    if (nxtcolor->digi1_dir == dir) {
+        return PBIO_SUCCESS;
+    }
+    pbio_error_t err = nxtcolor->funcs->set_digi1_dir(nxtcolor, dir);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    nxtcolor->digi1_dir = dir;
+    return PBIO_SUCCESS;
+}
+
+// Sets both pins at once, with digi1 as an output
+static pbio_error_t nxtcolor_set_pins(nxtcolor_t *nxtcolor, bool digi0, bool digi1) {
+
+    // First, ensure digi1 is set as a digital out
+    nxtcolor->digi1 = digi1;
+    pbio_error_t err = nxtcolor_set_digi1_dir(nxtcolor, OUT);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    // Set the requested state
+    nxtcolor_edge_delay(nxtcolor);
+    nxtcolor->digi0 = digi0;
+    return nxtcolor->funcs->set(nxtcolor);
+}
+
+static pbio_error_t nxtcolor_set_digi0(nxtcolor_t *nxtcolor, bool val) {
+    nxtcolor_edge_delay(nxtcolor);
+    nxtcolor->digi0 = val;
+    return nxtcolor->funcs->set(nxtcolor);
+}
+
+static pbio_error_t nxtcolor_set_digi1(nxtcolor_t *nxtcolor, bool val) {
+    return nxtcolor_set_pins(nxtcolor, nxtcolor->digi0, val);
+}
+
+static pbio_error_t nxtcolor_get_digi1(nxtcolor_t *nxtcolor, bool *val) {
+
+    // First, ensure it is set as a digital in
+    pbio_error_t err = nxtcolor_set_digi1_dir(nxtcolor, IN);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    // Get the state
+    nxtcolor_edge_delay(nxtcolor);
+    return nxtcolor->funcs->get_digi1(nxtcolor, val);
+}
+
+static pbio_error_t nxtcolor_get_adc(nxtcolor_t *nxtcolor, uint32_t *analog) {
 
     // First, ensure it is set as an input
-    if (nxtcolor->digi1_dir == OUT) {
-        err = sysfs_write_str(nxtcolor->f_digi1_dir, "in");
-        if (err != PBIO_SUCCESS) {
-            return err;
-        }
-        nxtcolor->digi1_dir = IN;
+    pbio_error_t err = nxtcolor_set_digi1_dir(nxtcolor, IN);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    // Let the output settle after the last change of the lamp
+    uint32_t elapsed = sampler_time_us() - nxtcolor->edge_time;
+    if (elapsed < LAMP_SETTLE_US) {
+        usleep(LAMP_SETTLE_US - elapsed);
     }
     // Get the state
     return sysfs_read_int(nxtcolor->f_adc_val, (int *)analog);
@@ -241,38 +665,28 @@ static pbio_error_t nxtcolor_send_byte(nxtcolor_t *nxtcolor, uint8_t msg)
     pbio_error_t err;
 
     // Init both pins as low
-    err = nxtcolor_set_digi0(nxtcolor, 0);
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
-    err = nxtcolor_set_digi1(nxtcolor, 0);
+    err = nxtcolor_set_pins(nxtcolor, 0, 0);
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
-    for (uint8_t i = 0; i < 8; i++)
-	{
-        // Set data pin
-        err = nxtcolor_set_digi1(nxtcolor, msg & 1);
+    for (uint8_t i = 0; i < 8; i++) {
+        // Set data pin, and the clock low after the previous bit
+        err = nxtcolor_set_pins(nxtcolor, 0, msg & 1);
         if (err != PBIO_SUCCESS) {
             return err;
         }
-		msg = msg >> 1;
+        msg = msg >> 1;
 
         // Set clock high
         err = nxtcolor_set_digi0(nxtcolor, 1);
         if (err != PBIO_SUCCESS) {
             return err;
         }
+    }
 
-        // Set clock low
-        err = nxtcolor_set_digi0(nxtcolor, 0);
-        if (err != PBIO_SUCCESS) {
-            return err;
-        }
-	}
-
-    return PBIO_SUCCESS;
+    // Set clock low
+    return nxtcolor_set_digi0(nxtcolor, 0);
 }
 
 static pbio_error_t nxtcolor_init_fs(nxtcolor_t *nxtcolor, pbio_port_t port) {
@@ -282,23 +696,7 @@ static pbio_error_t nxtcolor_init_fs(nxtcolor_t *nxtcolor, pbio_port_t port) {
     // Get the pin info for this port
     nxtcolor->pins = &pininfo[port-PBIO_PORT_1];
 
-    // Open the sysfs files for this sensor
-    err = sysfs_open(&nxtcolor->f_digi0_val, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi0, "value", "w");
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
-    err = sysfs_open(&nxtcolor->f_digi0_dir, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi0, "direction", "w");
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
-    err = sysfs_open(&nxtcolor->f_digi1_val, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi1, "value", "r+");
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
-    err = sysfs_open(&nxtcolor->f_digi1_dir, "/sys/class/gpio/gpio%d/%s", nxtcolor->pins->digi1, "direction", "w");
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
+    // Open the analog sysfs files for this sensor
     err = sysfs_open(&nxtcolor->f_adc_con, "/sys/bus/iio/devices/iio:device0/in_voltage%d_raw%s", nxtcolor->pins->adc_con, "", "r");
     if (err != PBIO_SUCCESS) {
         return err;
@@ -315,22 +713,21 @@ static pbio_error_t nxtcolor_init_fs(nxtcolor_t *nxtcolor, pbio_port_t port) {
         return PBIO_ERROR_NO_DEV;
     }
 
-    // Digi0 is always an output pin. Init as low
-    err = sysfs_write_str(nxtcolor->f_digi0_dir, "out");
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
-    err = nxtcolor_set_digi0(nxtcolor, 0);
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
-    // Digi1 can be set as output, or read as digital, and analog. Init as low.
-    err = nxtcolor_set_digi1(nxtcolor, 0);
-    if (err != PBIO_SUCCESS) {
-        return err;
+    // Digi0 is always an output pin. Digi1 can be set as output, or read as
+    // digital, and analog. Init both as low outputs, with the fastest
+    // available driver.
+    nxtcolor->digi0 = 0;
+    nxtcolor->digi1 = 0;
+    nxtcolor->digi1_dir = OUT;
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(nxtcolor_gpio_funcs); i++) {
+        err = nxtcolor_gpio_funcs[i]->open(nxtcolor);
+        if (err == PBIO_SUCCESS) {
+            nxtcolor->funcs = nxtcolor_gpio_funcs[i];
+            return PBIO_SUCCESS;
+        }
     }
 
-    return PBIO_SUCCESS;
+    return err;
 }
 
 static pbio_error_t nxtcolor_init(nxtcolor_t *nxtcolor, pbio_port_t port) {
@@ -441,9 +838,85 @@ pbio_error_t nxtcolor_set_light(nxtcolor_t *nxtcolor, nxtcolor_color_state color
     return PBIO_SUCCESS;
 }
 
-pbio_error_t nxtcolor_get_values_at_mode(pbio_port_t port, uint8_t mode, int32_t *values) {
+// Measure the reflection for each lamp color and the ambient light, and set
+// the light back to the configured lamp status afterwards
+static pbio_error_t nxtcolor_measure(nxtcolor_t *nxtcolor, uint32_t *rgba) {
+    pbio_error_t err;
+
+    // Read analog for each color
+    for (uint8_t i = 0; i < 4; i++) {
+        // Set the light
+        err = nxtcolor_set_light(nxtcolor, i);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        err = nxtcolor_get_adc(nxtcolor, &rgba[i]);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+    }
+
+    return nxtcolor_set_light(nxtcolor, nxtcolor->lamp);
+}
+
+// Copy the latest measurement of the sampler thread, if there is a recent
+// one that started after the last direct measurement
+static bool nxtcolor_get_snapshot(nxtcolor_t *nxtcolor, uint32_t *rgba) {
+    if (!sampler.running) {
+        return false;
+    }
+
+    nxtcolor_snapshot_t snapshot;
+    if (sampler_snapshot_read(&nxtcolor->snapshot_seq, &nxtcolor->snapshot, &snapshot, sizeof(snapshot)) == 0) {
+        return false;
+    }
+    memcpy(rgba, snapshot.rgba, sizeof(snapshot.rgba));
+
+    // Also reject measurements that are late because the sampler has stalled
+    return (int32_t)(snapshot.start - nxtcolor->not_before) >= 0 && sampler_is_recent(&sampler, snapshot.end);
+}
+
+// Measures all sensors that are in use and not set to a steady lamp color
+static void nxtcolor_sampler_poll(void) {
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(nxtcolorsensors); i++) {
+        nxtcolor_t *nxtcolor = &nxtcolorsensors[i];
+        if (!__atomic_load_n(&nxtcolor->ready, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        nxtcolor_snapshot_t snapshot;
+        pthread_mutex_lock(&nxtcolor->lock);
+        snapshot.start = sampler_time_us();
+        pbio_error_t err = nxtcolor->measuring ? nxtcolor_measure(nxtcolor, snapshot.rgba) : PBIO_ERROR_AGAIN;
+        pthread_mutex_unlock(&nxtcolor->lock);
+
+        if (err != PBIO_SUCCESS) {
+            continue;
+        }
+
+        snapshot.end = sampler_time_us();
+        sampler_snapshot_write(&nxtcolor->snapshot_seq, &nxtcolor->snapshot, &snapshot, sizeof(snapshot));
+    }
+}
+
+// Start measuring the colors of all NXT Color Sensors in the background at
+// the given rate (Hz)
+pbio_error_t nxtcolor_sampler_start(uint32_t rate) {
+    if (rate == 0 || rate > 1000) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    return sampler_start(&sampler, 1000000 / rate, nxtcolor_sampler_poll);
+}
+
+// Stop measuring colors in the background
+void nxtcolor_sampler_stop(void) {
+    sampler_stop(&sampler);
+}
+
+pbio_error_t nxtcolor_get_values_at_mode(pbio_port_t port, uint8_t mode, void *_values) {
 
     pbio_error_t err;
+    int32_t *values = _values;
 
     if (port < PBIO_PORT_1 || port > PBIO_PORT_4) {
         return PBIO_ERROR_INVALID_PORT;
@@ -459,11 +932,13 @@ pbio_error_t nxtcolor_get_values_at_mode(pbio_port_t port, uint8_t mode, int32_t
         if (err != PBIO_SUCCESS) {
             return err;
         }
-        nxtcolor->ready = true;
+        __atomic_store_n(&nxtcolor->ready, true, __ATOMIC_RELEASE);
     }
 
     // In one of the lamp modes, just set the right color
     if (mode > 0) {
+        pthread_mutex_lock(&nxtcolor->lock);
+        nxtcolor->measuring = false;
         switch(mode) {
             case 1:
                 nxtcolor->lamp = NXT_LAMP_RED;
@@ -478,20 +953,22 @@ pbio_error_t nxtcolor_get_values_at_mode(pbio_port_t port, uint8_t mode, int32_t
                 nxtcolor->lamp = NXT_LAMP_OFF;
                 break;
         }
-        return nxtcolor_set_light(nxtcolor, nxtcolor->lamp);
+        err = nxtcolor_set_light(nxtcolor, nxtcolor->lamp);
+        pthread_mutex_unlock(&nxtcolor->lock);
+        return err;
     }
 
-    // In measure mode, cycle through the colors and calculate color id
+    // In measure mode, cycle through the colors and calculate color id. Use
+    // the latest measurement of the sampler if there is one, or else measure
+    // now. Measurements by the sampler that started before this one are not
+    // used after it, so the values never go back in time.
     uint32_t rgba[4];
-
-    // Read analog for each color
-    for (uint8_t i = 0; i < 4; i++) {
-        // Set the light
-        err = nxtcolor_set_light(nxtcolor, i);
-        if (err != PBIO_SUCCESS) {
-            return err;
-        }
-        err = nxtcolor_get_adc(nxtcolor, &rgba[i]);
+    if (!nxtcolor->measuring || !nxtcolor_get_snapshot(nxtcolor, rgba)) {
+        pthread_mutex_lock(&nxtcolor->lock);
+        nxtcolor->measuring = true;
+        nxtcolor->not_before = sampler_time_us();
+        err = nxtcolor_measure(nxtcolor, rgba);
+        pthread_mutex_unlock(&nxtcolor->lock);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -531,6 +1008,5 @@ pbio_error_t nxtcolor_get_values_at_mode(pbio_port_t port, uint8_t mode, int32_t
     // Scale ambient to percentage
     values[3] = ((amb-nxtcolor->raw_min)*100)/(nxtcolor->raw_max-nxtcolor->raw_min);
 
-    // Set the light back to the configured lamp status
-    return nxtcolor_set_light(nxtcolor, nxtcolor->lamp);
+    return PBIO_SUCCESS;
 }
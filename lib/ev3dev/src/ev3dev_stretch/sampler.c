@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <ev3dev_stretch/sampler.h>
+
+#include <pbio/error.h>
+
+// Monotonic time (us). It wraps around, so only differences are meaningful.
+uint32_t sampler_time_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void *sampler_thread(void *arg) {
+    sampler_t *sampler = arg;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (!sampler->stopping) {
+        sampler->poll();
+
+        // Wake up on absolute deadlines, so the period does not grow with the
+        // time spent above. If the deadline has already passed, start over
+        // from now instead of catching up on calls that were missed.
+        deadline.tv_nsec += sampler->period_us * 1000;
+        while (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_nsec -= 1000000000;
+            deadline.tv_sec++;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec)) {
+            deadline = now;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+
+    return NULL;
+}
+
+// Starts calling poll from a background thread, once every period (us). If
+// the sampler is already running, it is restarted.
+pbio_error_t sampler_start(sampler_t *sampler, uint32_t period_us, void (*poll)(void)) {
+    sampler_stop(sampler);
+
+    sampler->period_us = period_us;
+    sampler->poll = poll;
+    sampler->stopping = false;
+    if (pthread_create(&sampler->thread, NULL, sampler_thread, sampler) != 0) {
+        return PBIO_ERROR_FAILED;
+    }
+    sampler->running = true;
+
+    return PBIO_SUCCESS;
+}
+
+// Stops the background thread and waits for it to finish
+void sampler_stop(sampler_t *sampler) {
+    if (!sampler->running) {
+        return;
+    }
+
+    sampler->running = false;
+    sampler->stopping = true;
+    pthread_join(sampler->thread, NULL);
+}
+
+// Tells whether something sampled at the given time is still current. It is
+// not if the sampler has stalled.
+bool sampler_is_recent(const sampler_t *sampler, uint32_t time) {
+    return sampler->running && sampler_time_us() - time < 3 * sampler->period_us;
+}
+
+// Publishes a snapshot for readers in other threads. The sequence count is odd
+// while the snapshot is being written. There may be only one writer.
+void sampler_snapshot_write(uint32_t *seq, void *snapshot, const void *data, size_t size) {
+    uint32_t count = *seq;
+    __atomic_store_n(seq, count + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(snapshot, data, size);
+    __atomic_store_n(seq, count + 2, __ATOMIC_RELEASE);
+}
+
+// Copies a consistent snapshot, retrying while it is being written. Returns
+// its sequence count, which is 0 if nothing was written yet.
+uint32_t sampler_snapshot_read(const uint32_t *seq, const void *snapshot, void *data, size_t size) {
+    uint32_t count;
+    do {
+        count = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        memcpy(data, snapshot, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((count & 1) || count != __atomic_load_n(seq, __ATOMIC_RELAXED));
+
+    return count;
+}
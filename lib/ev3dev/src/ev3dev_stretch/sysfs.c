@@ -2,11 +2,16 @@
 // Copyright (c) 2018-2020 The Pybricks Authors
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ev3dev_stretch/lego_sensor.h>
+#include <ev3dev_stretch/sampler.h>
+#include <ev3dev_stretch/sysfs.h>
 
 #include <pbio/port.h>
 #include <pbio/iodev.h>
@@ -14,6 +19,20 @@
 #define MAX_PATH_LENGTH 60
 #define MAX_READ_LENGTH "60"
 
+// Enough for a 32-bit number with sign and newline
+#define MAX_INT_LENGTH 13
+
+#define SENSOR_PATH "/sys/class/lego-sensor/sensor%d/%s"
+#define TACHO_MOTOR_PATH "/sys/class/tacho-motor/motor%d/%s"
+#define DC_MOTOR_PATH "/sys/class/dc-motor/motor%d/%s"
+
+// Statistics of the raw file descriptor I/O. These are updated from the
+// control loop thread and read from the main thread, so they are atomic.
+static uint32_t stats_reads;
+static uint32_t stats_writes;
+static uint32_t stats_time_sum;
+static uint32_t stats_time_max;
+
 // Get the ev3dev sensor number for a given port
 pbio_error_t sysfs_get_number(pbio_port_t port, const char *rdir, int *sysfs_number) {
     // Open lego-sensor directory in sysfs
@@ -80,17 +99,17 @@ pbio_error_t sysfs_open(FILE **file, const char *pathpat, int n, const char *att
 
 // Open a sensor sysfs attribute
 pbio_error_t sysfs_open_sensor_attr(FILE **file, int n, const char *attribute, const char *rw) {
-    return sysfs_open(file, "/sys/class/lego-sensor/sensor%d/%s", n, attribute, rw);
+    return sysfs_open(file, SENSOR_PATH, n, attribute, rw);
 }
 
 // Open a tacho-motor sysfs attribute
 pbio_error_t sysfs_open_tacho_motor_attr(FILE **file, int n, const char *attribute, const char *rw) {
-    return sysfs_open(file, "/sys/class/tacho-motor/motor%d/%s", n, attribute, rw);
+    return sysfs_open(file, TACHO_MOTOR_PATH, n, attribute, rw);
 }
 
 // Open a dc-motor sysfs attribute
 pbio_error_t sysfs_open_dc_motor_attr(FILE **file, int n, const char *attribute, const char *rw) {
-    return sysfs_open(file, "/sys/class/dc-motor/motor%d/%s", n, attribute, rw);
+    return sysfs_open(file, DC_MOTOR_PATH, n, attribute, rw);
 }
 
 // Read a string from a previously opened sysfs attribute
@@ -144,3 +163,133 @@ pbio_error_t sysfs_write_int(FILE *file, int val) {
 
     return PBIO_SUCCESS;
 }
+
+// The functions below use raw file descriptors instead of stdio. Each read or
+// write is a single pread or pwrite at offset zero, so it takes one system
+// call, and it does not share a file position with other threads.
+
+// Open a sysfs attribute as a raw file descriptor
+pbio_error_t sysfs_open_fd(int *fd, const char *pathpat, int n, const char *attribute, int flags) {
+    char path[MAX_PATH_LENGTH];
+
+    snprintf(path, MAX_PATH_LENGTH, pathpat, n, attribute);
+    *fd = open(path, flags | O_CLOEXEC);
+    if (*fd == -1) {
+        return PBIO_ERROR_IO;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+// Open a sensor sysfs attribute as a raw file descriptor
+pbio_error_t sysfs_open_sensor_attr_fd(int *fd, int n, const char *attribute, int flags) {
+    return sysfs_open_fd(fd, SENSOR_PATH, n, attribute, flags);
+}
+
+// Open a tacho-motor sysfs attribute as a raw file descriptor
+pbio_error_t sysfs_open_tacho_motor_attr_fd(int *fd, int n, const char *attribute, int flags) {
+    return sysfs_open_fd(fd, TACHO_MOTOR_PATH, n, attribute, flags);
+}
+
+// Open a dc-motor sysfs attribute as a raw file descriptor
+pbio_error_t sysfs_open_dc_motor_attr_fd(int *fd, int n, const char *attribute, int flags) {
+    return sysfs_open_fd(fd, DC_MOTOR_PATH, n, attribute, flags);
+}
+
+static void sysfs_stats_add(uint32_t *count, uint32_t start) {
+    uint32_t time = sampler_time_us() - start;
+
+    __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats_time_sum, time, __ATOMIC_RELAXED);
+
+    uint32_t max = __atomic_load_n(&stats_time_max, __ATOMIC_RELAXED);
+    while (time > max && !__atomic_compare_exchange_n(&stats_time_max, &max, time, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        ;
+    }
+}
+
+// Read an int from a raw sysfs attribute
+pbio_error_t sysfs_pread_int(int fd, int32_t *dest) {
+    char buf[MAX_INT_LENGTH];
+
+    uint32_t start = sampler_time_us();
+    ssize_t len = pread(fd, buf, sizeof(buf), 0);
+    sysfs_stats_add(&stats_reads, start);
+
+    if (len <= 0) {
+        return PBIO_ERROR_IO;
+    }
+
+    ssize_t i = 0;
+    bool negative = buf[0] == '-';
+    if (negative) {
+        i++;
+    }
+
+    if (i == len || buf[i] < '0' || buf[i] > '9') {
+        return PBIO_ERROR_IO;
+    }
+
+    // Accumulate as a negative number, so that INT32_MIN fits
+    int32_t val = 0;
+    for (; i < len && buf[i] >= '0' && buf[i] <= '9'; i++) {
+        int32_t digit = buf[i] - '0';
+        if (val < (INT32_MIN + digit) / 10) {
+            return PBIO_ERROR_IO;
+        }
+        val = val * 10 - digit;
+    }
+
+    // Only a negative number can be INT32_MIN
+    if (!negative && val == INT32_MIN) {
+        return PBIO_ERROR_IO;
+    }
+
+    *dest = negative ? val : -val;
+    return PBIO_SUCCESS;
+}
+
+// Write an int to a raw sysfs attribute
+pbio_error_t sysfs_pwrite_int(int fd, int32_t val) {
+    char buf[MAX_INT_LENGTH];
+
+    // Write the digits backwards from the end of the buffer, working with a
+    // negative number so that INT32_MIN does not overflow
+    char *p = buf + sizeof(buf);
+    int32_t rest = val < 0 ? val : -val;
+    do {
+        *--p = '0' - rest % 10;
+        rest /= 10;
+    } while (rest);
+    if (val < 0) {
+        *--p = '-';
+    }
+
+    size_t len = buf + sizeof(buf) - p;
+
+    uint32_t start = sampler_time_us();
+    ssize_t written = pwrite(fd, p, len, 0);
+    sysfs_stats_add(&stats_writes, start);
+
+    if (written != (ssize_t)len) {
+        return PBIO_ERROR_IO;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+// Get the number of raw reads and writes and the time spent in them
+void sysfs_get_stats(sysfs_stats_t *stats) {
+    stats->reads = __atomic_load_n(&stats_reads, __ATOMIC_RELAXED);
+    stats->writes = __atomic_load_n(&stats_writes, __ATOMIC_RELAXED);
+    stats->time_sum = __atomic_load_n(&stats_time_sum, __ATOMIC_RELAXED);
+    stats->time_max = __atomic_load_n(&stats_time_max, __ATOMIC_RELAXED);
+}
+
+// Reset the raw I/O statistics
+void sysfs_reset_stats(void) {
+    __atomic_store_n(&stats_reads, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats_writes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats_time_sum, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats_time_max, 0, __ATOMIC_RELAXED);
+}
@@ -11,6 +11,7 @@
 #include <btstack_chipset_cc256x.h>
 #include <btstack.h>
 #include <contiki.h>
+#include <contiki-lib.h>
 
 #include <pbio/event.h>
 #include <pbsys/status.h>
@@ -29,9 +30,13 @@ static btstack_context_callback_registration_t send_request;
 static btstack_packet_callback_registration_t hci_event_callback_registration;
 PROCESS(pbdrv_bluetooth_hci_process, "Bluetooth HCI");
 
+// UART tx data that is waiting to be sent, must be power of 2 for ring buffer!
+#define UART_TX_RING_SIZE 128
+static uint8_t uart_tx_ring_data[UART_TX_RING_SIZE];
+static struct ringbuf uart_tx_ring;
 // nRF UART tx is in progress
 static bool uart_tx_busy;
-// buffer to queue UART tx data
+// buffer for the UART tx data that is being sent
 static uint8_t uart_tx_buf[NRF_CHAR_SIZE];
 // bytes used in uart_tx_buf
 static uint8_t uart_tx_buf_size;
@@ -66,20 +71,24 @@ static const hci_transport_config_uart_t config = {
     .device_name = NULL,
 };
 
-pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+pbio_error_t pbdrv_bluetooth_tx_buf(const uint8_t *data, size_t size, size_t *written) {
     // make sure we have a Bluetooth connection
     if (con_handle == HCI_CON_HANDLE_INVALID) {
         return PBIO_ERROR_INVALID_OP;
     }
 
-    // can't add the the buffer if tx is in progress or buffer is full
-    if (uart_tx_busy || uart_tx_buf_size == NRF_CHAR_SIZE) {
-        return PBIO_ERROR_AGAIN;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        if (!ringbuf_put(&uart_tx_ring, data[i])) {
+            break;
+        }
     }
+    *written = i;
 
-    // append the char
-    uart_tx_buf[uart_tx_buf_size] = c;
-    uart_tx_buf_size++;
+    // can't add anything if the buffer is full
+    if (i == 0) {
+        return PBIO_ERROR_AGAIN;
+    }
 
     // poke the process to start tx soon-ish. This way, we can accumulate up to
     // NRF_CHAR_SIZE bytes before actually transmitting
@@ -88,18 +97,29 @@ pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+    size_t written;
+    return pbdrv_bluetooth_tx_buf(&c, 1, &written);
+}
+
+bool pbdrv_bluetooth_tx_is_idle(void) {
+    return con_handle == HCI_CON_HANDLE_INVALID || (!uart_tx_busy && ringbuf_elements(&uart_tx_ring) == 0);
+}
+
 static void nordic_can_send(void *context) {
     nordic_spp_service_server_send(con_handle, uart_tx_buf, uart_tx_buf_size);
     uart_tx_busy = false;
     uart_tx_buf_size = 0;
+
+    // send the rest of the buffer, if any
+    process_poll(&pbdrv_bluetooth_hci_process);
 }
 
 static void uart_rx_char_modified(const uint8_t *data, uint8_t size) {
-    for (int i = 0; i < size; i++) {
-        // TODO: set .port = bluetooth port
-        pbio_event_uart_rx_data_t rx = { .byte = data[i] };
-        process_post_synch(&pbsys_process, PBIO_EVENT_UART_RX, &rx);
-    }
+    // pass on the whole packet at once instead of one event per byte
+    // TODO: set .port = bluetooth port
+    pbio_event_uart_rx_data_t rx = { .data = data, .size = size };
+    process_post_synch(&pbsys_process, PBIO_EVENT_UART_RX, &rx);
 }
 
 static void nordic_data_received(hci_con_handle_t tx_con_handle, const uint8_t *data, uint16_t size) {
@@ -192,6 +212,9 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
         PROCESS_WAIT_UNTIL(con_handle != HCI_CON_HANDLE_INVALID || pbsys_status_test(PBSYS_STATUS_USER_PROGRAM_RUNNING));
         pbsys_status_clear(PBSYS_STATUS_BLE_ADVERTISING);
 
+        // discard anything that was not sent during the previous connection
+        ringbuf_init(&uart_tx_ring, uart_tx_ring_data, UART_TX_RING_SIZE);
+
         for (;;) {
             PROCESS_WAIT_EVENT();
 
@@ -200,7 +223,12 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
                 break;
             }
 
-            if (!uart_tx_busy && uart_tx_buf_size) {
+            if (!uart_tx_busy && ringbuf_elements(&uart_tx_ring)) {
+                // take the next notification worth of data from the buffer
+                int c;
+                while (uart_tx_buf_size < NRF_CHAR_SIZE && (c = ringbuf_get(&uart_tx_ring)) != -1) {
+                    uart_tx_buf[uart_tx_buf_size++] = c;
+                }
                 uart_tx_busy = true;
                 send_request.callback = &nordic_can_send;
                 nordic_spp_service_server_request_can_send_now(&send_request, con_handle);
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Control loop timer using a real-time thread on Linux.
+//
+// The thread waits for a timerfd that expires on absolute deadlines, so the
+// period does not grow with the time it takes to run the callback. The thread
+// does not need the MicroPython GIL.
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_CONTROL_TIMER_LINUX
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/timerfd.h>
+
+#include <pbdrv/control_timer.h>
+#include <pbio/error.h>
+
+#define PERIOD_NS (PBDRV_CONTROL_TIMER_PERIOD_MS * 1000000LL)
+
+static pbdrv_control_timer_callback_t pbdrv_control_timer_callback;
+static pthread_t thread;
+static volatile bool stopping;
+
+// Held while the callback runs and from pbdrv_control_timer_defer_begin() to
+// pbdrv_control_timer_defer_end(). It is recursive, so the callback can defer
+// itself.
+static pthread_mutex_t defer_mutex;
+static pthread_once_t defer_mutex_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pbdrv_control_timer_stats_t stats;
+
+static void defer_mutex_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&defer_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static int64_t timespec_to_ns(const struct timespec *ts) {
+    return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static struct timespec ns_to_timespec(int64_t ns) {
+    return (struct timespec) {
+               .tv_sec = ns / 1000000000LL,
+               .tv_nsec = ns % 1000000000LL,
+    };
+}
+
+static void *pbdrv_control_timer_thread(void *arg) {
+    int fd = (intptr_t)arg;
+
+    #if PBDRV_CONFIG_CONTROL_TIMER_LINUX_PRIORITY
+    // Real-time priority needs privileges. Without them, the thread just runs
+    // at normal priority.
+    struct sched_param param = { .sched_priority = PBDRV_CONFIG_CONTROL_TIMER_LINUX_PRIORITY };
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    #endif
+
+    // Time of the next tick
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t deadline = timespec_to_ns(&now) + PERIOD_NS;
+
+    struct itimerspec spec = {
+        .it_interval = ns_to_timespec(PERIOD_NS),
+        .it_value = ns_to_timespec(deadline),
+    };
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL);
+
+    while (!stopping) {
+        // Number of ticks since the previous read
+        uint64_t expirations;
+        if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            continue;
+        }
+
+        // Time since the most recent tick, and the time of the next one
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline += PERIOD_NS * expirations;
+        uint32_t lateness = (timespec_to_ns(&now) - (deadline - PERIOD_NS)) / 1000;
+
+        // Only run the callback if no changes are in progress
+        bool deferred = pthread_mutex_trylock(&defer_mutex) != 0;
+        if (!deferred) {
+            pbdrv_control_timer_callback();
+            pthread_mutex_unlock(&defer_mutex);
+        }
+
+        pthread_mutex_lock(&stats_mutex);
+        stats.ticks += expirations;
+        stats.missed += expirations - 1;
+        stats.deferred += deferred;
+        stats.lateness_sum += lateness;
+        if (lateness > stats.lateness_max) {
+            stats.lateness_max = lateness;
+        }
+        pthread_mutex_unlock(&stats_mutex);
+    }
+
+    close(fd);
+    return NULL;
+}
+
+pbio_error_t pbdrv_control_timer_start(pbdrv_control_timer_callback_t callback) {
+    if (pbdrv_control_timer_callback) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (fd == -1) {
+        return PBIO_ERROR_IO;
+    }
+
+    pthread_once(&defer_mutex_once, defer_mutex_init);
+    pbdrv_control_timer_callback = callback;
+    stopping = false;
+    pbdrv_control_timer_reset_stats();
+
+    if (pthread_create(&thread, NULL, pbdrv_control_timer_thread, (void *)(intptr_t)fd) != 0) {
+        close(fd);
+        pbdrv_control_timer_callback = NULL;
+        return PBIO_ERROR_FAILED;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+void pbdrv_control_timer_stop(void) {
+    if (!pbdrv_control_timer_callback) {
+        return;
+    }
+
+    // The thread wakes up on the next tick and exits
+    stopping = true;
+    pthread_join(thread, NULL);
+
+    pbdrv_control_timer_callback = NULL;
+}
+
+void pbdrv_control_timer_defer_begin(void) {
+    // This may be called before the timer is started
+    pthread_once(&defer_mutex_once, defer_mutex_init);
+    pthread_mutex_lock(&defer_mutex);
+}
+
+void pbdrv_control_timer_defer_end(void) {
+    pthread_mutex_unlock(&defer_mutex);
+}
+
+void pbdrv_control_timer_get_stats(pbdrv_control_timer_stats_t *_stats) {
+    pthread_mutex_lock(&stats_mutex);
+    *_stats = stats;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void pbdrv_control_timer_reset_stats(void) {
+    pthread_mutex_lock(&stats_mutex);
+    stats = (pbdrv_control_timer_stats_t) { 0 };
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+#endif // PBDRV_CONFIG_CONTROL_TIMER_LINUX
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Control loop timer using a basic TIM device on STM32 MCUs.
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_CONTROL_TIMER_STM32_TIM
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pbdrv/control_timer.h>
+#include <pbio/error.h>
+
+#include "control_timer_stm32_tim.h"
+
+#include STM32_H
+
+// The timer counts microseconds
+#define TIMER_RATE (1000000)
+
+static volatile pbdrv_control_timer_callback_t pbdrv_control_timer_callback;
+
+// Number of calls to pbdrv_control_timer_defer_begin() that have not ended
+// yet. Calls made by the callback itself leave it as they found it, so it
+// needs no locking.
+static volatile uint32_t defer_count;
+
+// Only written by the interrupt handler
+static pbdrv_control_timer_stats_t stats;
+
+pbio_error_t pbdrv_control_timer_start(pbdrv_control_timer_callback_t callback) {
+    const pbdrv_control_timer_stm32_tim_platform_data_t *pdata = &pbdrv_control_timer_stm32_tim_platform_data;
+
+    if (pbdrv_control_timer_callback) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    pbdrv_control_timer_callback = callback;
+    stats = (pbdrv_control_timer_stats_t) { 0 };
+
+    TIM_TypeDef *TIMx = pdata->TIMx;
+    TIMx->CR1 = 0;
+    TIMx->PSC = pdata->tim_clock_rate / TIMER_RATE - 1;
+    TIMx->ARR = PBDRV_CONTROL_TIMER_PERIOD_MS * (TIMER_RATE / 1000) - 1;
+    TIMx->CNT = 0;
+    // Load the prescaler now instead of at the first update event
+    TIMx->EGR = TIM_EGR_UG;
+    TIMx->SR = 0;
+    TIMx->DIER = TIM_DIER_UIE;
+
+    NVIC_SetPriority(pdata->irq, pdata->irq_priority);
+    NVIC_EnableIRQ(pdata->irq);
+
+    TIMx->CR1 = TIM_CR1_CEN;
+
+    return PBIO_SUCCESS;
+}
+
+void pbdrv_control_timer_stop(void) {
+    const pbdrv_control_timer_stm32_tim_platform_data_t *pdata = &pbdrv_control_timer_stm32_tim_platform_data;
+
+    pdata->TIMx->CR1 = 0;
+    pdata->TIMx->DIER = 0;
+    NVIC_DisableIRQ(pdata->irq);
+    NVIC_ClearPendingIRQ(pdata->irq);
+
+    pbdrv_control_timer_callback = NULL;
+}
+
+void pbdrv_control_timer_defer_begin(void) {
+    defer_count++;
+}
+
+void pbdrv_control_timer_defer_end(void) {
+    defer_count--;
+}
+
+void pbdrv_control_timer_get_stats(pbdrv_control_timer_stats_t *_stats) {
+    // The statistics don't fit in one word, so keep the interrupt out
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *_stats = stats;
+    __set_PRIMASK(primask);
+}
+
+void pbdrv_control_timer_reset_stats(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    stats = (pbdrv_control_timer_stats_t) { 0 };
+    __set_PRIMASK(primask);
+}
+
+void pbdrv_control_timer_stm32_tim_handle_irq(void) {
+    TIM_TypeDef *TIMx = pbdrv_control_timer_stm32_tim_platform_data.TIMx;
+
+    if (!(TIMx->SR & TIM_SR_UIF)) {
+        return;
+    }
+    TIMx->SR = ~TIM_SR_UIF;
+
+    // The counter restarted from zero at the tick, so it is the lateness
+    uint32_t lateness = TIMx->CNT;
+    stats.ticks++;
+    stats.lateness_sum += lateness;
+    if (lateness > stats.lateness_max) {
+        stats.lateness_max = lateness;
+    }
+
+    // The user is changing the state, so try again on the next tick
+    if (defer_count) {
+        stats.deferred++;
+        return;
+    }
+
+    pbdrv_control_timer_callback_t callback = pbdrv_control_timer_callback;
+    if (callback) {
+        callback();
+    }
+}
+
+#endif // PBDRV_CONFIG_CONTROL_TIMER_STM32_TIM
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Control loop timer using a basic TIM device on STM32 MCUs.
+
+#ifndef _INTERNAL_PBDRV_CONTROL_TIMER_STM32_TIM_H_
+#define _INTERNAL_PBDRV_CONTROL_TIMER_STM32_TIM_H_
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_CONTROL_TIMER_STM32_TIM
+
+#include <stdint.h>
+
+#include STM32_H
+
+typedef struct {
+    /** The timer peripheral to use. Its clock must be enabled in SystemInit. */
+    TIM_TypeDef *TIMx;
+    /** Clock rate supplied to timer (Hz). */
+    uint32_t tim_clock_rate;
+    /** The timer update interrupt. */
+    IRQn_Type irq;
+    /** NVIC priority of the interrupt. This should be the lowest one. */
+    uint32_t irq_priority;
+} pbdrv_control_timer_stm32_tim_platform_data_t;
+
+/** Platform-specific data - defined in platform.c */
+extern const pbdrv_control_timer_stm32_tim_platform_data_t pbdrv_control_timer_stm32_tim_platform_data;
+
+void pbdrv_control_timer_stm32_tim_handle_irq(void);
+
+#endif // PBDRV_CONFIG_CONTROL_TIMER_STM32_TIM
+
+#endif // _INTERNAL_PBDRV_CONTROL_TIMER_STM32_TIM_H_
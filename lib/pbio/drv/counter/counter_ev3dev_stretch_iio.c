@@ -4,17 +4,33 @@
 // ev3dev-stretch PRU/IIO Quadrature Encoder Counter driver
 //
 // This driver uses the PRU quadrature encoder found in ev3dev-stretch.
+//
+// If PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE is set, the counts of
+// all encoders are captured through the IIO buffer at that rate. A single
+// read() of the buffer then gives the timestamped counts of all motors at once,
+// and the rate is estimated from these samples. Otherwise, or if the buffer
+// cannot be set up, the count and rate attributes are read for each motor.
 
 #include <pbdrv/config.h>
 
 #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
 
 #include <libudev.h>
 
+#include <ev3dev_stretch/sysfs.h>
 #include <pbio/util.h>
 #include "counter.h"
 
@@ -25,50 +41,461 @@
 #define dbg_err(s)
 #endif
 
+#define NUM_DEV PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV
+
 typedef struct {
     pbdrv_counter_dev_t *dev;
-    FILE *count;
-    FILE *rate;
+    uint8_t channel;
+    int count;
+    int rate;
 } private_data_t;
 
-static private_data_t private_data[PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV];
+static private_data_t private_data[NUM_DEV];
 
-static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_count(pbdrv_counter_dev_t *dev, int32_t *count) {
-    private_data_t *priv = dev->priv;
+#if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE
 
-    if (!priv->count) {
-        return PBIO_ERROR_NO_DEV;
+// Name of the hrtimer trigger that is created if the device has no trigger yet
+#define TRIGGER_NAME "pbdrv-counter"
+#define TRIGGER_CONFIGFS_PATH "/sys/kernel/config/iio/triggers/hrtimer/" TRIGGER_NAME
+
+// Number of scans that the kernel buffer can hold
+#define BUFFER_LENGTH (128)
+
+// Number of scans kept for estimating the rate, and how many scans back the
+// estimate looks (20 ms at 1 kHz)
+#define HISTORY_SIZE (32)
+#define RATE_SCANS (PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE / 50)
+
+_Static_assert(RATE_SCANS > 0 && RATE_SCANS < HISTORY_SIZE, "sample rate must be 50 Hz to 1.5 kHz");
+
+// Largest scan: a 64-bit value for each count and the timestamp
+#define MAX_SCAN_SIZE ((NUM_DEV + 1) * 8)
+
+// Location and format of one channel in a scan
+typedef struct {
+    uint16_t offset;
+    uint8_t bytes;
+    uint8_t bits;
+    uint8_t shift;
+    bool is_signed;
+    bool big_endian;
+} scan_element_t;
+
+// Counts of all channels at one point in time
+typedef struct {
+    int64_t time;
+    int32_t count[NUM_DEV];
+} scan_t;
+
+static struct {
+    // Buffer device, or -1 if the attributes are used instead
+    int fd;
+    char syspath[128];
+    bool trigger_created;
+    size_t scan_size;
+    scan_element_t count[NUM_DEV];
+    scan_element_t timestamp;
+    // The most recent scans, newest at history[num_scans % HISTORY_SIZE - 1]
+    scan_t history[HISTORY_SIZE];
+    uint32_t num_scans;
+    // Channels whose newest count or rate was not taken yet. The buffer is
+    // only read when a channel is asked for again, so all motors of one
+    // control loop tick share one read().
+    uint32_t fresh_count;
+    uint32_t fresh_rate;
+    // The control loop thread and the main thread may both read counts. The
+    // control loop thread has real-time priority, so the lock passes that on
+    // to a thread that holds it, instead of waiting behind other threads.
+    pthread_mutex_t lock;
+    uint8_t raw[BUFFER_LENGTH * MAX_SCAN_SIZE];
+} capture = {
+    .fd = -1,
+};
+
+// Writes a string to the attribute at syspath/attr
+static pbio_error_t capture_write_attr(const char *syspath, const char *attr, const char *value) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return PBIO_ERROR_IO;
     }
 
-    if (fseek(priv->count, 0, SEEK_SET) == -1) {
+    ssize_t len = write(fd, value, strlen(value));
+    close(fd);
+
+    return len == (ssize_t)strlen(value) ? PBIO_SUCCESS : PBIO_ERROR_IO;
+}
+
+// Reads the first line of the attribute at syspath/attr
+static pbio_error_t capture_read_attr(const char *syspath, const char *attr, char *value, size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
         return PBIO_ERROR_IO;
     }
 
-    if (fscanf(priv->count, "%d", count) == EOF) {
+    ssize_t len = read(fd, value, size - 1);
+    close(fd);
+
+    if (len < 0) {
         return PBIO_ERROR_IO;
     }
 
+    value[len] = '\0';
+    value[strcspn(value, "\n")] = '\0';
     return PBIO_SUCCESS;
 }
 
-static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_rate(pbdrv_counter_dev_t *dev, int32_t *rate) {
-    private_data_t *priv = dev->priv;
+// Reads the index and the format of a scan element, such as "le:s32/32>>0"
+static pbio_error_t capture_get_scan_element(const char *name, int *index, scan_element_t *element) {
+    char attr[64];
+    char value[32];
+    pbio_error_t err;
 
-    if (!priv->rate) {
-        return PBIO_ERROR_NO_DEV;
+    snprintf(attr, sizeof(attr), "scan_elements/%s_index", name);
+    err = capture_read_attr(capture.syspath, attr, value, sizeof(value));
+    if (err != PBIO_SUCCESS) {
+        return err;
     }
+    *index = atoi(value);
 
-    if (fseek(priv->rate, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
+    snprintf(attr, sizeof(attr), "scan_elements/%s_type", name);
+    err = capture_read_attr(capture.syspath, attr, value, sizeof(value));
+    if (err != PBIO_SUCCESS) {
+        return err;
     }
 
-    if (fscanf(priv->rate, "%d", rate) == EOF) {
+    char endian, sign;
+    unsigned int bits, storage, shift;
+    if (sscanf(value, "%ce:%c%u/%u>>%u", &endian, &sign, &bits, &storage, &shift) != 5) {
         return PBIO_ERROR_IO;
     }
+    if ((storage != 8 && storage != 16 && storage != 32 && storage != 64) || bits > storage || bits + shift > storage) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
 
+    element->bytes = storage / 8;
+    element->bits = bits;
+    element->shift = shift;
+    element->is_signed = sign == 's';
+    element->big_endian = endian == 'b';
     return PBIO_SUCCESS;
 }
 
+// Enables the counts and the timestamp in the scans, and disables all other
+// channels. Then works out where each of them is in a scan.
+static pbio_error_t capture_setup_scan(void) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/scan_elements", capture.syspath);
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        size_t len = strlen(entry->d_name);
+        if (len < 3 || strcmp(entry->d_name + len - 3, "_en")) {
+            continue;
+        }
+        bool wanted = !strcmp(entry->d_name, "in_timestamp_en");
+        for (int i = 0; i < NUM_DEV; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "in_count%d_en", i);
+            wanted |= !strcmp(entry->d_name, name);
+        }
+        char attr[sizeof(entry->d_name) + 16];
+        snprintf(attr, sizeof(attr), "scan_elements/%s", entry->d_name);
+        if (capture_write_attr(capture.syspath, attr, wanted ? "1" : "0") != PBIO_SUCCESS) {
+            closedir(dir);
+            return PBIO_ERROR_IO;
+        }
+    }
+    closedir(dir);
+
+    // Channels are laid out by their index, each aligned to its own size
+    int index[NUM_DEV + 1];
+    scan_element_t *elements[NUM_DEV + 1];
+    for (int i = 0; i < NUM_DEV + 1; i++) {
+        char name[16];
+        elements[i] = i < NUM_DEV ? &capture.count[i] : &capture.timestamp;
+        if (i < NUM_DEV) {
+            snprintf(name, sizeof(name), "in_count%d", i);
+        } else {
+            snprintf(name, sizeof(name), "in_timestamp");
+        }
+        pbio_error_t err = capture_get_scan_element(name, &index[i], elements[i]);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+    }
+
+    size_t offset = 0;
+    uint8_t largest = 1;
+    for (int done = 0; done < NUM_DEV + 1; done++) {
+        // Next channel by index
+        int next = -1;
+        for (int i = 0; i < NUM_DEV + 1; i++) {
+            if (index[i] >= 0 && (next == -1 || index[i] < index[next])) {
+                next = i;
+            }
+        }
+        scan_element_t *element = elements[next];
+        offset = (offset + element->bytes - 1) / element->bytes * element->bytes;
+        element->offset = offset;
+        offset += element->bytes;
+        if (element->bytes > largest) {
+            largest = element->bytes;
+        }
+        index[next] = -1;
+    }
+
+    // The scan as a whole is aligned to its largest element
+    capture.scan_size = (offset + largest - 1) / largest * largest;
+    return PBIO_SUCCESS;
+}
+
+// Uses the current trigger of the device if it has one. Otherwise, creates an
+// hrtimer trigger at the sample rate.
+static pbio_error_t capture_setup_trigger(void) {
+    char value[64];
+    pbio_error_t err;
+
+    err = capture_read_attr(capture.syspath, "trigger/current_trigger", value, sizeof(value));
+    if (err != PBIO_SUCCESS) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+    if (value[0] != '\0' && strcmp(value, TRIGGER_NAME)) {
+        return PBIO_SUCCESS;
+    }
+
+    // This needs configfs and the iio-trig-hrtimer module
+    if (mkdir(TRIGGER_CONFIGFS_PATH, 0755) == 0) {
+        capture.trigger_created = true;
+    } else if (errno != EEXIST) {
+        dbg_err("failed to create hrtimer trigger");
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    // Find the trigger device to set its rate
+    DIR *dir = opendir("/sys/bus/iio/devices");
+    if (!dir) {
+        return PBIO_ERROR_IO;
+    }
+
+    err = PBIO_ERROR_NO_DEV;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        char path[sizeof(entry->d_name) + 32];
+        if (strncmp(entry->d_name, "trigger", 7)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/bus/iio/devices/%s", entry->d_name);
+        if (capture_read_attr(path, "name", value, sizeof(value)) != PBIO_SUCCESS || strcmp(value, TRIGGER_NAME)) {
+            continue;
+        }
+        snprintf(value, sizeof(value), "%d", PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE);
+        err = capture_write_attr(path, "sampling_frequency", value);
+        break;
+    }
+    closedir(dir);
+
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    return capture_write_attr(capture.syspath, "trigger/current_trigger", TRIGGER_NAME);
+}
+
+static void capture_stop(void) {
+    if (capture.fd == -1) {
+        return;
+    }
+
+    capture_write_attr(capture.syspath, "buffer/enable", "0");
+    close(capture.fd);
+    capture.fd = -1;
+
+    if (capture.trigger_created) {
+        capture_write_attr(capture.syspath, "trigger/current_trigger", "\n");
+        rmdir(TRIGGER_CONFIGFS_PATH);
+        capture.trigger_created = false;
+    }
+}
+
+static void capture_start(const char *syspath) {
+    snprintf(capture.syspath, sizeof(capture.syspath), "%s", syspath);
+
+    // The lock is only used once the buffer is open, which is below, before
+    // the control loop thread starts
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&capture.lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    // The buffer may still be enabled by a previous program. Nothing can be
+    // changed until it is disabled.
+    if (capture_write_attr(capture.syspath, "buffer/enable", "0") != PBIO_SUCCESS) {
+        dbg_err("IIO buffer not supported");
+        return;
+    }
+
+    // The timestamps are only compared to each other, but should not jump
+    // with the wall clock
+    capture_write_attr(capture.syspath, "current_timestamp_clock", "monotonic");
+
+    char value[16];
+    snprintf(value, sizeof(value), "%d", BUFFER_LENGTH);
+    if (capture_setup_scan() != PBIO_SUCCESS ||
+        capture_setup_trigger() != PBIO_SUCCESS ||
+        capture_write_attr(capture.syspath, "buffer/length", value) != PBIO_SUCCESS) {
+        dbg_err("failed to set up IIO buffer");
+        return;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/%s", strrchr(capture.syspath, '/') + 1);
+    capture.fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (capture.fd == -1) {
+        dbg_err("failed to open IIO buffer");
+        return;
+    }
+
+    if (capture_write_attr(capture.syspath, "buffer/enable", "1") != PBIO_SUCCESS) {
+        dbg_err("failed to enable IIO buffer");
+        capture_stop();
+        return;
+    }
+
+    // Stop sampling when the program ends, so the buffer does not keep
+    // running in the background
+    atexit(capture_stop);
+}
+
+static int64_t capture_get_element(const uint8_t *scan, const scan_element_t *element) {
+    uint64_t raw = 0;
+    for (uint8_t i = 0; i < element->bytes; i++) {
+        uint8_t byte = scan[element->offset + (element->big_endian ? i : element->bytes - 1 - i)];
+        raw = (raw << 8) | byte;
+    }
+    raw >>= element->shift;
+
+    if (element->bits == 64) {
+        return raw;
+    }
+    raw &= (1ULL << element->bits) - 1;
+    if (element->is_signed && (raw >> (element->bits - 1))) {
+        raw |= ~0ULL << element->bits;
+    }
+    return raw;
+}
+
+// Reads all scans that arrived since the previous read. Must hold the lock.
+static void capture_read(void) {
+    ssize_t len = read(capture.fd, capture.raw, sizeof(capture.raw));
+    if (len <= 0) {
+        return;
+    }
+
+    for (const uint8_t *scan = capture.raw; scan + capture.scan_size <= capture.raw + len; scan += capture.scan_size) {
+        scan_t *entry = &capture.history[capture.num_scans % HISTORY_SIZE];
+        entry->time = capture_get_element(scan, &capture.timestamp);
+        for (int i = 0; i < NUM_DEV; i++) {
+            entry->count[i] = capture_get_element(scan, &capture.count[i]);
+        }
+        capture.num_scans++;
+    }
+
+    capture.fresh_count = capture.fresh_rate = (1 << NUM_DEV) - 1;
+}
+
+static const scan_t *capture_get_scan(uint32_t scans_back) {
+    return &capture.history[(capture.num_scans - 1 - scans_back) % HISTORY_SIZE];
+}
+
+static pbio_error_t capture_get_count(private_data_t *priv, int32_t *count) {
+    pthread_mutex_lock(&capture.lock);
+
+    if (!(capture.fresh_count & (1 << priv->channel))) {
+        capture_read();
+    }
+    capture.fresh_count &= ~(1 << priv->channel);
+
+    // Until the first scan comes in, use the attribute instead
+    bool ready = capture.num_scans > 0;
+    if (ready) {
+        *count = capture_get_scan(0)->count[priv->channel];
+    }
+
+    pthread_mutex_unlock(&capture.lock);
+
+    return ready ? PBIO_SUCCESS : sysfs_pread_int(priv->count, count);
+}
+
+static pbio_error_t capture_get_rate(private_data_t *priv, int32_t *rate) {
+    pthread_mutex_lock(&capture.lock);
+
+    if (!(capture.fresh_rate & (1 << priv->channel))) {
+        capture_read();
+    }
+    capture.fresh_rate &= ~(1 << priv->channel);
+
+    // Counts per second between the newest scan and the one RATE_SCANS
+    // before it, using the times at which they were taken
+    bool ready = capture.num_scans > RATE_SCANS;
+    if (ready) {
+        const scan_t *newest = capture_get_scan(0);
+        const scan_t *oldest = capture_get_scan(RATE_SCANS);
+        int64_t time = newest->time - oldest->time;
+        int64_t counts = newest->count[priv->channel] - oldest->count[priv->channel];
+        *rate = time > 0 ? counts * 1000000000LL / time : 0;
+    }
+
+    pthread_mutex_unlock(&capture.lock);
+
+    return ready ? PBIO_SUCCESS : sysfs_pread_int(priv->rate, rate);
+}
+
+#endif // PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE
+
+static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_count(pbdrv_counter_dev_t *dev, int32_t *count) {
+    private_data_t *priv = dev->priv;
+
+    #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE
+    if (capture.fd != -1) {
+        return capture_get_count(priv, count);
+    }
+    #endif
+
+    if (priv->count == -1) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    return sysfs_pread_int(priv->count, count);
+}
+
+static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_rate(pbdrv_counter_dev_t *dev, int32_t *rate) {
+    private_data_t *priv = dev->priv;
+
+    #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE
+    if (capture.fd != -1) {
+        return capture_get_rate(priv, rate);
+    }
+    #endif
+
+    if (priv->rate == -1) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    return sysfs_pread_int(priv->rate, rate);
+}
+
 static const pbdrv_counter_funcs_t pbdrv_counter_ev3dev_stretch_iio_funcs = {
     .get_count = pbdrv_counter_ev3dev_stretch_iio_get_count,
     .get_rate = pbdrv_counter_ev3dev_stretch_iio_get_rate,
@@ -80,6 +507,11 @@ void pbdrv_counter_ev3dev_stretch_iio_init(pbdrv_counter_dev_t *devs) {
     struct udev_enumerate *enumerate;
     struct udev_list_entry *entry;
 
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+        private_data[i].count = -1;
+        private_data[i].rate = -1;
+    }
+
     udev = udev_new();
     if (!udev) {
         dbg_err("Failed to get udev context");
@@ -118,32 +550,33 @@ void pbdrv_counter_ev3dev_stretch_iio_init(pbdrv_counter_dev_t *devs) {
         private_data_t *priv = &private_data[i];
 
         snprintf(buf, sizeof(buf), "%s/in_count%d_raw", udev_list_entry_get_name(entry), (int)i);
-        priv->count = fopen(buf, "r");
-        if (!priv->count) {
+        priv->count = open(buf, O_RDONLY | O_CLOEXEC);
+        if (priv->count == -1) {
             dbg_err("failed to open count attribute");
             continue;
         }
 
-        setbuf(priv->count, NULL);
-
         snprintf(buf, sizeof(buf), "%s/in_frequency%d_input", udev_list_entry_get_name(entry), (int)i);
-        priv->rate = fopen(buf, "r");
-        if (!priv->rate) {
+        priv->rate = open(buf, O_RDONLY | O_CLOEXEC);
+        if (priv->rate == -1) {
             dbg_err("failed to open rate attribute");
             continue;
         }
 
-        setbuf(priv->rate, NULL);
-
         // FIXME: assuming that these are the only counter devices
         // counter_id should be passed from platform data instead
         _Static_assert(PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV == PBDRV_CONFIG_COUNTER_NUM_DEV,
             "need to fix counter_ev3dev_stretch_iio implementation to allow other counter devices");
+        priv->channel = i;
         priv->dev = &devs[i];
         priv->dev->funcs = &pbdrv_counter_ev3dev_stretch_iio_funcs;
         priv->dev->priv = priv;
     }
 
+    #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE
+    capture_start(udev_list_entry_get_name(entry));
+    #endif
+
 free_enumerate:
     udev_enumerate_unref(enumerate);
 free_udev:
@@ -6,6 +6,7 @@
 #if PBDRV_CONFIG_MOTOR && !PBIO_TEST_BUILD
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -27,7 +28,9 @@ typedef struct _motor_t {
     bool coasting;
     pbio_iodev_type_id_t id;
     FILE *f_command;
-    FILE *f_duty;
+    int fd_duty;
+    bool duty_valid;
+    int32_t duty_last;
 } motor_t;
 
 static motor_t motors[4];
@@ -70,7 +73,7 @@ static pbio_error_t ev3dev_motor_init(motor_t *mtr, pbio_port_t port) {
             return err;
         }
         // Open duty file
-        err = sysfs_open_tacho_motor_attr(&mtr->f_duty, mtr->n_motor, "duty_cycle_sp", "w");
+        err = sysfs_open_tacho_motor_attr_fd(&mtr->fd_duty, mtr->n_motor, "duty_cycle_sp", O_WRONLY);
         if (err != PBIO_SUCCESS) {
             return err;
 
@@ -91,7 +94,7 @@ static pbio_error_t ev3dev_motor_init(motor_t *mtr, pbio_port_t port) {
             return err;
         }
         // Open duty
-        err = sysfs_open_dc_motor_attr(&mtr->f_duty, mtr->n_motor, "duty_cycle_sp", "w");
+        err = sysfs_open_dc_motor_attr_fd(&mtr->fd_duty, mtr->n_motor, "duty_cycle_sp", O_WRONLY);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -104,6 +107,7 @@ static pbio_error_t ev3dev_motor_init(motor_t *mtr, pbio_port_t port) {
 
     // Now that we have found the motor, coast it
     mtr->coasting = true;
+    mtr->duty_valid = false;
     return sysfs_write_str(mtr->f_command, "stop");
 }
 
@@ -165,9 +169,17 @@ pbio_error_t pbdrv_motor_set_duty_cycle(pbio_port_t port, int16_t duty_cycle) {
             return ev3dev_motor_connect_status(mtr, err);
         }
         mtr->coasting = false;
+        mtr->duty_valid = false;
     }
-    // Set the duty cycle value
-    err = sysfs_write_int(mtr->f_duty, duty_cycle / 100);
+    // Set the duty cycle value, unless it is already set. The control loop
+    // sets it on every tick, but it usually changes much less often than that.
+    int32_t duty = duty_cycle / 100;
+    if (mtr->duty_valid && duty == mtr->duty_last) {
+        return PBIO_SUCCESS;
+    }
+    err = sysfs_pwrite_int(mtr->fd_duty, duty);
+    mtr->duty_valid = err == PBIO_SUCCESS;
+    mtr->duty_last = duty;
     return ev3dev_motor_connect_status(mtr, err);
 }
 
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Internal flash memory of STM32F4 MCUs with 1M of flash in a single bank.
+
+#include <pbdrv/config.h>
+
+#if PBDRV_CONFIG_FLASH_STM32F4
+
+#include <stdint.h>
+
+#include <pbdrv/flash.h>
+#include <pbio/error.h>
+
+#include STM32_H
+
+#define FLASH_START (0x08000000)
+#define FLASH_SIZE (1024 * 1024)
+
+#define FLASH_KEY1 (0x45670123)
+#define FLASH_KEY2 (0xCDEF89AB)
+
+#define FLASH_SR_ERRORS (FLASH_SR_PGSERR | FLASH_SR_PGPERR | FLASH_SR_PGAERR | FLASH_SR_WRPERR)
+
+// Gets the sector that holds the given offset from the start of flash. Sectors
+// 0 to 3 are 16K, sector 4 is 64K and the others are 128K.
+static uint32_t flash_get_sector(uint32_t offset) {
+    if (offset < 0x10000) {
+        return offset / 0x4000;
+    }
+    if (offset < 0x20000) {
+        return 4;
+    }
+    return 4 + offset / 0x20000;
+}
+
+static void flash_unlock(void) {
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+}
+
+static pbio_error_t flash_wait_and_lock(void) {
+    while (FLASH->SR & FLASH_SR_BSY) {
+    }
+
+    FLASH->CR = FLASH_CR_LOCK;
+
+    if (FLASH->SR & FLASH_SR_ERRORS) {
+        FLASH->SR = FLASH_SR_ERRORS;
+        return PBIO_ERROR_IO;
+    }
+    return PBIO_SUCCESS;
+}
+
+// Erases one sector. Nothing can be read from flash until the erase is done,
+// which takes 1 to 2 s for a 128K sector. So this runs from RAM with all
+// interrupts masked, since all handlers are in flash. Interrupts that occur
+// in the meantime are handled afterwards.
+__attribute__((section(".ramfunc"), long_call, noinline))
+static pbio_error_t flash_erase_sector(uint32_t sector) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (FLASH->CR & FLASH_CR_LOCK) {
+        FLASH->KEYR = FLASH_KEY1;
+        FLASH->KEYR = FLASH_KEY2;
+    }
+
+    // 32-bit parallelism requires a supply voltage of at least 2.7 V
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER | (sector << FLASH_CR_SNB_Pos);
+    FLASH->CR |= FLASH_CR_STRT;
+
+    while (FLASH->SR & FLASH_SR_BSY) {
+    }
+
+    FLASH->CR = FLASH_CR_LOCK;
+
+    pbio_error_t err = PBIO_SUCCESS;
+    if (FLASH->SR & FLASH_SR_ERRORS) {
+        FLASH->SR = FLASH_SR_ERRORS;
+        err = PBIO_ERROR_IO;
+    }
+
+    __set_PRIMASK(primask);
+    return err;
+}
+
+pbio_error_t pbdrv_flash_erase(uint32_t address, uint32_t size) {
+    if (size == 0 || address < FLASH_START || address - FLASH_START + size > FLASH_SIZE) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    uint32_t first = flash_get_sector(address - FLASH_START);
+    uint32_t last = flash_get_sector(address - FLASH_START + size - 1);
+
+    for (uint32_t sector = first; sector <= last; sector++) {
+        pbio_error_t err = flash_erase_sector(sector);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+    }
+
+    // Don't keep reading the old data from the data cache
+    if (FLASH->ACR & FLASH_ACR_DCEN) {
+        FLASH->ACR &= ~FLASH_ACR_DCEN;
+        FLASH->ACR |= FLASH_ACR_DCRST;
+        FLASH->ACR &= ~FLASH_ACR_DCRST;
+        FLASH->ACR |= FLASH_ACR_DCEN;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pbdrv_flash_write(uint32_t address, const uint32_t *data, uint32_t size) {
+    if (address % 4 || size % 4 || address < FLASH_START || address - FLASH_START + size > FLASH_SIZE) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    volatile uint32_t *dest = (volatile uint32_t *)address;
+
+    flash_unlock();
+    FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+
+    for (uint32_t i = 0; i < size / 4; i++) {
+        dest[i] = data[i];
+        while (FLASH->SR & FLASH_SR_BSY) {
+        }
+        if (FLASH->SR & FLASH_SR_ERRORS) {
+            break;
+        }
+    }
+
+    return flash_wait_and_lock();
+}
+
+#endif // PBDRV_CONFIG_FLASH_STM32F4
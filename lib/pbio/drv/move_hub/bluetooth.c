@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include <contiki.h>
+#include <contiki-lib.h>
 
 #include "pbio/config.h"
 #include "pbio/error.h"
@@ -74,9 +75,11 @@ static uint16_t pybricks_service_handle, pybricks_char_handle;
 
 // nRF UART GATT service handles
 static uint16_t uart_service_handle, uart_rx_char_handle, uart_tx_char_handle;
-// nRF UART tx is in progress
-static bool uart_tx_busy;
-// buffer to queue UART tx data
+// UART tx data that is waiting to be sent, must be power of 2 for ring buffer!
+#define UART_TX_RING_SIZE 128
+static uint8_t uart_tx_ring_data[UART_TX_RING_SIZE];
+static struct ringbuf uart_tx_ring;
+// buffer for the UART tx data that is being sent
 static uint8_t uart_tx_buf[NRF_CHAR_SIZE];
 // bytes used in uart_tx_buf
 static uint8_t uart_tx_buf_size;
@@ -509,11 +512,10 @@ static PT_THREAD(hci_init(struct pt *pt)) {
 }
 
 static void uart_rx_char_modified(uint8_t *data, uint8_t size) {
-    for (int i = 0; i < size; i++) {
-        // TODO: set .port = bluetooth port
-        pbio_event_uart_rx_data_t rx = { .byte = data[i] };
-        process_post_synch(&pbsys_process, PBIO_EVENT_UART_RX, &rx);
-    }
+    // pass on the whole packet at once instead of one event per byte
+    // TODO: set .port = bluetooth port
+    pbio_event_uart_rx_data_t rx = { .data = data, .size = size };
+    process_post_synch(&pbsys_process, PBIO_EVENT_UART_RX, &rx);
 }
 
 static PT_THREAD(init_uart_service(struct pt *pt)) {
@@ -593,30 +595,56 @@ static PT_THREAD(set_discoverable(struct pt *pt)) {
     PT_END(pt);
 }
 
-pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+pbio_error_t pbdrv_bluetooth_tx_buf(const uint8_t *data, size_t size, size_t *written) {
     // make sure we have a Bluetooth connection
     if (!conn_handle) {
         return PBIO_ERROR_INVALID_OP;
     }
 
-    // can't add the the buffer if tx is in progress or buffer is full
-    if (uart_tx_busy || uart_tx_buf_size == NRF_CHAR_SIZE) {
-        return PBIO_ERROR_AGAIN;
+    bool was_empty = ringbuf_elements(&uart_tx_ring) == 0;
+
+    size_t i;
+    for (i = 0; i < size; i++) {
+        if (!ringbuf_put(&uart_tx_ring, data[i])) {
+            break;
+        }
     }
+    *written = i;
 
-    // append the char
-    uart_tx_buf[uart_tx_buf_size] = c;
-    uart_tx_buf_size++;
+    // can't add anything if the buffer is full
+    if (i == 0) {
+        return PBIO_ERROR_AGAIN;
+    }
 
-    // poke the process to start tx soon-ish. This way, we can accumulate up to
-    // NRF_CHAR_SIZE bytes before actually transmitting
-    // TODO: it probably would be better to poll here instead of using events
-    // so that we don't fill up the event queue with 20 events
-    process_post(&pbdrv_bluetooth_hci_process, PROCESS_EVENT_MSG, NULL);
+    // poke the process to start tx soon-ish. It keeps sending until the buffer
+    // is empty, so it only needs to be poked if it was empty.
+    if (was_empty) {
+        process_post(&pbdrv_bluetooth_hci_process, PROCESS_EVENT_MSG, NULL);
+    }
 
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+    size_t written;
+    return pbdrv_bluetooth_tx_buf(&c, 1, &written);
+}
+
+bool pbdrv_bluetooth_tx_is_idle(void) {
+    return !conn_handle || (uart_tx_buf_size == 0 && ringbuf_elements(&uart_tx_ring) == 0);
+}
+
+// moves the next notification worth of data from the ring buffer to uart_tx_buf
+static void uart_tx_buf_fill(void) {
+    int c;
+    for (uart_tx_buf_size = 0; uart_tx_buf_size < NRF_CHAR_SIZE; uart_tx_buf_size++) {
+        if ((c = ringbuf_get(&uart_tx_ring)) == -1) {
+            break;
+        }
+        uart_tx_buf[uart_tx_buf_size] = c;
+    }
+}
+
 static PT_THREAD(uart_service_send_data(struct pt *pt))
 {
     tBleStatus ret;
@@ -671,6 +699,9 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
 
         etimer_set(&timer, clock_from_msec(500));
 
+        // discard anything that was not sent during the previous connection
+        ringbuf_init(&uart_tx_ring, uart_tx_ring_data, UART_TX_RING_SIZE);
+
         // conn_handle is set to 0 upon disconnection
         while (conn_handle) {
             PROCESS_WAIT_EVENT();
@@ -679,11 +710,13 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
                 // just occasionally checking to see if we are still connected
                 continue;
             }
-            if (ev == PROCESS_EVENT_MSG && uart_tx_buf_size) {
-                uart_tx_busy = true;
-                PROCESS_PT_SPAWN(&child_pt, uart_service_send_data(&child_pt));
-                uart_tx_busy = false;
-                uart_tx_buf_size = 0;
+            if (ev == PROCESS_EVENT_MSG) {
+                // send as many notifications as it takes to empty the buffer
+                while (ringbuf_elements(&uart_tx_ring)) {
+                    uart_tx_buf_fill();
+                    PROCESS_PT_SPAWN(&child_pt, uart_service_send_data(&child_pt));
+                    uart_tx_buf_size = 0;
+                }
             }
         }
 
@@ -9,6 +9,8 @@
 #ifndef _PBDRV_BLUETOOTH_H_
 #define _PBDRV_BLUETOOTH_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <pbdrv/config.h>
@@ -27,11 +29,41 @@
  */
 pbio_error_t pbdrv_bluetooth_tx(uint8_t c);
 
+/**
+ * Queues data to be transmitted via Bluetooth serial port. Data is sent in as
+ * many notifications as needed, as fast as the connection allows.
+ * @param data [in]     the data to be sent.
+ * @param size [in]     the size of *data* in bytes.
+ * @param written [out] the number of bytes that were queued. This can be
+ *                      less than *size* if the buffer is nearly full.
+ * @return              ::PBIO_SUCCESS if at least one byte was queued,
+ *                      ::PBIO_ERROR_AGAIN if the buffer is full,
+ *                      ::PBIO_ERROR_INVALID_OP if there is not an active
+ *                      Bluetooth connection or ::PBIO_ERROR_NOT_SUPPORTED if
+ *                      this platform does not support Bluetooth.
+ */
+pbio_error_t pbdrv_bluetooth_tx_buf(const uint8_t *data, size_t size, size_t *written);
+
+/**
+ * Tells whether all data that was queued for the Bluetooth serial port has
+ * been handed over to the Bluetooth chip.
+ * @return              True if there is nothing left to send or there is not
+ *                      an active Bluetooth connection.
+ */
+bool pbdrv_bluetooth_tx_is_idle(void);
+
 #else // PBDRV_CONFIG_BLUETOOTH
 
 static inline pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
     return PBIO_ERROR_NOT_SUPPORTED;
 }
+static inline pbio_error_t pbdrv_bluetooth_tx_buf(const uint8_t *data, size_t size, size_t *written) {
+    *written = 0;
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+static inline bool pbdrv_bluetooth_tx_is_idle(void) {
+    return true;
+}
 
 #endif // PBDRV_CONFIG_BLUETOOTH
 
@@ -97,4 +97,21 @@
 #endif
 #endif
 
+// set to (1) if the UART driver implements pbdrv_uart_read_available()
+#ifndef PBDRV_CONFIG_UART_READ_AVAILABLE
+#define PBDRV_CONFIG_UART_READ_AVAILABLE (0)
+#endif
+
+// SCHED_FIFO priority of the control timer thread on Linux, or 0 to run it at
+// normal priority
+#ifndef PBDRV_CONFIG_CONTROL_TIMER_LINUX_PRIORITY
+#define PBDRV_CONFIG_CONTROL_TIMER_LINUX_PRIORITY (0)
+#endif
+
+// Rate (Hz) at which the ev3dev-stretch IIO counter captures all counts
+// through the IIO buffer, or 0 to read the count attributes of each motor
+#ifndef PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE
+#define PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE (0)
+#endif
+
 #endif // _PBDRV_CONFIG_H_
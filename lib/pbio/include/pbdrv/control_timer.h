@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+/**
+ * @addtogroup ControlTimerDriver Driver: Control loop timer
+ * @{
+ */
+
+#ifndef _PBDRV_CONTROL_TIMER_H_
+#define _PBDRV_CONTROL_TIMER_H_
+
+#include <stdint.h>
+
+#include <pbdrv/config.h>
+#include <pbio/error.h>
+
+/** Time between two calls of the control timer callback (ms). */
+#define PBDRV_CONTROL_TIMER_PERIOD_MS (1)
+
+/**
+ * Callback that is called from the control timer interrupt.
+ */
+typedef void (*pbdrv_control_timer_callback_t)(void);
+
+/**
+ * Timing of the control timer ticks.
+ */
+typedef struct _pbdrv_control_timer_stats_t {
+    uint32_t ticks;         /**< Number of ticks */
+    uint32_t missed;        /**< Number of ticks that passed while the callback was still running for an earlier one */
+    uint32_t deferred;      /**< Number of ticks on which the callback was not called because it was deferred */
+    uint32_t lateness_max;  /**< Largest time from a tick to the call of the callback (us) */
+    uint64_t lateness_sum;  /**< Sum of the time from each tick to the call of the callback (us) */
+} pbdrv_control_timer_stats_t;
+
+#if PBDRV_CONFIG_CONTROL_TIMER
+
+/**
+ * Starts calling @p callback every ::PBDRV_CONTROL_TIMER_PERIOD_MS.
+ *
+ * On MCUs, the callback is called from a hardware timer interrupt that has
+ * the lowest priority on the system, so it only ever preempts regular
+ * (non-interrupt) code. On Linux, it is called from a thread of its own.
+ * Either way, regular code that changes state used by the callback must be
+ * wrapped in pbdrv_control_timer_defer_begin() and
+ * pbdrv_control_timer_defer_end().
+ *
+ * @param [in]  callback    The callback.
+ * @return                  ::PBIO_SUCCESS on success or ::PBIO_ERROR_INVALID_OP
+ *                          if the timer has already been started.
+ */
+pbio_error_t pbdrv_control_timer_start(pbdrv_control_timer_callback_t callback);
+
+/**
+ * Stops the control timer. The callback is not called after this returns.
+ */
+void pbdrv_control_timer_stop(void);
+
+/**
+ * Keeps the callback from being called until the matching call to
+ * pbdrv_control_timer_defer_end(). If the callback is running on another
+ * thread, this waits for it to return. Ticks that are due in between are
+ * skipped.
+ *
+ * Calls may be nested, and may also be made from the callback itself.
+ */
+void pbdrv_control_timer_defer_begin(void);
+
+/**
+ * Ends the effect of the matching call to pbdrv_control_timer_defer_begin().
+ */
+void pbdrv_control_timer_defer_end(void);
+
+/**
+ * Gets the timing of the ticks since the timer was started or the
+ * statistics were reset.
+ * @param [out] stats       The statistics.
+ */
+void pbdrv_control_timer_get_stats(pbdrv_control_timer_stats_t *stats);
+
+/**
+ * Starts counting the statistics from zero.
+ */
+void pbdrv_control_timer_reset_stats(void);
+
+#else // PBDRV_CONFIG_CONTROL_TIMER
+
+static inline pbio_error_t pbdrv_control_timer_start(pbdrv_control_timer_callback_t callback) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
+static inline void pbdrv_control_timer_stop(void) {
+}
+
+static inline void pbdrv_control_timer_defer_begin(void) {
+}
+
+static inline void pbdrv_control_timer_defer_end(void) {
+}
+
+static inline void pbdrv_control_timer_get_stats(pbdrv_control_timer_stats_t *stats) {
+    *stats = (pbdrv_control_timer_stats_t) { 0 };
+}
+
+static inline void pbdrv_control_timer_reset_stats(void) {
+}
+
+#endif // PBDRV_CONFIG_CONTROL_TIMER
+
+#endif // _PBDRV_CONTROL_TIMER_H_
+
+/** @} */
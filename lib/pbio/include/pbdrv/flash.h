@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+/**
+ * @addtogroup FlashDriver Driver: Internal flash memory
+ * @{
+ */
+
+#ifndef _PBDRV_FLASH_H_
+#define _PBDRV_FLASH_H_
+
+#include <stdint.h>
+
+#include <pbdrv/config.h>
+#include <pbio/error.h>
+
+#if PBDRV_CONFIG_FLASH
+
+/**
+ * Erases all flash sectors that overlap with the given range.
+ *
+ * This blocks until the flash is erased, which takes 1 to 2 s per 128K sector.
+ * Interrupts are masked in the meantime, because no code can run from flash.
+ * Peripherals must tolerate this. For example, the Bluetooth UART uses
+ * hardware flow control, so the Bluetooth chip keeps the connection alive and
+ * holds incoming data until the erase is done.
+ *
+ * @param [in]  address     Start address.
+ * @param [in]  size        Size of the range in bytes.
+ * @return                  ::PBIO_SUCCESS on success, ::PBIO_ERROR_INVALID_ARG
+ *                          if the range is outside of the flash memory or
+ *                          ::PBIO_ERROR_IO if the flash could not be erased.
+ */
+pbio_error_t pbdrv_flash_erase(uint32_t address, uint32_t size);
+
+/**
+ * Writes data to erased flash memory.
+ *
+ * @param [in]  address     Destination address. Must be 4-byte aligned.
+ * @param [in]  data        The data to write.
+ * @param [in]  size        Size of @p data in bytes. Must be a multiple of 4.
+ * @return                  ::PBIO_SUCCESS on success, ::PBIO_ERROR_INVALID_ARG
+ *                          if the range is not aligned or outside of the flash
+ *                          memory or ::PBIO_ERROR_IO if the flash could not be
+ *                          written.
+ */
+pbio_error_t pbdrv_flash_write(uint32_t address, const uint32_t *data, uint32_t size);
+
+#else // PBDRV_CONFIG_FLASH
+
+static inline pbio_error_t pbdrv_flash_erase(uint32_t address, uint32_t size) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
+static inline pbio_error_t pbdrv_flash_write(uint32_t address, const uint32_t *data, uint32_t size) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
+#endif // PBDRV_CONFIG_FLASH
+
+#endif // _PBDRV_FLASH_H_
+
+/** @} */
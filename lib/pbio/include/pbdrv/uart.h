@@ -35,6 +35,18 @@ pbio_error_t pbdrv_uart_set_baud_rate(pbdrv_uart_dev_t *uart, uint32_t baud);
 pbio_error_t pbdrv_uart_read_begin(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t length, uint32_t timeout);
 pbio_error_t pbdrv_uart_read_end(pbdrv_uart_dev_t *uart);
 void pbdrv_uart_read_cancel(pbdrv_uart_dev_t *uart);
+
+/**
+ * Reads the bytes that have been received so far, without waiting for more.
+ * Only available if ::PBDRV_CONFIG_UART_READ_AVAILABLE is set.
+ * @param [in]  uart    The UART device
+ * @param [out] msg     Buffer for the received bytes
+ * @param [in]  size    Size of *msg*
+ * @param [out] length  Number of bytes that were read, up to *size*
+ * @return              ::PBIO_SUCCESS or ::PBIO_ERROR_INVALID_OP if a read
+ *                      started with pbdrv_uart_read_begin() is in progress.
+ */
+pbio_error_t pbdrv_uart_read_available(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t size, uint8_t *length);
 pbio_error_t pbdrv_uart_write_begin(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t length, uint32_t timeout);
 pbio_error_t pbdrv_uart_write_end(pbdrv_uart_dev_t *uart);
 void pbdrv_uart_write_cancel(pbdrv_uart_dev_t *uart);
@@ -57,6 +69,10 @@ static inline pbio_error_t pbdrv_uart_read_end(pbdrv_uart_dev_t *uart) {
 }
 static inline void pbdrv_uart_read_cancel(pbdrv_uart_dev_t *uart) {
 }
+static inline pbio_error_t pbdrv_uart_read_available(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t size, uint8_t *length) {
+    *length = 0;
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
 static inline pbio_error_t pbdrv_uart_write_begin(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t length, uint32_t timeout) {
     return PBIO_ERROR_NOT_SUPPORTED;
 }
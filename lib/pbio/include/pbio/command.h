@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+/**
+ * @addtogroup Command pbio: Command queue
+ *
+ * Queue of commands from user code to the motor process.
+ *
+ * There is exactly one producer (user code) and one consumer (the control
+ * loop) for each queue. Each side only writes its own index, so neither side
+ * has to lock out the other. The producer and the consumer may run on
+ * different cores, such as the MicroPython thread and the control loop thread
+ * on ev3dev, so each index is written with release and read with acquire
+ * semantics. This makes the command data written before the index visible to
+ * the other side before the index itself.
+ *
+ * The consumer keeps the result of each command, so the producer can report
+ * the error of a command once it has been applied. It also keeps the error of
+ * the last command that failed, so the producer can send commands without
+ * waiting for them, and report failures on a later call.
+ *
+ * @{
+ */
+
+#ifndef _PBIO_COMMAND_H_
+#define _PBIO_COMMAND_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbio/error.h>
+
+/** Number of commands that can be pending at once. Must be a power of 2. */
+#define PBIO_COMMAND_QUEUE_SIZE (8)
+
+/** Number of arguments of a command. */
+#define PBIO_COMMAND_NUM_ARGS (3)
+
+/**
+ * A command, as interpreted by the owner of the queue.
+ */
+typedef struct _pbio_command_t {
+    uint8_t type;                           /**< Owner-specific command type */
+    int32_t args[PBIO_COMMAND_NUM_ARGS];    /**< Owner-specific arguments */
+    int32_t time;                           /**< Time at which the command was sent (us) */
+} pbio_command_t;
+
+/**
+ * Single producer, single consumer command queue.
+ */
+typedef struct _pbio_command_queue_t {
+    pbio_command_t commands[PBIO_COMMAND_QUEUE_SIZE];
+    pbio_error_t results[PBIO_COMMAND_QUEUE_SIZE];  /**< Result of each applied command. Written by the consumer only. */
+    uint8_t head;                   /**< Number of commands sent. Written by the producer only. */
+    uint8_t tail;                   /**< Number of commands applied. Written by the consumer only. */
+    volatile int32_t latency;       /**< Largest time between sending and applying a command (us). Written by the consumer only. */
+    pbio_error_t error;             /**< Error of the last command that failed. Written by the consumer only. */
+    uint8_t num_errors;             /**< Number of commands that failed. Written by the consumer only. */
+    uint8_t num_errors_taken;       /**< Number of failures reported by the producer. Written by the producer only. */
+} pbio_command_queue_t;
+
+void pbio_command_queue_reset(pbio_command_queue_t *queue);
+bool pbio_command_queue_is_empty(const pbio_command_queue_t *queue);
+
+// Producer side
+pbio_error_t pbio_command_queue_get_next_index(const pbio_command_queue_t *queue, uint8_t *index);
+pbio_error_t pbio_command_queue_send(pbio_command_queue_t *queue, uint8_t type, int32_t arg0, int32_t arg1, int32_t arg2);
+pbio_error_t pbio_command_queue_get_result(const pbio_command_queue_t *queue);
+pbio_error_t pbio_command_queue_take_error(pbio_command_queue_t *queue);
+
+// Consumer side
+const pbio_command_t *pbio_command_queue_peek(pbio_command_queue_t *queue);
+void pbio_command_queue_pop(pbio_command_queue_t *queue, pbio_error_t err);
+
+#endif // _PBIO_COMMAND_H_
+
+/** @} */
@@ -15,4 +15,27 @@
 #define PBIO_CONFIG_UARTDEV (0)
 #endif
 
+// Longest time window (ms) over which the rate of LPF2 motors is estimated
+// from their tacho count, or 0 to use the coarse rate reported by the motors
+#ifndef PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS
+#define PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS (100)
+#endif
+
+// Use fixed point instead of float math for the motor state observer
+#ifndef PBIO_CONFIG_OBSERVER_FIX16
+#define PBIO_CONFIG_OBSERVER_FIX16 (0)
+#endif
+
+// Run the motor control loop from the hardware timer of the control_timer
+// driver instead of the contiki event loop
+#ifndef PBIO_CONFIG_CONTROL_LOOP_TIMER
+#define PBIO_CONFIG_CONTROL_LOOP_TIMER (0)
+#endif
+
+// Estimate the attitude and heading from IMU samples, so the drivebase can use
+// the heading as feedback
+#ifndef PBIO_CONFIG_IMU
+#define PBIO_CONFIG_IMU (0)
+#endif
+
 #endif // _PBIO_CONFIG_H_
@@ -9,6 +9,7 @@
 
 #include <fixmath.h>
 
+#include <pbio/command.h>
 #include <pbio/error.h>
 #include <pbio/port.h>
 #include <pbio/dcmotor.h>
@@ -18,8 +19,14 @@
 
 #include <pbio/iodev.h>
 
+// Default time between control updates. This is also the time step of the
+// observer model.
 #define PBIO_CONTROL_LOOP_TIME_MS (5)
 
+// Range of loop times that can be configured for each controller
+#define PBIO_CONTROL_LOOP_TIME_MIN_MS (1)
+#define PBIO_CONTROL_LOOP_TIME_MAX_MS (100)
+
 #define PBIO_CONTROL_LOG_COLS (13)
 
 /**
@@ -27,12 +34,14 @@
  */
 typedef struct _pbio_control_settings_t {
     fix16_t counts_per_unit;        /**< Conversion between user units (degree, mm, etc) and integer counts used internally by controller */
+    int32_t loop_time;              /**< Time between control updates (ms) */
     int32_t stall_rate_limit;       /**< If this speed cannnot be reached even with the maximum duty value (equal to stall_torque_limit), the motor is considered to be stalled */
     int32_t stall_time;             /**< Minimum stall time before the run_stalled action completes */
     int32_t max_rate;               /**< Soft limit on the reference encoder rate in all run commands */
     int32_t rate_tolerance;         /**< Allowed deviation (counts/s) from target speed. Hence, if speed target is zero, any speed below this tolerance is considered to be standstill. */
     int32_t count_tolerance;        /**< Allowed deviation (counts) from target before motion is considered complete */
     int32_t abs_acceleration;       /**< Encoder acceleration/deceleration rate when beginning to move or stopping. Positive value in counts per second per second */
+    int32_t abs_jerk;               /**< Rate of change of the acceleration in counts per second cubed, or zero for trapezoidal speed profiles without jerk limit */
     int32_t pid_kp;                 /**< Proportional position control constant (and integral speed control constant) */
     int32_t pid_ki;                 /**< Integral position control constant */
     int32_t pid_kd;                 /**< Derivative position control constant (and proportional speed control constant) */
@@ -72,6 +81,41 @@ typedef enum {
     PBIO_CONTROL_ANGLE,  /**< Run to an angle */
 } pbio_control_type_t;
 
+/**
+ * Timing statistics of the control updates
+ */
+typedef struct _pbio_control_loop_stats_t {
+    int32_t time_prev;              /**< Time of the previous update (us) */
+    bool running;                   /**< Whether there was a previous update since control started */
+    uint32_t updates;               /**< Number of updates */
+    uint32_t overruns;              /**< Number of updates that came at least one full loop time late */
+    int32_t jitter;                 /**< Largest deviation of the time between two updates from the loop time (us) */
+} pbio_control_loop_stats_t;
+
+// Number of angle maneuvers that can be queued after the ongoing one
+#define PBIO_CONTROL_NUM_SEGMENTS (4)
+
+/**
+ * Angle maneuver that starts when the ongoing one reaches its target
+ */
+typedef struct _pbio_control_segment_t {
+    int32_t target_count;           /**< Count at the end of the maneuver */
+    int32_t target_rate;            /**< Rate while moving towards the target */
+    int32_t acceleration;           /**< Acceleration and deceleration */
+    pbio_actuation_t after_stop;    /**< What to do if no other maneuver follows */
+} pbio_control_segment_t;
+
+/**
+ * Queue of angle maneuvers. User code reserves a slot before it sends the
+ * command that adds the maneuver, so the control loop never finds it full.
+ */
+typedef struct _pbio_control_segments_t {
+    pbio_control_segment_t buf[PBIO_CONTROL_NUM_SEGMENTS];
+    volatile uint8_t reserved;      /**< Number of slots reserved. Written by user code only. */
+    uint8_t added;                  /**< Number of maneuvers added. Written by the control loop only. */
+    volatile uint8_t started;       /**< Number of maneuvers started or discarded. Written by the control loop only. */
+} pbio_control_segments_t;
+
 typedef struct _pbio_control_t {
     pbio_control_type_t type;
     pbio_control_settings_t settings;
@@ -81,6 +125,9 @@ typedef struct _pbio_control_t {
     pbio_count_integrator_t count_integrator;
     pbio_control_on_target_t on_target_func;
     pbio_log_t log;
+    pbio_control_loop_stats_t loop_stats;
+    pbio_command_queue_t *commands;
+    pbio_control_segments_t segments;
     bool stalled;
     bool on_target;
 } pbio_control_t;
@@ -91,6 +138,8 @@ int32_t pbio_control_user_to_counts(pbio_control_settings_t *s, int32_t user);
 
 void pbio_control_settings_get_limits(pbio_control_settings_t *s, int32_t *speed, int32_t *acceleration, int32_t *duty, int32_t *torque);
 pbio_error_t pbio_control_settings_set_limits(pbio_control_settings_t *ctl, int32_t speed, int32_t acceleration, int32_t duty, int32_t torque);
+void pbio_control_settings_get_jerk(pbio_control_settings_t *s, int32_t *jerk);
+pbio_error_t pbio_control_settings_set_jerk(pbio_control_settings_t *s, int32_t jerk);
 
 void pbio_control_settings_get_pid(pbio_control_settings_t *s, int32_t *pid_kp, int32_t *pid_ki, int32_t *pid_kd, int32_t *integral_range, int32_t *integral_rate);
 pbio_error_t pbio_control_settings_set_pid(pbio_control_settings_t *s, int32_t pid_kp, int32_t pid_ki, int32_t pid_kd, int32_t integral_range, int32_t integral_rate);
@@ -101,6 +150,12 @@ pbio_error_t pbio_control_settings_set_target_tolerances(pbio_control_settings_t
 void pbio_control_settings_get_stall_tolerances(pbio_control_settings_t *s,  int32_t *speed, int32_t *time);
 pbio_error_t pbio_control_settings_set_stall_tolerances(pbio_control_settings_t *s, int32_t speed, int32_t time);
 
+int32_t pbio_control_settings_get_loop_time(pbio_control_settings_t *s);
+pbio_error_t pbio_control_settings_set_loop_time(pbio_control_settings_t *s, int32_t time);
+
+void pbio_control_get_loop_stats(pbio_control_t *ctl, uint32_t *updates, uint32_t *overruns, int32_t *jitter, int32_t *latency);
+void pbio_control_reset_loop_stats(pbio_control_t *ctl);
+
 int32_t pbio_control_settings_get_max_integrator(pbio_control_settings_t *s);
 int32_t pbio_control_get_ref_time(pbio_control_t *ctl, int32_t time_now);
 
@@ -109,6 +164,13 @@ pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_
 pbio_error_t pbio_control_start_relative_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t relative_target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop);
 pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_now, int32_t duration, int32_t count_now, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_control_on_target_t stop_func, pbio_actuation_t after_stop);
 pbio_error_t pbio_control_start_hold_control(pbio_control_t *ctl, int32_t time_now, int32_t target_count);
+void pbio_control_start_trajectory(pbio_control_t *ctl, const pbio_trajectory_t *trajectory, pbio_actuation_t after_stop);
+
+pbio_error_t pbio_control_reserve_segment(pbio_control_t *ctl);
+void pbio_control_cancel_segment(pbio_control_t *ctl);
+void pbio_control_reset_segments(pbio_control_t *ctl);
+pbio_error_t pbio_control_queue_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop);
+void pbio_control_drop_segment(pbio_control_t *ctl);
 
 
 bool pbio_control_is_stalled(pbio_control_t *ctl);
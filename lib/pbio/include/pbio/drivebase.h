@@ -4,6 +4,7 @@
 #ifndef _PBIO_DRIVEBASE_H_
 #define _PBIO_DRIVEBASE_H_
 
+#include <pbio/imu.h>
 #include <pbio/servo.h>
 
 #if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
@@ -15,6 +16,12 @@ typedef struct _pbio_drivebase_t {
     int32_t dif_offset;
     pbio_control_t control_heading;
     pbio_control_t control_distance;
+    int32_t servo_loop_time;
+    pbio_command_queue_t commands;
+    #if PBIO_CONFIG_IMU
+    // If set, the heading is measured by this IMU instead of the motors
+    pbio_imu_t *imu;
+    #endif
 } pbio_drivebase_t;
 
 pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio_servo_t *right, fix16_t wheel_diameter, fix16_t axle_track);
@@ -47,6 +54,10 @@ pbio_error_t pbio_drivebase_get_drive_settings(pbio_drivebase_t *db, int32_t *dr
 
 pbio_error_t pbio_drivebase_set_drive_settings(pbio_drivebase_t *db, int32_t drive_speed, int32_t drive_acceleration, int32_t turn_rate, int32_t turn_acceleration);
 
+#if PBIO_CONFIG_IMU
+pbio_error_t pbio_drivebase_set_imu(pbio_drivebase_t *db, pbio_imu_t *imu);
+#endif
+
 #endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
 
 #endif // _PBIO_DRIVEBASE_H_
@@ -12,7 +12,7 @@
  * Contiki process events.
  */
 typedef enum {
-    PBIO_EVENT_UART_RX,         /**< Character was received on a UART port. *data* is ::pbio_event_uart_rx_data_t. */
+    PBIO_EVENT_UART_RX,         /**< Data was received on a UART port. *data* is ::pbio_event_uart_rx_data_t. */
     PBIO_EVENT_COM_CMD,         /**< Command received from Pybricks BLE service */
     /** System status indicator was set. Data is pbsys_status_t. */
     PBIO_EVENT_STATUS_SET,
@@ -25,7 +25,8 @@ typedef enum {
  */
 typedef struct {
     pbio_port_t port;           /**< The port the UART is associated with. */
-    uint8_t byte;               /**< The byte received. */
+    const uint8_t *data;        /**< The bytes received, e.g. one Bluetooth packet. */
+    uint8_t size;               /**< The number of bytes in *data*. */
 } pbio_event_uart_rx_data_t;
 
 // TODO: these enums for Pybricks communication protocol should have their own header file
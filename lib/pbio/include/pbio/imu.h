@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+/**
+ * @addtogroup IMU pbio: Inertial measurement unit
+ *
+ * Attitude and heading estimation from gyro and accelerometer samples.
+ *
+ * Samples are fed in at the fixed output data rate of the sensor by the
+ * background process that reads it. A Mahony filter keeps the attitude as a
+ * quaternion, correcting the gyro drift in tilt with the measured gravity.
+ * The heading is the rotation about the vertical, so it does not depend on
+ * how the hub is mounted. Whenever the hub lies still for a while, the mean
+ * gyro reading is taken as the new gyro bias.
+ *
+ * The heading is published as integers that can be read in constant time,
+ * also from the control loop interrupt.
+ *
+ * @{
+ */
+
+#ifndef _PBIO_IMU_H_
+#define _PBIO_IMU_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbio/config.h>
+#include <pbio/error.h>
+
+#if PBIO_CONFIG_IMU
+
+/**
+ * Attitude and heading estimate.
+ */
+typedef struct _pbio_imu_t {
+    float sample_time;              /**< Time between two samples (s) */
+    float q[4];                     /**< Attitude quaternion w, x, y, z, from the hub frame to the world frame */
+    bool aligned;                   /**< Whether the attitude was initialized from the gravity */
+    float integral[3];              /**< Integral of the attitude error (rad/s) */
+    float bias[3];                  /**< Gyro bias (deg/s) */
+    bool bias_valid;                /**< Whether the bias was calibrated at rest since the reset */
+    uint32_t rest_count;            /**< Number of samples in the current rest window */
+    float rest_sum[3];              /**< Sum of the gyro readings in the current rest window (deg/s) */
+    float rest_ref[3];              /**< First gyro reading of the current rest window (deg/s) */
+    float heading_frac;             /**< Heading change that is not in the published heading yet (mdeg) */
+    volatile int32_t heading;       /**< Heading, increasing clockwise as seen from above (mdeg) */
+    volatile int32_t heading_rate;  /**< Heading rate (mdeg/s) */
+} pbio_imu_t;
+
+pbio_error_t pbio_imu_get_imu(pbio_imu_t **imu);
+
+void pbio_imu_reset(pbio_imu_t *imu, float sample_time);
+void pbio_imu_update(pbio_imu_t *imu, const float *gyro, const float *accel, bool calibrate);
+
+void pbio_imu_get_heading(pbio_imu_t *imu, int32_t *heading, int32_t *heading_rate);
+void pbio_imu_reset_heading(pbio_imu_t *imu, int32_t heading);
+void pbio_imu_get_quaternion(pbio_imu_t *imu, float *q);
+bool pbio_imu_is_calibrated(pbio_imu_t *imu);
+
+#endif // PBIO_CONFIG_IMU
+
+#endif // _PBIO_IMU_H_
+
+/** @} */
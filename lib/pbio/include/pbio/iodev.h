@@ -4,6 +4,7 @@
 #ifndef _PBIO_IODEV_H_
 #define _PBIO_IODEV_H_
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -175,6 +176,12 @@ typedef enum {
  */
 #define PBIO_IODEV_MAX_DATA_SIZE    LUMP_MAX_MSG_SIZE
 
+/**
+ * Max number of values in a mode combination. Each value of each mode in the
+ * combination counts as one.
+ */
+#define PBIO_IODEV_MAX_COMBO_VALUES (8)
+
 /**
  * Max size of units of measurements (not including null terminator)
  */
@@ -366,6 +373,9 @@ typedef struct {
     pbio_error_t (*set_data_begin)(pbio_iodev_t *iodev, const uint8_t *data);
     pbio_error_t (*set_data_end)(pbio_iodev_t *iodev);
     void (*set_data_cancel)(pbio_iodev_t *iodev);
+    pbio_error_t (*set_mode_combo_begin)(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes);
+    pbio_error_t (*set_mode_combo_end)(pbio_iodev_t *iodev);
+    void (*set_mode_combo_cancel)(pbio_iodev_t *iodev);
     pbio_error_t (*write_begin)(pbio_iodev_t *iodev, const uint8_t *data, uint8_t size);
     pbio_error_t (*write_end)(pbio_iodev_t *iodev);
     void (*write_cancel)(pbio_iodev_t *iodev);
@@ -399,6 +409,29 @@ struct _pbio_iodev_t {
      * the values could be foreign-endian.
      */
     uint8_t bin_data[PBIO_IODEV_MAX_DATA_SIZE]  __attribute__((aligned(32)));
+    /**
+     * Modes that are received together, in the order that their values appear
+     * in *bin_data*. Not used if *num_combo_modes* is 0.
+     */
+    uint8_t combo_modes[PBIO_IODEV_MAX_COMBO_VALUES];
+    /**
+     * The number of modes in *combo_modes*.
+     */
+    uint8_t num_combo_modes;
+    /**
+     * Whether the device has accepted the modes in *combo_modes*. Until it
+     * has, *bin_data* holds the data of *mode* only.
+     */
+    bool combo_ack;
+    /**
+     * Number of times *bin_data* has been updated. This keeps counting up
+     * across mode changes and reconnects, so a larger value means newer data.
+     */
+    uint32_t data_seq;
+    /**
+     * Time at which *bin_data* was last updated, in microseconds.
+     */
+    uint32_t data_time;
 };
 
 /** @endcond */
@@ -406,9 +439,15 @@ struct _pbio_iodev_t {
 size_t pbio_iodev_size_of(pbio_iodev_data_type_t type);
 pbio_error_t pbio_iodev_get_data_format(pbio_iodev_t *iodev, uint8_t mode, uint8_t *len, pbio_iodev_data_type_t *type);
 pbio_error_t pbio_iodev_get_data(pbio_iodev_t *iodev, uint8_t **data);
+pbio_error_t pbio_iodev_get_data_seq(pbio_iodev_t *iodev, uint32_t *seq, uint32_t *time);
+pbio_error_t pbio_iodev_wait_newer_data(pbio_iodev_t *iodev, uint32_t seq);
 pbio_error_t pbio_iodev_set_mode_begin(pbio_iodev_t *iodev, uint8_t mode);
 pbio_error_t pbio_iodev_set_mode_end(pbio_iodev_t *iodev);
 void pbio_iodev_set_mode_cancel(pbio_iodev_t *iodev);
+pbio_error_t pbio_iodev_set_mode_combo_begin(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes);
+pbio_error_t pbio_iodev_set_mode_combo_end(pbio_iodev_t *iodev);
+void pbio_iodev_set_mode_combo_cancel(pbio_iodev_t *iodev);
+pbio_error_t pbio_iodev_get_combo_data(pbio_iodev_t *iodev, uint8_t mode, uint8_t **data);
 pbio_error_t pbio_iodev_set_data_begin(pbio_iodev_t *iodev, uint8_t mode, const uint8_t *data);
 pbio_error_t pbio_iodev_set_data_end(pbio_iodev_t *iodev);
 void pbio_iodev_set_data_cancel(pbio_iodev_t *iodev);
@@ -15,10 +15,19 @@
 // Maximum number of values to be logged per sample
 #define MAX_LOG_VALUES (NUM_DEFAULT_LOG_VALUES + 15)
 
+// First byte of an encoded log frame
+#define PBIO_LOGGER_FRAME_START (0xA5)
+
+// Maximum size of an encoded log frame: start, size, number of lost rows,
+// one value per column, and checksum
+#define PBIO_LOGGER_FRAME_SIZE_MAX (2 + 5 + MAX_LOG_VALUES * 5 + 1)
+
 typedef struct _pbio_log_t {
     bool active;
+    bool ring;
     uint32_t skipped;
-    uint32_t sampled;
+    volatile uint32_t sampled;
+    uint32_t drained;
     uint32_t len;
     int32_t start;
     uint8_t num_values;
@@ -27,10 +36,14 @@ typedef struct _pbio_log_t {
 } pbio_log_t;
 
 void pbio_logger_start(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div);
+void pbio_logger_start_ring(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div);
 pbio_error_t pbio_logger_read(pbio_log_t *log, int32_t sindex, int32_t *buf);
+pbio_error_t pbio_logger_drain(pbio_log_t *log, int32_t *buf, uint32_t *lost);
 pbio_error_t pbio_logger_update(pbio_log_t *log, int32_t *buf);
 int32_t pbio_logger_rows(pbio_log_t *log);
 int32_t pbio_logger_cols(pbio_log_t *log);
 void pbio_logger_stop(pbio_log_t *log);
 
+uint8_t pbio_logger_encode_frame(const int32_t *row, int32_t *prev, uint8_t num_values, uint32_t lost, uint8_t *frame);
+
 #endif // _PBIO_LOGGER_H_
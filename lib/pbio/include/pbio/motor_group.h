@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#ifndef _PBIO_MOTOR_GROUP_H_
+#define _PBIO_MOTOR_GROUP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbio/command.h>
+#include <pbio/servo.h>
+
+#if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
+
+// Maximum number of servos in a group
+#define PBIO_MOTOR_GROUP_NUM_SERVOS_MAX (PBDRV_CONFIG_NUM_MOTOR_CONTROLLER)
+
+/**
+ * Servos that move together. Their maneuvers start and end at the same time,
+ * and they are all updated in the same control tick.
+ */
+typedef struct _pbio_motor_group_t {
+    pbio_servo_t *servos[PBIO_MOTOR_GROUP_NUM_SERVOS_MAX];
+    uint8_t num_servos;
+    int32_t targets[PBIO_COMMAND_QUEUE_SIZE][PBIO_MOTOR_GROUP_NUM_SERVOS_MAX]; /**< Target of each servo, for each queued command */
+    pbio_command_queue_t commands;
+} pbio_motor_group_t;
+
+pbio_error_t pbio_motor_group_setup(pbio_motor_group_t *group, pbio_servo_t **servos, uint8_t num_servos);
+pbio_error_t pbio_motor_group_update(pbio_motor_group_t *group);
+bool pbio_motor_group_has_servo(pbio_motor_group_t *group, pbio_servo_t *srv);
+int32_t pbio_motor_group_get_loop_time(pbio_motor_group_t *group);
+
+pbio_error_t pbio_motor_group_run_target(pbio_motor_group_t *group, int32_t speed, const int32_t *targets, pbio_actuation_t after_stop);
+pbio_error_t pbio_motor_group_stop(pbio_motor_group_t *group, pbio_actuation_t after_stop);
+void pbio_motor_group_stop_force(pbio_motor_group_t *group);
+
+bool pbio_motor_group_is_done(pbio_motor_group_t *group);
+
+#endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
+
+#endif // _PBIO_MOTOR_GROUP_H_
@@ -4,22 +4,51 @@
 #ifndef _PBIO_MOTOR_PROCESS_H_
 #define _PBIO_MOTOR_PROCESS_H_
 
+#include <stdbool.h>
+
+#include <pbio/config.h>
 #include <pbio/drivebase.h>
 #include <pbio/error.h>
+#include <pbio/motor_group.h>
 #include <pbio/servo.h>
 
 #if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
 
 pbio_error_t pbio_motor_process_get_drivebase(pbio_drivebase_t **db);
+pbio_error_t pbio_motor_process_get_motor_group(pbio_motor_group_t **group);
 pbio_error_t pbio_motor_process_get_servo(pbio_port_t port, pbio_servo_t **srv);
 
 void pbio_motor_process_reset(void);
+bool pbio_motor_process_is_idle(void);
 
 #else
 
 static inline void pbio_motor_process_reset(void) {
 }
 
+static inline bool pbio_motor_process_is_idle(void) {
+    return true;
+}
+
 #endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
 
+#if PBIO_CONFIG_CONTROL_LOOP_TIMER && PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
+
+// The control loop runs in an interrupt or in a thread of its own, so it may
+// run during any change to the state of the servos and drivebase. Such
+// changes are wrapped in calls to the functions below. Updates that are due
+// in between are done on the next tick.
+void pbio_motor_process_defer_begin(void);
+void pbio_motor_process_defer_end(void);
+
+#else
+
+static inline void pbio_motor_process_defer_begin(void) {
+}
+
+static inline void pbio_motor_process_defer_end(void) {
+}
+
+#endif // PBIO_CONFIG_CONTROL_LOOP_TIMER
+
 #endif // _PBIO_MOTOR_PROCESS_H_
@@ -6,31 +6,64 @@
 
 #include <stdint.h>
 
+#include <fixmath.h>
+
+#include <pbio/config.h>
 #include <pbio/control.h>
 
+#if PBIO_CONFIG_OBSERVER_FIX16
+typedef fix16_t pbio_observer_coef_t;
+#define PBIO_OBSERVER_COEF(x) F16(x)
+#else
+typedef float pbio_observer_coef_t;
+#define PBIO_OBSERVER_COEF(x) ((float)(x))
+#endif
+
+/**
+ * Observer model of a motor, derived from its physical model by
+ * tools/observer-settings.py. All products are precomputed, so the control
+ * loop only has to multiply and add.
+ */
 typedef struct _pbio_observer_settings_t {
-    float phi_01;
-    float phi_11;
-    float gam_0;
-    float gam_1;
-    float k_0;
-    float k_1;
-    float k_2;
-    float f_low;
-    float obs_gain;
+    pbio_observer_coef_t phi_01;            /**< Count per rate over one loop time */
+    pbio_observer_coef_t phi_11;            /**< Rate per rate over one loop time */
+    pbio_observer_coef_t gam_0;             /**< Count per torque over one loop time */
+    pbio_observer_coef_t gam_1;             /**< Rate per torque over one loop time */
+    pbio_observer_coef_t k_0;               /**< Torque (Nm) per volt */
+    pbio_observer_coef_t f_low;             /**< Friction torque (Nm) */
+    pbio_observer_coef_t obs_gain;          /**< Torque (Nm) per count of estimation error */
+    int32_t ff_friction;                    /**< Friction torque (uNm): f_low * 10^6 */
+    pbio_observer_coef_t ff_rate;           /**< Back EMF torque per count/s (uNm): k_0 * k_2 * 10^6 */
+    pbio_observer_coef_t ff_acceleration;   /**< Torque per count/s^2 (uNm): k_0 * k_1 * 10^6 */
+    pbio_observer_coef_t duty_per_torque;   /**< Duty (0--10000) times mV per uNm: 10 / k_0 */
 } pbio_observer_settings_t;
 
+#if PBIO_CONFIG_OBSERVER_FIX16
+
+typedef struct _pbio_observer_t {
+    int32_t est_count;              /**< Estimated count, rounded down */
+    fix16_t est_count_frac;         /**< Fraction of a count to add to est_count, between 0 and 1 */
+    fix16_t est_rate;               /**< Estimated rate in counts/s */
+    int32_t time_prev;              /**< Time of the last model step (us) */
+    const pbio_observer_settings_t *settings;
+} pbio_observer_t;
+
+#else // PBIO_CONFIG_OBSERVER_FIX16
+
 typedef struct _pbio_observer_t {
     float est_count;
     float est_rate;
+    int32_t time_prev;
     const pbio_observer_settings_t *settings;
 } pbio_observer_t;
 
-void pbio_observer_reset(pbio_observer_t *obs, int32_t count_now, int32_t rate_now);
+#endif // PBIO_CONFIG_OBSERVER_FIX16
+
+void pbio_observer_reset(pbio_observer_t *obs, int32_t time_now, int32_t count_now, int32_t rate_now);
 
 void pbio_observer_get_estimated_state(pbio_observer_t *obs, int32_t *count, int32_t *rate);
 
-void pbio_observer_update(pbio_observer_t *obs, int32_t count, pbio_actuation_t actuation_type, int32_t control, int32_t battery_voltage);
+void pbio_observer_update(pbio_observer_t *obs, int32_t time_now, int32_t count, pbio_actuation_t actuation_type, int32_t control, int32_t battery_voltage);
 
 int32_t pbio_observer_get_feedforward_torque(pbio_observer_t *obs, int32_t rate_ref, int32_t acceleration_ref);
 
@@ -13,6 +13,7 @@
 #include <pbdrv/motor.h>
 #include <pbdrv/counter.h>
 
+#include <pbio/command.h>
 #include <pbio/error.h>
 #include <pbio/port.h>
 #include <pbio/dcmotor.h>
@@ -32,11 +33,13 @@ typedef struct _pbio_servo_t {
     pbio_port_t port;
     bool connected;
     bool claimed;
+    bool grouped;
     pbio_dcmotor_t *dcmotor;
     pbio_tacho_t *tacho;
     pbio_control_t control;
     pbio_observer_t observer;
     pbio_log_t log;
+    pbio_command_queue_t commands;
 } pbio_servo_t;
 
 pbio_error_t pbio_servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix16_t gear_ratio);
@@ -60,8 +63,10 @@ pbio_error_t pbio_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio
 pbio_error_t pbio_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop);
 pbio_error_t pbio_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop);
 pbio_error_t pbio_servo_track_target(pbio_servo_t *srv, int32_t target);
+pbio_error_t pbio_servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop);
 
 pbio_error_t pbio_servo_control_update(pbio_servo_t *srv);
+void pbio_servo_reject_commands(pbio_servo_t *srv, pbio_error_t err);
 
 #endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
 
@@ -31,6 +31,13 @@
 
 /**
  * Motor trajectory parameters for an ideal maneuver without disturbances
+ *
+ * If tj is nonzero, the trajectory is an S-curve: the moving average over tj
+ * of a trapezoidal profile. This makes each step in acceleration a ramp of
+ * duration tj, so the jerk never exceeds the acceleration divided by tj.
+ * Then t0, th0, and w0 give the start of the S-curve and t3 its end. The
+ * other points are the corners of the trapezoidal profile, which starts tj/2
+ * after t0 and ends tj/2 before t3.
  */
 typedef struct _pbio_trajectory_t {
     bool forever;                       /**<  Whether maneuver has end-point */
@@ -50,23 +57,26 @@ typedef struct _pbio_trajectory_t {
     int32_t w1;                          /**<  Encoder rate target when not accelerating */
     int32_t a0;                          /**<  Encoder acceleration during in-phase */
     int32_t a2;                          /**<  Encoder acceleration during out-phase */
+    int32_t tj;                          /**<  Time to ramp up the acceleration, or zero for a trapezoidal profile */
 } pbio_trajectory_t;
 
 // Core trajectory generators
 
 void pbio_trajectory_make_stationary(pbio_trajectory_t *ref, int32_t t0, int32_t th0);
 
-pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
-pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
 void pbio_trajectory_get_reference(pbio_trajectory_t *traject, int32_t time_ref, int32_t *count_ref, int32_t *count_ref_ext, int32_t *rate_ref, int32_t *acceleration_ref);
 
 // Extended and patched trajectories
 
-pbio_error_t pbio_trajectory_make_time_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t t3, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+pbio_error_t pbio_trajectory_make_time_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t t3, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
-pbio_error_t pbio_trajectory_make_angle_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+void pbio_trajectory_make_scaled(pbio_trajectory_t *ref, const pbio_trajectory_t *lead, int32_t t0, int32_t th0, int32_t distance, int32_t lead_distance);
+
+pbio_error_t pbio_trajectory_make_angle_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
 
 #endif // _PBIO_TRAJECTORY_H_
@@ -25,4 +25,11 @@
 #define PBIO_CONTAINER_OF(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
 #endif
 
+/**
+ * Keeps the compiler from moving memory accesses across this point. This
+ * orders the accesses as seen by an interrupt handler or a thread on the same
+ * core, but not as seen by another core.
+ */
+#define PBIO_COMPILER_BARRIER() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
 #endif // _PBIO_UTIL_H_
@@ -13,4 +13,14 @@
 #error "Must define PBSYS_CONFIG_STATUS_LIGHT in pbsysconfig.h"
 #endif
 
+// Size of the stdin ring buffer in bytes. Must be a power of 2. Larger buffers
+// let hosts stream data in bursts without it being dropped.
+#ifndef PBSYS_CONFIG_STDIN_BUF_SIZE
+#define PBSYS_CONFIG_STDIN_BUF_SIZE (128)
+#endif
+
+#if PBSYS_CONFIG_STDIN_BUF_SIZE & (PBSYS_CONFIG_STDIN_BUF_SIZE - 1)
+#error "PBSYS_CONFIG_STDIN_BUF_SIZE must be a power of 2"
+#endif
+
 #endif // _PBSYS_CONFIG_H_
@@ -17,6 +17,7 @@
 #define _PBSYS_SYS_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <pbio/config.h>
@@ -87,6 +88,19 @@ pbio_error_t pbsys_stdin_get_char(uint8_t *c);
  */
 pbio_error_t pbsys_stdout_put_char(uint8_t c);
 
+/**
+ * Write several characters to stdout.
+ * @param [in] data     The characters to write
+ * @param [in] size     The number of characters in *data*
+ * @param [out] written The number of characters that were written. This can
+ *                      be less than *size*.
+ * @return              ::PBIO_SUCCESS if at least one character was written,
+ *                      ::PBIO_ERROR_AGAIN if no characters could be written
+ *                      at this time or ::PBIO_ERROR_NOT_SUPPORTED if the
+ *                      platform does not have a stdout.
+ */
+pbio_error_t pbsys_stdout_put_buf(const uint8_t *data, size_t size, size_t *written);
+
 #else // PBIO_CONFIG_ENABLE_SYS
 
 static inline void pbsys_prepare_user_program(const pbsys_user_program_callbacks_t *callbacks) {
@@ -100,6 +114,10 @@ static inline pbio_error_t pbsys_stdin_get_char(uint8_t *c) {
 static inline pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return PBIO_ERROR_NOT_SUPPORTED;
 }
+static inline pbio_error_t pbsys_stdout_put_buf(const uint8_t *data, size_t size, size_t *written) {
+    *written = 0;
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
 
 #endif // PBIO_CONFIG_ENABLE_SYS
 
@@ -59,6 +59,19 @@ pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbsys_stdout_put_buf(const uint8_t *data, size_t size, size_t *written) {
+    // the UART has no buffer, so this is the same as writing one char
+    *written = 0;
+    if (size == 0) {
+        return PBIO_SUCCESS;
+    }
+    pbio_error_t err = pbsys_stdout_put_char(data[0]);
+    if (err == PBIO_SUCCESS) {
+        *written = 1;
+    }
+    return err;
+}
+
 PROCESS_THREAD(pbsys_process, ev, data) {
     static struct etimer timer;
 
@@ -15,10 +15,15 @@
 #define PBDRV_CONFIG_CLOCK                                  (1)
 #define PBDRV_CONFIG_CLOCK_LINUX                            (1)
 
+#define PBDRV_CONFIG_CONTROL_TIMER                          (1)
+#define PBDRV_CONFIG_CONTROL_TIMER_LINUX                    (1)
+#define PBDRV_CONFIG_CONTROL_TIMER_LINUX_PRIORITY           (50)
+
 #define PBDRV_CONFIG_COUNTER                                (1)
 #define PBDRV_CONFIG_COUNTER_NUM_DEV                        (4)
 #define PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO             (1)
 #define PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV     (4)
+#define PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_SAMPLE_RATE (1000)
 
 #define PBDRV_CONFIG_COUNTER_COUNTS_PER_DEGREE              (2)
 
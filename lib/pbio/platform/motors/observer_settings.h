@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2018-2020 The Pybricks Authors
+
+// This file is generated by tools/observer-settings.py. Do not edit.
+// Loop time: 5 ms
+
+#include <pbio/observer.h>
+
+#if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO || PBDRV_CONFIG_COUNTER_NXT
+
+static const pbio_observer_settings_t settings_observer_ev3_m = {
+    .phi_01 = PBIO_OBSERVER_COEF(0),
+    .phi_11 = PBIO_OBSERVER_COEF(0),
+    .gam_0 = PBIO_OBSERVER_COEF(0),
+    .gam_1 = PBIO_OBSERVER_COEF(0),
+    .k_0 = PBIO_OBSERVER_COEF(0.0222270619076427),
+    .f_low = PBIO_OBSERVER_COEF(0.00915862068965517),
+    .obs_gain = PBIO_OBSERVER_COEF(0),
+    .ff_friction = 9158,
+    .ff_rate = PBIO_OBSERVER_COEF(58.2456140350876),
+    .ff_acceleration = PBIO_OBSERVER_COEF(4.54315789473685),
+    .duty_per_torque = PBIO_OBSERVER_COEF(449.902017709392),
+};
+
+#endif // PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO || PBDRV_CONFIG_COUNTER_NXT
+
+#if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO || PBDRV_CONFIG_COUNTER_NXT
+
+static const pbio_observer_settings_t settings_observer_ev3_l = {
+    .phi_01 = PBIO_OBSERVER_COEF(0),
+    .phi_11 = PBIO_OBSERVER_COEF(0),
+    .gam_0 = PBIO_OBSERVER_COEF(0),
+    .gam_1 = PBIO_OBSERVER_COEF(0),
+    .k_0 = PBIO_OBSERVER_COEF(0.0498862433862434),
+    .f_low = PBIO_OBSERVER_COEF(0.00823809523809524),
+    .obs_gain = PBIO_OBSERVER_COEF(0),
+    .ff_friction = 8238,
+    .ff_rate = PBIO_OBSERVER_COEF(205.952380952381),
+    .ff_acceleration = PBIO_OBSERVER_COEF(21.625),
+    .duty_per_torque = PBIO_OBSERVER_COEF(200.456064061091),
+};
+
+#endif // PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO || PBDRV_CONFIG_COUNTER_NXT
+
+#if PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+static const pbio_observer_settings_t settings_observer_technic_m_angular = {
+    .phi_01 = PBIO_OBSERVER_COEF(0.00471127825986593),
+    .phi_11 = PBIO_OBSERVER_COEF(0.886778220155195),
+    .gam_0 = PBIO_OBSERVER_COEF(1.98652315497896),
+    .gam_1 = PBIO_OBSERVER_COEF(779.011955265974),
+    .k_0 = PBIO_OBSERVER_COEF(0.0225843564674797),
+    .f_low = PBIO_OBSERVER_COEF(0.0121864126829268),
+    .obs_gain = PBIO_OBSERVER_COEF(0.002),
+    .ff_friction = 12186,
+    .ff_rate = PBIO_OBSERVER_COEF(145.34023397131),
+    .ff_acceleration = PBIO_OBSERVER_COEF(6.04776117750001),
+    .duty_per_torque = PBIO_OBSERVER_COEF(442.784367772422),
+};
+
+#endif // PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+#if PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+static const pbio_observer_settings_t settings_observer_technic_l_angular = {
+    .phi_01 = PBIO_OBSERVER_COEF(0.00476139134919619),
+    .phi_11 = PBIO_OBSERVER_COEF(0.906099484723787),
+    .gam_0 = PBIO_OBSERVER_COEF(0.684051954862546),
+    .gam_1 = PBIO_OBSERVER_COEF(269.197410994572),
+    .k_0 = PBIO_OBSERVER_COEF(0.0523592212418605),
+    .f_low = PBIO_OBSERVER_COEF(0.0116196027906977),
+    .obs_gain = PBIO_OBSERVER_COEF(0.004),
+    .ff_friction = 11619,
+    .ff_rate = PBIO_OBSERVER_COEF(348.816561531145),
+    .ff_acceleration = PBIO_OBSERVER_COEF(17.687359368),
+    .duty_per_torque = PBIO_OBSERVER_COEF(190.988325701169),
+};
+
+#endif // PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+#if PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+static const pbio_observer_settings_t settings_observer_interactive = {
+    .phi_01 = PBIO_OBSERVER_COEF(0.00476271917080315),
+    .phi_11 = PBIO_OBSERVER_COEF(0.906613349592095),
+    .gam_0 = PBIO_OBSERVER_COEF(2.93111612537288),
+    .gam_1 = PBIO_OBSERVER_COEF(1153.59979915647),
+    .k_0 = PBIO_OBSERVER_COEF(0.0150093320549696),
+    .f_low = PBIO_OBSERVER_COEF(0.00561342281879195),
+    .obs_gain = PBIO_OBSERVER_COEF(0.002),
+    .ff_friction = 5613,
+    .ff_rate = PBIO_OBSERVER_COEF(80.952380952381),
+    .ff_acceleration = PBIO_OBSERVER_COEF(4.12857142857143),
+    .duty_per_torque = PBIO_OBSERVER_COEF(666.252166543878),
+};
+
+#endif // PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+#if (PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST) && PBDRV_CONFIG_COUNTER_STM32F0_GPIO_QUAD_ENC
+
+static const pbio_observer_settings_t settings_observer_movehub = {
+    .phi_01 = PBIO_OBSERVER_COEF(0.00482560542071841),
+    .phi_11 = PBIO_OBSERVER_COEF(0.931062779704023),
+    .gam_0 = PBIO_OBSERVER_COEF(2.20557850267896),
+    .gam_1 = PBIO_OBSERVER_COEF(871.853080213831),
+    .k_0 = PBIO_OBSERVER_COEF(0.0212090326929559),
+    .f_low = PBIO_OBSERVER_COEF(0.0124173913043478),
+    .obs_gain = PBIO_OBSERVER_COEF(0.002),
+    .ff_friction = 12417,
+    .ff_rate = PBIO_OBSERVER_COEF(79.0697674418604),
+    .ff_acceleration = PBIO_OBSERVER_COEF(5.53488372093023),
+    .duty_per_torque = PBIO_OBSERVER_COEF(471.497222186908),
+};
+
+#endif // (PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST) && PBDRV_CONFIG_COUNTER_STM32F0_GPIO_QUAD_ENC
+
+#if PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+static const pbio_observer_settings_t settings_observer_technic_l = {
+    .phi_01 = PBIO_OBSERVER_COEF(0.00480673379919288),
+    .phi_11 = PBIO_OBSERVER_COEF(0.923702638108049),
+    .gam_0 = PBIO_OBSERVER_COEF(1.53998720733935),
+    .gam_1 = PBIO_OBSERVER_COEF(607.954007356972),
+    .k_0 = PBIO_OBSERVER_COEF(0.0292913675213675),
+    .f_low = PBIO_OBSERVER_COEF(0.013215),
+    .obs_gain = PBIO_OBSERVER_COEF(0.002),
+    .ff_friction = 13215,
+    .ff_rate = PBIO_OBSERVER_COEF(125.498575498576),
+    .ff_acceleration = PBIO_OBSERVER_COEF(7.90641025641026),
+    .duty_per_torque = PBIO_OBSERVER_COEF(341.397512175052),
+};
+
+#endif // PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+#if PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
+
+static const pbio_observer_settings_t settings_observer_technic_xl = {
+    .phi_01 = PBIO_OBSERVER_COEF(0.00481529951016883),
+    .phi_11 = PBIO_OBSERVER_COEF(0.927040916512594),
+    .gam_0 = PBIO_OBSERVER_COEF(1.66041757033243),
+    .gam_1 = PBIO_OBSERVER_COEF(655.886425902678),
+    .k_0 = PBIO_OBSERVER_COEF(0.0259047425474255),
+    .f_low = PBIO_OBSERVER_COEF(0.00644634146341464),
+    .obs_gain = PBIO_OBSERVER_COEF(0.002),
+    .ff_friction = 6446,
+    .ff_rate = PBIO_OBSERVER_COEF(111.237373737374),
+    .ff_acceleration = PBIO_OBSERVER_COEF(7.34166666666667),
+    .duty_per_torque = PBIO_OBSERVER_COEF(386.029700225446),
+};
+
+#endif // PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST
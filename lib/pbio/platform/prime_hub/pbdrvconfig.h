@@ -40,9 +40,15 @@
 #define PBDRV_CONFIG_CLOCK                          (1)
 #define PBDRV_CONFIG_CLOCK_STM32                    (1)
 
+#define PBDRV_CONFIG_CONTROL_TIMER                  (1)
+#define PBDRV_CONFIG_CONTROL_TIMER_STM32_TIM        (1)
+
 #define PBDRV_CONFIG_COUNTER                        (1)
 #define PBDRV_CONFIG_COUNTER_NUM_DEV                (6)
 
+#define PBDRV_CONFIG_FLASH                          (1)
+#define PBDRV_CONFIG_FLASH_STM32F4                  (1)
+
 #define PBDRV_CONFIG_GPIO                           (1)
 #define PBDRV_CONFIG_GPIO_STM32F4                   (1)
 
@@ -3,3 +3,4 @@
 
 #define PBSYS_CONFIG_HUB_LIGHT_MATRIX                 (1)
 #define PBSYS_CONFIG_STATUS_LIGHT                   (1)
+#define PBSYS_CONFIG_STDIN_BUF_SIZE                 (1024)
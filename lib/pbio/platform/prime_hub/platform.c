@@ -11,6 +11,7 @@
 #include "../../drv/adc/adc_stm32_hal.h"
 #include "../../drv/bluetooth/bluetooth_btstack_control_gpio.h"
 #include "../../drv/bluetooth/bluetooth_btstack_uart_block_stm32_hal.h"
+#include "../../drv/control_timer/control_timer_stm32_tim.h"
 #include "../../drv/ioport/ioport_lpf2.h"
 #include "../../drv/led/led_array_pwm.h"
 #include "../../drv/led/led_dual.h"
@@ -20,6 +21,10 @@
 #include "../../drv/sound/sound_stm32_hal_dac.h"
 #include "../../drv/uart/uart_stm32f4_ll_irq.h"
 
+// Clock of the timers on APB1. The bus runs at 48MHz (see SystemInit()), and
+// since it is divided down from HCLK, its timers run at twice that.
+#define APB1_TIM_CLOCK_RATE (96000000)
+
 // bootloader magic
 
 typedef struct {
@@ -120,6 +125,19 @@ void USART2_IRQHandler(void) {
     pbdrv_bluetooth_btstack_uart_block_stm32_hal_handle_uart_irq();
 }
 
+// Control loop timer
+
+const pbdrv_control_timer_stm32_tim_platform_data_t pbdrv_control_timer_stm32_tim_platform_data = {
+    .TIMx = TIM7,
+    .tim_clock_rate = APB1_TIM_CLOCK_RATE,
+    .irq = TIM7_IRQn,
+    .irq_priority = 15,
+};
+
+void TIM7_IRQHandler(void) {
+    pbdrv_control_timer_stm32_tim_handle_irq();
+}
+
 // I/O ports
 
 const pbdrv_ioport_lpf2_platform_data_t pbdrv_ioport_lpf2_platform_data = {
@@ -387,7 +405,7 @@ const pbdrv_sound_stm32_hal_dac_platform_data_t pbdrv_sound_stm32_hal_dac_platfo
     .dma_ch = DMA_CHANNEL_7,
     .dma_irq = DMA1_Stream5_IRQn,
     .tim = TIM6,
-    .tim_clock_rate = 48000000, // APB1: 48MHz
+    .tim_clock_rate = APB1_TIM_CLOCK_RATE,
 };
 
 void HAL_DAC_MspInit(DAC_HandleTypeDef *hdac) {
@@ -740,7 +758,7 @@ void SystemInit(void) {
         RCC_AHB1ENR_GPIODEN | RCC_AHB1ENR_GPIOEEN | RCC_AHB1ENR_DMA1EN | RCC_AHB1ENR_DMA2EN;
     RCC->APB1ENR |= RCC_APB1ENR_USART2EN | RCC_APB1ENR_UART4EN | RCC_APB1ENR_UART5EN |
         RCC_APB1ENR_UART7EN | RCC_APB1ENR_UART8EN | RCC_APB1ENR_TIM2EN | RCC_APB1ENR_TIM3EN |
-        RCC_APB1ENR_TIM4EN | RCC_APB1ENR_TIM6EN | RCC_APB1ENR_TIM12EN | RCC_APB1ENR_I2C2EN |
+        RCC_APB1ENR_TIM4EN | RCC_APB1ENR_TIM6EN | RCC_APB1ENR_TIM7EN | RCC_APB1ENR_TIM12EN | RCC_APB1ENR_I2C2EN |
         RCC_APB1ENR_DACEN;
     RCC->APB2ENR |= RCC_APB2ENR_TIM1EN | RCC_APB2ENR_TIM8EN | RCC_APB2ENR_UART9EN |
         RCC_APB2ENR_UART10EN | RCC_APB2ENR_ADC1EN | RCC_APB2ENR_SPI1EN | RCC_APB2ENR_SYSCFGEN;
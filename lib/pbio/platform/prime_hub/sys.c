@@ -11,23 +11,21 @@
 #include "pbio/main.h"
 
 #include <pbsys/battery.h>
+#include <pbsys/config.h>
 #include <pbsys/status.h>
 #include <pbsys/supervisor.h>
 #include <pbsys/sys.h>
 
 #include "../sys/hmi.h"
 
-// ring buffer size for stdin data - must be power of 2!
-#define STDIN_BUF_SIZE 128
-
 // user program stop function
 static pbsys_stop_callback_t user_stop_func;
 // user program stdin event function
 static pbsys_stdin_event_callback_t user_stdin_event_func;
 
 // stdin ring buffer
-static uint8_t stdin_buf[STDIN_BUF_SIZE];
-static uint8_t stdin_buf_head, stdin_buf_tail;
+static uint8_t stdin_buf[PBSYS_CONFIG_STDIN_BUF_SIZE];
+static uint16_t stdin_buf_head, stdin_buf_tail;
 
 PROCESS(pbsys_process, "System");
 
@@ -55,7 +53,7 @@ pbio_error_t pbsys_stdin_get_char(uint8_t *c) {
     }
 
     *c = stdin_buf[stdin_buf_tail];
-    stdin_buf_tail = (stdin_buf_tail + 1) & (STDIN_BUF_SIZE - 1);
+    stdin_buf_tail = (stdin_buf_tail + 1) & (PBSYS_CONFIG_STDIN_BUF_SIZE - 1);
 
     return PBIO_SUCCESS;
 }
@@ -64,22 +62,30 @@ pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return pbdrv_bluetooth_tx(c);
 }
 
-static void handle_stdin_char(uint8_t c) {
-    uint8_t new_head = (stdin_buf_head + 1) & (STDIN_BUF_SIZE - 1);
+pbio_error_t pbsys_stdout_put_buf(const uint8_t *data, size_t size, size_t *written) {
+    return pbdrv_bluetooth_tx_buf(data, size, written);
+}
 
-    // optional hook function can steal the character
-    if (user_stdin_event_func && user_stdin_event_func(c)) {
-        return;
-    }
+static void handle_stdin_data(const uint8_t *data, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+        uint8_t c = data[i];
 
-    // otherwise write character to ring buffer
+        // optional hook function can steal the character
+        if (user_stdin_event_func && user_stdin_event_func(c)) {
+            continue;
+        }
+
+        // otherwise write character to ring buffer
 
-    if (new_head == stdin_buf_tail) {
-        // overflow. drop the data :-(
-        return;
+        uint16_t new_head = (stdin_buf_head + 1) & (PBSYS_CONFIG_STDIN_BUF_SIZE - 1);
+        if (new_head == stdin_buf_tail) {
+            // overflow. drop the data :-( but keep passing the rest of the
+            // packet to the hook function, which may be looking for CTRL+C
+            continue;
+        }
+        stdin_buf[stdin_buf_head] = c;
+        stdin_buf_head = new_head;
     }
-    stdin_buf[stdin_buf_head] = c;
-    stdin_buf_head = new_head;
 }
 
 PROCESS_THREAD(pbsys_process, ev, data) {
@@ -105,7 +111,7 @@ PROCESS_THREAD(pbsys_process, ev, data) {
             }
         } else if (ev == PBIO_EVENT_UART_RX) {
             pbio_event_uart_rx_data_t *rx = data;
-            handle_stdin_char(rx->byte);
+            handle_stdin_data(rx->data, rx->size);
         } else if (ev == PBIO_EVENT_COM_CMD) {
             pbio_com_cmd_t cmd = (uint32_t)data;
 
@@ -36,6 +36,9 @@
 #define PBDRV_CONFIG_CLOCK                          (1)
 #define PBDRV_CONFIG_CLOCK_STM32                    (1)
 
+#define PBDRV_CONFIG_CONTROL_TIMER                  (1)
+#define PBDRV_CONFIG_CONTROL_TIMER_STM32_TIM        (1)
+
 #define PBDRV_CONFIG_COUNTER                        (1)
 #define PBDRV_CONFIG_COUNTER_NUM_DEV                (4)
 
@@ -68,6 +71,7 @@
 #define PBDRV_CONFIG_UART                           (1)
 #define PBDRV_CONFIG_UART_STM32L4_LL_DMA                (1)
 #define PBDRV_CONFIG_UART_STM32L4_LL_DMA_NUM_UART       (4)
+#define PBDRV_CONFIG_UART_READ_AVAILABLE                (1)
 
 #define PBDRV_CONFIG_HAS_PORT_A (1)
 #define PBDRV_CONFIG_HAS_PORT_B (1)
@@ -8,6 +8,7 @@
 #include "../../drv/adc/adc_stm32_hal.h"
 #include "../../drv/battery/battery_adc.h"
 #include "../../drv/button/button_gpio.h"
+#include "../../drv/control_timer/control_timer_stm32_tim.h"
 #include "../../drv/ioport/ioport_lpf2.h"
 #include "../../drv/led/led_pwm.h"
 #include "../../drv/pwm/pwm_stm32_tim.h"
@@ -62,6 +63,19 @@ const pbdrv_button_gpio_platform_t pbdrv_button_gpio_platform[PBDRV_CONFIG_BUTTO
     },
 };
 
+// Control loop timer
+
+const pbdrv_control_timer_stm32_tim_platform_data_t pbdrv_control_timer_stm32_tim_platform_data = {
+    .TIMx = TIM7,
+    .tim_clock_rate = 10000000, // APB1: 5MHz, doubled for timers
+    .irq = TIM7_IRQn,
+    .irq_priority = 15,
+};
+
+void TIM7_IRQHandler(void) {
+    pbdrv_control_timer_stm32_tim_handle_irq();
+}
+
 // I/O ports
 
 const pbdrv_ioport_lpf2_platform_data_t pbdrv_ioport_lpf2_platform_data = {
@@ -497,7 +511,7 @@ void SystemInit(void) {
         RCC_AHB1ENR_CRCEN;
     RCC->AHB2ENR |= RCC_AHB2ENR_GPIOAEN | RCC_AHB2ENR_GPIOBEN | RCC_AHB2ENR_GPIOCEN |
         RCC_AHB2ENR_GPIODEN | RCC_AHB2ENR_GPIOHEN | RCC_AHB2ENR_ADCEN;
-    RCC->APB1ENR1 |= RCC_APB1ENR1_TIM2EN | RCC_APB1ENR1_TIM6EN | RCC_APB1ENR1_WWDGEN |
+    RCC->APB1ENR1 |= RCC_APB1ENR1_TIM2EN | RCC_APB1ENR1_TIM6EN | RCC_APB1ENR1_TIM7EN | RCC_APB1ENR1_WWDGEN |
         RCC_APB1ENR1_USART2EN | RCC_APB1ENR1_USART3EN | RCC_APB1ENR1_I2C1EN | RCC_APB1ENR1_PWREN;
     RCC->APB1ENR2 |= RCC_APB1ENR2_LPUART1EN;
     RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN | RCC_APB2ENR_TIM1EN | RCC_APB2ENR_SPI1EN |
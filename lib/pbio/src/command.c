@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <contiki.h>
+
+#include <pbio/command.h>
+#include <pbio/error.h>
+
+// Each side reads the index of the other side with acquire semantics, so that
+// it sees the data that was written before the index was released.
+#define LOAD_INDEX(index) __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define STORE_INDEX(index, value) __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+
+/**
+ * Discards all pending commands and errors, and resets the latency.
+ * Discarded commands fail with ::PBIO_ERROR_CANCELED.
+ *
+ * This changes both sides of the queue, so it may only be called while the
+ * consumer is not running, such as during setup.
+ * @param [in]  queue   The queue.
+ */
+void pbio_command_queue_reset(pbio_command_queue_t *queue) {
+    for (uint8_t tail = queue->tail; tail != queue->head; tail++) {
+        queue->results[tail % PBIO_COMMAND_QUEUE_SIZE] = PBIO_ERROR_CANCELED;
+    }
+    STORE_INDEX(queue->tail, queue->head);
+    queue->latency = 0;
+    queue->num_errors_taken = queue->num_errors;
+}
+
+/**
+ * Tells whether there are no commands pending. Commands are pending until
+ * they have been applied, not just until the consumer starts to apply them.
+ * @param [in]  queue   The queue.
+ * @return              True if all commands have been applied.
+ */
+bool pbio_command_queue_is_empty(const pbio_command_queue_t *queue) {
+    return LOAD_INDEX(queue->head) == LOAD_INDEX(queue->tail);
+}
+
+/**
+ * Gets the index at which the next command will be stored. Owners can use
+ * this to keep more data for a command than fits in its arguments, in a
+ * buffer of ::PBIO_COMMAND_QUEUE_SIZE entries of their own. The entry is not
+ * in use by the consumer until the command is sent.
+ * @param [in]  queue   The queue.
+ * @param [out] index   Index of the next command.
+ * @return              ::PBIO_SUCCESS or ::PBIO_ERROR_AGAIN if the queue is full.
+ */
+pbio_error_t pbio_command_queue_get_next_index(const pbio_command_queue_t *queue, uint8_t *index) {
+    uint8_t head = queue->head;
+    if ((uint8_t)(head - LOAD_INDEX(queue->tail)) >= PBIO_COMMAND_QUEUE_SIZE) {
+        return PBIO_ERROR_AGAIN;
+    }
+    *index = head % PBIO_COMMAND_QUEUE_SIZE;
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Sends a command to the consumer. Use pbio_command_queue_get_result() or
+ * pbio_command_queue_take_error() to find out if it could be applied.
+ * @param [in]  queue   The queue.
+ * @param [in]  type    Command type.
+ * @param [in]  arg0    First command argument.
+ * @param [in]  arg1    Second command argument.
+ * @param [in]  arg2    Third command argument.
+ * @return              ::PBIO_SUCCESS if the command was queued or
+ *                      ::PBIO_ERROR_AGAIN if the queue is full.
+ */
+pbio_error_t pbio_command_queue_send(pbio_command_queue_t *queue, uint8_t type, int32_t arg0, int32_t arg1, int32_t arg2) {
+
+    uint8_t head = queue->head;
+    if ((uint8_t)(head - LOAD_INDEX(queue->tail)) >= PBIO_COMMAND_QUEUE_SIZE) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    pbio_command_t *cmd = &queue->commands[head % PBIO_COMMAND_QUEUE_SIZE];
+    cmd->type = type;
+    cmd->args[0] = arg0;
+    cmd->args[1] = arg1;
+    cmd->args[2] = arg2;
+    cmd->time = clock_usecs();
+
+    // Hand the command over to the consumer
+    STORE_INDEX(queue->head, head + 1);
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gets the result of the command that was sent last.
+ * @param [in]  queue   The queue.
+ * @return              ::PBIO_ERROR_AGAIN if the command has not been applied
+ *                      yet, or else the result of applying it.
+ */
+pbio_error_t pbio_command_queue_get_result(const pbio_command_queue_t *queue) {
+    uint8_t head = queue->head;
+    if (LOAD_INDEX(queue->tail) != head) {
+        return PBIO_ERROR_AGAIN;
+    }
+    return queue->results[(uint8_t)(head - 1) % PBIO_COMMAND_QUEUE_SIZE];
+}
+
+/**
+ * Gets the error of the last command that failed since the previous call.
+ * This does not wait for pending commands, so their errors are reported by a
+ * later call.
+ * @param [in]  queue   The queue.
+ * @return              ::PBIO_SUCCESS if no command failed since the previous
+ *                      call, or else the error of the last one that did.
+ */
+pbio_error_t pbio_command_queue_take_error(pbio_command_queue_t *queue) {
+    uint8_t num_errors = LOAD_INDEX(queue->num_errors);
+    if (num_errors == queue->num_errors_taken) {
+        return PBIO_SUCCESS;
+    }
+    queue->num_errors_taken = num_errors;
+    return queue->error;
+}
+
+/**
+ * Gets the oldest pending command without removing it from the queue.
+ * @param [in]  queue   The queue.
+ * @return              The command or NULL if there are none.
+ */
+const pbio_command_t *pbio_command_queue_peek(pbio_command_queue_t *queue) {
+    uint8_t tail = queue->tail;
+    if (tail == LOAD_INDEX(queue->head)) {
+        return NULL;
+    }
+    return &queue->commands[tail % PBIO_COMMAND_QUEUE_SIZE];
+}
+
+/**
+ * Removes the oldest pending command from the queue, once it has been applied.
+ * @param [in]  queue   The queue.
+ * @param [in]  err     Result of applying the command.
+ */
+void pbio_command_queue_pop(pbio_command_queue_t *queue, pbio_error_t err) {
+    uint8_t tail = queue->tail;
+
+    // Keep track of the slowest command
+    int32_t latency = clock_usecs() - queue->commands[tail % PBIO_COMMAND_QUEUE_SIZE].time;
+    if (latency > queue->latency) {
+        queue->latency = latency;
+    }
+
+    // Keep the error until the producer takes it
+    if (err != PBIO_SUCCESS) {
+        queue->error = err;
+        STORE_INDEX(queue->num_errors, queue->num_errors + 1);
+    }
+
+    // Give the slot back to the producer, along with the result
+    queue->results[tail % PBIO_COMMAND_QUEUE_SIZE] = err;
+    STORE_INDEX(queue->tail, tail + 1);
+}
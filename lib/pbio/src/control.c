@@ -6,9 +6,74 @@
 #include <pbio/config.h>
 #include <pbio/control.h>
 #include <pbio/math.h>
+#include <pbio/motor_process.h>
 #include <pbio/trajectory.h>
 #include <pbio/integrator.h>
 
+static void pbio_control_update_loop_stats(pbio_control_t *ctl, int32_t time_now) {
+    pbio_control_loop_stats_t *stats = &ctl->loop_stats;
+
+    if (stats->running) {
+        int32_t loop_time = ctl->settings.loop_time * US_PER_MS;
+        int32_t interval = time_now - stats->time_prev;
+
+        stats->jitter = max(stats->jitter, abs(interval - loop_time));
+        if (interval >= loop_time * 2) {
+            stats->overruns++;
+        }
+    }
+
+    stats->time_prev = time_now;
+    stats->running = true;
+    stats->updates++;
+}
+
+// Discards the queued angle maneuvers. This happens whenever another maneuver
+// is started directly.
+static void control_flush_segments(pbio_control_t *ctl) {
+    ctl->segments.started = ctl->segments.added;
+}
+
+// Starts the next queued angle maneuver once the ongoing one is far enough
+// along. If the next target lies further in the same direction, the new
+// maneuver starts where the ongoing one would begin to slow down, so the
+// motor keeps going. Otherwise, the motor comes to a stop at the target first.
+static void control_start_next_segment(pbio_control_t *ctl, int32_t time_ref) {
+    pbio_control_segments_t *segments = &ctl->segments;
+    pbio_trajectory_t *trajectory = &ctl->trajectory;
+
+    if (ctl->type != PBIO_CONTROL_ANGLE || segments->started == segments->added) {
+        return;
+    }
+
+    pbio_control_segment_t *next = &segments->buf[segments->started % PBIO_CONTROL_NUM_SEGMENTS];
+
+    int32_t direction = pbio_math_sign(trajectory->th3 - trajectory->th0);
+    bool blend = direction != 0 && direction == pbio_math_sign(next->target_count - trajectory->th3);
+    if (time_ref - (blend ? trajectory->t2 - trajectory->tj / 2 : trajectory->t3) < 0) {
+        return;
+    }
+
+    // Start from the current reference, so position and speed are continuous
+    int32_t count_ref, count_ref_ext, rate_ref, acceleration_ref;
+    pbio_trajectory_get_reference(trajectory, time_ref, &count_ref, &count_ref_ext, &rate_ref, &acceleration_ref);
+
+    segments->started++;
+    ctl->on_target = false;
+    ctl->on_target_func = pbio_control_on_target_angle;
+
+    pbio_error_t err = pbio_trajectory_make_angle_based(trajectory, time_ref, count_ref, next->target_count, rate_ref, next->target_rate, ctl->settings.max_rate, next->acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
+    if (err != PBIO_SUCCESS) {
+        // The arguments were checked when the maneuver was queued, so this
+        // is unlikely. Just stop here and skip the rest.
+        pbio_trajectory_make_stationary(trajectory, time_ref, count_ref);
+        ctl->after_stop = PBIO_ACTUATION_HOLD;
+        control_flush_segments(ctl);
+        return;
+    }
+    ctl->after_stop = next->after_stop;
+}
+
 void pbio_control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t rate_now, int32_t count_est, int32_t rate_est, pbio_actuation_t *actuation, int32_t *control, int32_t *rate_ref, int32_t *acceleration_ref) {
 
     // Declare current time, positions, rates, and their reference value and error
@@ -17,10 +82,16 @@ void pbio_control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_no
     int32_t rate_err, rate_feedback;
     int32_t torque, torque_due_to_proportional, torque_due_to_integral, torque_due_to_derivative;
 
+    // Keep track of how regularly the updates come in
+    pbio_control_update_loop_stats(ctl, time_now);
+
     // Get the time at which we want to evaluate the reference position/velocities.
     // This compensates for any time we may have spent pausing when the motor was stalled.
     time_ref = pbio_control_get_ref_time(ctl, time_now);
 
+    // Move on to the next queued maneuver if it is time
+    control_start_next_segment(ctl, time_ref);
+
     // Get reference signals
     pbio_trajectory_get_reference(&ctl->trajectory, time_ref, &count_ref, &count_ref_ext, rate_ref, acceleration_ref);
 
@@ -57,7 +128,7 @@ void pbio_control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_no
     // We want to stop building up further errors if we are at the proportional torque limit. So, we pause the trajectory
     // if we get at this limit. We wait a little longer though, to make sure it does not fall back to below the limit
     // within one sample, which we can predict using the current rate times the loop time, with a factor two tolerance.
-    int32_t max_windup_torque = ctl->settings.max_torque + (ctl->settings.pid_kp * abs(rate_now) * PBIO_CONTROL_LOOP_TIME_MS * 2) / MS_PER_SECOND;
+    int32_t max_windup_torque = ctl->settings.max_torque + (ctl->settings.pid_kp * abs(rate_now) / MS_PER_SECOND) * ctl->settings.loop_time * 2;
 
     // Position anti-windup: pause trajectory or integration if falling behind despite using maximum torque
 
@@ -129,16 +200,23 @@ void pbio_control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_no
 
 
 void pbio_control_stop(pbio_control_t *ctl) {
+    pbio_motor_process_defer_begin();
     ctl->type = PBIO_CONTROL_NONE;
     ctl->on_target = true;
     ctl->on_target_func = pbio_control_on_target_always;
     ctl->stalled = false;
+    ctl->loop_stats.running = false;
+    control_flush_segments(ctl);
+    pbio_motor_process_defer_end();
 }
 
-pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop) {
+static pbio_error_t control_start_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop) {
 
     pbio_error_t err;
 
+    // This replaces any queued maneuvers
+    control_flush_segments(ctl);
+
     // Set new maneuver action and stop type, and state
     ctl->after_stop = after_stop;
     ctl->on_target = false;
@@ -147,7 +225,7 @@ pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_
     // Compute the trajectory
     if (ctl->type == PBIO_CONTROL_NONE) {
         // If no control is ongoing, start from physical state
-        err = pbio_trajectory_make_angle_based(&ctl->trajectory, time_now, count_now, target_count, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_angle_based(&ctl->trajectory, time_now, count_now, target_count, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -156,7 +234,7 @@ pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_
         int32_t time_ref = pbio_control_get_ref_time(ctl, time_now);
 
         // Make the new trajectory and try to patch to existing one
-        err = pbio_trajectory_make_angle_based_patched(&ctl->trajectory, time_ref, target_count, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_angle_based_patched(&ctl->trajectory, time_ref, target_count, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -175,6 +253,13 @@ pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop) {
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = control_start_angle_control(ctl, time_now, count_now, target_count, rate_now, target_rate, acceleration, after_stop);
+    pbio_motor_process_defer_end();
+    return err;
+}
+
 pbio_error_t pbio_control_start_relative_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t relative_target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop) {
 
     // Get the count from which the relative count is to be counted
@@ -204,6 +289,11 @@ pbio_error_t pbio_control_start_relative_angle_control(pbio_control_t *ctl, int3
 
 pbio_error_t pbio_control_start_hold_control(pbio_control_t *ctl, int32_t time_now, int32_t target_count) {
 
+    pbio_motor_process_defer_begin();
+
+    // This replaces any queued maneuvers
+    control_flush_segments(ctl);
+
     // Set new maneuver action and stop type, and state
     ctl->after_stop = PBIO_ACTUATION_HOLD;
     ctl->on_target = false;
@@ -221,14 +311,47 @@ pbio_error_t pbio_control_start_hold_control(pbio_control_t *ctl, int32_t time_n
         ctl->type = PBIO_CONTROL_ANGLE;
     }
 
+    pbio_motor_process_defer_end();
+
     return PBIO_SUCCESS;
 }
 
 
-pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_now, int32_t duration, int32_t count_now, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_control_on_target_t stop_func, pbio_actuation_t after_stop) {
+// Starts an angle maneuver along a trajectory that was made by the caller,
+// such as one that is synchronized with other motors.
+void pbio_control_start_trajectory(pbio_control_t *ctl, const pbio_trajectory_t *trajectory, pbio_actuation_t after_stop) {
+
+    pbio_motor_process_defer_begin();
+
+    // This replaces any queued maneuvers
+    control_flush_segments(ctl);
+
+    // Set new maneuver action and stop type, and state
+    ctl->after_stop = after_stop;
+    ctl->on_target = false;
+    ctl->on_target_func = pbio_control_on_target_angle;
+    ctl->trajectory = *trajectory;
+
+    // Reset PID control if needed
+    if (ctl->type != PBIO_CONTROL_ANGLE) {
+        // New angle maneuver, so reset the rate integrator
+        int32_t integrator_max = pbio_control_settings_get_max_integrator(&ctl->settings);
+        pbio_count_integrator_reset(&ctl->count_integrator, ctl->trajectory.t0, ctl->trajectory.th0, ctl->trajectory.th0, integrator_max);
+
+        // Set the new control state
+        ctl->type = PBIO_CONTROL_ANGLE;
+    }
+
+    pbio_motor_process_defer_end();
+}
+
+static pbio_error_t control_start_timed_control(pbio_control_t *ctl, int32_t time_now, int32_t duration, int32_t count_now, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_control_on_target_t stop_func, pbio_actuation_t after_stop) {
 
     pbio_error_t err;
 
+    // This replaces any queued maneuvers
+    control_flush_segments(ctl);
+
     // Set new maneuver action and stop type, and state
     ctl->after_stop = after_stop;
     ctl->on_target = false;
@@ -237,7 +360,7 @@ pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_
     // Compute the trajectory
     if (ctl->type == PBIO_CONTROL_TIMED) {
         // If timed control is already ongoing make the new trajectory and try to patch to existing one
-        err = pbio_trajectory_make_time_based_patched(&ctl->trajectory, time_now, duration, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_time_based_patched(&ctl->trajectory, time_now, duration, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -248,13 +371,13 @@ pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_
         pbio_trajectory_get_reference(&ctl->trajectory, time_ref, &count_start, &unused, &rate_start, &unused);
 
         // Now start the timed trajectory from there
-        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_start, 0, rate_start, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_start, 0, rate_start, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
     } else {
         // If no control is ongoing, start from physical state
-        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_now, 0, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_now, 0, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -272,6 +395,79 @@ pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_now, int32_t duration, int32_t count_now, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_control_on_target_t stop_func, pbio_actuation_t after_stop) {
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = control_start_timed_control(ctl, time_now, duration, count_now, rate_now, target_rate, acceleration, stop_func, after_stop);
+    pbio_motor_process_defer_end();
+    return err;
+}
+
+/**
+ * Reserves room for an angle maneuver that will be queued by a command that
+ * is about to be sent to the control loop.
+ * @param [in]  ctl     The controller.
+ * @return              ::PBIO_SUCCESS or ::PBIO_ERROR_AGAIN if the queue is full.
+ */
+pbio_error_t pbio_control_reserve_segment(pbio_control_t *ctl) {
+    if ((uint8_t)(ctl->segments.reserved - ctl->segments.started) >= PBIO_CONTROL_NUM_SEGMENTS) {
+        return PBIO_ERROR_AGAIN;
+    }
+    ctl->segments.reserved++;
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gives back a reservation if the command could not be sent after all.
+ * @param [in]  ctl     The controller.
+ */
+void pbio_control_cancel_segment(pbio_control_t *ctl) {
+    ctl->segments.reserved--;
+}
+
+/**
+ * Discards all reservations and queued maneuvers. This may only be done
+ * while the control loop is not running, along with discarding the commands
+ * that hold the reservations.
+ * @param [in]  ctl     The controller.
+ */
+void pbio_control_reset_segments(pbio_control_t *ctl) {
+    ctl->segments.reserved = 0;
+    ctl->segments.added = 0;
+    ctl->segments.started = 0;
+}
+
+/**
+ * Uses up a reservation without queuing a maneuver, such as when the command
+ * that holds it fails.
+ * @param [in]  ctl     The controller.
+ */
+void pbio_control_drop_segment(pbio_control_t *ctl) {
+    ctl->segments.added++;
+    ctl->segments.started++;
+}
+
+/**
+ * Queues an angle maneuver to start when the ongoing angle maneuver reaches
+ * its target. If there is none, it starts right away. This uses up the
+ * reservation made with pbio_control_reserve_segment().
+ */
+pbio_error_t pbio_control_queue_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop) {
+    pbio_control_segments_t *segments = &ctl->segments;
+
+    if (ctl->type == PBIO_CONTROL_ANGLE && !ctl->on_target) {
+        pbio_control_segment_t *segment = &segments->buf[segments->added % PBIO_CONTROL_NUM_SEGMENTS];
+        segment->target_count = target_count;
+        segment->target_rate = target_rate;
+        segment->acceleration = acceleration;
+        segment->after_stop = after_stop;
+        segments->added++;
+        return PBIO_SUCCESS;
+    }
+
+    pbio_control_drop_segment(ctl);
+    return pbio_control_start_angle_control(ctl, time_now, count_now, target_count, rate_now, target_rate, acceleration, after_stop);
+}
+
 static bool _pbio_control_on_target_always(pbio_trajectory_t *trajectory, pbio_control_settings_t *settings, int32_t time, int32_t count, int32_t rate, bool stalled) {
     return true;
 }
@@ -337,10 +533,27 @@ pbio_error_t pbio_control_settings_set_limits(pbio_control_settings_t *s, int32_
     if (speed < 1 || acceleration < 1 || duty < 1 || torque < 1 || duty > 100) {
         return PBIO_ERROR_INVALID_ARG;
     }
+    pbio_motor_process_defer_begin();
     s->max_rate = pbio_control_user_to_counts(s, speed);
     s->abs_acceleration = pbio_control_user_to_counts(s, acceleration);
     s->max_duty = duty * 100;
     s->max_torque = torque;
+    pbio_motor_process_defer_end();
+    return PBIO_SUCCESS;
+}
+
+void pbio_control_settings_get_jerk(pbio_control_settings_t *s, int32_t *jerk) {
+    *jerk = pbio_control_counts_to_user(s, s->abs_jerk);
+}
+
+pbio_error_t pbio_control_settings_set_jerk(pbio_control_settings_t *s, int32_t jerk) {
+    // Zero jerk selects trapezoidal speed profiles
+    if (jerk < 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    pbio_motor_process_defer_begin();
+    s->abs_jerk = pbio_control_user_to_counts(s, jerk);
+    pbio_motor_process_defer_end();
     return PBIO_SUCCESS;
 }
 
@@ -357,11 +570,13 @@ pbio_error_t pbio_control_settings_set_pid(pbio_control_settings_t *s, int32_t p
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    pbio_motor_process_defer_begin();
     s->pid_kp = pid_kp;
     s->pid_ki = pid_ki;
     s->pid_kd = pid_kd;
     s->integral_range = pbio_control_user_to_counts(s, integral_range);
     s->integral_rate = pbio_control_user_to_counts(s, integral_rate);
+    pbio_motor_process_defer_end();
     return PBIO_SUCCESS;
 }
 
@@ -375,8 +590,10 @@ pbio_error_t pbio_control_settings_set_target_tolerances(pbio_control_settings_t
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    pbio_motor_process_defer_begin();
     s->count_tolerance = pbio_control_user_to_counts(s, position);
     s->rate_tolerance = pbio_control_user_to_counts(s, speed);
+    pbio_motor_process_defer_end();
     return PBIO_SUCCESS;
 }
 
@@ -390,11 +607,46 @@ pbio_error_t pbio_control_settings_set_stall_tolerances(pbio_control_settings_t
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    pbio_motor_process_defer_begin();
     s->stall_rate_limit = pbio_control_user_to_counts(s, speed);
     s->stall_time = time * US_PER_MS;
+    pbio_motor_process_defer_end();
+    return PBIO_SUCCESS;
+}
+
+int32_t pbio_control_settings_get_loop_time(pbio_control_settings_t *s) {
+    return s->loop_time;
+}
+
+pbio_error_t pbio_control_settings_set_loop_time(pbio_control_settings_t *s, int32_t time) {
+    if (time < PBIO_CONTROL_LOOP_TIME_MIN_MS || time > PBIO_CONTROL_LOOP_TIME_MAX_MS) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    pbio_motor_process_defer_begin();
+    s->loop_time = time;
+    pbio_motor_process_defer_end();
     return PBIO_SUCCESS;
 }
 
+void pbio_control_get_loop_stats(pbio_control_t *ctl, uint32_t *updates, uint32_t *overruns, int32_t *jitter, int32_t *latency) {
+    *updates = ctl->loop_stats.updates;
+    *overruns = ctl->loop_stats.overruns;
+    *jitter = ctl->loop_stats.jitter;
+    *latency = ctl->commands ? ctl->commands->latency : 0;
+}
+
+void pbio_control_reset_loop_stats(pbio_control_t *ctl) {
+    pbio_motor_process_defer_begin();
+    ctl->loop_stats.updates = 0;
+    ctl->loop_stats.overruns = 0;
+    ctl->loop_stats.jitter = 0;
+    if (ctl->commands) {
+        ctl->commands->latency = 0;
+    }
+    pbio_motor_process_defer_end();
+}
+
 int32_t pbio_control_settings_get_max_integrator(pbio_control_settings_t *s) {
     // If ki is very small, then the integrator is "unlimited"
     if (s->pid_ki <= 10) {
@@ -420,5 +672,13 @@ bool pbio_control_is_stalled(pbio_control_t *ctl) {
 }
 
 bool pbio_control_is_done(pbio_control_t *ctl) {
+    // Commands that have not been applied yet will start a new maneuver
+    if (ctl->commands && !pbio_command_queue_is_empty(ctl->commands)) {
+        return false;
+    }
+    // So will queued maneuvers
+    if (ctl->segments.reserved != ctl->segments.started) {
+        return false;
+    }
     return ctl->type == PBIO_CONTROL_NONE || ctl->on_target;
 }
@@ -8,10 +8,14 @@
 #include <pbio/error.h>
 #include <pbio/drivebase.h>
 #include <pbio/math.h>
+#include <pbio/motor_process.h>
 #include <pbio/servo.h>
 
 #if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
 
+static void drivebase_apply_commands(pbio_drivebase_t *db);
+static pbio_error_t drivebase_straight(pbio_drivebase_t *db, int32_t distance, int32_t drive_speed, int32_t drive_acceleration);
+
 static pbio_error_t drivebase_adopt_settings(pbio_control_settings_t *s_distance, pbio_control_settings_t *s_heading, pbio_control_settings_t *s_left, pbio_control_settings_t *s_right) {
 
     // All rate/count acceleration limits add up, because distance state is two motors counts added
@@ -25,6 +29,7 @@ static pbio_error_t drivebase_adopt_settings(pbio_control_settings_t *s_distance
     // As acceleration, we take double the single motor amount, because drivebases are
     // usually expected to respond quickly to speed setpoint changes
     s_distance->abs_acceleration = (s_left->abs_acceleration + s_right->abs_acceleration) * 2;
+    s_distance->abs_jerk = (s_left->abs_jerk + s_right->abs_jerk) * 2;
 
     // Use the average PID of both motors
     s_distance->pid_kp = (s_left->pid_kp + s_right->pid_kp) / 2;
@@ -35,6 +40,9 @@ static pbio_error_t drivebase_adopt_settings(pbio_control_settings_t *s_distance
     s_distance->max_torque = min(s_left->max_torque, s_right->max_torque);
     s_distance->stall_time = min(s_left->stall_time, s_right->stall_time);
 
+    // Update as often as the fastest motor
+    s_distance->loop_time = min(s_left->loop_time, s_right->loop_time);
+
     // Copy rate estimator usage, required to be the same on both motors
     if (s_left->use_estimated_rate != s_right->use_estimated_rate || s_left->use_estimated_count != s_right->use_estimated_count) {
         return PBIO_ERROR_INVALID_ARG;
@@ -50,6 +58,28 @@ static pbio_error_t drivebase_adopt_settings(pbio_control_settings_t *s_distance
     return PBIO_SUCCESS;
 }
 
+// Follows changes to the loop time of the servos made after setup. A loop time
+// that is set on the drivebase controllers directly is kept until then.
+static void drivebase_follow_servo_loop_time(pbio_drivebase_t *db) {
+    int32_t loop_time = min(db->left->control.settings.loop_time, db->right->control.settings.loop_time);
+    if (loop_time != db->servo_loop_time) {
+        db->control_distance.settings.loop_time = loop_time;
+        db->control_heading.settings.loop_time = loop_time;
+        db->servo_loop_time = loop_time;
+    }
+}
+
+#if PBIO_CONFIG_IMU
+// Get the heading measured by the IMU, as the count difference of the motors
+// that would give the same heading
+static void drivebase_get_imu_state(pbio_drivebase_t *db, int32_t *dif, int32_t *dif_rate) {
+    int32_t heading, heading_rate;
+    pbio_imu_get_heading(db->imu, &heading, &heading_rate);
+    *dif = pbio_control_user_to_counts(&db->control_heading.settings, heading) / 1000;
+    *dif_rate = pbio_control_user_to_counts(&db->control_heading.settings, heading_rate) / 1000;
+}
+#endif // PBIO_CONFIG_IMU
+
 // Get the physical state of a drivebase
 static pbio_error_t drivebase_get_state(pbio_drivebase_t *db,
     int32_t *time_now,
@@ -92,6 +122,12 @@ static pbio_error_t drivebase_get_state(pbio_drivebase_t *db,
     *dif = count_left - count_right;
     *dif_rate = rate_left - rate_right;
 
+    #if PBIO_CONFIG_IMU
+    if (db->imu) {
+        drivebase_get_imu_state(db, dif, dif_rate);
+    }
+    #endif
+
     return PBIO_SUCCESS;
 }
 
@@ -112,6 +148,13 @@ static void drivebase_get_estimated_state(pbio_drivebase_t *db,
     *sum_rate = rate_left + rate_right;
     *dif = count_left - count_right;
     *dif_rate = rate_left - rate_right;
+
+    #if PBIO_CONFIG_IMU
+    // The IMU heading needs no estimate
+    if (db->imu) {
+        drivebase_get_imu_state(db, dif, dif_rate);
+    }
+    #endif
 }
 
 // Actuate a drivebase
@@ -144,7 +187,7 @@ static pbio_error_t pbio_drivebase_actuate(pbio_drivebase_t *db, pbio_actuation_
             pbio_drivebase_claim_servos(db, false);
             break;
         case PBIO_ACTUATION_HOLD:
-            err = pbio_drivebase_straight(db, 0, db->control_distance.settings.max_rate, db->control_distance.settings.max_rate);
+            err = drivebase_straight(db, 0, db->control_distance.settings.max_rate, db->control_distance.settings.max_rate);
             break;
         case PBIO_ACTUATION_DUTY:
             err = pbio_dcmotor_set_duty_cycle_sys(db->left->dcmotor, sum_control + dif_control);
@@ -163,9 +206,14 @@ static pbio_error_t pbio_drivebase_actuate(pbio_drivebase_t *db, pbio_actuation_
     return err;
 }
 
-pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio_servo_t *right, fix16_t wheel_diameter, fix16_t axle_track) {
+static pbio_error_t drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio_servo_t *right, fix16_t wheel_diameter, fix16_t axle_track) {
     pbio_error_t err;
 
+    // Servos in use by a motor group cannot be used by the drivebase
+    if (left->grouped || right->grouped) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
     // Stop any existing drivebase motion
     err = pbio_drivebase_stop_force(db);
     if (!(err == PBIO_SUCCESS || err == PBIO_ERROR_NO_DEV)) {
@@ -173,11 +221,11 @@ pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio
     }
 
     // Reset both motors to a passive state
-    err = pbio_servo_stop(left, PBIO_ACTUATION_COAST);
+    err = pbio_servo_stop_force(left);
     if (err != PBIO_SUCCESS) {
         return err;
     }
-    err = pbio_servo_stop(right, PBIO_ACTUATION_COAST);
+    err = pbio_servo_stop_force(right);
     if (err != PBIO_SUCCESS) {
         return err;
     }
@@ -192,16 +240,26 @@ pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    // Commands sent to both controllers go through the same queue
+    db->control_distance.commands = &db->commands;
+    db->control_heading.commands = &db->commands;
+
     // Individual servos
     db->left = left;
     db->right = right;
     pbio_drivebase_claim_servos(db, false);
 
+    #if PBIO_CONFIG_IMU
+    // Measure the heading with the motors until told otherwise
+    db->imu = NULL;
+    #endif
+
     // Adopt settings as the average or sum of both servos, except scaling
     err = drivebase_adopt_settings(&db->control_distance.settings, &db->control_heading.settings, &db->left->control.settings, &db->right->control.settings);
     if (err != PBIO_SUCCESS) {
         return err;
     }
+    db->servo_loop_time = db->control_distance.settings.loop_time;
 
     // Count difference between the motors for every 1 degree drivebase rotation
     db->control_heading.settings.counts_per_unit =
@@ -232,6 +290,13 @@ pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio_servo_t *right, fix16_t wheel_diameter, fix16_t axle_track) {
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = drivebase_setup(db, left, right, wheel_diameter, axle_track);
+    pbio_motor_process_defer_end();
+    return err;
+}
+
 // Claim servos so that they cannot be used independently
 void pbio_drivebase_claim_servos(pbio_drivebase_t *db, bool claim) {
     // Stop control
@@ -242,7 +307,7 @@ void pbio_drivebase_claim_servos(pbio_drivebase_t *db, bool claim) {
     db->right->claimed = claim;
 }
 
-pbio_error_t pbio_drivebase_stop(pbio_drivebase_t *db, pbio_actuation_t after_stop) {
+static pbio_error_t drivebase_stop(pbio_drivebase_t *db, pbio_actuation_t after_stop) {
 
     pbio_error_t err;
 
@@ -272,6 +337,7 @@ pbio_error_t pbio_drivebase_stop_force(pbio_drivebase_t *db) {
     // Stop control so polling will stop
     pbio_control_stop(&db->control_distance);
     pbio_control_stop(&db->control_heading);
+    pbio_command_queue_reset(&db->commands);
 
     pbio_error_t err;
 
@@ -291,6 +357,15 @@ pbio_error_t pbio_drivebase_stop_force(pbio_drivebase_t *db) {
 
 pbio_error_t pbio_drivebase_update(pbio_drivebase_t *db) {
 
+    // Start the maneuvers that were requested since the previous update
+    drivebase_apply_commands(db);
+
+    // Not set up yet
+    if (db->left == NULL || db->right == NULL) {
+        return PBIO_SUCCESS;
+    }
+    drivebase_follow_servo_loop_time(db);
+
     // If passive, log and exit
     if (db->control_heading.type == PBIO_CONTROL_NONE || db->control_distance.type == PBIO_CONTROL_NONE) {
         return PBIO_SUCCESS;
@@ -346,7 +421,7 @@ pbio_error_t pbio_drivebase_update(pbio_drivebase_t *db) {
     return pbio_dcmotor_set_duty_cycle_sys(db->right->dcmotor, duty_right);
 }
 
-pbio_error_t pbio_drivebase_straight(pbio_drivebase_t *db, int32_t distance, int32_t drive_speed, int32_t drive_acceleration) {
+static pbio_error_t drivebase_straight(pbio_drivebase_t *db, int32_t distance, int32_t drive_speed, int32_t drive_acceleration) {
 
     pbio_error_t err;
 
@@ -383,7 +458,7 @@ pbio_error_t pbio_drivebase_straight(pbio_drivebase_t *db, int32_t distance, int
     return PBIO_SUCCESS;
 }
 
-pbio_error_t pbio_drivebase_turn(pbio_drivebase_t *db, int32_t angle, int32_t turn_rate, int32_t turn_acceleration) {
+static pbio_error_t drivebase_turn(pbio_drivebase_t *db, int32_t angle, int32_t turn_rate, int32_t turn_acceleration) {
 
     pbio_error_t err;
 
@@ -420,7 +495,7 @@ pbio_error_t pbio_drivebase_turn(pbio_drivebase_t *db, int32_t angle, int32_t tu
 
     return PBIO_SUCCESS;
 }
-pbio_error_t pbio_drivebase_drive(pbio_drivebase_t *db, int32_t speed, int32_t turn_rate) {
+static pbio_error_t drivebase_drive(pbio_drivebase_t *db, int32_t speed, int32_t turn_rate) {
 
     pbio_error_t err;
 
@@ -475,7 +550,10 @@ pbio_error_t pbio_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, i
 
 pbio_error_t pbio_drivebase_reset_state(pbio_drivebase_t *db) {
     int32_t time_now, sum_rate, dif_rate;
-    return drivebase_get_state(db, &time_now, &db->sum_offset, &sum_rate, &db->dif_offset, &dif_rate);
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = drivebase_get_state(db, &time_now, &db->sum_offset, &sum_rate, &db->dif_offset, &dif_rate);
+    pbio_motor_process_defer_end();
+    return err;
 }
 
 pbio_error_t pbio_drivebase_get_drive_settings(pbio_drivebase_t *db, int32_t *drive_speed, int32_t *drive_acceleration, int32_t *turn_rate, int32_t *turn_acceleration) {
@@ -504,4 +582,127 @@ pbio_error_t pbio_drivebase_set_drive_settings(pbio_drivebase_t *db, int32_t dri
     return PBIO_SUCCESS;
 }
 
+#if PBIO_CONFIG_IMU
+
+static pbio_error_t drivebase_set_imu(pbio_drivebase_t *db, pbio_imu_t *imu) {
+    pbio_error_t err;
+
+    // Ongoing maneuvers were planned with the other heading
+    err = drivebase_stop(db, PBIO_ACTUATION_COAST);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    int32_t time_now, sum, sum_rate, dif, dif_rate;
+    err = drivebase_get_state(db, &time_now, &sum, &sum_rate, &dif, &dif_rate);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    int32_t angle = dif - db->dif_offset;
+
+    db->imu = imu;
+
+    // Keep the angle as it was
+    err = drivebase_get_state(db, &time_now, &sum, &sum_rate, &dif, &dif_rate);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    db->dif_offset = dif - angle;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Selects the heading feedback of the drivebase. The drivebase stops, and its
+ * angle continues from where it was.
+ * @param [in]  db      The drivebase.
+ * @param [in]  imu     IMU that measures the heading, or NULL to measure it
+ *                      with the motors.
+ * @return              Error code.
+ */
+pbio_error_t pbio_drivebase_set_imu(pbio_drivebase_t *db, pbio_imu_t *imu) {
+    if (!db->left || !db->right) {
+        return PBIO_ERROR_NO_DEV;
+    }
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = drivebase_set_imu(db, imu);
+    pbio_motor_process_defer_end();
+    return err;
+}
+
+#endif // PBIO_CONFIG_IMU
+
+/* Commands from user code to the control loop */
+
+typedef enum {
+    DRIVEBASE_COMMAND_STOP,
+    DRIVEBASE_COMMAND_STRAIGHT,
+    DRIVEBASE_COMMAND_TURN,
+    DRIVEBASE_COMMAND_DRIVE,
+} drivebase_command_type_t;
+
+static pbio_error_t drivebase_apply_command(pbio_drivebase_t *db, const pbio_command_t *cmd) {
+    const int32_t *args = cmd->args;
+
+    switch ((drivebase_command_type_t)cmd->type) {
+        case DRIVEBASE_COMMAND_STOP:
+            return drivebase_stop(db, args[0]);
+        case DRIVEBASE_COMMAND_STRAIGHT:
+            return drivebase_straight(db, args[0], args[1], args[2]);
+        case DRIVEBASE_COMMAND_TURN:
+            return drivebase_turn(db, args[0], args[1], args[2]);
+        case DRIVEBASE_COMMAND_DRIVE:
+            return drivebase_drive(db, args[0], args[1]);
+    }
+    return PBIO_ERROR_INVALID_ARG;
+}
+
+// Applies all commands that were sent since the previous update. If one
+// fails, the drivebase stops. The queue keeps the result for the sender.
+static void drivebase_apply_commands(pbio_drivebase_t *db) {
+    const pbio_command_t *cmd;
+    while ((cmd = pbio_command_queue_peek(&db->commands)) != NULL) {
+        pbio_error_t err = drivebase_apply_command(db, cmd);
+        if (err != PBIO_SUCCESS) {
+            drivebase_stop(db, PBIO_ACTUATION_COAST);
+        }
+        pbio_command_queue_pop(&db->commands, err);
+    }
+}
+
+static pbio_error_t drivebase_send_command(pbio_drivebase_t *db, drivebase_command_type_t type, int32_t arg0, int32_t arg1, int32_t arg2) {
+
+    // Commands can only be applied once the drivebase is set up
+    if (!db->left || !db->right) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    return pbio_command_queue_send(&db->commands, type, arg0, arg1, arg2);
+}
+
+/* pbio user functions */
+
+pbio_error_t pbio_drivebase_stop(pbio_drivebase_t *db, pbio_actuation_t after_stop) {
+    return drivebase_send_command(db, DRIVEBASE_COMMAND_STOP, after_stop, 0, 0);
+}
+
+pbio_error_t pbio_drivebase_straight(pbio_drivebase_t *db, int32_t distance, int32_t drive_speed, int32_t drive_acceleration) {
+    // Check arguments now, since errors of the command are only known later
+    if (drive_speed == 0 && distance != 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    return drivebase_send_command(db, DRIVEBASE_COMMAND_STRAIGHT, distance, drive_speed, drive_acceleration);
+}
+
+pbio_error_t pbio_drivebase_turn(pbio_drivebase_t *db, int32_t angle, int32_t turn_rate, int32_t turn_acceleration) {
+    if (turn_rate == 0 && angle != 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    return drivebase_send_command(db, DRIVEBASE_COMMAND_TURN, angle, turn_rate, turn_acceleration);
+}
+
+pbio_error_t pbio_drivebase_drive(pbio_drivebase_t *db, int32_t speed, int32_t turn_rate) {
+    return drivebase_send_command(db, DRIVEBASE_COMMAND_DRIVE, speed, turn_rate, 0);
+}
+
 #endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <pbio/config.h>
+
+#if PBIO_CONFIG_IMU
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbio/imu.h>
+
+#define DEG_TO_RAD (0.017453293f)
+
+// Standard gravity (m/s^2)
+#define GRAVITY (9.80665f)
+
+// Proportional and integral gain of the attitude correction (1/s and 1/s^2)
+#define MAHONY_KP (1.0f)
+#define MAHONY_KI (0.02f)
+
+// Gravity is only used to correct the attitude if the acceleration is within
+// this fraction of it, since anything else means that the hub is moving
+#define ACCEL_TOLERANCE (0.2f)
+
+// The hub is at rest if the gyro stays within this distance (deg/s) of the
+// first reading of the window, and the acceleration is close to gravity
+#define REST_GYRO_TOLERANCE (1.5f)
+#define REST_ACCEL_TOLERANCE (0.05f)
+
+// Largest gyro bias (deg/s). Steady turns faster than this are not mistaken
+// for rest, even though they look the same to the gyro. The gyro zero rate
+// level is typically within 1 deg/s.
+#define REST_BIAS_MAX (2.0f)
+
+// The gyro bias is the mean reading over this much time at rest (s)
+#define REST_TIME (0.5f)
+
+static pbio_imu_t imu;
+
+pbio_error_t pbio_imu_get_imu(pbio_imu_t **_imu) {
+    *_imu = &imu;
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Resets the attitude, the heading and the gyro bias.
+ *
+ * This may not be called while the IMU is being updated.
+ * @param [in]  imu         The IMU.
+ * @param [in]  sample_time Time between two samples (s).
+ */
+void pbio_imu_reset(pbio_imu_t *imu, float sample_time) {
+    imu->sample_time = sample_time;
+    imu->q[0] = 1.0f;
+    imu->q[1] = imu->q[2] = imu->q[3] = 0.0f;
+    imu->aligned = false;
+    for (uint8_t i = 0; i < 3; i++) {
+        imu->integral[i] = 0.0f;
+        imu->bias[i] = 0.0f;
+    }
+    imu->bias_valid = false;
+    imu->rest_count = 0;
+    imu->heading_rate = 0;
+    pbio_imu_reset_heading(imu, 0);
+}
+
+// Gets the up direction of the world frame in the hub frame
+static void imu_get_up(pbio_imu_t *imu, float *up) {
+    float *q = imu->q;
+    up[0] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    up[1] = 2.0f * (q[2] * q[3] + q[0] * q[1]);
+    up[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+}
+
+// Sets the attitude such that the given direction in the hub frame is up
+static void imu_align(pbio_imu_t *imu, const float *a) {
+    float *q = imu->q;
+
+    // Shortest rotation from a to the world Z axis, or half a turn about the
+    // X axis if the hub is upside down
+    if (a[2] < -0.999f) {
+        q[0] = 0.0f;
+        q[1] = 1.0f;
+        q[2] = 0.0f;
+        q[3] = 0.0f;
+        return;
+    }
+    q[0] = 1.0f + a[2];
+    q[1] = a[1];
+    q[2] = -a[0];
+    q[3] = 0.0f;
+
+    float norm = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+    q[0] /= norm;
+    q[1] /= norm;
+    q[2] /= norm;
+}
+
+// Takes the mean gyro reading as the bias when the hub has been at rest for
+// long enough
+static void imu_update_bias(pbio_imu_t *imu, const float *gyro, float accel_norm, bool calibrate) {
+
+    bool at_rest = calibrate && accel_norm > GRAVITY * (1.0f - REST_ACCEL_TOLERANCE) && accel_norm < GRAVITY * (1.0f + REST_ACCEL_TOLERANCE);
+    for (uint8_t i = 0; i < 3 && at_rest; i++) {
+        at_rest = fabsf(gyro[i]) < REST_BIAS_MAX && (imu->rest_count == 0 || fabsf(gyro[i] - imu->rest_ref[i]) < REST_GYRO_TOLERANCE);
+    }
+
+    // Start a new window on the first sample or whenever the hub moves
+    if (!at_rest || imu->rest_count == 0) {
+        for (uint8_t i = 0; i < 3; i++) {
+            imu->rest_ref[i] = gyro[i];
+            imu->rest_sum[i] = 0.0f;
+        }
+        imu->rest_count = 0;
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+        imu->rest_sum[i] += gyro[i];
+    }
+    imu->rest_count++;
+
+    if (imu->rest_count * imu->sample_time >= REST_TIME) {
+        for (uint8_t i = 0; i < 3; i++) {
+            imu->bias[i] = imu->rest_sum[i] / imu->rest_count;
+        }
+        imu->bias_valid = true;
+        imu->rest_count = 0;
+    }
+}
+
+/**
+ * Updates the attitude and the heading with the next sample.
+ * @param [in]  imu     The IMU.
+ * @param [in]  gyro    Angular velocity in the hub frame (deg/s).
+ * @param [in]  accel   Acceleration in the hub frame (m/s^2).
+ * @param [in]  calibrate Whether the gyro bias may be calibrated if the hub is
+ *                      at rest. This should be false while the motors may be
+ *                      driving the hub, since a slow steady turn looks the
+ *                      same as a bias.
+ */
+void pbio_imu_update(pbio_imu_t *imu, const float *gyro, const float *accel, bool calibrate) {
+    float dt = imu->sample_time;
+    float *q = imu->q;
+
+    float accel_norm = sqrtf(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+
+    imu_update_bias(imu, gyro, accel_norm, calibrate);
+
+    // Angular velocity without the bias (rad/s)
+    float w[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        w[i] = (gyro[i] - imu->bias[i]) * DEG_TO_RAD;
+    }
+
+    // The heading changes with the rotation about the vertical
+    float up[3];
+    imu_get_up(imu, up);
+    float heading_rate = -(w[0] * up[0] + w[1] * up[1] + w[2] * up[2]) / DEG_TO_RAD * 1000.0f;
+
+    // Correct the attitude towards the measured gravity, unless the hub is
+    // accelerating
+    if (accel_norm > GRAVITY * (1.0f - ACCEL_TOLERANCE) && accel_norm < GRAVITY * (1.0f + ACCEL_TOLERANCE)) {
+        float a[3] = {
+            accel[0] / accel_norm,
+            accel[1] / accel_norm,
+            accel[2] / accel_norm,
+        };
+
+        // Start from the measured gravity, so the attitude need not converge
+        if (!imu->aligned) {
+            imu_align(imu, a);
+            imu->aligned = true;
+            imu_get_up(imu, up);
+        }
+
+        float e[3] = {
+            a[1] * up[2] - a[2] * up[1],
+            a[2] * up[0] - a[0] * up[2],
+            a[0] * up[1] - a[1] * up[0],
+        };
+        for (uint8_t i = 0; i < 3; i++) {
+            imu->integral[i] += MAHONY_KI * e[i] * dt;
+            w[i] += MAHONY_KP * e[i] + imu->integral[i];
+        }
+    }
+
+    // Integrate the attitude
+    float dq[4] = {
+        0.5f * (-q[1] * w[0] - q[2] * w[1] - q[3] * w[2]),
+        0.5f * (q[0] * w[0] + q[2] * w[2] - q[3] * w[1]),
+        0.5f * (q[0] * w[1] - q[1] * w[2] + q[3] * w[0]),
+        0.5f * (q[0] * w[2] + q[1] * w[1] - q[2] * w[0]),
+    };
+    float norm = 0.0f;
+    for (uint8_t i = 0; i < 4; i++) {
+        q[i] += dq[i] * dt;
+        norm += q[i] * q[i];
+    }
+    norm = sqrtf(norm);
+    for (uint8_t i = 0; i < 4; i++) {
+        q[i] /= norm;
+    }
+
+    // Integrate the heading. Only whole millidegrees go into the published
+    // heading, so that it does not lose precision as it grows.
+    imu->heading_frac += heading_rate * dt;
+    int32_t whole = (int32_t)imu->heading_frac;
+    imu->heading_frac -= whole;
+    imu->heading += whole;
+    imu->heading_rate = (int32_t)heading_rate;
+}
+
+/**
+ * Gets the heading. This takes constant time, so it may be called from the
+ * control loop.
+ * @param [in]  imu             The IMU.
+ * @param [out] heading         Heading, increasing clockwise as seen from above (mdeg).
+ * @param [out] heading_rate    Heading rate (mdeg/s).
+ */
+void pbio_imu_get_heading(pbio_imu_t *imu, int32_t *heading, int32_t *heading_rate) {
+    *heading = imu->heading;
+    *heading_rate = imu->heading_rate;
+}
+
+/**
+ * Sets the heading to the given value.
+ * @param [in]  imu         The IMU.
+ * @param [in]  heading     New heading (mdeg).
+ */
+void pbio_imu_reset_heading(pbio_imu_t *imu, int32_t heading) {
+    imu->heading_frac = 0.0f;
+    imu->heading = heading;
+}
+
+/**
+ * Gets the attitude.
+ * @param [in]  imu     The IMU.
+ * @param [out] q       Quaternion w, x, y, z that rotates the hub frame to the world frame.
+ */
+void pbio_imu_get_quaternion(pbio_imu_t *imu, float *q) {
+    for (uint8_t i = 0; i < 4; i++) {
+        q[i] = imu->q[i];
+    }
+}
+
+/**
+ * Tells whether the gyro bias has been calibrated, which happens whenever
+ * the hub is at rest for a moment.
+ * @param [in]  imu     The IMU.
+ * @return              True if the bias was calibrated since the reset.
+ */
+bool pbio_imu_is_calibrated(pbio_imu_t *imu) {
+    return imu->bias_valid;
+}
+
+#endif // PBIO_CONFIG_IMU
@@ -72,6 +72,47 @@ pbio_error_t pbio_iodev_get_data(pbio_iodev_t *iodev, uint8_t **data) {
     return PBIO_SUCCESS;
 }
 
+/**
+ * Gets the sequence number and arrival time of the raw data of an I/O device.
+ * @param [in]  iodev       The I/O device
+ * @param [out] seq         The number of data updates so far
+ * @param [out] time        The time of the last data update in microseconds
+ * @return                  ::PBIO_SUCCESS on success
+ *                          ::PBIO_ERROR_NO_DEV if the port does not have a device attached
+ */
+pbio_error_t pbio_iodev_get_data_seq(pbio_iodev_t *iodev, uint32_t *seq, uint32_t *time) {
+    if (iodev->info->type_id == PBIO_IODEV_TYPE_ID_NONE) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    *seq = iodev->data_seq;
+    *time = iodev->data_time;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Checks if an I/O device has received data that is newer than a given sample.
+ * Call this repeatedly to wait for new data.
+ * @param [in]  iodev       The I/O device
+ * @param [in]  seq         Sequence number of the sample, from ::pbio_iodev_get_data_seq()
+ * @return                  ::PBIO_SUCCESS if there is newer data
+ *                          ::PBIO_ERROR_AGAIN if there is no newer data yet
+ *                          ::PBIO_ERROR_NO_DEV if the port does not have a device attached
+ */
+pbio_error_t pbio_iodev_wait_newer_data(pbio_iodev_t *iodev, uint32_t seq) {
+    if (iodev->info->type_id == PBIO_IODEV_TYPE_ID_NONE) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    // Compare the difference, so this keeps working when the count wraps
+    if ((int32_t)(iodev->data_seq - seq) <= 0) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    return PBIO_SUCCESS;
+}
+
 /**
  * Sets the mode of an I/O device.
  * @param [in]  iodev       The I/O device
@@ -108,6 +149,106 @@ void pbio_iodev_set_mode_cancel(pbio_iodev_t *iodev) {
     iodev->ops->set_mode_cancel(iodev);
 }
 
+/**
+ * Makes an I/O device send the data of several modes at the same time.
+ * @param [in]  iodev       The I/O device
+ * @param [in]  modes       The modes, in the order that their data will be in
+ * @param [in]  num_modes   The number of modes
+ * @return                  ::PBIO_SUCCESS on success
+ *                          ::PBIO_ERROR_INVALID_ARG if the modes can't be combined
+ *                          ::PBIO_ERROR_NOT_SUPPORTED if the device does not support mode combinations
+ *
+ * All values of each mode are included. The combination ends when a single
+ * mode is set with ::pbio_iodev_set_mode_begin().
+ */
+pbio_error_t pbio_iodev_set_mode_combo_begin(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes) {
+    if (!iodev->ops->set_mode_combo_begin) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    if (num_modes == 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    uint8_t num_values = 0;
+    uint8_t size = 0;
+    for (uint8_t i = 0; i < num_modes; i++) {
+        // The device tells which modes can be combined
+        if (modes[i] >= iodev->info->num_modes || !(iodev->info->mode_combos & (1 << modes[i]))) {
+            return PBIO_ERROR_INVALID_ARG;
+        }
+        for (uint8_t j = 0; j < i; j++) {
+            if (modes[i] == modes[j]) {
+                return PBIO_ERROR_INVALID_ARG;
+            }
+        }
+        const pbio_iodev_mode_t *mode = &iodev->info->mode_info[modes[i]];
+        num_values += mode->num_values;
+        size += mode->num_values * pbio_iodev_size_of(mode->data_type);
+    }
+
+    // All values have to fit in one message
+    if (num_values > PBIO_IODEV_MAX_COMBO_VALUES || size > PBIO_IODEV_MAX_DATA_SIZE) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    return iodev->ops->set_mode_combo_begin(iodev, modes, num_modes);
+}
+
+pbio_error_t pbio_iodev_set_mode_combo_end(pbio_iodev_t *iodev) {
+    if (!iodev->ops->set_mode_combo_end) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    return iodev->ops->set_mode_combo_end(iodev);
+}
+
+void pbio_iodev_set_mode_combo_cancel(pbio_iodev_t *iodev) {
+    if (!iodev->ops->set_mode_combo_cancel) {
+        return;
+    }
+
+    iodev->ops->set_mode_combo_cancel(iodev);
+}
+
+/**
+ * Gets the raw data of one mode of the mode combination of an I/O device.
+ * @param [in]  iodev       The I/O device
+ * @param [in]  mode        The mode
+ * @param [out] data        Pointer to hold array of data values
+ * @return                  ::PBIO_SUCCESS on success
+ *                          ::PBIO_ERROR_NO_DEV if the port does not have a device attached
+ *                          ::PBIO_ERROR_INVALID_OP if the mode is not in the current combination
+ *                          or the device has not accepted the combination yet
+ *
+ * The data is valid once ::pbio_iodev_set_mode_combo_end() has returned
+ * ::PBIO_SUCCESS. Its binary format and size are the same as when the mode is
+ * used by itself.
+ */
+pbio_error_t pbio_iodev_get_combo_data(pbio_iodev_t *iodev, uint8_t mode, uint8_t **data) {
+    if (iodev->info->type_id == PBIO_IODEV_TYPE_ID_NONE) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    // Until the device accepts the combo, the data is that of a single mode
+    if (!iodev->combo_ack) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    // The data of each mode follows the data of the modes before it
+    uint8_t offset = 0;
+    for (uint8_t i = 0; i < iodev->num_combo_modes; i++) {
+        const pbio_iodev_mode_t *info = &iodev->info->mode_info[iodev->combo_modes[i]];
+        if (iodev->combo_modes[i] == mode) {
+            *data = iodev->bin_data + offset;
+            return PBIO_SUCCESS;
+        }
+        offset += info->num_values * pbio_iodev_size_of(info->data_type);
+    }
+
+    return PBIO_ERROR_INVALID_OP;
+}
+
 /**
  * Sets the raw data of an I/O device.
  * @param [in]  iodev       The I/O device
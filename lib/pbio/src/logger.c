@@ -10,36 +10,69 @@
 #include <pbio/config.h>
 #include <pbio/error.h>
 #include <pbio/logger.h>
+#include <pbio/motor_process.h>
+#include <pbio/util.h>
+
+static void logger_start(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div, bool ring) {
+    // The control loop must not log while the buffer is being replaced
+    pbio_motor_process_defer_begin();
 
-/**
- * Starts logging in the background.
- * @param [in]  log     pointer to log
- * @param [in]  buf     array large enough to hold @p len rows of data
- * @param [in]  len     maximum number of rows that can be logged
- * @param [in]  div     clock divider to slow down sampling period
- */
-void pbio_logger_start(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div) {
     // (re-)initialize logger status for this servo
     log->sampled = 0;
+    log->drained = 0;
     log->skipped = 0;
+    log->ring = ring;
     log->data = buf;
     log->len = len;
     log->sample_div = div;
     log->start = clock_usecs();
     log->active = true;
+
+    pbio_motor_process_defer_end();
+}
+
+/**
+ * Starts logging in the background.
+ * @param [in]  log     pointer to log
+ * @param [in]  buf     array large enough to hold @p len rows of data
+ * @param [in]  len     maximum number of rows that can be logged
+ * @param [in]  div     clock divider to slow down sampling period
+ */
+void pbio_logger_start(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div) {
+    logger_start(log, buf, len, div, false);
+}
+
+/**
+ * Starts logging in the background without end. Once the buffer is full,
+ * each new row replaces the oldest one, so the latest @p len rows are kept.
+ * @param [in]  log     pointer to log
+ * @param [in]  buf     array large enough to hold @p len rows of data
+ * @param [in]  len     number of rows that are kept
+ * @param [in]  div     clock divider to slow down sampling period
+ */
+void pbio_logger_start_ring(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div) {
+    logger_start(log, buf, len, div, true);
 }
 
 int32_t pbio_logger_rows(pbio_log_t *log) {
-    return log->sampled;
+    uint32_t sampled = log->sampled;
+    return sampled < log->len ? sampled : log->len;
 }
 
 int32_t pbio_logger_cols(pbio_log_t *log) {
     return log->num_values;
 }
 
+/**
+ * Stops logging. Once this returns, the control loop no longer writes to the
+ * buffer, so it may be freed.
+ * @param [in]  log     pointer to log
+ */
 void pbio_logger_stop(pbio_log_t *log) {
     // Release the logger for re-use
+    pbio_motor_process_defer_begin();
     log->active = false;
+    pbio_motor_process_defer_end();
 }
 
 pbio_error_t pbio_logger_update(pbio_log_t *log, int32_t *buf) {
@@ -56,26 +89,30 @@ pbio_error_t pbio_logger_update(pbio_log_t *log, int32_t *buf) {
     log->skipped = 0;
 
     // Raise error if log is full, which should not happen
-    if (log->sampled > log->len) {
+    if (log->sampled > log->len && !log->ring) {
         log->active = false;
         return PBIO_ERROR_FAILED;
     }
 
     // Stop successfully when done
-    if (log->sampled == log->len) {
+    if ((log->sampled == log->len && !log->ring) || log->len == 0) {
         log->active = false;
         return PBIO_SUCCESS;
     }
 
+    // Get the row to write, replacing the oldest one in ring mode
+    int32_t *row = &log->data[(log->sampled % log->len) * log->num_values];
+
     // Write time of logging
-    log->data[log->sampled * log->num_values] = (clock_usecs() - log->start) / 1000;
+    row[0] = (clock_usecs() - log->start) / 1000;
 
     // Write the data
     for (uint8_t i = NUM_DEFAULT_LOG_VALUES; i < log->num_values; i++) {
-        log->data[log->sampled * log->num_values + i] = buf[i - NUM_DEFAULT_LOG_VALUES];
+        row[i] = buf[i - NUM_DEFAULT_LOG_VALUES];
     }
 
-    // Increment sample counter
+    // Increment sample counter, which hands the row over to the reader
+    PBIO_COMPILER_BARRIER();
     log->sampled++;
 
     return PBIO_SUCCESS;
@@ -89,17 +126,115 @@ pbio_error_t pbio_logger_read(pbio_log_t *log, int32_t sindex, int32_t *buf) {
     }
 
     // Get index or latest sample if requested index is -1
-    uint32_t index = sindex < 0 ? log->sampled - 1 : (uint32_t)sindex;
+    uint32_t sampled = log->sampled;
+    uint32_t rows = pbio_logger_rows(log);
+    uint32_t index = sindex < 0 ? rows - 1 : (uint32_t)sindex;
 
     // Ensure index is within bounds
-    if (index >= log->sampled) {
+    if (index >= rows) {
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    // Count from the oldest row that is kept
+    index = (sampled - rows + index) % log->len;
+
     // Read the data
+    PBIO_COMPILER_BARRIER();
     for (uint8_t i = 0; i < log->num_values; i++) {
         buf[i] = log->data[index * log->num_values + i];
     }
 
     return PBIO_SUCCESS;
 }
+
+/**
+ * Reads the oldest row that has not been read by this function yet. This
+ * lets the caller stream the log while it is running.
+ *
+ * In ring mode, rows that are replaced before they are read are skipped.
+ * @param [in]  log     pointer to log
+ * @param [out] buf     array large enough to hold one row
+ * @param [out] lost    number of rows skipped since the previous call
+ * @return              ::PBIO_SUCCESS or ::PBIO_ERROR_AGAIN if there is no
+ *                      new row yet.
+ */
+pbio_error_t pbio_logger_drain(pbio_log_t *log, int32_t *buf, uint32_t *lost) {
+    *lost = 0;
+
+    for (;;) {
+        // Skip rows that have been replaced already
+        uint32_t sampled = log->sampled;
+        if (sampled - log->drained > log->len) {
+            *lost += sampled - log->drained - log->len;
+            log->drained = sampled - log->len;
+        }
+
+        if (log->drained == sampled) {
+            return PBIO_ERROR_AGAIN;
+        }
+
+        // Read the data
+        PBIO_COMPILER_BARRIER();
+        const int32_t *row = &log->data[(log->drained % log->len) * log->num_values];
+        for (uint8_t i = 0; i < log->num_values; i++) {
+            buf[i] = row[i];
+        }
+        PBIO_COMPILER_BARRIER();
+
+        // If the control loop interrupted us to replace this row, try again
+        if (log->sampled - log->drained > log->len) {
+            continue;
+        }
+
+        log->drained++;
+        return PBIO_SUCCESS;
+    }
+}
+
+// Appends value to frame as a base-128 varint and returns the new size
+static uint8_t encode_varint(uint8_t *frame, uint8_t size, uint32_t value) {
+    while (value >= 0x80) {
+        frame[size++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    frame[size++] = value;
+    return size;
+}
+
+/**
+ * Encodes a row as a compact binary frame, for streaming the log to a host.
+ *
+ * The frame is ::PBIO_LOGGER_FRAME_START, the size of the payload, the
+ * payload, and the XOR of the payload bytes. The payload is the number of
+ * lost rows, followed by the difference of each value with the previous row.
+ * All are varints, and the differences are zigzag encoded, so slowly changing
+ * values take only a byte or two.
+ * @param [in]  row         values to encode
+ * @param [inout] prev      previous row, all zero for the first frame. It is
+ *                          updated to this row.
+ * @param [in]  num_values  number of values in the row
+ * @param [in]  lost        number of rows lost since the previous frame
+ * @param [out] frame       buffer of at least ::PBIO_LOGGER_FRAME_SIZE_MAX bytes
+ * @return                  size of the frame
+ */
+uint8_t pbio_logger_encode_frame(const int32_t *row, int32_t *prev, uint8_t num_values, uint32_t lost, uint8_t *frame) {
+    uint8_t size = 2;
+
+    size = encode_varint(frame, size, lost);
+    for (uint8_t i = 0; i < num_values; i++) {
+        int32_t delta = (int32_t)((uint32_t)row[i] - (uint32_t)prev[i]);
+        size = encode_varint(frame, size, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        prev[i] = row[i];
+    }
+
+    uint8_t checksum = 0;
+    for (uint8_t i = 2; i < size; i++) {
+        checksum ^= frame[i];
+    }
+
+    frame[0] = PBIO_LOGGER_FRAME_START;
+    frame[1] = size - 2;
+    frame[size++] = checksum;
+
+    return size;
+}
@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <contiki.h>
+
+#include <pbio/motor_group.h>
+#include <pbio/motor_process.h>
+
+#if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
+
+static pbio_error_t motor_group_setup(pbio_motor_group_t *group, pbio_servo_t **servos, uint8_t num_servos) {
+    pbio_error_t err;
+
+    if (num_servos < 1 || num_servos > PBIO_MOTOR_GROUP_NUM_SERVOS_MAX) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    // There is only one group, which stays in use until the motors are reset
+    if (group->num_servos != 0) {
+        return PBIO_ERROR_BUSY;
+    }
+
+    for (uint8_t i = 0; i < num_servos; i++) {
+        // Each servo can be in the group only once
+        for (uint8_t j = 0; j < i; j++) {
+            if (servos[i] == servos[j]) {
+                return PBIO_ERROR_INVALID_ARG;
+            }
+        }
+
+        // Servos in use by a drivebase cannot be in the group
+        if (servos[i]->claimed) {
+            return PBIO_ERROR_INVALID_OP;
+        }
+    }
+
+    pbio_command_queue_reset(&group->commands);
+
+    for (uint8_t i = 0; i < num_servos; i++) {
+        // Reset the servo to a passive state
+        err = pbio_servo_stop_force(servos[i]);
+        if (err != PBIO_SUCCESS) {
+            pbio_motor_group_stop_force(group);
+            return err;
+        }
+
+        // Claim it, so it takes no commands of its own
+        servos[i]->grouped = true;
+        group->servos[i] = servos[i];
+        group->num_servos = i + 1;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pbio_motor_group_setup(pbio_motor_group_t *group, pbio_servo_t **servos, uint8_t num_servos) {
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = motor_group_setup(group, servos, num_servos);
+    pbio_motor_process_defer_end();
+    return err;
+}
+
+bool pbio_motor_group_has_servo(pbio_motor_group_t *group, pbio_servo_t *srv) {
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        if (group->servos[i] == srv) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The group is updated as often as its fastest servo
+int32_t pbio_motor_group_get_loop_time(pbio_motor_group_t *group) {
+    int32_t loop_time = PBIO_CONTROL_LOOP_TIME_MAX_MS;
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        loop_time = min(loop_time, group->servos[i]->control.settings.loop_time);
+    }
+    return loop_time;
+}
+
+void pbio_motor_group_stop_force(pbio_motor_group_t *group) {
+    pbio_command_queue_reset(&group->commands);
+
+    // Stop all servos and release them, so they are updated individually again
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        pbio_servo_stop_force(group->servos[i]);
+        group->servos[i]->grouped = false;
+    }
+    group->num_servos = 0;
+}
+
+bool pbio_motor_group_is_done(pbio_motor_group_t *group) {
+    // Commands that have not been applied yet will start a new maneuver
+    if (!pbio_command_queue_is_empty(&group->commands)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        if (!pbio_control_is_done(&group->servos[i]->control)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Group maneuvers, started by the control loop */
+
+static pbio_error_t group_stop(pbio_motor_group_t *group, pbio_actuation_t after_stop) {
+    pbio_error_t err;
+
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        pbio_servo_t *srv = group->servos[i];
+
+        // Return if this servo is in use by a drive base
+        if (srv->claimed) {
+            return PBIO_ERROR_INVALID_OP;
+        }
+
+        switch (after_stop) {
+            case PBIO_ACTUATION_HOLD: {
+                int32_t count_now;
+                err = pbio_tacho_get_count(srv->tacho, &count_now);
+                if (err != PBIO_SUCCESS) {
+                    return err;
+                }
+                err = pbio_control_start_hold_control(&srv->control, clock_usecs(), count_now);
+                break;
+            }
+            case PBIO_ACTUATION_BRAKE:
+                pbio_control_stop(&srv->control);
+                err = pbio_dcmotor_brake(srv->dcmotor);
+                break;
+            default:
+                pbio_control_stop(&srv->control);
+                err = pbio_dcmotor_coast(srv->dcmotor);
+                break;
+        }
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+    }
+    return PBIO_SUCCESS;
+}
+
+// Moves all servos to their targets. The servo that turns the most, in
+// degrees, goes at the given speed. The others go proportionally slower, so
+// they all start and finish together. If one of them cannot keep up, they
+// all slow down.
+static pbio_error_t group_run_target(pbio_motor_group_t *group, int32_t speed, const int32_t *targets, pbio_actuation_t after_stop) {
+    pbio_error_t err;
+
+    int32_t time_now = clock_usecs();
+    int32_t count_start[PBIO_MOTOR_GROUP_NUM_SERVOS_MAX];
+    int32_t distance[PBIO_MOTOR_GROUP_NUM_SERVOS_MAX];
+    int32_t lead_user_distance = 0;
+    uint8_t lead = 0;
+
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        pbio_servo_t *srv = group->servos[i];
+        pbio_control_t *ctl = &srv->control;
+
+        // Return if this servo is in use by a drive base
+        if (srv->claimed) {
+            return PBIO_ERROR_INVALID_OP;
+        }
+
+        // Start from the physical count, or from the ongoing reference if
+        // there is one, so the reference angle is continuous
+        if (ctl->type == PBIO_CONTROL_NONE) {
+            err = pbio_tacho_get_count(srv->tacho, &count_start[i]);
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+        } else {
+            int32_t unused;
+            pbio_trajectory_get_reference(&ctl->trajectory, pbio_control_get_ref_time(ctl, time_now), &count_start[i], &unused, &unused, &unused);
+        }
+        distance[i] = pbio_control_user_to_counts(&ctl->settings, targets[i]) - count_start[i];
+
+        int32_t user_distance = abs(pbio_control_counts_to_user(&ctl->settings, distance[i]));
+        if (user_distance > lead_user_distance) {
+            lead_user_distance = user_distance;
+            lead = i;
+        }
+    }
+
+    // If nothing has to move, just hold
+    pbio_control_settings_t *lead_settings = &group->servos[lead]->control.settings;
+    if (distance[lead] == 0) {
+        for (uint8_t i = 0; i < group->num_servos; i++) {
+            err = pbio_control_start_hold_control(&group->servos[i]->control, time_now, count_start[i]);
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+        }
+        return PBIO_SUCCESS;
+    }
+
+    // Each servo goes as fast as the leading one, scaled by its distance over
+    // the distance of the leading one. Limit the leading one accordingly.
+    int64_t rate = min(abs(pbio_control_user_to_counts(lead_settings, speed)), lead_settings->max_rate);
+    int64_t acceleration = lead_settings->abs_acceleration;
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        pbio_control_settings_t *settings = &group->servos[i]->control.settings;
+        int64_t ratio_num = abs(distance[lead]);
+        int64_t ratio_den = abs(distance[i]);
+        if (rate * ratio_den > settings->max_rate * ratio_num) {
+            rate = settings->max_rate * ratio_num / ratio_den;
+        }
+        if (acceleration * ratio_den > settings->abs_acceleration * ratio_num) {
+            acceleration = settings->abs_acceleration * ratio_num / ratio_den;
+        }
+    }
+    rate = max(rate, 1);
+    acceleration = max(acceleration, 1);
+
+    // Make the trajectory of the leading servo, starting from standstill
+    pbio_trajectory_t lead_trajectory;
+    err = pbio_trajectory_make_angle_based(&lead_trajectory, time_now, count_start[lead], count_start[lead] + distance[lead], 0, rate, rate, acceleration, acceleration, lead_settings->abs_jerk);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    // Scale it for each servo, on the time axis of its own controller
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        pbio_control_t *ctl = &group->servos[i]->control;
+        int32_t time_start = ctl->type == PBIO_CONTROL_NONE ? time_now : pbio_control_get_ref_time(ctl, time_now);
+
+        pbio_trajectory_t trajectory;
+        pbio_trajectory_make_scaled(&trajectory, &lead_trajectory, time_start, count_start[i], distance[i], distance[lead]);
+        pbio_control_start_trajectory(ctl, &trajectory, after_stop);
+    }
+
+    return PBIO_SUCCESS;
+}
+
+/* Commands from user code to the control loop */
+
+typedef enum {
+    GROUP_COMMAND_STOP,
+    GROUP_COMMAND_RUN_TARGET,
+} group_command_type_t;
+
+static pbio_error_t group_apply_command(pbio_motor_group_t *group, const pbio_command_t *cmd) {
+    const int32_t *args = cmd->args;
+
+    switch ((group_command_type_t)cmd->type) {
+        case GROUP_COMMAND_STOP:
+            return group_stop(group, args[0]);
+        case GROUP_COMMAND_RUN_TARGET:
+            return group_run_target(group, args[0], group->targets[args[2]], args[1]);
+    }
+    return PBIO_ERROR_INVALID_ARG;
+}
+
+// Applies all commands that were sent since the previous update. If one
+// fails, the group stops. The queue keeps the result for the sender.
+static void group_apply_commands(pbio_motor_group_t *group) {
+    const pbio_command_t *cmd;
+    while ((cmd = pbio_command_queue_peek(&group->commands)) != NULL) {
+        pbio_error_t err = group_apply_command(group, cmd);
+        if (err != PBIO_SUCCESS) {
+            group_stop(group, PBIO_ACTUATION_COAST);
+        }
+        pbio_command_queue_pop(&group->commands, err);
+    }
+}
+
+pbio_error_t pbio_motor_group_update(pbio_motor_group_t *group) {
+
+    // Start the maneuvers that were requested since the previous update
+    group_apply_commands(group);
+
+    // Update all servos in the same tick, and reset connected status on failure
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        pbio_servo_t *srv = group->servos[i];
+        if (pbio_servo_is_connected(srv)) {
+            pbio_servo_set_connected(srv, pbio_servo_control_update(srv) == PBIO_SUCCESS);
+        }
+    }
+
+    return PBIO_SUCCESS;
+}
+
+/* pbio user functions */
+
+pbio_error_t pbio_motor_group_stop(pbio_motor_group_t *group, pbio_actuation_t after_stop) {
+    // Commands can only be applied once the group is set up
+    if (group->num_servos == 0) {
+        return PBIO_ERROR_NO_DEV;
+    }
+    return pbio_command_queue_send(&group->commands, GROUP_COMMAND_STOP, after_stop, 0, 0);
+}
+
+pbio_error_t pbio_motor_group_run_target(pbio_motor_group_t *group, int32_t speed, const int32_t *targets, pbio_actuation_t after_stop) {
+    if (group->num_servos == 0) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    // Check arguments now, since errors of the command are only known later
+    if (speed == 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    // The targets don't fit in the command, so keep them alongside it
+    uint8_t index;
+    pbio_error_t err = pbio_command_queue_get_next_index(&group->commands, &index);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    for (uint8_t i = 0; i < group->num_servos; i++) {
+        group->targets[index][i] = targets[i];
+    }
+
+    return pbio_command_queue_send(&group->commands, GROUP_COMMAND_RUN_TARGET, speed, after_stop, index);
+}
+
+#endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
@@ -1,8 +1,14 @@
 // SPDX-License-Identifier: MIT
 // Copyright (c) 2018-2020 The Pybricks Authors
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbdrv/control_timer.h>
+#include <pbio/config.h>
 #include <pbio/control.h>
 #include <pbio/drivebase.h>
+#include <pbio/motor_group.h>
 #include <pbio/motor_process.h>
 #include <pbio/servo.h>
 
@@ -14,12 +20,38 @@ PROCESS(pbio_motor_process, "servo");
 
 static pbio_servo_t servos[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];
 static pbio_drivebase_t drivebase;
+static pbio_motor_group_t motor_group;
+
+// Time of the next update of each servo, of the drivebase, and of the motor
+// group. Each device runs at its own loop time.
+static clock_time_t servo_deadlines[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];
+static clock_time_t drivebase_deadline;
+static clock_time_t motor_group_deadline;
+
+#if PBIO_CONFIG_CONTROL_LOOP_TIMER
+
+// The control loop timer never runs updates while changes to the servo and
+// drivebase state are in progress
+void pbio_motor_process_defer_begin(void) {
+    pbdrv_control_timer_defer_begin();
+}
+
+void pbio_motor_process_defer_end(void) {
+    pbdrv_control_timer_defer_end();
+}
+
+#endif // PBIO_CONFIG_CONTROL_LOOP_TIMER
 
 pbio_error_t pbio_motor_process_get_drivebase(pbio_drivebase_t **db) {
     *db = &drivebase;
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_motor_process_get_motor_group(pbio_motor_group_t **group) {
+    *group = &motor_group;
+    return PBIO_SUCCESS;
+}
+
 pbio_error_t pbio_motor_process_get_servo(pbio_port_t port, pbio_servo_t **srv) {
 
     if (port < PBDRV_CONFIG_FIRST_MOTOR_PORT || port > PBDRV_CONFIG_LAST_MOTOR_PORT) {
@@ -31,10 +63,46 @@ pbio_error_t pbio_motor_process_get_servo(pbio_port_t port, pbio_servo_t **srv)
     return PBIO_SUCCESS;
 }
 
+// Tells whether a motor could be moving the hub
+static bool motor_is_idle(pbio_servo_t *srv) {
+    if (srv->dcmotor && srv->dcmotor->state == PBIO_DCMOTOR_DUTY_PASSIVE) {
+        return false;
+    }
+    return pbio_control_is_done(&srv->control);
+}
+
+/**
+ * Tells whether all motors and the drivebase are done with their commands.
+ *
+ * They may still hold their position, but none of them is driving the hub.
+ * @return                  True if no motor is active, false otherwise.
+ */
+bool pbio_motor_process_is_idle(void) {
+    if (!pbio_control_is_done(&drivebase.control_distance) || !pbio_control_is_done(&drivebase.control_heading)) {
+        return false;
+    }
+    if (!pbio_motor_group_is_done(&motor_group)) {
+        return false;
+    }
+    for (uint8_t i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
+        if (!motor_is_idle(&servos[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void pbio_motor_process_reset(void) {
 
+    pbio_motor_process_defer_begin();
+
     // Force stop the drivebase
     pbio_drivebase_stop_force(&drivebase);
+    drivebase_deadline = clock_time();
+
+    // Force stop the motor group and release its servos
+    pbio_motor_group_stop_force(&motor_group);
+    motor_group_deadline = clock_time();
 
     // Force stop the servos
     for (uint8_t i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
@@ -48,35 +116,104 @@ void pbio_motor_process_reset(void) {
 
         // Run setup and set connected flag on success
         pbio_servo_set_connected(srv, pbio_servo_setup(srv, PBIO_DIRECTION_CLOCKWISE, fix16_one) == PBIO_SUCCESS);
+
+        // Spread the servo updates over successive clock ticks, so they
+        // don't all happen at once with the drivebase update.
+        servo_deadlines[i] = clock_time() + clock_from_msec(i + 1);
     }
+
+    pbio_motor_process_defer_end();
 }
 
-PROCESS_THREAD(pbio_motor_process, ev, data) {
-    static struct etimer timer;
+// Tells whether the given deadline has been reached
+static bool deadline_reached(clock_time_t deadline, clock_time_t now) {
+    return (int32_t)(now - deadline) >= 0;
+}
 
-    PROCESS_BEGIN();
+// Gets the next deadline after an update at the given loop time (ms). The
+// phase is kept, so missed updates are skipped rather than done in a burst.
+static clock_time_t next_deadline(clock_time_t deadline, int32_t loop_time, clock_time_t now) {
+    // Devices that are not set up yet have no loop time
+    if (loop_time < PBIO_CONTROL_LOOP_TIME_MIN_MS) {
+        loop_time = PBIO_CONTROL_LOOP_TIME_MS;
+    }
+    clock_time_t period = clock_from_msec(loop_time);
+    return now + period - (now - deadline) % period;
+}
 
-    pbio_motor_process_reset();
+// Runs all updates that are due and returns the time until the next one
+static clock_time_t pbio_motor_process_update(clock_time_t now) {
 
-    etimer_set(&timer, clock_from_msec(PBIO_CONTROL_LOOP_TIME_MS));
+    // Update drivebase
+    if (deadline_reached(drivebase_deadline, now)) {
+        pbio_drivebase_update(&drivebase);
+        int32_t loop_time = min(drivebase.control_distance.settings.loop_time, drivebase.control_heading.settings.loop_time);
+        drivebase_deadline = next_deadline(drivebase_deadline, loop_time, now);
+    }
+    clock_time_t next = drivebase_deadline;
 
-    for (;;) {
-        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && etimer_expired(&timer));
+    // Update the servos of the motor group together
+    if (deadline_reached(motor_group_deadline, now)) {
+        pbio_motor_group_update(&motor_group);
+        motor_group_deadline = next_deadline(motor_group_deadline, pbio_motor_group_get_loop_time(&motor_group), now);
+    }
+    if ((int32_t)(motor_group_deadline - next) < 0) {
+        next = motor_group_deadline;
+    }
 
-        // Update drivebase
-        pbio_drivebase_update(&drivebase);
+    // Update the other servos
+    for (uint8_t i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
 
-        // Update servos
-        for (uint8_t i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
+        if (pbio_motor_group_has_servo(&motor_group, &servos[i])) {
+            continue;
+        }
 
+        if (deadline_reached(servo_deadlines[i], now)) {
             // Update control and reset connected status on failure
             if (pbio_servo_is_connected(&servos[i])) {
                 pbio_servo_set_connected(&servos[i], pbio_servo_control_update(&servos[i]) == PBIO_SUCCESS);
+            } else {
+                pbio_servo_reject_commands(&servos[i], PBIO_ERROR_NO_DEV);
             }
+            servo_deadlines[i] = next_deadline(servo_deadlines[i], servos[i].control.settings.loop_time, now);
+        }
+
+        if ((int32_t)(servo_deadlines[i] - next) < 0) {
+            next = servo_deadlines[i];
         }
+    }
+
+    return next - now;
+}
+
+#if PBIO_CONFIG_CONTROL_LOOP_TIMER
+// Called from the control loop timer on each clock tick, unless deferred
+static void pbio_motor_process_timer_callback(void) {
+    pbio_motor_process_update(clock_time());
+}
+#endif // PBIO_CONFIG_CONTROL_LOOP_TIMER
+
+PROCESS_THREAD(pbio_motor_process, ev, data) {
+    static struct etimer timer;
+
+    PROCESS_BEGIN();
+
+    pbio_motor_process_reset();
+
+    #if PBIO_CONFIG_CONTROL_LOOP_TIMER
+    // From here on, the control loop runs in the timer interrupt
+    if (pbdrv_control_timer_start(pbio_motor_process_timer_callback) == PBIO_SUCCESS) {
+        PROCESS_EXIT();
+    }
+    #endif
+
+    etimer_set(&timer, pbio_motor_process_update(clock_time()));
+
+    for (;;) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER && etimer_expired(&timer));
 
-        // Reset timer to wait for next update
-        etimer_restart(&timer);
+        // Update whatever is due and wait until the next deadline
+        etimer_set(&timer, pbio_motor_process_update(clock_time()));
     }
 
     PROCESS_END();
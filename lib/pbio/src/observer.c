@@ -5,11 +5,77 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <fixmath.h>
+
+#include <pbio/config.h>
 #include <pbio/control.h>
 #include <pbio/math.h>
 #include <pbio/observer.h>
+#include <pbio/trajectory.h>
+
+#if PBIO_CONFIG_OBSERVER_FIX16
+
+// Largest count error (counts) fed back into the observer. This keeps the
+// error within the fix16 range even if the estimate is far off.
+#define MAX_COUNT_ERR (32767)
+
+void pbio_observer_reset(pbio_observer_t *obs, int32_t time_now, int32_t count_now, int32_t rate_now) {
+    obs->time_prev = time_now;
+    obs->est_count = count_now;
+    obs->est_count_frac = 0;
+    obs->est_rate = fix16_from_int(rate_now);
+}
+
+void pbio_observer_get_estimated_state(pbio_observer_t *obs, int32_t *count, int32_t *rate) {
+    // Round towards zero, like the float model does.
+    *count = obs->est_count + (obs->est_count < 0 && obs->est_count_frac > 0);
+    *rate = obs->est_rate / fix16_one;
+}
+
+static void pbio_observer_step(pbio_observer_t *obs, int32_t count, pbio_actuation_t actuation_type, int32_t control, int32_t battery_voltage) {
+
+    const pbio_observer_settings_t *s = obs->settings;
+
+    // Torques in Nm
+    fix16_t tau_e = (control * battery_voltage) / 10000000 * s->k_0;
+    int32_t count_err = max(-MAX_COUNT_ERR, min(count - obs->est_count, MAX_COUNT_ERR));
+    fix16_t tau_o = fix16_mul(s->obs_gain, fix16_from_int(count_err) - obs->est_count_frac);
+    fix16_t tau_f = obs->est_rate > 0 ? s->f_low: -s->f_low;
+
+    fix16_t delta_count = fix16_mul(s->phi_01, obs->est_rate) + fix16_mul(s->gam_0, tau_e + tau_o);
+    fix16_t next_rate = fix16_mul(s->phi_11, obs->est_rate) + fix16_mul(s->gam_1, tau_e + tau_o - tau_f);
+
+    if ((next_rate < 0) != (next_rate + fix16_mul(s->gam_1, tau_f) < 0)) {
+        next_rate = 0;
+    }
+
+    // Carry whole counts out of the fraction, so the fraction stays between 0 and 1
+    delta_count += obs->est_count_frac;
+    obs->est_count += delta_count >> 16;
+    obs->est_count_frac = delta_count & 0xFFFF;
+    obs->est_rate = next_rate;
+}
+
+int32_t pbio_observer_get_feedforward_torque(pbio_observer_t *obs, int32_t rate_ref, int32_t acceleration_ref) {
+    const pbio_observer_settings_t *s = obs->settings;
+
+    // Torque terms in micronewtons
+    int32_t friction_compensation_torque = s->ff_friction * pbio_math_sign(rate_ref);
+    int32_t back_emf_compensation_torque = pbio_math_mul_i32_fix16(rate_ref, s->ff_rate);
+    int32_t acceleration_torque = pbio_math_mul_i32_fix16(acceleration_ref, s->ff_acceleration);
 
-void pbio_observer_reset(pbio_observer_t *obs, int32_t count_now, int32_t rate_now) {
+    return friction_compensation_torque + back_emf_compensation_torque + acceleration_torque;
+}
+
+int32_t pbio_observer_torque_to_duty(pbio_observer_t *obs, int32_t desired_torque, int32_t battery_voltage) {
+    // Scale micronewtons by battery voltage to duty (0--10000)
+    return pbio_math_mul_i32_fix16(desired_torque, obs->settings->duty_per_torque) / battery_voltage;
+}
+
+#else // PBIO_CONFIG_OBSERVER_FIX16
+
+void pbio_observer_reset(pbio_observer_t *obs, int32_t time_now, int32_t count_now, int32_t rate_now) {
+    obs->time_prev = time_now;
     obs->est_count = count_now;
     obs->est_rate = rate_now;
 }
@@ -19,7 +85,7 @@ void pbio_observer_get_estimated_state(pbio_observer_t *obs, int32_t *count, int
     *rate = (int32_t)obs->est_rate;
 }
 
-void pbio_observer_update(pbio_observer_t *obs, int32_t count, pbio_actuation_t actuation_type, int32_t control, int32_t battery_voltage) {
+static void pbio_observer_step(pbio_observer_t *obs, int32_t count, pbio_actuation_t actuation_type, int32_t control, int32_t battery_voltage) {
 
     if (actuation_type != PBIO_ACTUATION_DUTY) {
         // TODO
@@ -45,16 +111,44 @@ void pbio_observer_update(pbio_observer_t *obs, int32_t count, pbio_actuation_t
 int32_t pbio_observer_get_feedforward_torque(pbio_observer_t *obs, int32_t rate_ref, int32_t acceleration_ref) {
     const pbio_observer_settings_t *s = obs->settings;
 
-    // Torque terms in micronewtons (TODO: Convert to integer math)
-    int32_t friction_compensation_torque = (int32_t)(s->f_low * pbio_math_sign(rate_ref) * 1000000);
-    int32_t back_emf_compensation_torque = (int32_t)(s->k_0 * s->k_2 * rate_ref * 1000000);
-    int32_t acceleration_torque = (int32_t)(s->k_0 * s->k_1 * acceleration_ref * 1000000);
+    // Torque terms in micronewtons. Platforms without FPU should use
+    // PBIO_CONFIG_OBSERVER_FIX16 to do this in integer math.
+    int32_t friction_compensation_torque = s->ff_friction * pbio_math_sign(rate_ref);
+    int32_t back_emf_compensation_torque = (int32_t)(s->ff_rate * rate_ref);
+    int32_t acceleration_torque = (int32_t)(s->ff_acceleration * acceleration_ref);
 
+    return friction_compensation_torque + back_emf_compensation_torque + acceleration_torque;
+}
+
+int32_t pbio_observer_torque_to_duty(pbio_observer_t *obs, int32_t desired_torque, int32_t battery_voltage) {
     // Scale micronewtons by battery voltage to duty (0--10000)
-    return (int32_t)(friction_compensation_torque + back_emf_compensation_torque + acceleration_torque);
+    return (int32_t)(desired_torque * obs->settings->duty_per_torque / battery_voltage);
 }
 
+#endif // PBIO_CONFIG_OBSERVER_FIX16
 
-int32_t pbio_observer_torque_to_duty(pbio_observer_t *obs, int32_t desired_torque, int32_t battery_voltage) {
-    return (int32_t)(desired_torque / obs->settings->k_0 * 10 / battery_voltage);
+// Time step of the observer model, independent of the loop time of the controller
+#define OBSERVER_STEP_TIME (PBIO_CONTROL_LOOP_TIME_MS * US_PER_MS)
+
+// Most model steps taken in one update, enough for the slowest control loop
+#define OBSERVER_MAX_STEPS (PBIO_CONTROL_LOOP_TIME_MAX_MS / PBIO_CONTROL_LOOP_TIME_MS)
+
+void pbio_observer_update(pbio_observer_t *obs, int32_t time_now, int32_t count, pbio_actuation_t actuation_type, int32_t control, int32_t battery_voltage) {
+
+    // The model is discretized at PBIO_CONTROL_LOOP_TIME_MS. Take as many
+    // steps as fit in the time since the last one, rounded to the nearest
+    // step so that timer jitter does not skip or double a step. Control loops
+    // faster than the model just take a step every few updates.
+    int32_t steps = (time_now - obs->time_prev + OBSERVER_STEP_TIME / 2) / OBSERVER_STEP_TIME;
+
+    // If the observer was not updated for a long time, don't catch up.
+    if (steps > OBSERVER_MAX_STEPS) {
+        steps = OBSERVER_MAX_STEPS;
+        obs->time_prev = time_now - steps * OBSERVER_STEP_TIME;
+    }
+
+    for (int32_t i = 0; i < steps; i++) {
+        pbio_observer_step(obs, count, actuation_type, control, battery_voltage);
+    }
+    obs->time_prev += steps * OBSERVER_STEP_TIME;
 }
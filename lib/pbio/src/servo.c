@@ -11,16 +11,25 @@
 #include <pbdrv/motor.h>
 #include <pbdrv/battery.h>
 #include <pbio/math.h>
+#include <pbio/motor_process.h>
 #include <pbio/observer.h>
 #include <pbio/servo.h>
 
 #if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
 
-pbio_error_t pbio_servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix16_t gear_ratio) {
+static void servo_apply_commands(pbio_servo_t *srv);
+static pbio_error_t servo_track_target(pbio_servo_t *srv, int32_t target);
+
+// Servos in use by a drivebase or by a motor group take no commands of their own
+static bool servo_is_claimed(pbio_servo_t *srv) {
+    return srv->claimed || srv->grouped;
+}
+
+static pbio_error_t servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix16_t gear_ratio) {
     pbio_error_t err;
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -36,8 +45,11 @@ pbio_error_t pbio_servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix
         return err;
     }
 
-    // Reset state
+    // Reset state and discard commands meant for the previous setup
     pbio_control_stop(&srv->control);
+    pbio_command_queue_reset(&srv->commands);
+    pbio_control_reset_segments(&srv->control);
+    srv->control.commands = &srv->commands;
 
     // Load default settings for this device type
     pbio_servo_load_settings(&srv->control.settings, &srv->observer.settings, srv->dcmotor->id);
@@ -51,11 +63,18 @@ pbio_error_t pbio_servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix
     if (err != PBIO_SUCCESS) {
         return err;
     }
-    pbio_observer_reset(&srv->observer, count_now, 0);
+    pbio_observer_reset(&srv->observer, clock_usecs(), count_now, 0);
 
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix16_t gear_ratio) {
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = servo_setup(srv, direction, gear_ratio);
+    pbio_motor_process_defer_end();
+    return err;
+}
+
 bool pbio_servo_is_connected(pbio_servo_t *srv) {
     return srv->connected;
 }
@@ -64,17 +83,21 @@ void pbio_servo_set_connected(pbio_servo_t *srv, bool connected) {
     srv->connected = connected;
 }
 
-pbio_error_t pbio_servo_reset_angle(pbio_servo_t *srv, int32_t reset_angle, bool reset_to_abs) {
+static pbio_error_t servo_reset_angle(pbio_servo_t *srv, int32_t reset_angle, bool reset_to_abs) {
 
     pbio_error_t err;
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
+    // The control loop is deferred, so apply the commands that were sent
+    // before the reset right now. That way, they use the old angle.
+    servo_apply_commands(srv);
+
     // Reset the state observer
-    pbio_observer_reset(&srv->observer, reset_angle, 0);
+    pbio_observer_reset(&srv->observer, clock_usecs(), reset_angle, 0);
 
     // If the motor was in a passive mode (coast, brake, user duty),
     // just reset angle and leave motor state unchanged.
@@ -107,7 +130,14 @@ pbio_error_t pbio_servo_reset_angle(pbio_servo_t *srv, int32_t reset_angle, bool
 
     // Set the new target based on the old angle and the old target, after the angle reset
     int32_t new_target = reset_angle + target_old - angle_old;
-    return pbio_servo_track_target(srv, new_target);
+    return servo_track_target(srv, new_target);
+}
+
+pbio_error_t pbio_servo_reset_angle(pbio_servo_t *srv, int32_t reset_angle, bool reset_to_abs) {
+    pbio_motor_process_defer_begin();
+    pbio_error_t err = servo_reset_angle(srv, reset_angle, reset_to_abs);
+    pbio_motor_process_defer_end();
+    return err;
 }
 
 // Get the physical state of a single motor
@@ -154,6 +184,9 @@ pbio_error_t pbio_servo_control_update(pbio_servo_t *srv) {
     int32_t rate_now, rate_est, rate_ref;
     int32_t acceleration_ref;
 
+    // Start the maneuvers that were requested since the previous update
+    servo_apply_commands(srv);
+
     // Read the physical state
     pbio_error_t err = servo_get_state(srv, &time_now, &count_now, &rate_now);
     if (err != PBIO_SUCCESS) {
@@ -207,17 +240,17 @@ pbio_error_t pbio_servo_control_update(pbio_servo_t *srv) {
     pbio_logger_update(&srv->log, log_data);
 
     // Update the state observer
-    pbio_observer_update(&srv->observer, count_now, actuation, duty_cycle, battery_voltage);
+    pbio_observer_update(&srv->observer, time_now, count_now, actuation, duty_cycle, battery_voltage);
 
     return PBIO_SUCCESS;
 }
 
-/* pbio user functions */
+/* Servo maneuvers, started by the control loop */
 
-pbio_error_t pbio_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps) {
+static pbio_error_t servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps) {
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -228,10 +261,10 @@ pbio_error_t pbio_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps) {
     return pbio_dcmotor_set_duty_cycle_usr(srv->dcmotor, duty_steps);
 }
 
-pbio_error_t pbio_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop) {
+static pbio_error_t servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop) {
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -256,6 +289,8 @@ pbio_error_t pbio_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop) {
 pbio_error_t pbio_servo_stop_force(pbio_servo_t *srv) {
     // Set control status passive so poll won't call it again
     pbio_control_stop(&srv->control);
+    pbio_command_queue_reset(&srv->commands);
+    pbio_control_reset_segments(&srv->control);
 
     // Release claim from drivebases or other classes
     srv->claimed = false;
@@ -267,12 +302,12 @@ pbio_error_t pbio_servo_stop_force(pbio_servo_t *srv) {
     return PBIO_SUCCESS;
 }
 
-pbio_error_t pbio_servo_run(pbio_servo_t *srv, int32_t speed) {
+static pbio_error_t servo_run(pbio_servo_t *srv, int32_t speed) {
 
     pbio_error_t err;
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -300,12 +335,12 @@ pbio_error_t pbio_servo_run(pbio_servo_t *srv, int32_t speed) {
     return pbio_control_start_timed_control(&srv->control, time_now, DURATION_FOREVER, count_now, rate_now, target_rate, srv->control.settings.abs_acceleration, pbio_control_on_target_never, PBIO_ACTUATION_COAST);
 }
 
-pbio_error_t pbio_servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t duration, pbio_actuation_t after_stop) {
+static pbio_error_t servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t duration, pbio_actuation_t after_stop) {
 
     pbio_error_t err;
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -323,12 +358,12 @@ pbio_error_t pbio_servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t durat
     return pbio_control_start_timed_control(&srv->control, time_now, duration * US_PER_MS, count_now, rate_now, target_rate, srv->control.settings.abs_acceleration, pbio_control_on_target_time, after_stop);
 }
 
-pbio_error_t pbio_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio_actuation_t after_stop) {
+static pbio_error_t servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio_actuation_t after_stop) {
 
     pbio_error_t err;
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -346,12 +381,12 @@ pbio_error_t pbio_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio
     return pbio_control_start_timed_control(&srv->control, time_now, DURATION_FOREVER, count_now, rate_now, target_rate, srv->control.settings.abs_acceleration, pbio_control_on_target_stalled, after_stop);
 }
 
-pbio_error_t pbio_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+static pbio_error_t servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
 
     pbio_error_t err;
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -369,12 +404,12 @@ pbio_error_t pbio_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t tar
     return pbio_control_start_angle_control(&srv->control, time_now, count_now, target_count, rate_now, target_rate, srv->control.settings.abs_acceleration, after_stop);
 }
 
-pbio_error_t pbio_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop) {
+static pbio_error_t servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop) {
 
     pbio_error_t err;
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -393,10 +428,10 @@ pbio_error_t pbio_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angl
     return pbio_control_start_relative_angle_control(&srv->control, time_now, count_now, relative_target_count, rate_now, target_rate, srv->control.settings.abs_acceleration, after_stop);
 }
 
-pbio_error_t pbio_servo_track_target(pbio_servo_t *srv, int32_t target) {
+static pbio_error_t servo_track_target(pbio_servo_t *srv, int32_t target) {
 
     // Return if this servo is already in use by higher level entity
-    if (srv->claimed) {
+    if (servo_is_claimed(srv)) {
         return PBIO_ERROR_INVALID_OP;
     }
 
@@ -407,4 +442,171 @@ pbio_error_t pbio_servo_track_target(pbio_servo_t *srv, int32_t target) {
     return pbio_control_start_hold_control(&srv->control, time_start, target_count);
 }
 
+static pbio_error_t servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+
+    pbio_error_t err;
+
+    // Return if this servo is already in use by higher level entity
+    if (servo_is_claimed(srv)) {
+        pbio_control_drop_segment(&srv->control);
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    // Get targets in unit of counts
+    int32_t target_rate = pbio_control_user_to_counts(&srv->control.settings, speed);
+    int32_t target_count = pbio_control_user_to_counts(&srv->control.settings, target);
+
+    // Get the initial physical motor state, used if the maneuver starts right away
+    int32_t time_now, count_now, rate_now;
+    err = servo_get_state(srv, &time_now, &count_now, &rate_now);
+    if (err != PBIO_SUCCESS) {
+        pbio_control_drop_segment(&srv->control);
+        return err;
+    }
+
+    return pbio_control_queue_angle_control(&srv->control, time_now, count_now, target_count, rate_now, target_rate, srv->control.settings.abs_acceleration, after_stop);
+}
+
+/* Commands from user code to the control loop */
+
+typedef enum {
+    SERVO_COMMAND_SET_DUTY_CYCLE,
+    SERVO_COMMAND_STOP,
+    SERVO_COMMAND_RUN,
+    SERVO_COMMAND_RUN_TIME,
+    SERVO_COMMAND_RUN_UNTIL_STALLED,
+    SERVO_COMMAND_RUN_TARGET,
+    SERVO_COMMAND_RUN_ANGLE,
+    SERVO_COMMAND_TRACK_TARGET,
+    SERVO_COMMAND_QUEUE_TARGET,
+} servo_command_type_t;
+
+static pbio_error_t servo_apply_command(pbio_servo_t *srv, const pbio_command_t *cmd) {
+    const int32_t *args = cmd->args;
+
+    switch ((servo_command_type_t)cmd->type) {
+        case SERVO_COMMAND_SET_DUTY_CYCLE:
+            return servo_set_duty_cycle(srv, args[0]);
+        case SERVO_COMMAND_STOP:
+            return servo_stop(srv, args[0]);
+        case SERVO_COMMAND_RUN:
+            return servo_run(srv, args[0]);
+        case SERVO_COMMAND_RUN_TIME:
+            return servo_run_time(srv, args[0], args[1], args[2]);
+        case SERVO_COMMAND_RUN_UNTIL_STALLED:
+            return servo_run_until_stalled(srv, args[0], args[1]);
+        case SERVO_COMMAND_RUN_TARGET:
+            return servo_run_target(srv, args[0], args[1], args[2]);
+        case SERVO_COMMAND_RUN_ANGLE:
+            return servo_run_angle(srv, args[0], args[1], args[2]);
+        case SERVO_COMMAND_TRACK_TARGET:
+            return servo_track_target(srv, args[0]);
+        case SERVO_COMMAND_QUEUE_TARGET:
+            return servo_queue_target(srv, args[0], args[1], args[2]);
+    }
+    return PBIO_ERROR_INVALID_ARG;
+}
+
+// Applies all commands that were sent since the previous update. If one
+// fails, the servo stops. The queue keeps the result for the sender.
+static void servo_apply_commands(pbio_servo_t *srv) {
+    const pbio_command_t *cmd;
+    while ((cmd = pbio_command_queue_peek(&srv->commands)) != NULL) {
+        pbio_error_t err = servo_apply_command(srv, cmd);
+        if (err != PBIO_SUCCESS && !servo_is_claimed(srv)) {
+            servo_stop(srv, PBIO_ACTUATION_COAST);
+        }
+        pbio_command_queue_pop(&srv->commands, err);
+    }
+}
+
+// Fails all commands that were sent, without applying them. This is for
+// servos that the control loop does not update because they are disconnected.
+void pbio_servo_reject_commands(pbio_servo_t *srv, pbio_error_t err) {
+    const pbio_command_t *cmd;
+    while ((cmd = pbio_command_queue_peek(&srv->commands)) != NULL) {
+        // Release the segment that was reserved for this command
+        if (cmd->type == SERVO_COMMAND_QUEUE_TARGET) {
+            pbio_control_drop_segment(&srv->control);
+        }
+        pbio_command_queue_pop(&srv->commands, err);
+    }
+}
+
+static pbio_error_t servo_send_command(pbio_servo_t *srv, servo_command_type_t type, int32_t arg0, int32_t arg1, int32_t arg2) {
+
+    // Return if this servo is already in use by higher level entity
+    if (servo_is_claimed(srv)) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    // Commands are applied by the control loop, which only updates connected servos
+    if (!srv->connected) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    return pbio_command_queue_send(&srv->commands, type, arg0, arg1, arg2);
+}
+
+/* pbio user functions */
+
+pbio_error_t pbio_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps) {
+    return servo_send_command(srv, SERVO_COMMAND_SET_DUTY_CYCLE, duty_steps, 0, 0);
+}
+
+pbio_error_t pbio_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop) {
+    return servo_send_command(srv, SERVO_COMMAND_STOP, after_stop, 0, 0);
+}
+
+pbio_error_t pbio_servo_run(pbio_servo_t *srv, int32_t speed) {
+    return servo_send_command(srv, SERVO_COMMAND_RUN, speed, 0, 0);
+}
+
+pbio_error_t pbio_servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t duration, pbio_actuation_t after_stop) {
+    // Check arguments now, since errors of the command are only known later
+    if (duration < 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    return servo_send_command(srv, SERVO_COMMAND_RUN_TIME, speed, duration, after_stop);
+}
+
+pbio_error_t pbio_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio_actuation_t after_stop) {
+    return servo_send_command(srv, SERVO_COMMAND_RUN_UNTIL_STALLED, speed, after_stop, 0);
+}
+
+pbio_error_t pbio_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+    if (speed == 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    return servo_send_command(srv, SERVO_COMMAND_RUN_TARGET, speed, target, after_stop);
+}
+
+pbio_error_t pbio_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop) {
+    if (speed == 0 && angle != 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    return servo_send_command(srv, SERVO_COMMAND_RUN_ANGLE, speed, angle, after_stop);
+}
+
+pbio_error_t pbio_servo_track_target(pbio_servo_t *srv, int32_t target) {
+    return servo_send_command(srv, SERVO_COMMAND_TRACK_TARGET, target, 0, 0);
+}
+
+pbio_error_t pbio_servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+    if (speed == 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    // Make sure there is room for the maneuver when the command is applied
+    pbio_error_t err = pbio_control_reserve_segment(&srv->control);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = servo_send_command(srv, SERVO_COMMAND_QUEUE_TARGET, speed, target, after_stop);
+    if (err != PBIO_SUCCESS) {
+        pbio_control_cancel_segment(&srv->control);
+    }
+    return err;
+}
+
 #endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
@@ -69,6 +69,7 @@ void pbio_trajectory_make_stationary(pbio_trajectory_t *ref, int32_t t0, int32_t
     ref->w1 = 0;
     ref->a0 = 0;
     ref->a2 = 0;
+    ref->tj = 0;
 
     // This is a finite maneuver
     ref->forever = false;
@@ -82,7 +83,7 @@ static int64_t x_time2(int32_t b, int32_t t) {
     return x_time(x_time(b, t), t) / (2 * US_PER_MS);
 }
 
-pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
+static pbio_error_t make_time_based_trapezoid(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
 
     // Work with time intervals instead of absolute time. Read 'm' as '-'.
     int32_t t3mt0;
@@ -193,10 +194,12 @@ pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0,
         reverse_trajectory(ref);
     }
 
+    ref->tj = 0;
+
     return PBIO_SUCCESS;
 }
 
-pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
+static pbio_error_t make_angle_based_trapezoid(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
 
     // Return error for zero speed
     if (wt == 0) {
@@ -294,16 +297,237 @@ pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0
 
     // This is a finite maneuver
     ref->forever = false;
+    ref->tj = 0;
 
     return PBIO_SUCCESS;
 }
 
+// Gets the time (us) to ramp up to the given acceleration at the given jerk.
+static int32_t get_jerk_time(int32_t a, int32_t j) {
+    if (j <= 0) {
+        // No jerk limit, so make a trapezoidal profile
+        return 0;
+    }
+    // Limit ramps to one second. Longer ones are not useful for motors.
+    if (j < a) {
+        return US_PER_SECOND;
+    }
+    return wdiva(a, j);
+}
+
+// Turns the trapezoidal profile into an S-curve that starts h before it and
+// ends h after it, starting from the given high res angle.
+static void make_s_curve(pbio_trajectory_t *ref, int32_t h, int64_t mth0) {
+    ref->t0 -= h;
+    ref->t3 += h;
+    ref->tj = 2 * h;
+    as_count(mth0, &ref->th0, &ref->th0_ext);
+}
+
+pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j) {
+
+    // The ramps take place within the given duration
+    int32_t tj = get_jerk_time(min(a, amax), j);
+    if (duration != DURATION_FOREVER && duration >= 0) {
+        tj = min(tj, duration);
+    }
+    int32_t h = tj / 2;
+
+    // Make the trapezoidal profile to be smoothed. It starts h later, at the
+    // initial speed.
+    pbio_error_t err = make_time_based_trapezoid(ref, t0 + h, duration == DURATION_FOREVER ? duration : duration - 2 * h, th0, th0_ext, w0, wt, wmax, a, amax);
+    if (err != PBIO_SUCCESS || h == 0) {
+        return err;
+    }
+
+    // Shift it ahead by the distance traveled in that time, so that the
+    // S-curve starts at the given angle
+    int64_t shift = x_time(ref->w0, h);
+    as_count(as_mcount(ref->th1, ref->th1_ext) + shift, &ref->th1, &ref->th1_ext);
+    as_count(as_mcount(ref->th2, ref->th2_ext) + shift, &ref->th2, &ref->th2_ext);
+    as_count(as_mcount(ref->th3, ref->th3_ext) + shift, &ref->th3, &ref->th3_ext);
+    make_s_curve(ref, h, as_mcount(th0, th0_ext));
+
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j) {
+
+    int32_t h = get_jerk_time(min(a, amax), j) / 2;
+
+    // Make the trapezoidal profile to be smoothed. It starts h later, ahead
+    // by the distance traveled at the initial speed in that time.
+    w0 = max(-wmax, min(w0, wmax));
+    pbio_error_t err = make_angle_based_trapezoid(ref, t0 + h, th0 + timest(w0, h), th3, w0, wt, wmax, a, amax);
+    if (err != PBIO_SUCCESS || h == 0) {
+        return err;
+    }
+
+    // The S-curve starts where the trapezoidal profile would have been h
+    // earlier. This differs from th0 by the rounding of the shift above.
+    make_s_curve(ref, h, as_mcount(ref->th0, ref->th0_ext) - x_time(ref->w0, h));
+
+    return PBIO_SUCCESS;
+}
+
+// Scales value by numerator / denominator, rounded to the nearest integer
+static int64_t scale(int64_t value, int32_t numerator, int32_t denominator) {
+    int64_t product = value * numerator;
+    int64_t half = abs(denominator) / 2;
+    return ((product < 0) == (denominator < 0) ? product + half : product - half) / denominator;
+}
+
+// Makes a trajectory with the same timing as the lead trajectory, which
+// travels lead_distance. It starts at t0 and th0 and travels distance instead.
+// The lead trajectory must be finite and travel a nonzero distance.
+void pbio_trajectory_make_scaled(pbio_trajectory_t *ref, const pbio_trajectory_t *lead, int32_t t0, int32_t th0, int32_t distance, int32_t lead_distance) {
+
+    // Same times, relative to the start
+    ref->t0 = t0;
+    ref->t1 = t0 + (lead->t1 - lead->t0);
+    ref->t2 = t0 + (lead->t2 - lead->t0);
+    ref->t3 = t0 + (lead->t3 - lead->t0);
+    ref->tj = lead->tj;
+    ref->forever = false;
+
+    // Speeds and accelerations scaled by the ratio of the distances
+    ref->w0 = scale(lead->w0, distance, lead_distance);
+    ref->w1 = scale(lead->w1, distance, lead_distance);
+    ref->a0 = scale(lead->a0, distance, lead_distance);
+    ref->a2 = scale(lead->a2, distance, lead_distance);
+
+    // Angles relative to the start, scaled likewise
+    int64_t lead_mth0 = as_mcount(lead->th0, lead->th0_ext);
+    ref->th0 = th0;
+    ref->th0_ext = 0;
+    as_count(as_mcount(th0, 0) + scale(as_mcount(lead->th1, lead->th1_ext) - lead_mth0, distance, lead_distance), &ref->th1, &ref->th1_ext);
+    ref->th3 = th0 + distance;
+    ref->th3_ext = 0;
+
+    // The scaled speeds are rounded, so go back from the end to get th2.
+    // This way, the deceleration ends exactly at the target.
+    int32_t t_dec = ref->t3 - ref->t2;
+    as_count(as_mcount(ref->th3, 0) - x_time(ref->w1, t_dec) - x_time2(ref->a2, t_dec), &ref->th2, &ref->th2_ext);
+}
+
+// Gets the reference of the trapezoidal profile underlying an S-curve, which
+// keeps the initial speed before it starts. Also gets the time at which the
+// current phase ends, or returns false if it does not end.
+//
+// Unlike the corner angles, the angle evaluated here is continuous, since
+// its derivatives are taken over the window below. So the acceleration phase
+// is evaluated from the start, the deceleration phase back from the end, and
+// the constant speed phase is interpolated in between.
+static bool get_trapezoid_reference(pbio_trajectory_t *traject, int32_t time, int64_t *mcount, int32_t *rate, int32_t *acceleration, int32_t *time_end) {
+
+    int32_t h = traject->tj / 2;
+    int32_t t0 = traject->t0 + h;
+    int32_t t3 = traject->t3 - h;
+    int64_t mth0 = as_mcount(traject->th0, traject->th0_ext) + x_time(traject->w0, h);
+    int64_t mth1 = mth0 + x_time(traject->w0, traject->t1 - t0) + x_time2(traject->a0, traject->t1 - t0);
+
+    if (time - t0 < 0) {
+        // Before the start
+        *rate = traject->w0;
+        *mcount = mth0 + x_time(traject->w0, time - t0);
+        *acceleration = 0;
+        *time_end = t0;
+        return true;
+    }
+    if (time - traject->t1 < 0) {
+        // Acceleration phase
+        *rate = traject->w0 + timest(traject->a0, time - t0);
+        *mcount = mth0 + x_time(traject->w0, time - t0) + x_time2(traject->a0, time - t0);
+        *acceleration = traject->a0;
+        *time_end = traject->t1;
+        return true;
+    }
+    if (traject->forever) {
+        // Constant speed phase that does not end
+        *rate = traject->w1;
+        *mcount = mth1 + x_time(traject->w1, time - traject->t1);
+        *acceleration = 0;
+        return false;
+    }
+    int64_t mth3 = as_mcount(traject->th3, traject->th3_ext);
+    int64_t mth2 = mth3 + x_time2(traject->a2, t3 - traject->t2);
+    if (time - traject->t2 < 0) {
+        // Constant speed phase
+        *rate = traject->w1;
+        *mcount = mth1 + (mth2 - mth1) * (time - traject->t1) / (traject->t2 - traject->t1);
+        *acceleration = 0;
+        *time_end = traject->t2;
+        return true;
+    }
+    if (time - t3 < 0) {
+        // Deceleration phase
+        *rate = -timest(traject->a2, t3 - time);
+        *mcount = mth3 + x_time2(traject->a2, t3 - time);
+        *acceleration = traject->a2;
+        *time_end = t3;
+        return true;
+    }
+    // Zero speed phase
+    *rate = 0;
+    *mcount = mth3;
+    *acceleration = 0;
+    return false;
+}
+
+// Evaluates the S-curve as the average of the trapezoidal profile between
+// time_ref - tj/2 and time_ref + tj/2. The window is integrated one phase at
+// a time. It spans at most all five phases, so this takes constant time.
+static void get_s_curve_reference(pbio_trajectory_t *traject, int32_t time_ref, int64_t *mcount_ref, int32_t *rate_ref, int32_t *acceleration_ref) {
+
+    int32_t h = traject->tj / 2;
+    int32_t time_begin = time_ref - h;
+    int32_t time_end = time_ref + h;
+
+    int64_t mcount_begin, mcount_end, mcount;
+    int32_t rate_begin, rate_end, rate, acceleration, time_next;
+
+    // Integral of the angle relative to the start of the window (millicount * us)
+    int64_t integral = 0;
+
+    int32_t time = time_begin;
+    bool ends = get_trapezoid_reference(traject, time, &mcount_begin, &rate_begin, &acceleration, &time_next);
+    mcount = mcount_begin;
+    rate = rate_begin;
+    while (true) {
+        if (!ends || time_next - time_end > 0) {
+            time_next = time_end;
+        }
+
+        // Integrate the phase in closed form. Everything stays within range
+        // of int64_t, since the window is no longer than a second.
+        int64_t dt = time_next - time;
+        integral += (mcount - mcount_begin) * dt;
+        integral += rate * dt * dt / (2 * US_PER_MS);
+        integral += acceleration * dt / US_PER_MS * dt / US_PER_MS * dt / (6 * US_PER_MS);
+
+        time = time_next;
+        if (time == time_end) {
+            break;
+        }
+        ends = get_trapezoid_reference(traject, time, &mcount, &rate, &acceleration, &time_next);
+    }
+    get_trapezoid_reference(traject, time_end, &mcount_end, &rate_end, &acceleration, &time_next);
+
+    // The average angle, and its derivatives from the ends of the window
+    *mcount_ref = mcount_begin + integral / traject->tj;
+    *rate_ref = (mcount_end - mcount_begin) * MS_PER_SECOND / traject->tj;
+    *acceleration_ref = ((int64_t)(rate_end - rate_begin)) * US_PER_SECOND / traject->tj;
+}
+
 // Evaluate the reference speed and velocity at the (shifted) time
 void pbio_trajectory_get_reference(pbio_trajectory_t *traject, int32_t time_ref, int32_t *count_ref, int32_t *count_ref_ext, int32_t *rate_ref, int32_t *acceleration_ref) {
 
     int64_t mcount_ref;
 
-    if (time_ref - traject->t1 < 0) {
+    if (traject->tj != 0) {
+        // S-curve
+        get_s_curve_reference(traject, time_ref, &mcount_ref, rate_ref, acceleration_ref);
+    } else if (time_ref - traject->t1 < 0) {
         // If we are here, then we are still in the acceleration phase. Includes conversion from microseconds to seconds, in two steps to avoid overflows and round off errors
         *rate_ref = traject->w0 + timest(traject->a0, time_ref - traject->t0);
         mcount_ref = as_mcount(traject->th0, traject->th0_ext) + x_time(traject->w0, time_ref - traject->t0) + x_time2(traject->a0, time_ref - traject->t0);
@@ -332,7 +556,7 @@ void pbio_trajectory_get_reference(pbio_trajectory_t *traject, int32_t time_ref,
     if (time_ref - traject->t0 > (DURATION_MAX_S + 120) * MS_PER_SECOND * US_PER_MS) {
         // Infinite maneuvers just maintain the same reference speed, continuing again from current time
         if (traject->forever) {
-            pbio_trajectory_make_time_based(traject, time_ref, DURATION_FOREVER, *count_ref, *count_ref_ext, traject->w1, traject->w1, traject->w1, abs(traject->a2), abs(traject->a2));
+            pbio_trajectory_make_time_based(traject, time_ref, DURATION_FOREVER, *count_ref, *count_ref_ext, traject->w1, traject->w1, traject->w1, abs(traject->a2), abs(traject->a2), 0);
         }
         // All other maneuvers are considered complete and just stop. In practice, other maneuvers are not
         // allowed to be this long. This just ensures that if a motor stops and holds, it will continue to
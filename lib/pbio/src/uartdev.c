@@ -35,6 +35,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <contiki.h>
@@ -62,6 +63,14 @@
 #define EV3_UART_SPEED_LPF2         115200  // standard baud rate for Powered Up
 #define EV3_UART_SPEED_MAX          460800  // in practice 115200 is max
 
+#if PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS
+// Number of tacho samples kept for estimating the rate. Must be a power of 2.
+#define TACHO_HISTORY_SIZE          16
+// The rate is estimated over at least this many counts, unless that takes
+// longer than the rate window
+#define TACHO_RATE_MIN_COUNTS       4
+#endif
+
 #define EV3_UART_DATA_KEEP_ALIVE_TIMEOUT    100 /* msec */
 #define EV3_UART_IO_TIMEOUT                 250 /* msec */
 
@@ -152,10 +161,15 @@ typedef enum {
  * @tx_msg: Buffer to hold messages transmitted to the device
  * @rx_msg: Buffer to hold messages received from the device
  * @rx_msg_size: Size of the current message being received
+ * @rx_msg_pos: Number of bytes of the current data message received so far
  * @ext_mode: Extra mode adder for Powered Up devices (for modes > LUMP_MAX_MODE)
  * @write_cmd_size: The size parameter received from a WRITE command
  * @tacho_rate: The tacho rate received from an LPF2 motor
  * @max_tacho_rate: The "100%" rate received from an LPF2 motor
+ * @tacho_history_count: Recent tacho counts, for estimating the rate
+ * @tacho_history_time: Arrival times of the recent tacho counts (us)
+ * @tacho_history_head: Number of tacho samples received, modulo 256
+ * @tacho_history_num: Number of valid tacho samples, up to TACHO_HISTORY_SIZE
  * @last_err: data->msg to be printed in case of an error.
  * @err_count: Total number of errors that have occurred
  * @num_data_err: Number of bad reads when receiving DATA data->msgs.
@@ -167,6 +181,9 @@ typedef enum {
  * @speed_payload: Buffer for holding baud rate change message data
  * @mode_combo_payload: Buffer for holding mode combo message data
  * @mode_combo_size: Actual size of mode combo message
+ * @combo_data_size: Size of the data of the mode combo set by the user
+ * @combo_rec: Flag that indicates that data of the mode combo set by the user
+ *      has been received
  */
 typedef struct {
     pbio_iodev_t iodev;
@@ -188,10 +205,19 @@ typedef struct {
     uint8_t *tx_msg;
     uint8_t *rx_msg;
     uint8_t rx_msg_size;
+    #if PBDRV_CONFIG_UART_READ_AVAILABLE
+    uint8_t rx_msg_pos;
+    #endif
     uint8_t ext_mode;
     uint8_t write_cmd_size;
     int8_t tacho_rate;
     int32_t max_tacho_rate;
+    #if PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS
+    int32_t tacho_history_count[TACHO_HISTORY_SIZE];
+    int32_t tacho_history_time[TACHO_HISTORY_SIZE];
+    volatile uint8_t tacho_history_head;
+    volatile uint8_t tacho_history_num;
+    #endif
     DBG_ERR(const char *last_err);
     uint32_t err_count;
     uint32_t num_data_err;
@@ -199,8 +225,10 @@ typedef struct {
     bool tx_busy;
     bool mode_change_tx_done;
     uint8_t speed_payload[4];
-    uint8_t mode_combo_payload[5];
+    uint8_t mode_combo_payload[2 + PBIO_IODEV_MAX_COMBO_VALUES];
     uint8_t mode_combo_size;
+    uint8_t combo_data_size;
+    bool combo_rec;
 } uartdev_port_data_t;
 
 enum {
@@ -422,6 +450,7 @@ static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
                 case LUMP_CMD_WRITE:
                     if (cmd2 & 0x20) {
                         data->write_cmd_size = cmd2 & 0x3;
+                        data->iodev.combo_ack = true;
                         if (PBIO_IODEV_IS_FEEDBACK_MOTOR(&data->iodev)) {
                             // TODO: msg[3] and msg[4] probably give us useful information
                         } else {
@@ -684,9 +713,33 @@ static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
                 // The counter driver must return the corrected count
                 data->tacho_count = tacho_count_msg - data->tacho_offset;
 
+                #if PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS
+                // Keep the count and its arrival time for estimating the rate
+                uint8_t head = data->tacho_history_head;
+                data->tacho_history_count[head % TACHO_HISTORY_SIZE] = data->tacho_count;
+                data->tacho_history_time[head % TACHO_HISTORY_SIZE] = clock_usecs();
+                // Samples must be written before the index that hands them over
+                PBIO_COMPILER_BARRIER();
+                data->tacho_history_head = head + 1;
+                if (data->tacho_history_num < TACHO_HISTORY_SIZE) {
+                    data->tacho_history_num++;
+                }
+                #endif
+
                 if (data->iodev.capability_flags & PBIO_IODEV_CAPABILITY_FLAG_HAS_MOTOR_ABS_POS) {
                     data->abs_pos = data->rx_msg[7] << 8 | data->rx_msg[6];
                 }
+            } else if (data->iodev.num_combo_modes && data->iodev.combo_ack) {
+                // Once the device has accepted the mode combo, all of its
+                // values come in each message, regardless of the mode
+                if (msg_size - 2 < data->combo_data_size) {
+                    DBG_ERR(data->last_err = "Mode combo data too short");
+                    break;
+                }
+                memcpy(data->iodev.bin_data, data->rx_msg + 1, data->combo_data_size);
+                data->iodev.data_time = clock_usecs();
+                data->iodev.data_seq++;
+                data->combo_rec = true;
             } else {
                 if (mode >= data->info->num_modes) {
                     DBG_ERR(data->last_err = "Invalid mode received");
@@ -695,6 +748,8 @@ static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
                 data->iodev.mode = mode;
                 if (mode == data->new_mode) {
                     memcpy(data->iodev.bin_data, data->rx_msg + 1, msg_size - 2);
+                    data->iodev.data_time = clock_usecs();
+                    data->iodev.data_seq++;
                 }
             }
 
@@ -832,11 +887,16 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
     // reset state for new device
     data->info->type_id = PBIO_IODEV_TYPE_ID_NONE;
     data->iodev.capability_flags = PBIO_IODEV_CAPABILITY_FLAG_NONE;
+    data->iodev.num_combo_modes = 0;
+    data->iodev.combo_ack = false;
     data->ext_mode = 0;
     data->status = PBIO_UARTDEV_STATUS_SYNCING;
     // default max tacho rate for BOOST external motor since it is the only
     // motor that does not send this info
     data->max_tacho_rate = 1400;
+    #if PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS
+    data->tacho_history_num = 0;
+    #endif
 
     pbdrv_uart_flush(data->uart);
 
@@ -1086,6 +1146,69 @@ err:
     PT_END(&data->pt);
 }
 
+#if PBDRV_CONFIG_UART_READ_AVAILABLE
+
+// Adds one byte of the data stream to the current message, and parses the
+// message once it is complete. Bytes that can't start a data message are
+// dropped, which gets us back into sync with the data stream.
+static void pbio_uartdev_receive_data_byte(uartdev_port_data_t *data, uint8_t byte) {
+    if (data->rx_msg_pos == 0) {
+        data->rx_msg_size = ev3_uart_get_msg_size(byte);
+        if (data->rx_msg_size < 3 || data->rx_msg_size > EV3_UART_MAX_MESSAGE_SIZE) {
+            DBG_ERR(data->last_err = "Bad data message size");
+            return;
+        }
+
+        uint8_t msg_type = byte & LUMP_MSG_TYPE_MASK;
+        uint8_t cmd = byte & LUMP_MSG_CMD_MASK;
+        if (msg_type != LUMP_MSG_TYPE_DATA && (msg_type != LUMP_MSG_TYPE_CMD ||
+                                               (cmd != LUMP_CMD_WRITE && cmd != LUMP_CMD_EXT_MODE))) {
+            DBG_ERR(data->last_err = "Bad msg type");
+            return;
+        }
+    }
+
+    data->rx_msg[data->rx_msg_pos++] = byte;
+
+    if (data->rx_msg_pos == data->rx_msg_size) {
+        pbio_uartdev_parse_msg(data);
+        data->rx_msg_pos = 0;
+    }
+}
+
+// Parses whatever has been received each time we get polled, instead of
+// waiting for the header and the rest of each message separately.
+static PT_THREAD(pbio_uartdev_receive_data(uartdev_port_data_t * data)) {
+    uint8_t buf[EV3_UART_MAX_MESSAGE_SIZE];
+    uint8_t length;
+    pbio_error_t err;
+
+    PT_BEGIN(&data->data_pt);
+
+    data->rx_msg_pos = 0;
+
+    while (true) {
+        err = pbdrv_uart_read_available(data->uart, buf, sizeof(buf), &length);
+        if (err != PBIO_SUCCESS) {
+            DBG_ERR(data->last_err = "UART Rx data error");
+            break;
+        }
+
+        for (uint8_t i = 0; i < length; i++) {
+            pbio_uartdev_receive_data_byte(data, buf[i]);
+        }
+
+        // Wait for the next event once the driver has no more data
+        if (length < sizeof(buf)) {
+            PT_YIELD(&data->data_pt);
+        }
+    }
+
+    PT_END(&data->data_pt);
+}
+
+#else // PBDRV_CONFIG_UART_READ_AVAILABLE
+
 // REVISIT: This is not the greatest. We can easily get a buffer overrun and
 // loose data. For now, the retry after bad message size helps get back into
 // sync with the data stream.
@@ -1140,6 +1263,8 @@ static PT_THREAD(pbio_uartdev_receive_data(uartdev_port_data_t * data)) {
     PT_END(&data->data_pt);
 }
 
+#endif // PBDRV_CONFIG_UART_READ_AVAILABLE
+
 static pbio_error_t ev3_uart_set_mode_begin(pbio_iodev_t *iodev, uint8_t mode) {
     uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
     pbio_error_t err;
@@ -1157,6 +1282,10 @@ static pbio_error_t ev3_uart_set_mode_begin(pbio_iodev_t *iodev, uint8_t mode) {
     port_data->new_mode = mode;
     port_data->mode_change_tx_done = false;
 
+    // Selecting a mode ends the mode combo
+    iodev->num_combo_modes = 0;
+    iodev->combo_ack = false;
+
     return PBIO_SUCCESS;
 }
 
@@ -1188,6 +1317,79 @@ static pbio_error_t ev3_uart_set_mode_end(pbio_iodev_t *iodev) {
     return PBIO_SUCCESS;
 }
 
+static pbio_error_t ev3_uart_set_mode_combo_begin(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes) {
+    uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
+    pbio_error_t err;
+
+    // Motors already use a mode combo for position and speed
+    if (PBIO_IODEV_IS_FEEDBACK_MOTOR(iodev)) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    // Select each value of each mode, in order
+    uint8_t num_values = 0;
+    uint8_t size = 0;
+    for (uint8_t i = 0; i < num_modes; i++) {
+        pbio_iodev_mode_t *mode = &port_data->info->mode_info[modes[i]];
+        for (uint8_t j = 0; j < mode->num_values; j++) {
+            port_data->mode_combo_payload[2 + num_values++] = modes[i] << 4 | j;
+        }
+        size += mode->num_values * pbio_iodev_size_of(mode->data_type);
+    }
+    port_data->mode_combo_payload[0] = 0x20 | num_values; // mode combo command, x values
+    port_data->mode_combo_payload[1] = 0; // combo index
+    port_data->mode_combo_size = num_values + 2;
+
+    err = ev3_uart_begin_tx_msg(port_data, LUMP_MSG_TYPE_CMD, LUMP_CMD_WRITE,
+        port_data->mode_combo_payload, port_data->mode_combo_size);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    // Data is not decoded as a combo until the device accepts it
+    iodev->combo_ack = false;
+    port_data->combo_data_size = size;
+    port_data->combo_rec = false;
+    for (uint8_t i = 0; i < num_modes; i++) {
+        iodev->combo_modes[i] = modes[i];
+    }
+    iodev->num_combo_modes = num_modes;
+    port_data->mode_change_tx_done = false;
+
+    return PBIO_SUCCESS;
+}
+
+static pbio_error_t ev3_uart_set_mode_combo_end(pbio_iodev_t *iodev) {
+    uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
+    pbio_error_t err;
+
+    if (!port_data->mode_change_tx_done) {
+        err = pbdrv_uart_write_end(port_data->uart);
+        if (err == PBIO_ERROR_AGAIN) {
+            return err;
+        }
+        port_data->tx_busy = false;
+
+        if (err != PBIO_SUCCESS) {
+            // The device never got the combo, so the single mode stays
+            iodev->num_combo_modes = 0;
+            iodev->combo_ack = false;
+            return err;
+        }
+
+        port_data->mode_change_tx_done = true;
+        return PBIO_ERROR_AGAIN;
+    }
+
+    if (!port_data->combo_rec) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    port_data->mode_change_tx_done = false;
+
+    return PBIO_SUCCESS;
+}
+
 static pbio_error_t ev3_uart_set_data_begin(pbio_iodev_t *iodev, const uint8_t *data) {
     uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
     pbio_iodev_mode_t *mode = &port_data->info->mode_info[iodev->mode];
@@ -1227,10 +1429,29 @@ static void ev3_uart_write_cancel(pbio_iodev_t *iodev) {
     pbdrv_uart_write_cancel(port_data->uart);
 }
 
+static void ev3_uart_set_mode_combo_cancel(pbio_iodev_t *iodev) {
+    uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
+
+    if (port_data->mode_change_tx_done) {
+        // Stop waiting for the device to accept the combo
+        port_data->mode_change_tx_done = false;
+    } else {
+        pbdrv_uart_write_cancel(port_data->uart);
+        port_data->tx_busy = false;
+    }
+
+    // Data is not decoded as a combo, even if the device accepts it later
+    iodev->num_combo_modes = 0;
+    iodev->combo_ack = false;
+}
+
 static const pbio_iodev_ops_t pbio_uartdev_ops = {
     .set_mode_begin = ev3_uart_set_mode_begin,
     .set_mode_end = ev3_uart_set_mode_end,
     .set_mode_cancel = ev3_uart_write_cancel,
+    .set_mode_combo_begin = ev3_uart_set_mode_combo_begin,
+    .set_mode_combo_end = ev3_uart_set_mode_combo_end,
+    .set_mode_combo_cancel = ev3_uart_set_mode_combo_cancel,
     .set_data_begin = ev3_uart_set_data_begin,
     .set_data_end = ev3_uart_write_end,
     .set_data_cancel = ev3_uart_write_cancel,
@@ -1274,6 +1495,35 @@ static pbio_error_t pbio_uartdev_get_rate(pbdrv_counter_dev_t *dev, int32_t *rat
         return PBIO_ERROR_NO_DEV;
     }
 
+    #if PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS
+    // Differentiate the count from the latest sample back to the first one
+    // that is far enough away in count or in time. Fast moves get a short
+    // window and slow moves get a fine resolution. The oldest slot is skipped,
+    // since it may be overwritten while we read.
+    uint8_t num = port_data->tacho_history_num;
+    PBIO_COMPILER_BARRIER();
+    uint8_t head = port_data->tacho_history_head;
+    PBIO_COMPILER_BARRIER();
+    if (num > TACHO_HISTORY_SIZE - 1) {
+        num = TACHO_HISTORY_SIZE - 1;
+    }
+    if (num >= 2) {
+        uint8_t last = (uint8_t)(head - 1) % TACHO_HISTORY_SIZE;
+        for (uint8_t k = 1; k < num; k++) {
+            uint8_t slot = (uint8_t)(head - 1 - k) % TACHO_HISTORY_SIZE;
+            int32_t counts = port_data->tacho_history_count[last] - port_data->tacho_history_count[slot];
+            int32_t duration = port_data->tacho_history_time[last] - port_data->tacho_history_time[slot];
+            if (abs(counts) >= TACHO_RATE_MIN_COUNTS || duration >= PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS * 1000 || k == num - 1) {
+                if (duration > 0) {
+                    *rate = (int64_t)counts * 1000000 / duration;
+                    return PBIO_SUCCESS;
+                }
+                break;
+            }
+        }
+    }
+    #endif
+
     // tacho_rate is in percent, so we need to convert it to counts per second
     *rate = port_data->max_tacho_rate * port_data->tacho_rate / 100;
 
@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Host-side benchmark for the pbio control loop. Each case runs one kind of
+// maneuver against the simulated clock and the test counter/PWM drivers and
+// reports how long one control update takes, as CSV on stdout.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <contiki.h>
+
+#include <pbio/control.h>
+#include <pbio/drivebase.h>
+#include <pbio/main.h>
+#include <pbio/motor_process.h>
+#include <pbio/servo.h>
+
+#include "test-pbio.h"
+
+#define PBIO_BENCH_DEFAULT_UPDATES (20000)
+
+typedef struct {
+    const char *name;
+    // Starts (or restarts) the maneuver under test.
+    pbio_error_t (*start)(void);
+    // Runs a single control update. This is the only part that is timed.
+    pbio_error_t (*update)(void);
+    // Tells whether the maneuver has completed and has to be restarted.
+    bool (*is_done)(void);
+    // Moves the simulated motor after each update.
+    void (*simulate)(void);
+} pbio_bench_case_t;
+
+static pbio_servo_t *servo;
+static pbio_drivebase_t *drivebase;
+static pbio_control_t control;
+
+// Simulated motor that tracks the given control reference perfectly.
+static void bench_track_reference(pbio_control_t *ctl, int32_t scale) {
+    int32_t count_ref, count_ref_ext, rate_ref, acceleration_ref;
+    int32_t time_ref = pbio_control_get_ref_time(ctl, clock_usecs());
+    pbio_trajectory_get_reference(&ctl->trajectory, time_ref, &count_ref, &count_ref_ext, &rate_ref, &acceleration_ref);
+    pbio_test_counter_set_count(count_ref / scale);
+    pbio_test_counter_set_rate(rate_ref / scale);
+}
+
+// Simulated motor that does not move at all.
+static void bench_simulate_stalled(void) {
+    pbio_test_counter_set_rate(0);
+}
+
+/* Bare controller */
+
+static pbio_error_t bench_control_start_timed(void) {
+    return pbio_control_start_timed_control(&control, clock_usecs(), DURATION_FOREVER, 0, 0, control.settings.max_rate / 2, control.settings.abs_acceleration, pbio_control_on_target_never, PBIO_ACTUATION_COAST);
+}
+
+static pbio_error_t bench_control_start_angle(void) {
+    control.settings.abs_jerk = 0;
+    return pbio_control_start_relative_angle_control(&control, clock_usecs(), 0, 36000, 0, control.settings.max_rate / 2, control.settings.abs_acceleration, PBIO_ACTUATION_HOLD);
+}
+
+static pbio_error_t bench_control_start_s_curve(void) {
+    control.settings.abs_jerk = control.settings.abs_acceleration * 10;
+    return pbio_control_start_relative_angle_control(&control, clock_usecs(), 0, 36000, 0, control.settings.max_rate / 2, control.settings.abs_acceleration, PBIO_ACTUATION_HOLD);
+}
+
+static pbio_error_t bench_control_update(void) {
+    int32_t count_ref, count_ref_ext, rate_ref, acceleration_ref, torque;
+    pbio_actuation_t actuation;
+    int32_t time_now = clock_usecs();
+    int32_t time_ref = pbio_control_get_ref_time(&control, time_now);
+    pbio_trajectory_get_reference(&control.trajectory, time_ref, &count_ref, &count_ref_ext, &rate_ref, &acceleration_ref);
+    pbio_control_update(&control, time_now, count_ref, rate_ref, count_ref, rate_ref, &actuation, &torque, &rate_ref, &acceleration_ref);
+    return PBIO_SUCCESS;
+}
+
+static bool bench_control_is_done(void) {
+    return pbio_control_is_done(&control);
+}
+
+static void bench_control_simulate(void) {
+    // The bare controller is fed its own reference in bench_control_update.
+}
+
+/* Servo */
+
+static pbio_error_t bench_servo_start_timed(void) {
+    return pbio_servo_run(servo, 500);
+}
+
+static pbio_error_t bench_servo_start_angle(void) {
+    return pbio_servo_run_angle(servo, 500, 3600, PBIO_ACTUATION_HOLD);
+}
+
+static pbio_error_t bench_servo_start_hold(void) {
+    return pbio_servo_track_target(servo, 90);
+}
+
+static pbio_error_t bench_servo_start_stalled(void) {
+    return pbio_servo_run_until_stalled(servo, 500, PBIO_ACTUATION_COAST);
+}
+
+static pbio_error_t bench_servo_update(void) {
+    return pbio_servo_control_update(servo);
+}
+
+static bool bench_servo_is_done(void) {
+    return pbio_control_is_done(&servo->control);
+}
+
+static void bench_servo_simulate(void) {
+    bench_track_reference(&servo->control, 1);
+}
+
+/* Drive base */
+
+// The test platform has a single motor port, so both sides of the drive base
+// use the same servo. This still runs every step of the drive base update.
+
+static pbio_error_t bench_drivebase_start_straight(void) {
+    pbio_error_t err = pbio_drivebase_setup(drivebase, servo, servo, F16C(56, 0), F16C(114, 0));
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    return pbio_drivebase_straight(drivebase, 10000, 100, 200);
+}
+
+static pbio_error_t bench_drivebase_start_drive(void) {
+    pbio_error_t err = pbio_drivebase_setup(drivebase, servo, servo, F16C(56, 0), F16C(114, 0));
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    return pbio_drivebase_drive(drivebase, 100, 0);
+}
+
+static pbio_error_t bench_drivebase_update(void) {
+    return pbio_drivebase_update(drivebase);
+}
+
+static bool bench_drivebase_is_done(void) {
+    return pbio_control_is_done(&drivebase->control_distance) && pbio_control_is_done(&drivebase->control_heading);
+}
+
+static void bench_drivebase_simulate(void) {
+    // Sum of both (identical) motors, so each one is at half of the reference
+    bench_track_reference(&drivebase->control_distance, 2);
+}
+
+static const pbio_bench_case_t bench_cases[] = {
+    { "control_timed", bench_control_start_timed, bench_control_update, bench_control_is_done, bench_control_simulate },
+    { "control_angle", bench_control_start_angle, bench_control_update, bench_control_is_done, bench_control_simulate },
+    { "control_s_curve", bench_control_start_s_curve, bench_control_update, bench_control_is_done, bench_control_simulate },
+    { "servo_timed", bench_servo_start_timed, bench_servo_update, bench_servo_is_done, bench_servo_simulate },
+    { "servo_angle", bench_servo_start_angle, bench_servo_update, bench_servo_is_done, bench_servo_simulate },
+    { "servo_hold", bench_servo_start_hold, bench_servo_update, bench_servo_is_done, bench_servo_simulate },
+    { "servo_stalled", bench_servo_start_stalled, bench_servo_update, bench_servo_is_done, bench_simulate_stalled },
+    { "drivebase_straight", bench_drivebase_start_straight, bench_drivebase_update, bench_drivebase_is_done, bench_drivebase_simulate },
+    { "drivebase_drive", bench_drivebase_start_drive, bench_drivebase_update, bench_drivebase_is_done, bench_drivebase_simulate },
+};
+
+static int compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_setup(void) {
+    pbio_init();
+
+    // Let the motor process initialize the servos, then leave it idle. From
+    // here on, updates are only done by the benchmark itself.
+    while (pbio_do_one_event()) {
+    }
+
+    pbio_motor_process_get_servo(PBIO_PORT_A, &servo);
+    pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, fix16_one);
+    pbio_servo_set_connected(servo, true);
+
+    pbio_motor_process_get_drivebase(&drivebase);
+
+    control.settings = servo->control.settings;
+    pbio_control_stop(&control);
+}
+
+static pbio_error_t bench_run(const pbio_bench_case_t *bench, int64_t *samples, int updates) {
+    pbio_error_t err;
+
+    // Start from a passive state so each case is independent of the previous one
+    pbio_test_counter_set_count(0);
+    pbio_test_counter_set_rate(0);
+    pbio_drivebase_stop_force(drivebase);
+    pbio_servo_stop_force(servo);
+    pbio_control_stop(&control);
+
+    err = bench->start();
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    for (int i = 0; i < updates; i++) {
+        clock_tick(clock_from_msec(PBIO_CONTROL_LOOP_TIME_MS));
+
+        int64_t start = now_ns();
+        err = bench->update();
+        samples[i] = now_ns() - start;
+
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+
+        bench->simulate();
+
+        if (bench->is_done()) {
+            err = bench->start();
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+        }
+    }
+    return PBIO_SUCCESS;
+}
+
+int main(int argc, const char **argv) {
+    int updates = PBIO_BENCH_DEFAULT_UPDATES;
+    int64_t budget_ns = 0;
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    const char *env_updates = getenv("PBIO_BENCH_UPDATES");
+    if (env_updates) {
+        updates = atoi(env_updates);
+    }
+    if (updates <= 0) {
+        fprintf(stderr, "PBIO_BENCH_UPDATES must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    // Optional upper limit for the 99th percentile of each case, in ns
+    const char *env_budget = getenv("PBIO_BENCH_BUDGET_NS");
+    if (env_budget) {
+        budget_ns = atoll(env_budget);
+    }
+
+    int64_t *samples = malloc(sizeof(*samples) * updates);
+    if (samples == NULL) {
+        perror("failed to allocate samples");
+        return EXIT_FAILURE;
+    }
+
+    bench_setup();
+
+    int ret = EXIT_SUCCESS;
+
+    printf("case,updates,mean_ns,median_ns,p99_ns,max_ns\n");
+
+    for (size_t c = 0; c < sizeof(bench_cases) / sizeof(bench_cases[0]); c++) {
+        const pbio_bench_case_t *bench = &bench_cases[c];
+
+        if (filter && !strstr(bench->name, filter)) {
+            continue;
+        }
+
+        pbio_error_t err = bench_run(bench, samples, updates);
+        if (err != PBIO_SUCCESS) {
+            fprintf(stderr, "%s: failed with error %d\n", bench->name, err);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+
+        int64_t total = 0;
+        for (int i = 0; i < updates; i++) {
+            total += samples[i];
+        }
+        qsort(samples, updates, sizeof(*samples), compare_int64);
+
+        int64_t p99 = samples[(updates * 99) / 100];
+        printf("%s,%d,%lld,%lld,%lld,%lld\n", bench->name, updates,
+            (long long)(total / updates),
+            (long long)samples[updates / 2],
+            (long long)p99,
+            (long long)samples[updates - 1]);
+
+        if (budget_ns > 0 && p99 > budget_ns) {
+            fprintf(stderr, "%s: p99 of %lld ns exceeds budget of %lld ns\n", bench->name, (long long)p99, (long long)budget_ns);
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    free(samples);
+
+    return ret;
+}
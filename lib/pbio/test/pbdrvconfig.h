@@ -21,6 +21,7 @@
 #define PBDRV_CONFIG_PWM_TEST                       (1)
 
 #define PBDRV_CONFIG_UART                           (1)
+#define PBDRV_CONFIG_UART_READ_AVAILABLE            (1)
 
 #define PBDRV_CONFIG_MOTOR                          (1)
 #define PBDRV_CONFIG_HAS_PORT_A                     (1)
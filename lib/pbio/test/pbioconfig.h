@@ -1,10 +1,14 @@
 
 #define PBIO_CONFIG_DCMOTOR                 (1)
 
+#define PBIO_CONFIG_IMU                     (1)
+
 #define PBIO_CONFIG_LIGHT                   (1)
 #define PBIO_CONFIG_LIGHT_MATRIX              (1)
 
 #define PBIO_CONFIG_TACHO                   (1)
 
+#define PBIO_CONFIG_OBSERVER_FIX16          (1)
+
 #define PBIO_CONFIG_UARTDEV                 (1)
 #define PBIO_CONFIG_UARTDEV_NUM_DEV         (1)
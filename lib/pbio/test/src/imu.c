@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbio/imu.h>
+
+// Samples at 833 Hz, like the hubs do
+#define SAMPLE_TIME (1.0f / 833)
+#define SAMPLES_PER_SECOND (833)
+
+// Feeds the same sample for the given number of seconds, while the motors
+// are idle, or not
+static void feed_while(pbio_imu_t *imu, float seconds, const float *gyro, const float *accel, bool idle) {
+    for (int32_t i = 0; i < seconds * SAMPLES_PER_SECOND; i++) {
+        pbio_imu_update(imu, gyro, accel, idle);
+    }
+}
+
+static void feed(pbio_imu_t *imu, float seconds, const float *gyro, const float *accel) {
+    feed_while(imu, seconds, gyro, accel, true);
+}
+
+void test_imu_heading(void *env) {
+    pbio_imu_t *imu;
+    pbio_imu_get_imu(&imu);
+    pbio_imu_reset(imu, SAMPLE_TIME);
+
+    const float flat[] = {0.0f, 0.0f, 9.81f};
+    const float still[] = {0.0f, 0.0f, 0.0f};
+    int32_t heading, rate;
+
+    // Turning counterclockwise about the vertical decreases the heading
+    const float ccw[] = {0.0f, 0.0f, 90.0f};
+    feed(imu, 1.0f, ccw, flat);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading + 90000), <, 200);
+    tt_want_int_op(abs(rate + 90000), <, 10);
+
+    // Keeps counting past a full turn
+    const float cw[] = {0.0f, 0.0f, -180.0f};
+    feed(imu, 4.0f, cw, flat);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading - 630000), <, 1000);
+
+    feed(imu, 1.0f, still, flat);
+    pbio_imu_reset_heading(imu, 45000);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(heading, ==, 45000);
+    tt_want_int_op(rate, ==, 0);
+
+    // With the hub on its side, with the X axis up, the heading changes with
+    // rotation about the X axis instead
+    pbio_imu_reset(imu, SAMPLE_TIME);
+    const float side[] = {9.81f, 0.0f, 0.0f};
+    const float about_x[] = {90.0f, 0.0f, 0.0f};
+    const float about_z[] = {0.0f, 0.0f, 90.0f};
+    feed(imu, 1.0f, about_x, side);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading + 90000), <, 200);
+
+    feed(imu, 1.0f, still, side);
+    pbio_imu_reset_heading(imu, 0);
+    feed(imu, 0.5f, about_z, side);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading), <, 500);
+
+    // The attitude follows the mounting
+    float q[4];
+    pbio_imu_get_quaternion(imu, q);
+    tt_want(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3] > 0.999f);
+}
+
+void test_imu_calibration(void *env) {
+    pbio_imu_t *imu;
+    pbio_imu_get_imu(&imu);
+    pbio_imu_reset(imu, SAMPLE_TIME);
+
+    const float flat[] = {0.0f, 0.0f, 9.81f};
+    const float biased[] = {0.4f, -0.3f, 0.8f};
+    int32_t heading, rate;
+
+    // The bias is not known before the hub has been at rest for a moment
+    feed(imu, 0.25f, biased, flat);
+    tt_want(!pbio_imu_is_calibrated(imu));
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(heading, <, -100);
+
+    // After that, the heading no longer drifts
+    feed(imu, 0.5f, biased, flat);
+    tt_want(pbio_imu_is_calibrated(imu));
+    pbio_imu_reset_heading(imu, 0);
+    feed(imu, 10.0f, biased, flat);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading), <, 10);
+    tt_want_int_op(abs(rate), <, 10);
+
+    // Motion starts a new window, so the bias stays as it was
+    const float turning[] = {0.4f, -0.3f, 30.8f};
+    feed(imu, 1.0f, turning, flat);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading + 30000), <, 100);
+    tt_want(pbio_imu_is_calibrated(imu));
+
+    // A slow steady turn while the motors drive the hub is not a new bias
+    const float creeping[] = {0.4f, -0.3f, 1.8f};
+    pbio_imu_reset_heading(imu, 0);
+    feed_while(imu, 10.0f, creeping, flat, false);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading + 10000), <, 100);
+
+    // Neither is a steady turn faster than any bias, even with idle motors
+    const float slow[] = {0.4f, -0.3f, 3.8f};
+    pbio_imu_reset_heading(imu, 0);
+    feed(imu, 10.0f, slow, flat);
+    pbio_imu_get_heading(imu, &heading, &rate);
+    tt_want_int_op(abs(heading + 30000), <, 100);
+}
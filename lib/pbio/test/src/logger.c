@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdint.h>
+
+#include <pbio/logger.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#define TEST_COLS (NUM_DEFAULT_LOG_VALUES + 2)
+#define TEST_ROWS (4)
+
+// Logs n rows of which the first value is i
+static void log_rows(pbio_log_t *log, int32_t first, int32_t n) {
+    for (int32_t i = first; i < first + n; i++) {
+        int32_t values[] = { i, -i };
+        pbio_logger_update(log, values);
+    }
+}
+
+void test_logger_ring(void *env) {
+    pbio_log_t log = { .num_values = TEST_COLS };
+    int32_t buf[TEST_ROWS * TEST_COLS];
+    int32_t row[TEST_COLS];
+    uint32_t lost;
+
+    // Without ring mode, logging stops once the buffer is full
+    pbio_logger_start(&log, buf, TEST_ROWS, 1);
+    log_rows(&log, 0, TEST_ROWS + 2);
+    tt_want_int_op(pbio_logger_rows(&log), ==, TEST_ROWS);
+    tt_want(!log.active);
+    tt_want_int_op(pbio_logger_read(&log, -1, row), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[1], ==, TEST_ROWS - 1);
+
+    // In ring mode, the latest rows are kept, oldest first
+    pbio_logger_start_ring(&log, buf, TEST_ROWS, 1);
+    log_rows(&log, 0, TEST_ROWS + 2);
+    tt_want(log.active);
+    tt_want_int_op(pbio_logger_rows(&log), ==, TEST_ROWS);
+    tt_want_int_op(pbio_logger_read(&log, 0, row), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[1], ==, 2);
+    tt_want_int_op(pbio_logger_read(&log, -1, row), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[1], ==, TEST_ROWS + 1);
+    tt_want_int_op(pbio_logger_read(&log, TEST_ROWS, row), ==, PBIO_ERROR_INVALID_ARG);
+
+    // Draining skips the rows that were replaced, then reads the rest once
+    tt_want_int_op(pbio_logger_drain(&log, row, &lost), ==, PBIO_SUCCESS);
+    tt_want_int_op(lost, ==, 2);
+    tt_want_int_op(row[1], ==, 2);
+    for (int32_t i = 3; i < TEST_ROWS + 2; i++) {
+        tt_want_int_op(pbio_logger_drain(&log, row, &lost), ==, PBIO_SUCCESS);
+        tt_want_int_op(lost, ==, 0);
+        tt_want_int_op(row[1], ==, i);
+    }
+    tt_want_int_op(pbio_logger_drain(&log, row, &lost), ==, PBIO_ERROR_AGAIN);
+
+    // New rows can be drained as they come
+    log_rows(&log, TEST_ROWS + 2, 1);
+    tt_want_int_op(pbio_logger_drain(&log, row, &lost), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[2], ==, -(TEST_ROWS + 2));
+}
+
+void test_logger_encode_frame(void *env) {
+    int32_t prev[2] = { 0 };
+    uint8_t frame[PBIO_LOGGER_FRAME_SIZE_MAX];
+
+    // Values are zigzag varints relative to the previous row
+    int32_t row1[] = { 100, -1 };
+    tt_want_int_op(pbio_logger_encode_frame(row1, prev, 2, 0, frame), ==, 7);
+    tt_want_int_op(frame[0], ==, PBIO_LOGGER_FRAME_START);
+    tt_want_int_op(frame[1], ==, 4);
+    tt_want_int_op(frame[2], ==, 0);
+    tt_want_int_op(frame[3], ==, 0xC8);
+    tt_want_int_op(frame[4], ==, 0x01);
+    tt_want_int_op(frame[5], ==, 0x01);
+    tt_want_int_op(frame[6], ==, 0x00 ^ 0xC8 ^ 0x01 ^ 0x01);
+    tt_want_int_op(prev[0], ==, 100);
+
+    // Small changes take a byte each
+    int32_t row2[] = { 105, -2 };
+    tt_want_int_op(pbio_logger_encode_frame(row2, prev, 2, 3, frame), ==, 6);
+    tt_want_int_op(frame[2], ==, 3);
+    tt_want_int_op(frame[3], ==, 10);
+    tt_want_int_op(frame[4], ==, 1);
+
+    // Even the largest change fits in the frame
+    int32_t row3[] = { INT32_MIN, INT32_MAX };
+    tt_want_int_op(pbio_logger_encode_frame(row3, prev, 2, UINT32_MAX, frame), <=, PBIO_LOGGER_FRAME_SIZE_MAX);
+}
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <fixmath.h>
+
+#include <pbio/control.h>
+#include <pbio/iodev.h>
+#include <pbio/observer.h>
+#include <pbio/servo.h>
+
+// Reference implementation of the float observer model. This is the engine
+// that platforms without PBIO_CONFIG_OBSERVER_FIX16 use. It is evaluated with
+// the same coefficients as the engine under test, which are checked against
+// the physical motor models in test_observer_coefficients.
+
+#if PBIO_CONFIG_OBSERVER_FIX16
+#define COEF(x) fix16_to_float(x)
+#else
+#define COEF(x) (x)
+#endif
+
+typedef struct {
+    float est_count;
+    float est_rate;
+    const pbio_observer_settings_t *settings;
+} test_observer_float_t;
+
+static void test_observer_float_update(test_observer_float_t *obs, int32_t count, int32_t control, int32_t battery_voltage) {
+    const pbio_observer_settings_t *s = obs->settings;
+
+    float tau_e = (control * battery_voltage) / 10000000 * COEF(s->k_0);
+    float tau_o = COEF(s->obs_gain) * (count - obs->est_count);
+    float tau_f = obs->est_rate > 0 ? COEF(s->f_low): -COEF(s->f_low);
+
+    float next_count = obs->est_count + COEF(s->phi_01) * obs->est_rate + COEF(s->gam_0) * (tau_e + tau_o);
+    float next_rate = COEF(s->phi_11) * obs->est_rate + COEF(s->gam_1) * (tau_e + tau_o - tau_f);
+
+    if ((next_rate < 0) != (next_rate + COEF(s->gam_1) * tau_f < 0)) {
+        next_rate = 0;
+    }
+
+    obs->est_count = next_count;
+    obs->est_rate = next_rate;
+}
+
+static int32_t test_observer_float_feedforward(const pbio_observer_settings_t *s, int32_t rate_ref, int32_t acceleration_ref) {
+    int32_t friction_compensation_torque = s->ff_friction * (rate_ref == 0 ? 0 : rate_ref > 0 ? 1 : -1);
+    int32_t back_emf_compensation_torque = (int32_t)(COEF(s->ff_rate) * rate_ref);
+    int32_t acceleration_torque = (int32_t)(COEF(s->ff_acceleration) * acceleration_ref);
+    return friction_compensation_torque + back_emf_compensation_torque + acceleration_torque;
+}
+
+static int32_t test_observer_float_torque_to_duty(const pbio_observer_settings_t *s, int32_t desired_torque, int32_t battery_voltage) {
+    return (int32_t)(desired_torque * COEF(s->duty_per_torque) / battery_voltage);
+}
+
+// Duty cycle profile with rest, ramp up, full speed, reversal and coasting,
+// sampled every PBIO_CONTROL_LOOP_TIME_MS.
+static int32_t test_observer_duty(int32_t i) {
+    if (i < 100) {
+        return 0;
+    }
+    if (i < 300) {
+        return (i - 100) * 50;
+    }
+    if (i < 500) {
+        return 10000;
+    }
+    if (i < 700) {
+        return -6000;
+    }
+    return 0;
+}
+
+#define TEST_OBSERVER_STEPS (1000)
+#define TEST_OBSERVER_VOLTAGE (7600)
+
+// Maximum deviation of the fixed point engine from the float model, due to
+// rounding of intermediate results.
+#define TEST_OBSERVER_COUNT_TOLERANCE (2)   // counts
+#define TEST_OBSERVER_RATE_TOLERANCE (10)   // counts/s
+#define TEST_OBSERVER_TORQUE_TOLERANCE (10) // uNm
+#define TEST_OBSERVER_DUTY_TOLERANCE (1)    // duty steps (0--10000)
+
+static const pbio_iodev_type_id_t test_observer_motors[] = {
+    PBIO_IODEV_TYPE_ID_INTERACTIVE_MOTOR,
+    PBIO_IODEV_TYPE_ID_TECHNIC_L_MOTOR,
+    PBIO_IODEV_TYPE_ID_TECHNIC_XL_MOTOR,
+    PBIO_IODEV_TYPE_ID_SPIKE_M_MOTOR,
+    PBIO_IODEV_TYPE_ID_SPIKE_L_MOTOR,
+};
+
+void test_observer_fix16(void *env) {
+    for (size_t m = 0; m < sizeof(test_observer_motors) / sizeof(test_observer_motors[0]); m++) {
+        pbio_control_settings_t control_settings;
+        pbio_observer_t obs;
+        test_observer_float_t ref;
+
+        pbio_servo_load_settings(&control_settings, &obs.settings, test_observer_motors[m]);
+        ref.settings = obs.settings;
+
+        // The simulated motor is a float model of another motor, so the
+        // observer has a model error to correct for.
+        test_observer_float_t plant = { 0 };
+        pbio_servo_load_settings(&control_settings, &plant.settings, PBIO_IODEV_TYPE_ID_TECHNIC_L_MOTOR);
+
+        pbio_observer_reset(&obs, 0, 0, 0);
+        ref.est_count = 0;
+        ref.est_rate = 0;
+
+        for (int32_t i = 0; i < TEST_OBSERVER_STEPS; i++) {
+            int32_t duty = test_observer_duty(i);
+            int32_t count = (int32_t)plant.est_count;
+
+            pbio_observer_update(&obs, (i + 1) * PBIO_CONTROL_LOOP_TIME_MS * US_PER_MS, count, PBIO_ACTUATION_DUTY, duty, TEST_OBSERVER_VOLTAGE);
+            test_observer_float_update(&ref, count, duty, TEST_OBSERVER_VOLTAGE);
+            test_observer_float_update(&plant, count, duty, TEST_OBSERVER_VOLTAGE);
+
+            int32_t count_est, rate_est;
+            pbio_observer_get_estimated_state(&obs, &count_est, &rate_est);
+            tt_want_int_op(abs(count_est - (int32_t)ref.est_count), <=, TEST_OBSERVER_COUNT_TOLERANCE);
+            tt_want_int_op(abs(rate_est - (int32_t)ref.est_rate), <=, TEST_OBSERVER_RATE_TOLERANCE);
+        }
+
+        for (int32_t rate = -1500; rate <= 1500; rate += 250) {
+            for (int32_t acceleration = -5000; acceleration <= 5000; acceleration += 2500) {
+                int32_t torque = pbio_observer_get_feedforward_torque(&obs, rate, acceleration);
+                int32_t torque_ref = test_observer_float_feedforward(obs.settings, rate, acceleration);
+                tt_want_int_op(abs(torque - torque_ref), <=, TEST_OBSERVER_TORQUE_TOLERANCE);
+
+                int32_t duty = pbio_observer_torque_to_duty(&obs, torque_ref, TEST_OBSERVER_VOLTAGE);
+                int32_t duty_ref = test_observer_float_torque_to_duty(obs.settings, torque_ref, TEST_OBSERVER_VOLTAGE);
+                tt_want_int_op(abs(duty - duty_ref), <=, TEST_OBSERVER_DUTY_TOLERANCE);
+            }
+        }
+    }
+}
+
+// Physical models of the motors, copied from tools/observer-settings.py. The
+// coefficients are derived from these here, independently of the generated
+// tables, so a generator error or a stale table does not go unnoticed.
+typedef struct {
+    pbio_iodev_type_id_t id;
+    double k_0;
+    double k_1;
+    double k_2;
+    double f_low;
+    double obs_gain;
+} test_observer_model_t;
+
+static const test_observer_model_t test_observer_models[] = {
+    { PBIO_IODEV_TYPE_ID_INTERACTIVE_MOTOR, 0.01500933205496964, 0.000275066965901687, 0.00539346991964092, 0.005613422818791947, 0.002 },
+    { PBIO_IODEV_TYPE_ID_TECHNIC_L_MOTOR, 0.029291367521367528, 0.000269922879177378, 0.00428449014567267, 0.013215000000000001, 0.002 },
+    { PBIO_IODEV_TYPE_ID_TECHNIC_XL_MOTOR, 0.025904742547425474, 0.000283410138248848, 0.00429409300377042, 0.006446341463414635, 0.002 },
+    { PBIO_IODEV_TYPE_ID_SPIKE_M_MOTOR, 0.02258435646747968, 0.000267785410941794, 0.00643543836108826, 0.01218641268292683, 0.002 },
+    { PBIO_IODEV_TYPE_ID_SPIKE_L_MOTOR, 0.052359221241860474, 0.000337807915176920, 0.00666198910636721, 0.011619602790697674, 0.004 },
+};
+
+// Difference between a table coefficient and its exact value, in units of
+// the last place of the table type. Rounding allows a difference of 1.
+#if PBIO_CONFIG_OBSERVER_FIX16
+static int32_t test_observer_coef_error(pbio_observer_coef_t actual, double expected) {
+    return abs(actual - F16(expected));
+}
+#else
+static int32_t test_observer_coef_error(pbio_observer_coef_t actual, double expected) {
+    return (int32_t)(fabs(actual - expected) / (fabs(expected) * 1e-7 + 1e-12));
+}
+#endif
+
+void test_observer_coefficients(void *env) {
+    const double loop_time = PBIO_CONTROL_LOOP_TIME_MS / 1000.0;
+
+    for (size_t m = 0; m < sizeof(test_observer_models) / sizeof(test_observer_models[0]); m++) {
+        const test_observer_model_t *model = &test_observer_models[m];
+        const pbio_observer_settings_t *s;
+        pbio_control_settings_t control_settings;
+
+        pbio_servo_load_settings(&control_settings, &s, model->id);
+
+        // Zero order hold discretization of k_1 * dw/dt = -k_2 * w + tau / k_0.
+        double a = model->k_2 / model->k_1;
+        double b = 1 / (model->k_0 * model->k_1);
+        double phi_11 = exp(-a * loop_time);
+        double phi_01 = (1 - phi_11) / a;
+
+        tt_want_int_op(test_observer_coef_error(s->phi_01, phi_01), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->phi_11, phi_11), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->gam_0, b * (loop_time - phi_01) / a), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->gam_1, b * phi_01), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->k_0, model->k_0), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->f_low, model->f_low), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->obs_gain, model->obs_gain), <=, 1);
+        tt_want_int_op(s->ff_friction, ==, (int32_t)(model->f_low * 1000000));
+        tt_want_int_op(test_observer_coef_error(s->ff_rate, model->k_0 * model->k_2 * 1000000), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->ff_acceleration, model->k_0 * model->k_1 * 1000000), <=, 1);
+        tt_want_int_op(test_observer_coef_error(s->duty_per_torque, 10 / model->k_0), <=, 1);
+    }
+}
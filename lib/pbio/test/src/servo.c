@@ -18,6 +18,7 @@
 #include <pbio/control.h>
 #include <pbio/error.h>
 #include <pbio/logger.h>
+#include <pbio/motor_group.h>
 #include <pbio/motor_process.h>
 #include <pbio/servo.h>
 
@@ -325,3 +326,374 @@ PT_THREAD(test_servo_run_time(struct pt *pt)) {
 
     PT_END(pt);
 }
+
+#define TEST_LOOP_TIME_ROWS 64
+#define TEST_LOOP_TIME_COLS (PBIO_SERVO_LOG_COLS + NUM_DEFAULT_LOG_VALUES)
+
+/**
+ * Runs the motor process for the given number of clock ticks and checks that
+ * the servo was updated once per loop time.
+ * @param [in]  pt          The Contiki proto-thread
+ * @param [in]  servo       The servo under test
+ * @param [in]  loop_time   The loop time to test (ms)
+ */
+static PT_THREAD(test_servo_loop_time_func(struct pt *pt, pbio_servo_t *servo, int32_t loop_time)) {
+    static int32_t log_buf[TEST_LOOP_TIME_ROWS * TEST_LOOP_TIME_COLS];
+    static int32_t ticks;
+
+    PT_BEGIN(pt);
+
+    tt_uint_op(pbio_control_settings_set_loop_time(&servo->control.settings, loop_time), ==, PBIO_SUCCESS);
+    tt_int_op(pbio_control_settings_get_loop_time(&servo->control.settings), ==, loop_time);
+
+    servo->log.num_values = TEST_LOOP_TIME_COLS;
+    pbio_logger_start(&servo->log, log_buf, TEST_LOOP_TIME_ROWS, 1);
+
+    for (ticks = 0; ticks < (TEST_LOOP_TIME_ROWS - 1) * loop_time; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+
+    // The first update may still happen at the previous loop time
+    tt_int_op(pbio_logger_rows(&servo->log), >=, TEST_LOOP_TIME_ROWS - 2);
+
+    // After that, updates are exactly one loop time apart
+    for (int i = 2; i < pbio_logger_rows(&servo->log); i++) {
+        tt_int_op(log_buf[i * TEST_LOOP_TIME_COLS] - log_buf[(i - 1) * TEST_LOOP_TIME_COLS], ==, loop_time);
+    }
+
+end:
+    pbio_logger_stop(&servo->log);
+
+    PT_END(pt);
+}
+
+PT_THREAD(test_servo_loop_time(struct pt *pt)) {
+    static struct pt child;
+    static pbio_servo_t *servo;
+
+    PT_BEGIN(pt);
+
+    process_start(&pbio_motor_process, NULL);
+    tt_want(process_is_running(&pbio_motor_process));
+
+    tt_uint_op(pbio_motor_process_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    pbio_servo_set_connected(servo, true);
+
+    tt_int_op(pbio_control_settings_get_loop_time(&servo->control.settings), ==, PBIO_CONTROL_LOOP_TIME_MS);
+    tt_uint_op(pbio_control_settings_set_loop_time(&servo->control.settings, PBIO_CONTROL_LOOP_TIME_MIN_MS - 1), ==, PBIO_ERROR_INVALID_ARG);
+    tt_uint_op(pbio_control_settings_set_loop_time(&servo->control.settings, PBIO_CONTROL_LOOP_TIME_MAX_MS + 1), ==, PBIO_ERROR_INVALID_ARG);
+
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+
+    PT_SPAWN(pt, &child, test_servo_loop_time_func(&child, servo, 20));
+    PT_SPAWN(pt, &child, test_servo_loop_time_func(&child, servo, PBIO_CONTROL_LOOP_TIME_MIN_MS));
+
+end:
+    PT_END(pt);
+}
+
+PT_THREAD(test_servo_loop_stats(struct pt *pt)) {
+    static pbio_servo_t *servo;
+    static int32_t ticks;
+    uint32_t updates, overruns;
+    int32_t jitter, latency;
+
+    PT_BEGIN(pt);
+
+    process_start(&pbio_motor_process, NULL);
+    tt_want(process_is_running(&pbio_motor_process));
+
+    tt_uint_op(pbio_motor_process_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    pbio_servo_set_connected(servo, true);
+
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+
+    // Updates on every loop time have no jitter and no overruns
+    for (ticks = 0; ticks < 100 * PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    pbio_control_get_loop_stats(&servo->control, &updates, &overruns, &jitter, &latency);
+    tt_uint_op(updates, >=, 99);
+    tt_uint_op(overruns, ==, 0);
+    tt_int_op(jitter, ==, 0);
+
+    // Skip two updates
+    clock_tick(3 * PBIO_CONTROL_LOOP_TIME_MS);
+    PT_YIELD(pt);
+    pbio_control_get_loop_stats(&servo->control, &updates, &overruns, &jitter, &latency);
+    tt_uint_op(overruns, ==, 1);
+    tt_int_op(jitter, >=, 2 * PBIO_CONTROL_LOOP_TIME_MS * US_PER_MS);
+
+    // Let the updates get back in phase, then count from zero again
+    for (ticks = 0; ticks < 2 * PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    pbio_control_reset_loop_stats(&servo->control);
+    for (ticks = 0; ticks < 10 * PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    pbio_control_get_loop_stats(&servo->control, &updates, &overruns, &jitter, &latency);
+    tt_uint_op(updates, ==, 10);
+    tt_uint_op(overruns, ==, 0);
+    tt_int_op(jitter, ==, 0);
+
+    // Stopping does not count as an overrun when control starts again
+    tt_uint_op(pbio_servo_stop(servo, PBIO_ACTUATION_COAST), ==, PBIO_SUCCESS);
+    clock_tick(10 * PBIO_CONTROL_LOOP_TIME_MS);
+    PT_YIELD(pt);
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    for (ticks = 0; ticks < 10 * PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    pbio_control_get_loop_stats(&servo->control, &updates, &overruns, &jitter, &latency);
+    tt_uint_op(overruns, ==, 0);
+    tt_int_op(jitter, ==, 0);
+
+end:
+    PT_END(pt);
+}
+
+PT_THREAD(test_servo_commands(struct pt *pt)) {
+    static pbio_servo_t *servo;
+    static int32_t ticks;
+    uint32_t updates, overruns;
+    int32_t jitter, latency;
+
+    PT_BEGIN(pt);
+
+    process_start(&pbio_motor_process, NULL);
+    tt_want(process_is_running(&pbio_motor_process));
+
+    tt_uint_op(pbio_motor_process_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    pbio_servo_set_connected(servo, true);
+
+    // Commands are queued until the next update, and the maneuver is not
+    // done while they are pending
+    tt_want(pbio_control_is_done(&servo->control));
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    tt_want_int_op(servo->control.type, ==, PBIO_CONTROL_NONE);
+    tt_want(!pbio_control_is_done(&servo->control));
+    for (ticks = 1; ticks < PBIO_COMMAND_QUEUE_SIZE; ticks++) {
+        tt_uint_op(pbio_servo_track_target(servo, ticks), ==, PBIO_SUCCESS);
+    }
+    tt_uint_op(pbio_servo_track_target(servo, 0), ==, PBIO_ERROR_AGAIN);
+
+    // Arguments are checked right away
+    tt_uint_op(pbio_servo_run_time(servo, 500, -1, PBIO_ACTUATION_COAST), ==, PBIO_ERROR_INVALID_ARG);
+    tt_uint_op(pbio_servo_run_target(servo, 0, 90, PBIO_ACTUATION_COAST), ==, PBIO_ERROR_INVALID_ARG);
+
+    // All pending commands are applied on the next update
+    for (ticks = 0; ticks < PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_want_int_op(servo->control.type, ==, PBIO_CONTROL_ANGLE);
+    tt_want_int_op(servo->control.trajectory.th3, ==, PBIO_COMMAND_QUEUE_SIZE - 1);
+    pbio_control_get_loop_stats(&servo->control, &updates, &overruns, &jitter, &latency);
+    tt_int_op(latency, >, 0);
+    tt_int_op(latency, <=, PBIO_CONTROL_LOOP_TIME_MS * US_PER_MS);
+
+    // A command that fails when it is applied stops the servo, and its own
+    // result is the error
+    tt_uint_op(pbio_servo_run_angle(servo, 1, DURATION_MAX_S * 2, PBIO_ACTUATION_COAST), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_command_queue_get_result(&servo->commands), ==, PBIO_ERROR_AGAIN);
+    for (ticks = 0; ticks < PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_want_int_op(servo->control.type, ==, PBIO_CONTROL_NONE);
+    tt_uint_op(pbio_command_queue_get_result(&servo->commands), ==, PBIO_ERROR_INVALID_ARG);
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    for (ticks = 0; ticks < PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_uint_op(pbio_command_queue_get_result(&servo->commands), ==, PBIO_SUCCESS);
+
+    // The error of the failed command is kept for the sender, even though a
+    // later command succeeded, and is reported only once
+    tt_uint_op(pbio_command_queue_take_error(&servo->commands), ==, PBIO_ERROR_INVALID_ARG);
+    tt_uint_op(pbio_command_queue_take_error(&servo->commands), ==, PBIO_SUCCESS);
+
+    // Commands to a servo that was disconnected in the meantime fail
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    pbio_servo_set_connected(servo, false);
+    for (ticks = 0; ticks < PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_uint_op(pbio_command_queue_get_result(&servo->commands), ==, PBIO_ERROR_NO_DEV);
+    tt_uint_op(pbio_command_queue_take_error(&servo->commands), ==, PBIO_ERROR_NO_DEV);
+    pbio_servo_set_connected(servo, true);
+
+    // Servos in use by a drivebase take no commands
+    servo->claimed = true;
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_ERROR_INVALID_OP);
+    servo->claimed = false;
+
+    // Setting up again discards pending commands
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    tt_want(pbio_control_is_done(&servo->control));
+
+end:
+    PT_END(pt);
+}
+
+PT_THREAD(test_servo_queue_target(struct pt *pt)) {
+    static pbio_servo_t *servo;
+    static int32_t ticks;
+    static int32_t count_max;
+    static bool stopped_on_the_way;
+
+    PT_BEGIN(pt);
+
+    process_start(&pbio_motor_process, NULL);
+    tt_want(process_is_running(&pbio_motor_process));
+
+    pbio_test_counter_set_count(0);
+    pbio_test_counter_set_rate(0);
+    tt_uint_op(pbio_motor_process_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    pbio_servo_set_connected(servo, true);
+
+    // Go through 90 and 180 to 360 without stopping, then back to 0
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 90, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 180, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 360, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 0, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 0, PBIO_ACTUATION_HOLD), ==, PBIO_ERROR_AGAIN);
+    tt_uint_op(pbio_servo_queue_target(servo, 0, 0, PBIO_ACTUATION_HOLD), ==, PBIO_ERROR_INVALID_ARG);
+
+    count_max = 0;
+    stopped_on_the_way = false;
+    for (ticks = 0; ticks < 10000 && !pbio_control_is_done(&servo->control); ticks++) {
+        // The motor follows the reference exactly
+        int32_t time_ref = pbio_control_get_ref_time(&servo->control, clock_usecs());
+        int32_t count_ref, count_ref_ext, rate_ref, acceleration_ref;
+        pbio_trajectory_get_reference(&servo->control.trajectory, time_ref, &count_ref, &count_ref_ext, &rate_ref, &acceleration_ref);
+        if (servo->control.type != PBIO_CONTROL_NONE) {
+            pbio_test_counter_set_count(count_ref);
+            pbio_test_counter_set_rate(rate_ref);
+        }
+
+        // The intermediate targets are passed at speed
+        int32_t count_first = pbio_control_user_to_counts(&servo->control.settings, 45);
+        int32_t count_last = pbio_control_user_to_counts(&servo->control.settings, 315);
+        if (count_max < count_last && count_ref > count_first && rate_ref <= 0) {
+            stopped_on_the_way = true;
+        }
+        count_max = max(count_max, count_ref);
+
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+
+    tt_want(!stopped_on_the_way);
+    tt_want(pbio_control_is_done(&servo->control));
+    tt_want_int_op(count_max, ==, pbio_control_user_to_counts(&servo->control.settings, 360));
+    tt_want_int_op(servo->control.trajectory.th3, ==, 0);
+
+    // Starting another maneuver discards the queue
+    tt_uint_op(pbio_servo_run_target(servo, 500, 90, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 180, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    for (ticks = 0; ticks < PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_want_int_op(servo->control.type, ==, PBIO_CONTROL_TIMED);
+    tt_want_int_op(servo->control.segments.reserved, ==, servo->control.segments.started);
+
+    // Queued maneuvers that fail release their segments, and the sender gets
+    // the error afterwards
+    tt_uint_op(pbio_command_queue_take_error(&servo->commands), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 180, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 360, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    pbio_servo_set_connected(servo, false);
+    for (ticks = 0; ticks < PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_want_int_op(servo->control.segments.reserved, ==, servo->control.segments.started);
+    tt_uint_op(pbio_command_queue_take_error(&servo->commands), ==, PBIO_ERROR_NO_DEV);
+    pbio_servo_set_connected(servo, true);
+
+end:
+    PT_END(pt);
+}
+
+PT_THREAD(test_servo_motor_group(struct pt *pt)) {
+    static pbio_motor_group_t *group;
+    static pbio_servo_t *servos[2];
+    static int32_t ticks;
+    static int32_t target = 180;
+
+    PT_BEGIN(pt);
+
+    process_start(&pbio_motor_process, NULL);
+    tt_want(process_is_running(&pbio_motor_process));
+
+    pbio_test_counter_set_count(0);
+    pbio_test_counter_set_rate(0);
+    tt_uint_op(pbio_motor_process_get_servo(PBIO_PORT_A, &servos[0]), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servos[0], PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    pbio_servo_set_connected(servos[0], true);
+    servos[1] = servos[0];
+
+    // Each servo can be in the group only once
+    tt_uint_op(pbio_motor_process_get_motor_group(&group), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motor_group_run_target(group, 500, &target, PBIO_ACTUATION_HOLD), ==, PBIO_ERROR_NO_DEV);
+    tt_uint_op(pbio_motor_group_setup(group, servos, 0), ==, PBIO_ERROR_INVALID_ARG);
+    tt_uint_op(pbio_motor_group_setup(group, servos, 2), ==, PBIO_ERROR_INVALID_ARG);
+    tt_uint_op(pbio_motor_group_setup(group, servos, 1), ==, PBIO_SUCCESS);
+    tt_want(pbio_motor_group_has_servo(group, servos[0]));
+
+    // The group is in use, and its servos take no commands of their own
+    tt_uint_op(pbio_motor_group_setup(group, servos, 1), ==, PBIO_ERROR_BUSY);
+    tt_uint_op(pbio_servo_run(servos[0], 500), ==, PBIO_ERROR_INVALID_OP);
+
+    // The group updates the servo and takes it to its target
+    tt_uint_op(pbio_motor_group_run_target(group, 500, &target, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motor_group_run_target(group, 0, &target, PBIO_ACTUATION_HOLD), ==, PBIO_ERROR_INVALID_ARG);
+    tt_want(!pbio_motor_group_is_done(group));
+    for (ticks = 0; ticks < 10000 && !pbio_motor_group_is_done(group); ticks++) {
+        // The motor follows the reference exactly
+        pbio_control_t *ctl = &servos[0]->control;
+        int32_t count_ref, count_ref_ext, rate_ref, acceleration_ref;
+        pbio_trajectory_get_reference(&ctl->trajectory, pbio_control_get_ref_time(ctl, clock_usecs()), &count_ref, &count_ref_ext, &rate_ref, &acceleration_ref);
+        if (ctl->type != PBIO_CONTROL_NONE) {
+            pbio_test_counter_set_count(count_ref);
+            pbio_test_counter_set_rate(rate_ref);
+        }
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_want(pbio_motor_group_is_done(group));
+    tt_want_int_op(servos[0]->control.trajectory.th3, ==, pbio_control_user_to_counts(&servos[0]->control.settings, target));
+
+    // Servos in use by a drivebase make the group stop
+    servos[0]->claimed = true;
+    tt_uint_op(pbio_motor_group_stop(group, PBIO_ACTUATION_COAST), ==, PBIO_SUCCESS);
+    for (ticks = 0; ticks < PBIO_CONTROL_LOOP_TIME_MS; ticks++) {
+        clock_tick(1);
+        PT_YIELD(pt);
+    }
+    tt_uint_op(pbio_command_queue_get_result(&group->commands), ==, PBIO_ERROR_INVALID_OP);
+    servos[0]->claimed = false;
+
+    // Resetting the motors releases the servo
+    pbio_motor_process_reset();
+    tt_want(!pbio_motor_group_has_servo(group, servos[0]));
+    tt_want(!servos[0]->grouped);
+
+end:
+    PT_END(pt);
+}
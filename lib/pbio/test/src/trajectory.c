@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <pbio/trajectory.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+// Time step between samples of the reference (us)
+#define STEP (US_PER_MS)
+
+// Checks that the reference of an S-curve changes smoothly and respects the
+// acceleration and jerk limits
+static void check_s_curve(pbio_trajectory_t *traject, int32_t a, int32_t j) {
+    int32_t count, count_ext, rate, acceleration;
+    int32_t rate_prev = traject->w0;
+    int32_t acceleration_prev = 0;
+
+    for (int32_t time = traject->t0; time - traject->t3 <= 0; time += STEP) {
+        pbio_trajectory_get_reference(traject, time, &count, &count_ext, &rate, &acceleration);
+        tt_want_int_op(abs(acceleration), <=, a);
+        // Allow for round-off of the rate between samples
+        tt_want_int_op(abs(rate - rate_prev), <=, timest(a, STEP) + 1);
+        tt_want_int_op(abs(acceleration - acceleration_prev), <=, timest(j, STEP) + 20);
+        rate_prev = rate;
+        acceleration_prev = acceleration;
+    }
+}
+
+void test_trajectory_s_curve(void *env) {
+    pbio_trajectory_t traject;
+    int32_t count, count_ext, rate, acceleration;
+
+    // Zero jerk gives the trapezoidal profile with a step in acceleration
+    tt_want_int_op(pbio_trajectory_make_angle_based(&traject, 0, 0, 3600, 0, 1000, 2000, 2000, 2000, 0), ==, PBIO_SUCCESS);
+    tt_want_int_op(traject.tj, ==, 0);
+    pbio_trajectory_get_reference(&traject, STEP, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(acceleration, ==, 2000);
+
+    // The S-curve ramps up the acceleration over a / j = 0.1 s instead, so
+    // it takes that much longer
+    int32_t t3 = traject.t3;
+    tt_want_int_op(pbio_trajectory_make_angle_based(&traject, 0, 0, 3600, 0, 1000, 2000, 2000, 2000, 20000), ==, PBIO_SUCCESS);
+    tt_want_int_op(traject.tj, ==, 100 * US_PER_MS);
+    tt_want_int_op(traject.t0, ==, 0);
+    tt_want_int_op(traject.t3, ==, t3 + traject.tj);
+    pbio_trajectory_get_reference(&traject, STEP, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(acceleration, ==, 20);
+    check_s_curve(&traject, 2000, 20000);
+
+    // It ends exactly at the target
+    pbio_trajectory_get_reference(&traject, traject.t3, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(count, ==, 3600);
+    tt_want_int_op(count_ext, ==, 0);
+    tt_want_int_op(rate, ==, 0);
+    tt_want_int_op(acceleration, ==, 0);
+
+    // Starting from a nonzero speed, it starts where and how fast it was told
+    tt_want_int_op(pbio_trajectory_make_angle_based(&traject, 1000, -500, -3600, -500, 1000, 2000, 2000, 2000, 20000), ==, PBIO_SUCCESS);
+    pbio_trajectory_get_reference(&traject, 1000, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(count, ==, -500);
+    tt_want_int_op(rate, ==, -500);
+    check_s_curve(&traject, 2000, 20000);
+    pbio_trajectory_get_reference(&traject, traject.t3, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(count, ==, -3600);
+    tt_want_int_op(rate, ==, 0);
+
+    // Timed maneuvers take the given duration, including the ramps
+    tt_want_int_op(pbio_trajectory_make_time_based(&traject, 0, US_PER_SECOND, 100, 0, 0, 500, 2000, 2000, 2000, 20000), ==, PBIO_SUCCESS);
+    tt_want_int_op(traject.t3 - traject.t0, ==, US_PER_SECOND);
+    pbio_trajectory_get_reference(&traject, 0, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(count, ==, 100);
+    tt_want_int_op(rate, ==, 0);
+    check_s_curve(&traject, 2000, 20000);
+    pbio_trajectory_get_reference(&traject, US_PER_SECOND, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(rate, ==, 0);
+    tt_want_int_op(acceleration, ==, 0);
+}
+
+void test_trajectory_scaled(void *env) {
+    pbio_trajectory_t lead, traject;
+    int32_t lead_count, lead_rate, count, count_ext, rate, acceleration;
+
+    for (int32_t j = 0; j <= 20000; j += 20000) {
+        // A third of the distance back, on another time axis, takes just as long
+        tt_want_int_op(pbio_trajectory_make_angle_based(&lead, 0, 0, 3600, 0, 1000, 2000, 2000, 2000, j), ==, PBIO_SUCCESS);
+        pbio_trajectory_make_scaled(&traject, &lead, 5000, 100, -1200, 3600);
+        tt_want_int_op(traject.t3 - traject.t0, ==, lead.t3 - lead.t0);
+
+        // All along the way, it is where the lead is, scaled. Both counts are
+        // rounded, so they may be apart by up to two.
+        for (int32_t time = 0; time - lead.t3 <= 0; time += STEP) {
+            pbio_trajectory_get_reference(&lead, time, &lead_count, &count_ext, &lead_rate, &acceleration);
+            pbio_trajectory_get_reference(&traject, 5000 + time, &count, &count_ext, &rate, &acceleration);
+            tt_want_int_op(abs(count - (100 - lead_count / 3)), <=, 2);
+            tt_want_int_op(abs(rate + lead_rate / 3), <=, 1);
+        }
+
+        // And it ends exactly at its own target
+        pbio_trajectory_get_reference(&traject, traject.t3, &count, &count_ext, &rate, &acceleration);
+        tt_want_int_op(count, ==, -1100);
+        tt_want_int_op(rate, ==, 0);
+    }
+}
@@ -35,16 +35,45 @@ static struct {
     struct etimer tx_timer;
     uint8_t tx_msg_length;
     pbio_error_t tx_msg_result;
+    #if PBDRV_CONFIG_UART_READ_AVAILABLE
+    uint8_t rx_available[64];
+    uint8_t rx_available_length;
+    bool rx_available_polled;
+    #endif
 } test_uart_dev;
 
+#if PBDRV_CONFIG_UART_READ_AVAILABLE
+// Makes bytes available to pbdrv_uart_read_available(), as if they were
+// received in the background
+static void simulate_rx_available(const uint8_t *data, uint8_t length) {
+    assert(test_uart_dev.rx_available_length + length <= sizeof(test_uart_dev.rx_available));
+    memcpy(&test_uart_dev.rx_available[test_uart_dev.rx_available_length], data, length);
+    test_uart_dev.rx_available_length += length;
+    process_poll(&pbio_uartdev_process);
+}
+#endif
+
 PT_THREAD(simulate_rx_msg(struct pt *pt, const uint8_t *msg, uint8_t length, bool *ok)) {
     PT_BEGIN(pt);
 
     // First uartdev reads one byte header
     PT_WAIT_UNTIL(pt, {
         clock_tick(1);
+        #if PBDRV_CONFIG_UART_READ_AVAILABLE
+        test_uart_dev.rx_available_polled ||
+        #endif
         test_uart_dev.rx_msg_result == PBIO_ERROR_AGAIN;
     });
+
+    #if PBDRV_CONFIG_UART_READ_AVAILABLE
+    // Data messages are read as they come in, whole or in pieces
+    if (test_uart_dev.rx_available_polled) {
+        simulate_rx_available(msg, length);
+        *ok = true;
+        PT_EXIT(pt);
+    }
+    #endif
+
     tt_uint_op(test_uart_dev.rx_msg_length, ==, 1);
     memcpy(test_uart_dev.rx_msg, msg, 1);
     test_uart_dev.rx_msg_result = PBIO_SUCCESS;
@@ -211,6 +240,10 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     static const uint8_t msg90[] = { 0x46, 0x08, 0xB1 }; // extened mode info
     static const uint8_t msg91[] = { 0xD0, 0x00, 0x00, 0x00, 0x00, 0x2F }; // mode 8 data
 
+    static const uint8_t msg92[] = { 0x5C, 0x24, 0x00, 0x10, 0x60, 0x61, 0x62, 0x00, 0x00, 0xF4 }; // combo modes 1 and 6
+    static const uint8_t msg93[] = { 0x4C, 0x24, 0x00, 0x97 }; // combo accepted
+    static const uint8_t msg94[] = { 0xD9, 0x05, 0x10, 0x00, 0x20, 0x00, 0x30, 0x00, 0x00, 0x23 }; // combo data
+
     // used in SIMULATE_RX/TX_MSG macros
     static struct pt child;
     static bool ok;
@@ -586,6 +619,10 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     tt_uint_op(pbio_iodev_set_mode_end(iodev), ==, PBIO_ERROR_AGAIN);
     tt_uint_op(iodev->mode, !=, 1);
 
+    static uint32_t seq, time;
+    tt_uint_op(pbio_iodev_get_data_seq(iodev, &seq, &time), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_iodev_wait_newer_data(iodev, seq), ==, PBIO_ERROR_AGAIN);
+
     // data message with new mode
     SIMULATE_RX_MSG(msg88);
 
@@ -596,6 +633,11 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     tt_uint_op(err, ==, PBIO_SUCCESS);
     tt_uint_op(iodev->mode, ==, 1);
 
+    // the new data is timestamped and counted
+    tt_uint_op(pbio_iodev_wait_newer_data(iodev, seq), ==, PBIO_SUCCESS);
+    tt_uint_op(iodev->data_seq, ==, seq + 1);
+    tt_uint_op(iodev->data_time, >, time);
+
 
     // also do mode 8 since it requires the extended mode flag
 
@@ -623,6 +665,58 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     tt_uint_op(err, ==, PBIO_SUCCESS);
     tt_uint_op(iodev->mode, ==, 8);
 
+
+    // read proximity and RGB values together
+
+    static const uint8_t combo_modes[] = { 1, 6 };
+    uint8_t *data;
+
+    // mode 8 can't be combined
+    static const uint8_t bad_combo_modes[] = { 1, 8 };
+    tt_uint_op(pbio_iodev_set_mode_combo_begin(iodev, bad_combo_modes, 2), ==, PBIO_ERROR_INVALID_ARG);
+
+    PT_WAIT_WHILE(pt, {
+        clock_tick(1);
+        (err = pbio_iodev_set_mode_combo_begin(iodev, combo_modes, 2)) == PBIO_ERROR_AGAIN;
+    });
+    tt_uint_op(err, ==, PBIO_SUCCESS);
+
+    SIMULATE_TX_MSG(msg92);
+
+    // should be blocked since the device has not accepted the combo yet, so
+    // the data is still that of mode 8
+    tt_uint_op(pbio_iodev_set_mode_combo_end(iodev), ==, PBIO_ERROR_AGAIN);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 1, &data), ==, PBIO_ERROR_INVALID_OP);
+
+    // giving up keeps mode 8, and the combo can be set again
+    pbio_iodev_set_mode_combo_cancel(iodev);
+    tt_uint_op(iodev->num_combo_modes, ==, 0);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 1, &data), ==, PBIO_ERROR_INVALID_OP);
+
+    PT_WAIT_WHILE(pt, {
+        clock_tick(1);
+        (err = pbio_iodev_set_mode_combo_begin(iodev, combo_modes, 2)) == PBIO_ERROR_AGAIN;
+    });
+    tt_uint_op(err, ==, PBIO_SUCCESS);
+
+    SIMULATE_TX_MSG(msg92);
+    SIMULATE_RX_MSG(msg93);
+    SIMULATE_RX_MSG(msg94);
+
+    PT_WAIT_WHILE(pt, {
+        clock_tick(1);
+        (err = pbio_iodev_set_mode_combo_end(iodev)) == PBIO_ERROR_AGAIN;
+    });
+    tt_uint_op(err, ==, PBIO_SUCCESS);
+
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 1, &data), ==, PBIO_SUCCESS);
+    tt_uint_op(*(int8_t *)data, ==, 5);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 6, &data), ==, PBIO_SUCCESS);
+    tt_uint_op(data[0] | data[1] << 8, ==, 0x10);
+    tt_uint_op(data[2] | data[3] << 8, ==, 0x20);
+    tt_uint_op(data[4] | data[5] << 8, ==, 0x30);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 0, &data), ==, PBIO_ERROR_INVALID_OP);
+
     PT_YIELD(pt);
 
 end:
@@ -1041,6 +1135,84 @@ PT_THREAD(test_technic_large_motor(struct pt *pt)) {
         SIMULATE_RX_MSG(msg57);
     }
 
+    #if PBIO_CONFIG_UARTDEV_RATE_WINDOW_MS
+    // The motor reports full speed, but the count does not change, so the
+    // rate estimated from the count is zero
+    tt_want_uint_op(pbdrv_counter_get_dev(0, &counter), ==, PBIO_SUCCESS);
+    tt_want_uint_op(pbdrv_counter_get_rate(counter, &count), ==, PBIO_SUCCESS);
+    tt_want_int_op(count, ==, 0);
+
+    // Now the count goes up by 3 for every message. Only the rate estimated
+    // from the count and the arrival times can resolve this.
+    static uint8_t msg_moving[10];
+    static int32_t time_start;
+    for (i = 0; i < 10; i++) {
+        SIMULATE_TX_MSG(msg58);
+        memcpy(msg_moving, msg57, sizeof(msg_moving));
+        msg_moving[1] = 0;
+        msg_moving[2] = 3 * i;
+        msg_moving[3] = msg_moving[4] = msg_moving[5] = 0;
+        msg_moving[9] = 0xFF;
+        for (int j = 0; j < 9; j++) {
+            msg_moving[9] ^= msg_moving[j];
+        }
+        SIMULATE_RX_MSG(msg_moving);
+        if (i == 0) {
+            time_start = clock_usecs();
+        }
+    }
+    PT_YIELD(pt);
+
+    tt_want_uint_op(pbdrv_counter_get_dev(0, &counter), ==, PBIO_SUCCESS);
+    tt_want_uint_op(pbdrv_counter_get_count(counter, &count), ==, PBIO_SUCCESS);
+    tt_want_int_op(count, ==, 27);
+    tt_want_uint_op(pbdrv_counter_get_rate(counter, &count), ==, PBIO_SUCCESS);
+    int32_t rate_expected = (int64_t)27 * 1000000 / (clock_usecs() - time_start);
+    tt_want_int_op(count, >=, rate_expected * 9 / 10);
+    tt_want_int_op(count, <=, rate_expected * 11 / 10);
+    #endif
+
+    #if PBDRV_CONFIG_UART_READ_AVAILABLE
+    // Data messages can also be read in arbitrary pieces as they come in
+    static uint8_t msg_count[10];
+    memcpy(msg_count, msg57, sizeof(msg_count));
+    msg_count[2] = 50;
+    msg_count[3] = msg_count[4] = msg_count[5] = 0;
+    msg_count[9] = 0xFF;
+    for (int j = 0; j < 9; j++) {
+        msg_count[9] ^= msg_count[j];
+    }
+
+    // A message that arrives in two pieces is still parsed as one
+    SIMULATE_TX_MSG(msg58);
+    simulate_rx_available(msg_count, 4);
+    PT_YIELD(pt);
+    tt_want_uint_op(pbdrv_counter_get_count(counter, &count), ==, PBIO_SUCCESS);
+    tt_want_int_op(count, !=, 50);
+    simulate_rx_available(&msg_count[4], sizeof(msg_count) - 4);
+    PT_YIELD(pt);
+    tt_want_uint_op(pbdrv_counter_get_count(counter, &count), ==, PBIO_SUCCESS);
+    tt_want_int_op(count, ==, 50);
+
+    // A stray byte is skipped and a message with a bad checksum is dropped
+    static const uint8_t junk[] = { 0x00 };
+    msg_count[2] = 100;
+    msg_count[9] ^= 50 ^ 100;
+    simulate_rx_available(junk, sizeof(junk));
+    msg_count[9] ^= 0x01;
+    simulate_rx_available(msg_count, sizeof(msg_count));
+    PT_YIELD(pt);
+    tt_want_uint_op(pbdrv_counter_get_count(counter, &count), ==, PBIO_SUCCESS);
+    tt_want_int_op(count, ==, 50);
+
+    // The parser is back in sync for the next good message
+    msg_count[9] ^= 0x01;
+    simulate_rx_available(msg_count, sizeof(msg_count));
+    PT_YIELD(pt);
+    tt_want_uint_op(pbdrv_counter_get_count(counter, &count), ==, PBIO_SUCCESS);
+    tt_want_int_op(count, ==, 100);
+    #endif
+
     static pbio_iodev_t *iodev;
     tt_uint_op(pbio_uartdev_get(0, &iodev), ==, PBIO_SUCCESS);
     tt_want_uint_op(iodev->info->type_id, ==, PBIO_IODEV_TYPE_ID_TECHNIC_L_MOTOR);
@@ -1540,6 +1712,11 @@ pbio_error_t pbdrv_uart_read_begin(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t
         return PBIO_ERROR_AGAIN;
     }
 
+    #if PBDRV_CONFIG_UART_READ_AVAILABLE
+    test_uart_dev.rx_available_length = 0;
+    test_uart_dev.rx_available_polled = false;
+    #endif
+
     test_uart_dev.rx_msg = msg;
     test_uart_dev.rx_msg_length = length;
     test_uart_dev.rx_msg_result = PBIO_ERROR_AGAIN;
@@ -1566,6 +1743,22 @@ void pbdrv_uart_read_cancel(pbdrv_uart_dev_t *uart) {
 
 }
 
+#if PBDRV_CONFIG_UART_READ_AVAILABLE
+pbio_error_t pbdrv_uart_read_available(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t size, uint8_t *length) {
+    if (test_uart_dev.rx_msg) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    *length = test_uart_dev.rx_available_length < size ? test_uart_dev.rx_available_length : size;
+    memcpy(msg, test_uart_dev.rx_available, *length);
+    test_uart_dev.rx_available_length -= *length;
+    memmove(test_uart_dev.rx_available, &test_uart_dev.rx_available[*length], test_uart_dev.rx_available_length);
+    test_uart_dev.rx_available_polled = true;
+
+    return PBIO_SUCCESS;
+}
+#endif
+
 pbio_error_t pbdrv_uart_write_begin(pbdrv_uart_dev_t *uart, uint8_t *msg, uint8_t length, uint32_t timeout) {
     if (test_uart_dev.tx_msg) {
         return PBIO_ERROR_AGAIN;
@@ -1594,5 +1787,5 @@ pbio_error_t pbdrv_uart_write_end(pbdrv_uart_dev_t *uart) {
 }
 
 void pbdrv_uart_write_cancel(pbdrv_uart_dev_t *uart) {
-
+    test_uart_dev.tx_msg = NULL;
 }
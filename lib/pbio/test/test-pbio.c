@@ -115,6 +115,15 @@ static struct testcase_t pbio_color_tests[] = {
     END_OF_TESTCASES
 };
 
+PBIO_TEST_FUNC(test_imu_heading);
+PBIO_TEST_FUNC(test_imu_calibration);
+
+static struct testcase_t pbio_imu_tests[] = {
+    PBIO_TEST(test_imu_heading),
+    PBIO_TEST(test_imu_calibration),
+    END_OF_TESTCASES
+};
+
 PBIO_PT_THREAD_TEST_FUNC(test_light_animation);
 PBIO_PT_THREAD_TEST_FUNC(test_color_light);
 PBIO_PT_THREAD_TEST_FUNC(test_light_matrix);
@@ -128,6 +137,15 @@ static struct testcase_t pbio_light_tests[] = {
     END_OF_TESTCASES
 };
 
+PBIO_TEST_FUNC(test_logger_ring);
+PBIO_TEST_FUNC(test_logger_encode_frame);
+
+static struct testcase_t pbio_logger_tests[] = {
+    PBIO_TEST(test_logger_ring),
+    PBIO_TEST(test_logger_encode_frame),
+    END_OF_TESTCASES
+};
+
 PBIO_TEST_FUNC(test_sqrt);
 PBIO_TEST_FUNC(test_mul_i32_fix16);
 PBIO_TEST_FUNC(test_div_i32_fix16);
@@ -139,12 +157,40 @@ static struct testcase_t pbio_math_tests[] = {
     END_OF_TESTCASES
 };
 
+PBIO_TEST_FUNC(test_observer_fix16);
+PBIO_TEST_FUNC(test_observer_coefficients);
+
+static struct testcase_t pbio_observer_tests[] = {
+    PBIO_TEST(test_observer_fix16),
+    PBIO_TEST(test_observer_coefficients),
+    END_OF_TESTCASES
+};
+
+PBIO_TEST_FUNC(test_trajectory_s_curve);
+PBIO_TEST_FUNC(test_trajectory_scaled);
+
+static struct testcase_t pbio_trajectory_tests[] = {
+    PBIO_TEST(test_trajectory_s_curve),
+    PBIO_TEST(test_trajectory_scaled),
+    END_OF_TESTCASES
+};
+
 PBIO_PT_THREAD_TEST_FUNC(test_servo_run_angle);
 PBIO_PT_THREAD_TEST_FUNC(test_servo_run_time);
+PBIO_PT_THREAD_TEST_FUNC(test_servo_loop_time);
+PBIO_PT_THREAD_TEST_FUNC(test_servo_loop_stats);
+PBIO_PT_THREAD_TEST_FUNC(test_servo_commands);
+PBIO_PT_THREAD_TEST_FUNC(test_servo_queue_target);
+PBIO_PT_THREAD_TEST_FUNC(test_servo_motor_group);
 
 static struct testcase_t pbio_motor_tests[] = {
     PBIO_PT_THREAD_TEST(test_servo_run_angle),
     PBIO_PT_THREAD_TEST(test_servo_run_time),
+    PBIO_PT_THREAD_TEST(test_servo_loop_time),
+    PBIO_PT_THREAD_TEST(test_servo_loop_stats),
+    PBIO_PT_THREAD_TEST(test_servo_commands),
+    PBIO_PT_THREAD_TEST(test_servo_queue_target),
+    PBIO_PT_THREAD_TEST(test_servo_motor_group),
     END_OF_TESTCASES
 };
 
@@ -175,9 +221,13 @@ static struct testgroup_t test_groups[] = {
     { "drv/counter/", pbdrv_counter_tests },
     { "drv/pwm/", pbdrv_pwm_tests },
     { "src/color/", pbio_color_tests },
+    { "src/imu/", pbio_imu_tests },
     { "src/light/", pbio_light_tests },
+    { "src/logger/", pbio_logger_tests },
     { "src/math/", pbio_math_tests },
     { "src/motor/", pbio_motor_tests },
+    { "src/observer/", pbio_observer_tests },
+    { "src/trajectory/", pbio_trajectory_tests },
     { "src/uartdev/", pbio_uartdev_tests, },
     { "sys/status/", pbsys_status_tests, },
     END_OF_GROUPS
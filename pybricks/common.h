@@ -52,7 +52,7 @@ extern const mp_obj_type_t pb_type_Control;
 mp_obj_t common_Control_obj_make_new(pbio_control_t *control);
 
 // pybricks._common.Logger()
-mp_obj_t common_Logger_obj_make_new(pbio_log_t *log, uint8_t num_values);
+mp_obj_t common_Logger_obj_make_new(pbio_log_t *log, uint8_t num_values, pbio_control_settings_t *settings);
 
 // pybricks._common.Motor()
 typedef struct _common_Motor_obj_t {
@@ -6,6 +6,7 @@
 #if PYBRICKS_PY_COMMON_MOTORS
 
 #include <pbio/control.h>
+#include <pbio/motor_process.h>
 
 #include "py/obj.h"
 
@@ -32,7 +33,7 @@ mp_obj_t common_Control_obj_make_new(pbio_control_t *control) {
     self->control = control;
 
     // Create an instance of the Logger class
-    self->logger = common_Logger_obj_make_new(&self->control->log, PBIO_CONTROL_LOG_COLS);
+    self->logger = common_Logger_obj_make_new(&self->control->log, PBIO_CONTROL_LOG_COLS, &self->control->settings);
 
     #if MICROPY_PY_BUILTINS_FLOAT
     self->scale = mp_obj_new_float(fix16_to_float(control->settings.counts_per_unit));
@@ -43,12 +44,29 @@ mp_obj_t common_Control_obj_make_new(pbio_control_t *control) {
     return self;
 }
 
-STATIC void raise_if_control_busy(pbio_control_t *ctl) {
-    if (ctl->type != PBIO_CONTROL_NONE) {
+// Starts a change of the settings. Commands that were already sent decide
+// whether control is active, so this first waits until they are applied. If
+// control is not active, the control loop is deferred until the change is
+// done, so control can't start halfway through. Otherwise, this raises.
+STATIC void begin_settings_change(pbio_control_t *ctl) {
+    while (ctl->commands && !pbio_command_queue_is_empty(ctl->commands)) {
+        pb_wait_for_command_queue();
+    }
+
+    pbio_motor_process_defer_begin();
+
+    if (ctl->type != PBIO_CONTROL_NONE || (ctl->commands && !pbio_command_queue_is_empty(ctl->commands))) {
+        pbio_motor_process_defer_end();
         pb_assert(PBIO_ERROR_INVALID_OP);
     }
 }
 
+// Lets the control loop run again and raises if the change failed
+STATIC void end_settings_change(pbio_error_t err) {
+    pbio_motor_process_defer_end();
+    pb_assert(err);
+}
+
 // pybricks._common.Control.limits
 STATIC mp_obj_t common_Control_limits(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
 
@@ -73,21 +91,42 @@ STATIC mp_obj_t common_Control_limits(size_t n_args, const mp_obj_t *pos_args, m
         return mp_obj_new_tuple(4, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     speed = pb_obj_get_default_int(speed_in, speed);
     acceleration = pb_obj_get_default_int(acceleration_in, acceleration);
     duty = pb_obj_get_default_int(duty_in, duty);
     torque = pb_obj_get_default_int(torque_in, torque);
 
-    pb_assert(pbio_control_settings_set_limits(&self->control->settings, speed, acceleration, duty, torque));
+    begin_settings_change(self->control);
+    end_settings_change(pbio_control_settings_set_limits(&self->control->settings, speed, acceleration, duty, torque));
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Control_limits_obj, 1, common_Control_limits);
 
+// pybricks._common.Control.jerk
+STATIC mp_obj_t common_Control_jerk(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        common_Control_obj_t, self,
+        PB_ARG_DEFAULT_NONE(jerk));
+
+    // If no value is given, return current value
+    if (jerk_in == mp_const_none) {
+        int32_t jerk;
+        pbio_control_settings_get_jerk(&self->control->settings, &jerk);
+        return mp_obj_new_int(jerk);
+    }
+
+    int32_t jerk = pb_obj_get_int(jerk_in);
+
+    begin_settings_change(self->control);
+    end_settings_change(pbio_control_settings_set_jerk(&self->control->settings, jerk));
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Control_jerk_obj, 1, common_Control_jerk);
+
 // pybricks._common.Control.pid
 STATIC mp_obj_t common_Control_pid(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
 
@@ -116,9 +155,6 @@ STATIC mp_obj_t common_Control_pid(size_t n_args, const mp_obj_t *pos_args, mp_m
         return mp_obj_new_tuple(5, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     kp = pb_obj_get_default_int(kp_in, kp);
     ki = pb_obj_get_default_int(ki_in, ki);
@@ -126,7 +162,8 @@ STATIC mp_obj_t common_Control_pid(size_t n_args, const mp_obj_t *pos_args, mp_m
     integral_range = pb_obj_get_default_int(integral_range_in, integral_range);
     integral_rate = pb_obj_get_default_int(integral_rate_in, integral_rate);
 
-    pb_assert(pbio_control_settings_set_pid(&self->control->settings, kp, ki, kd, integral_range, integral_rate));
+    begin_settings_change(self->control);
+    end_settings_change(pbio_control_settings_set_pid(&self->control->settings, kp, ki, kd, integral_range, integral_rate));
 
     return mp_const_none;
 }
@@ -152,14 +189,12 @@ STATIC mp_obj_t common_Control_target_tolerances(size_t n_args, const mp_obj_t *
         return mp_obj_new_tuple(2, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     speed = pb_obj_get_default_int(speed_in, speed);
     position = pb_obj_get_default_int(position_in, position);
 
-    pb_assert(pbio_control_settings_set_target_tolerances(&self->control->settings, speed, position));
+    begin_settings_change(self->control);
+    end_settings_change(pbio_control_settings_set_target_tolerances(&self->control->settings, speed, position));
 
     return mp_const_none;
 }
@@ -185,19 +220,64 @@ STATIC mp_obj_t common_Control_stall_tolerances(size_t n_args, const mp_obj_t *p
         return mp_obj_new_tuple(2, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     speed = pb_obj_get_default_int(speed_in, speed);
     time = pb_obj_get_default_int(time_in, time);
 
-    pb_assert(pbio_control_settings_set_stall_tolerances(&self->control->settings, speed, time));
+    begin_settings_change(self->control);
+    end_settings_change(pbio_control_settings_set_stall_tolerances(&self->control->settings, speed, time));
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Control_stall_tolerances_obj, 1, common_Control_stall_tolerances);
 
+// pybricks._common.Control.loop_time
+STATIC mp_obj_t common_Control_loop_time(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        common_Control_obj_t, self,
+        PB_ARG_DEFAULT_NONE(time));
+
+    // If no value is given, return current value
+    if (time_in == mp_const_none) {
+        return mp_obj_new_int(pbio_control_settings_get_loop_time(&self->control->settings));
+    }
+
+    int32_t time = pb_obj_get_int(time_in);
+
+    begin_settings_change(self->control);
+    end_settings_change(pbio_control_settings_set_loop_time(&self->control->settings, time));
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Control_loop_time_obj, 1, common_Control_loop_time);
+
+// pybricks._common.Control.loop_stats
+STATIC mp_obj_t common_Control_loop_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        common_Control_obj_t, self,
+        PB_ARG_DEFAULT_FALSE(reset));
+
+    // Read current values
+    uint32_t updates, overruns;
+    int32_t jitter, latency;
+    pbio_control_get_loop_stats(self->control, &updates, &overruns, &jitter, &latency);
+
+    // Start counting from zero if requested
+    if (mp_obj_is_true(reset_in)) {
+        pbio_control_reset_loop_stats(self->control);
+    }
+
+    mp_obj_t ret[4];
+    ret[0] = mp_obj_new_int_from_uint(updates);
+    ret[1] = mp_obj_new_int_from_uint(overruns);
+    ret[2] = mp_obj_new_int(jitter);
+    ret[3] = mp_obj_new_int(latency);
+    return mp_obj_new_tuple(4, ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Control_loop_stats_obj, 1, common_Control_loop_stats);
+
 // pybricks._common.Control.trajectory
 STATIC mp_obj_t common_Control_trajectory(mp_obj_t self_in) {
     common_Control_obj_t *self = MP_OBJ_TO_PTR(self_in);
@@ -229,7 +309,11 @@ MP_DEFINE_CONST_FUN_OBJ_1(common_Control_trajectory_obj, common_Control_trajecto
 // pybricks._common.Control.done
 STATIC mp_obj_t common_Control_done(mp_obj_t self_in) {
     common_Control_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    return mp_obj_new_bool(pbio_control_is_done(self->control));
+    bool done = pbio_control_is_done(self->control);
+    if (self->control->commands) {
+        pb_assert_command_error(self->control->commands);
+    }
+    return mp_obj_new_bool(done);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(common_Control_done_obj, common_Control_done);
 
@@ -243,9 +327,12 @@ MP_DEFINE_CONST_FUN_OBJ_1(common_Control_stalled_obj, common_Control_stalled);
 // dir(pybricks.common.Control)
 STATIC const mp_rom_map_elem_t common_Control_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_limits), MP_ROM_PTR(&common_Control_limits_obj) },
+    { MP_ROM_QSTR(MP_QSTR_jerk), MP_ROM_PTR(&common_Control_jerk_obj) },
     { MP_ROM_QSTR(MP_QSTR_pid), MP_ROM_PTR(&common_Control_pid_obj) },
     { MP_ROM_QSTR(MP_QSTR_target_tolerances), MP_ROM_PTR(&common_Control_target_tolerances_obj) },
     { MP_ROM_QSTR(MP_QSTR_stall_tolerances), MP_ROM_PTR(&common_Control_stall_tolerances_obj) },
+    { MP_ROM_QSTR(MP_QSTR_loop_time), MP_ROM_PTR(&common_Control_loop_time_obj) },
+    { MP_ROM_QSTR(MP_QSTR_loop_stats), MP_ROM_PTR(&common_Control_loop_stats_obj) },
     { MP_ROM_QSTR(MP_QSTR_trajectory), MP_ROM_PTR(&common_Control_trajectory_obj) },
     { MP_ROM_QSTR(MP_QSTR_done), MP_ROM_PTR(&common_Control_done_obj) },
     { MP_ROM_QSTR(MP_QSTR_stalled), MP_ROM_PTR(&common_Control_stalled_obj) },
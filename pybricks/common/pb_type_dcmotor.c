@@ -71,7 +71,7 @@ STATIC mp_obj_t common_DCMotor_duty(size_t n_args, const mp_obj_t *pos_args, mp_
 
     if (is_servo) {
         common_Motor_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
-        pb_assert(pbio_servo_set_duty_cycle(self->srv, duty * 100));
+        pb_assert_send(&self->srv->commands, pbio_servo_set_duty_cycle(self->srv, duty * 100));
     } else {
         common_DCMotor_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
         pb_assert(pbio_dcmotor_set_duty_cycle_usr(self->dcmotor, duty * 100));
@@ -90,7 +90,7 @@ STATIC mp_obj_t common_DCMotor_stop(mp_obj_t self_in) {
 
     if (is_servo) {
         common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
-        pb_assert(pbio_servo_stop(self->srv, PBIO_ACTUATION_COAST));
+        pb_assert_send(&self->srv->commands, pbio_servo_stop(self->srv, PBIO_ACTUATION_COAST));
     } else {
         common_DCMotor_obj_t *self = MP_OBJ_TO_PTR(self_in);
         pb_assert(pbio_dcmotor_coast(self->dcmotor));
@@ -108,7 +108,7 @@ STATIC mp_obj_t common_DCMotor_brake(mp_obj_t self_in) {
 
     if (is_servo) {
         common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
-        pb_assert(pbio_servo_stop(self->srv, PBIO_ACTUATION_BRAKE));
+        pb_assert_send(&self->srv->commands, pbio_servo_stop(self->srv, PBIO_ACTUATION_BRAKE));
     } else {
         common_DCMotor_obj_t *self = MP_OBJ_TO_PTR(self_in);
         #if PYBRICKS_PY_EV3DEVICES
@@ -9,6 +9,8 @@
 
 #include <lsm6ds3tr_c_reg.h>
 
+#include <pbio/imu.h>
+
 #include <pybricks/common.h>
 #include <pybricks/geometry.h>
 #include <pybricks/parameters.h>
@@ -16,6 +18,7 @@
 #include <pybricks/util_pb/pb_imu.h>
 #include <pybricks/util_pb/pb_error.h>
 #include <pybricks/util_mp/pb_kwarg_helper.h>
+#include <pybricks/util_mp/pb_obj_helper.h>
 
 typedef struct _common_IMU_obj_t {
     mp_obj_base_t base;
@@ -176,12 +179,68 @@ STATIC mp_obj_t common_IMU_angular_velocity(size_t n_args, const mp_obj_t *pos_a
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_IMU_angular_velocity_obj, 1, common_IMU_angular_velocity);
 
+// pybricks._common.IMU.samples
+STATIC mp_obj_t common_IMU_samples(mp_obj_t self_in) {
+    common_IMU_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    // Get all samples since the previous call, a few at a time to keep the
+    // stack small. Each is a tuple of the time (us), the acceleration and the
+    // angular velocity.
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    pb_imu_sample_t samples[8];
+    size_t count;
+    while ((count = pb_imu_read_samples(self->imu_dev, samples, MP_ARRAY_SIZE(samples))) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            common_IMU_rotate_3d_axis(self, samples[i].accel);
+            common_IMU_rotate_3d_axis(self, samples[i].gyro);
+            mp_obj_t values[] = {
+                mp_obj_new_int_from_uint(samples[i].time),
+                mp_obj_new_float_from_f(samples[i].accel[0]),
+                mp_obj_new_float_from_f(samples[i].accel[1]),
+                mp_obj_new_float_from_f(samples[i].accel[2]),
+                mp_obj_new_float_from_f(samples[i].gyro[0]),
+                mp_obj_new_float_from_f(samples[i].gyro[1]),
+                mp_obj_new_float_from_f(samples[i].gyro[2]),
+            };
+            mp_obj_list_append(list, mp_obj_new_tuple(MP_ARRAY_SIZE(values), values));
+        }
+    }
+    return list;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(common_IMU_samples_obj, common_IMU_samples);
+
+// pybricks._common.IMU.heading
+STATIC mp_obj_t common_IMU_heading(mp_obj_t self_in) {
+    // The heading is kept up to date in the background, so just read it
+    pbio_imu_t *imu;
+    pbio_imu_get_imu(&imu);
+    int32_t heading, heading_rate;
+    pbio_imu_get_heading(imu, &heading, &heading_rate);
+    return mp_obj_new_float_from_f(heading / 1000.0f);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(common_IMU_heading_obj, common_IMU_heading);
+
+// pybricks._common.IMU.reset_heading
+STATIC mp_obj_t common_IMU_reset_heading(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_METHOD_SKIP_SELF(n_args, pos_args, kw_args,
+        PB_ARG_REQUIRED(angle));
+
+    pbio_imu_t *imu;
+    pbio_imu_get_imu(&imu);
+    pbio_imu_reset_heading(imu, pb_obj_get_int(angle_in) * 1000);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_IMU_reset_heading_obj, 1, common_IMU_reset_heading);
+
 // dir(pybricks.common.IMU)
 STATIC const mp_rom_map_elem_t common_IMU_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_up),               MP_ROM_PTR(&common_IMU_up_obj)              },
     { MP_ROM_QSTR(MP_QSTR_tilt),             MP_ROM_PTR(&common_IMU_tilt_obj)            },
     { MP_ROM_QSTR(MP_QSTR_acceleration),     MP_ROM_PTR(&common_IMU_acceleration_obj)    },
     { MP_ROM_QSTR(MP_QSTR_angular_velocity), MP_ROM_PTR(&common_IMU_angular_velocity_obj)},
+    { MP_ROM_QSTR(MP_QSTR_samples),          MP_ROM_PTR(&common_IMU_samples_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_heading),          MP_ROM_PTR(&common_IMU_heading_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_reset_heading),    MP_ROM_PTR(&common_IMU_reset_heading_obj)   },
 };
 STATIC MP_DEFINE_CONST_DICT(common_IMU_locals_dict, common_IMU_locals_dict_table);
 
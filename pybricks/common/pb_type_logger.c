@@ -11,8 +11,10 @@
 
 #include <pbio/config.h>
 #include <pbio/logger.h>
+#include <pbio/motor_process.h>
 #include <pbio/servo.h>
 
+#include "py/mphal.h"
 #include "py/obj.h"
 #include "py/runtime.h"
 #include "py/mpconfig.h"
@@ -25,29 +27,90 @@
 typedef struct _tools_Logger_obj_t {
     mp_obj_base_t base;
     pbio_log_t *log;
+    pbio_control_settings_t *settings;
     int32_t *buf;
     uint32_t size;
+    int32_t prev[MAX_LOG_VALUES];
 } tools_Logger_obj_t;
 
 STATIC mp_obj_t tools_Logger_start(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
         tools_Logger_obj_t, self,
         PB_ARG_REQUIRED(duration),
-        PB_ARG_DEFAULT_INT(divisor, 1));
+        PB_ARG_DEFAULT_INT(divisor, 1),
+        PB_ARG_DEFAULT_FALSE(stream));
 
     mp_int_t divisor = pb_obj_get_int(divisor_in);
     divisor = max(divisor, 1);
-    mp_int_t rows = pb_obj_get_int(duration_in) / PBIO_CONTROL_LOOP_TIME_MS / divisor;
+    mp_int_t rows = pb_obj_get_int(duration_in) / pbio_control_settings_get_loop_time(self->settings) / divisor;
+    rows = max(rows, 1);
     mp_int_t size = rows * pbio_logger_cols(self->log);
-    self->buf = m_renew(int32_t, self->buf, self->size, size);
-    self->size = size;
+    bool stream = mp_obj_is_true(stream_in);
+
+    // The control loop must not run between stopping the logger and starting
+    // it with the new buffer, or it could log into freed memory.
+    pbio_motor_process_defer_begin();
+
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        pbio_logger_stop(self->log);
+
+        // Keep the buffer if it is big enough. Otherwise, free it before
+        // getting a new one, so the old and the new one are never needed at
+        // the same time.
+        if (size > self->size) {
+            m_del(int32_t, self->buf, self->size);
+            self->buf = NULL;
+            self->size = 0;
+            self->buf = m_new(int32_t, size);
+            self->size = size;
+        }
+
+        // Streams start from zero
+        memset(self->prev, 0, sizeof(self->prev));
 
-    pbio_logger_start(self->log, self->buf, rows, divisor);
+        // In streaming mode, keep logging and keep only the latest duration
+        if (stream) {
+            pbio_logger_start_ring(self->log, self->buf, rows, divisor);
+        } else {
+            pbio_logger_start(self->log, self->buf, rows, divisor);
+        }
+        nlr_pop();
+    } else {
+        // Let the control loop run again if there is no memory for the buffer
+        pbio_motor_process_defer_end();
+        nlr_jump(nlr.ret_val);
+    }
+
+    pbio_motor_process_defer_end();
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_Logger_start_obj, 1, tools_Logger_start);
 
+// Sends the rows that were logged since the previous call to stdout, as
+// binary frames. Returns the number of rows sent.
+STATIC mp_obj_t tools_Logger_drain(mp_obj_t self_in) {
+    tools_Logger_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    int32_t data[MAX_LOG_VALUES];
+    uint8_t frame[PBIO_LOGGER_FRAME_SIZE_MAX];
+    uint8_t num_values = pbio_logger_cols(self->log);
+    uint32_t lost;
+    mp_int_t sent = 0;
+
+    // Send only the rows that are there now, so this ends while logging
+    mp_int_t pending = self->log->sampled - self->log->drained;
+    while (sent < pending && pbio_logger_drain(self->log, data, &lost) == PBIO_SUCCESS) {
+        uint8_t size = pbio_logger_encode_frame(data, self->prev, num_values, lost, frame);
+        mp_hal_stdout_tx_strn((const char *)frame, size);
+        sent++;
+    }
+
+    return mp_obj_new_int(sent);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(tools_Logger_drain_obj, tools_Logger_drain);
+
 STATIC mp_obj_t tools_Logger_get(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
         tools_Logger_obj_t, self,
@@ -192,6 +255,7 @@ STATIC const mp_rom_map_elem_t tools_Logger_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&tools_Logger_get_obj) },
     { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&tools_Logger_stop_obj) },
     { MP_ROM_QSTR(MP_QSTR_save), MP_ROM_PTR(&tools_Logger_save_obj) },
+    { MP_ROM_QSTR(MP_QSTR_drain), MP_ROM_PTR(&tools_Logger_drain_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(tools_Logger_locals_dict, tools_Logger_locals_dict_table);
 
@@ -202,10 +266,11 @@ STATIC const mp_obj_type_t tools_Logger_type = {
     .unary_op = tools_Logger_unary_op,
 };
 
-mp_obj_t common_Logger_obj_make_new(pbio_log_t *log, uint8_t num_values) {
+mp_obj_t common_Logger_obj_make_new(pbio_log_t *log, uint8_t num_values, pbio_control_settings_t *settings) {
     tools_Logger_obj_t *logger = m_new_obj(tools_Logger_obj_t);
     logger->base.type = (mp_obj_type_t *)&tools_Logger_type;
     logger->log = log;
+    logger->settings = settings;
     logger->log->num_values = num_values + NUM_DEFAULT_LOG_VALUES;
     return logger;
 }
@@ -25,8 +25,11 @@ STATIC void wait_for_completion(pbio_servo_t *srv) {
         mp_hal_delay_ms(5);
     }
     if (!pbio_servo_is_connected(srv)) {
+        // This is raised instead of the errors of the rejected commands
+        pbio_command_queue_take_error(&srv->commands);
         pb_assert(PBIO_ERROR_IO);
     }
+    pb_assert_command_error(&srv->commands);
 }
 
 // pybricks._common.Motor.__init__
@@ -99,7 +102,7 @@ STATIC mp_obj_t common_Motor_make_new(const mp_obj_type_t *type, size_t n_args,
     self->control = common_Control_obj_make_new(&self->srv->control);
 
     // Create an instance of the Logger class
-    self->logger = common_Logger_obj_make_new(&self->srv->log, PBIO_SERVO_LOG_COLS);
+    self->logger = common_Logger_obj_make_new(&self->srv->log, PBIO_SERVO_LOG_COLS, &self->srv->control.settings);
 
     return MP_OBJ_FROM_PTR(self);
 }
@@ -152,7 +155,7 @@ STATIC mp_obj_t common_Motor_run(size_t n_args, const mp_obj_t *pos_args, mp_map
         PB_ARG_REQUIRED(speed));
 
     mp_int_t speed = pb_obj_get_int(speed_in);
-    pb_assert(pbio_servo_run(self->srv, speed));
+    pb_assert_send(&self->srv->commands, pbio_servo_run(self->srv, speed));
 
     return mp_const_none;
 }
@@ -161,7 +164,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Motor_run_obj, 1, common_Motor_run);
 // pybricks._common.Motor.hold
 STATIC mp_obj_t common_Motor_hold(mp_obj_t self_in) {
     common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    pb_assert(pbio_servo_stop(self->srv, PBIO_ACTUATION_HOLD));
+    pb_assert_send(&self->srv->commands, pbio_servo_stop(self->srv, PBIO_ACTUATION_HOLD));
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_1(common_Motor_hold_obj, common_Motor_hold);
@@ -185,7 +188,7 @@ STATIC mp_obj_t common_Motor_run_time(size_t n_args, const mp_obj_t *pos_args, m
     pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
 
     // Call pbio with parsed user/default arguments
-    pb_assert(pbio_servo_run_time(self->srv, speed, time, then));
+    pb_assert_send(&self->srv->commands, pbio_servo_run_time(self->srv, speed, time, then));
 
     if (mp_obj_is_true(wait_in)) {
         wait_for_completion(self->srv);
@@ -228,7 +231,7 @@ STATIC mp_obj_t common_Motor_run_until_stalled(size_t n_args, const mp_obj_t *po
     nlr_buf_t nlr;
     if (nlr_push(&nlr) == 0) {
         // Call pbio with parsed user/default arguments
-        pb_assert(pbio_servo_run_until_stalled(self->srv, speed, then));
+        pb_assert_send(&self->srv->commands, pbio_servo_run_until_stalled(self->srv, speed, then));
 
         // In this command we always wait for completion, so we can return the
         // final angle below.
@@ -271,7 +274,7 @@ STATIC mp_obj_t common_Motor_run_angle(size_t n_args, const mp_obj_t *pos_args,
     pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
 
     // Call pbio with parsed user/default arguments
-    pb_assert(pbio_servo_run_angle(self->srv, speed, angle, then));
+    pb_assert_send(&self->srv->commands, pbio_servo_run_angle(self->srv, speed, angle, then));
 
     if (mp_obj_is_true(wait_in)) {
         wait_for_completion(self->srv);
@@ -295,7 +298,7 @@ STATIC mp_obj_t common_Motor_run_target(size_t n_args, const mp_obj_t *pos_args,
     pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
 
     // Call pbio with parsed user/default arguments
-    pb_assert(pbio_servo_run_target(self->srv, speed, target_angle, then));
+    pb_assert_send(&self->srv->commands, pbio_servo_run_target(self->srv, speed, target_angle, then));
 
     if (mp_obj_is_true(wait_in)) {
         wait_for_completion(self->srv);
@@ -312,12 +315,34 @@ STATIC mp_obj_t common_Motor_track_target(size_t n_args, const mp_obj_t *pos_arg
         PB_ARG_REQUIRED(target_angle));
 
     mp_int_t target_angle = pb_obj_get_int(target_angle_in);
-    pb_assert(pbio_servo_track_target(self->srv, target_angle));
+    pb_assert_send(&self->srv->commands, pbio_servo_track_target(self->srv, target_angle));
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Motor_track_target_obj, 1, common_Motor_track_target);
 
+// pybricks._common.Motor.queue_target
+STATIC mp_obj_t common_Motor_queue_target(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        common_Motor_obj_t, self,
+        PB_ARG_REQUIRED(speed),
+        PB_ARG_REQUIRED(target_angle),
+        PB_ARG_DEFAULT_OBJ(then, pb_Stop_HOLD_obj));
+
+    mp_int_t speed = pb_obj_get_int(speed_in);
+    mp_int_t target_angle = pb_obj_get_int(target_angle_in);
+    pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
+
+    // Start after the ongoing run_target or queued maneuvers. This only
+    // queues the maneuver, so if it fails when the control loop starts it,
+    // the error is raised by the next call or when waiting for completion.
+    // This only waits if the queue is full.
+    pb_assert_send(&self->srv->commands, pbio_servo_queue_target(self->srv, speed, target_angle, then));
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Motor_queue_target_obj, 1, common_Motor_queue_target);
+
 // dir(pybricks.builtins.Motor)
 STATIC const mp_rom_map_elem_t common_Motor_locals_dict_table[] = {
     //
@@ -339,6 +364,7 @@ STATIC const mp_rom_map_elem_t common_Motor_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_run_angle), MP_ROM_PTR(&common_Motor_run_angle_obj) },
     { MP_ROM_QSTR(MP_QSTR_run_target), MP_ROM_PTR(&common_Motor_run_target_obj) },
     { MP_ROM_QSTR(MP_QSTR_track_target), MP_ROM_PTR(&common_Motor_track_target_obj) },
+    { MP_ROM_QSTR(MP_QSTR_queue_target), MP_ROM_PTR(&common_Motor_queue_target_obj) },
     { MP_ROM_QSTR(MP_QSTR_control), MP_ROM_ATTRIBUTE_OFFSET(common_Motor_obj_t, control) },
     { MP_ROM_QSTR(MP_QSTR_log), MP_ROM_ATTRIBUTE_OFFSET(common_Motor_obj_t, logger) },
 };
@@ -9,11 +9,16 @@
 #include "py/obj.h"
 #include "py/runtime.h"
 
+#include <pbdrv/control_timer.h>
 #include <pbsys/sys.h>
 
 #include <pybricks/experimental.h>
 #include <pybricks/robotics.h>
 
+#include <pybricks/util_mp/pb_kwarg_helper.h>
+#include <pybricks/util_mp/pb_obj_helper.h>
+#include <pybricks/util_pb/pb_error.h>
+
 #if PYBRICKS_HUB_MOVEHUB
 
 // Move Hub has internal STMicroelectronics LIS3DH motion sensor
@@ -211,6 +216,10 @@ STATIC const mp_obj_type_t mod_experimental_Motion_type = {
 
 #include <signal.h>
 
+#include <ev3dev_stretch/lego_sensor.h>
+#include <ev3dev_stretch/nxtcolor.h>
+#include <ev3dev_stretch/sysfs.h>
+
 #include "py/mpthread.h"
 
 STATIC void sighandler(int signum) {
@@ -236,6 +245,49 @@ STATIC mp_obj_t mod_experimental_pthread_raise(mp_obj_t thread_id_in, mp_obj_t e
     return mp_obj_new_int(mp_thread_schedule_exception(thread_id, ex_in));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_experimental_pthread_raise_obj, mod_experimental_pthread_raise);
+
+STATIC mp_obj_t mod_experimental_sysfs_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_DEFAULT_FALSE(reset));
+
+    sysfs_stats_t stats;
+    sysfs_get_stats(&stats);
+
+    // Start counting from zero if requested
+    if (mp_obj_is_true(reset_in)) {
+        sysfs_reset_stats();
+    }
+
+    // Reads, writes, mean and maximum time per system call (us). Together
+    // with control_timer_stats(), this gives the system calls per tick.
+    uint32_t calls = stats.reads + stats.writes;
+    mp_obj_t ret[4];
+    ret[0] = mp_obj_new_int_from_uint(stats.reads);
+    ret[1] = mp_obj_new_int_from_uint(stats.writes);
+    ret[2] = mp_obj_new_int_from_uint(calls ? stats.time_sum / calls : 0);
+    ret[3] = mp_obj_new_int_from_uint(stats.time_max);
+    return mp_obj_new_tuple(4, ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_experimental_sysfs_stats_obj, 0, mod_experimental_sysfs_stats);
+
+STATIC mp_obj_t mod_experimental_sensor_sampler(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_DEFAULT_INT(rate, 0));
+
+    // Read all sensors in the background at the given rate (Hz), or stop
+    // doing so if the rate is 0
+    mp_int_t rate = pb_obj_get_int(rate_in);
+    if (rate == 0) {
+        lego_sensor_sampler_stop();
+        nxtcolor_sampler_stop();
+    } else {
+        pb_assert(lego_sensor_sampler_start(rate < 0 ? 0 : rate));
+        pb_assert(nxtcolor_sampler_start(rate));
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_experimental_sensor_sampler_obj, 0, mod_experimental_sensor_sampler);
 #endif // PYBRICKS_HUB_EV3BRICK
 
 STATIC mp_obj_t experimental_getchar(void) {
@@ -248,15 +300,45 @@ STATIC mp_obj_t experimental_getchar(void) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(experimental_getchar_obj, experimental_getchar);
 
+#if PBDRV_CONFIG_CONTROL_TIMER
+STATIC mp_obj_t experimental_control_timer_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_DEFAULT_FALSE(reset));
+
+    pbdrv_control_timer_stats_t stats;
+    pbdrv_control_timer_get_stats(&stats);
+
+    // Start counting from zero if requested
+    if (mp_obj_is_true(reset_in)) {
+        pbdrv_control_timer_reset_stats();
+    }
+
+    // Ticks, missed ticks, deferred ticks, mean and maximum lateness (us)
+    mp_obj_t ret[5];
+    ret[0] = mp_obj_new_int_from_uint(stats.ticks);
+    ret[1] = mp_obj_new_int_from_uint(stats.missed);
+    ret[2] = mp_obj_new_int_from_uint(stats.deferred);
+    ret[3] = mp_obj_new_int_from_uint(stats.ticks ? stats.lateness_sum / stats.ticks : 0);
+    ret[4] = mp_obj_new_int_from_uint(stats.lateness_max);
+    return mp_obj_new_tuple(5, ret);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(experimental_control_timer_stats_obj, 0, experimental_control_timer_stats);
+#endif // PBDRV_CONFIG_CONTROL_TIMER
+
 STATIC const mp_rom_map_elem_t experimental_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_experimental_c) },
     { MP_ROM_QSTR(MP_QSTR_getchar),  MP_ROM_PTR(&experimental_getchar_obj)},
+    #if PBDRV_CONFIG_CONTROL_TIMER
+    { MP_ROM_QSTR(MP_QSTR_control_timer_stats), MP_ROM_PTR(&experimental_control_timer_stats_obj)},
+    #endif // PBDRV_CONFIG_CONTROL_TIMER
     #if PYBRICKS_HUB_MOVEHUB
     { MP_ROM_QSTR(MP_QSTR_Motion), MP_ROM_PTR(&mod_experimental_Motion_type) },
     #endif // PYBRICKS_HUB_MOVEHUB
     #if PYBRICKS_HUB_EV3BRICK
     { MP_ROM_QSTR(MP_QSTR___init__), MP_ROM_PTR(&mod_experimental___init___obj) },
     { MP_ROM_QSTR(MP_QSTR_pthread_raise), MP_ROM_PTR(&mod_experimental_pthread_raise_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sysfs_stats), MP_ROM_PTR(&mod_experimental_sysfs_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sensor_sampler), MP_ROM_PTR(&mod_experimental_sensor_sampler_obj) },
     #endif // PYBRICKS_HUB_EV3BRICK
 };
 STATIC MP_DEFINE_CONST_DICT(pb_module_experimental_globals, experimental_globals_table);
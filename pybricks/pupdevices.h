@@ -25,6 +25,8 @@ extern const mp_obj_type_t pb_type_pupdevices_UltrasonicSensor;
 
 pb_device_t *pupdevices_ColorDistanceSensor__get_device(mp_obj_t obj);
 
+mp_obj_t pupdevices__set_mode_combo(pb_device_t *pbdev, size_t n_args, const mp_obj_t *args);
+
 #endif // PYBRICKS_PY_PUPDEVICES
 
 #endif // PYBRICKS_INCLUDED_PYBRICKS_PUPDEVICES_H
@@ -5,9 +5,31 @@
 
 #if PYBRICKS_PY_PUPDEVICES
 
+#include <pbio/iodev.h>
+
 #include <pybricks/common.h>
 #include <pybricks/pupdevices.h>
 
+#include <pybricks/util_pb/pb_device.h>
+#include <pybricks/util_pb/pb_error.h>
+
+// Makes a device send the data of all given modes at once, so reading any of
+// them does not require a mode change. Used by the mode_combo method of sensors.
+mp_obj_t pupdevices__set_mode_combo(pb_device_t *pbdev, size_t n_args, const mp_obj_t *args) {
+    uint8_t modes[PBIO_IODEV_MAX_COMBO_VALUES];
+
+    if (n_args > PBIO_IODEV_MAX_COMBO_VALUES) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+    for (size_t i = 0; i < n_args; i++) {
+        modes[i] = mp_obj_get_int(args[i]);
+    }
+
+    pb_device_set_mode_combo(pbdev, modes, n_args);
+
+    return mp_const_none;
+}
+
 STATIC const mp_rom_map_elem_t pupdevices_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),            MP_ROM_QSTR(MP_QSTR_pupdevices)                    },
     #if PYBRICKS_PY_COMMON_MOTORS
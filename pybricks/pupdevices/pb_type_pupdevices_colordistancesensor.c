@@ -128,6 +128,13 @@ STATIC mp_obj_t pupdevices_ColorDistanceSensor_hsv(mp_obj_t self_in) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(pupdevices_ColorDistanceSensor_hsv_obj, pupdevices_ColorDistanceSensor_hsv);
 
+// pybricks.pupdevices.ColorDistanceSensor.mode_combo
+STATIC mp_obj_t pupdevices_ColorDistanceSensor_mode_combo(size_t n_args, const mp_obj_t *args) {
+    pupdevices_ColorDistanceSensor_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    return pupdevices__set_mode_combo(self->pbdev, n_args - 1, args + 1);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pupdevices_ColorDistanceSensor_mode_combo_obj, 1, 1 + PBIO_IODEV_MAX_COMBO_VALUES, pupdevices_ColorDistanceSensor_mode_combo);
+
 // dir(pybricks.pupdevices.ColorDistanceSensor)
 STATIC const mp_rom_map_elem_t pupdevices_ColorDistanceSensor_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_color),       MP_ROM_PTR(&pupdevices_ColorDistanceSensor_color_obj)                },
@@ -135,6 +142,7 @@ STATIC const mp_rom_map_elem_t pupdevices_ColorDistanceSensor_locals_dict_table[
     { MP_ROM_QSTR(MP_QSTR_ambient),     MP_ROM_PTR(&pupdevices_ColorDistanceSensor_ambient_obj)              },
     { MP_ROM_QSTR(MP_QSTR_distance),    MP_ROM_PTR(&pupdevices_ColorDistanceSensor_distance_obj)             },
     { MP_ROM_QSTR(MP_QSTR_hsv),         MP_ROM_PTR(&pupdevices_ColorDistanceSensor_hsv_obj)                  },
+    { MP_ROM_QSTR(MP_QSTR_mode_combo),  MP_ROM_PTR(&pupdevices_ColorDistanceSensor_mode_combo_obj)           },
     { MP_ROM_QSTR(MP_QSTR_detectable_colors),   MP_ROM_PTR(&pb_ColorSensor_detectable_colors_obj)                            },
     { MP_ROM_QSTR(MP_QSTR_light),       MP_ROM_ATTRIBUTE_OFFSET(pupdevices_ColorDistanceSensor_obj_t, light) },
 };
@@ -152,6 +152,13 @@ STATIC mp_obj_t pupdevices_ColorSensor_ambient(mp_obj_t self_in) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(pupdevices_ColorSensor_ambient_obj, pupdevices_ColorSensor_ambient);
 
+// pybricks.pupdevices.ColorSensor.mode_combo
+STATIC mp_obj_t pupdevices_ColorSensor_mode_combo(size_t n_args, const mp_obj_t *args) {
+    pupdevices_ColorSensor_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    return pupdevices__set_mode_combo(self->pbdev, n_args - 1, args + 1);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pupdevices_ColorSensor_mode_combo_obj, 1, 1 + PBIO_IODEV_MAX_COMBO_VALUES, pupdevices_ColorSensor_mode_combo);
+
 // dir(pybricks.pupdevices.ColorSensor)
 STATIC const mp_rom_map_elem_t pupdevices_ColorSensor_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_lights),      MP_ROM_ATTRIBUTE_OFFSET(pupdevices_ColorSensor_obj_t, lights)},
@@ -159,6 +166,7 @@ STATIC const mp_rom_map_elem_t pupdevices_ColorSensor_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_color),       MP_ROM_PTR(&pupdevices_ColorSensor_color_obj)                },
     { MP_ROM_QSTR(MP_QSTR_reflection),  MP_ROM_PTR(&pupdevices_ColorSensor_reflection_obj)           },
     { MP_ROM_QSTR(MP_QSTR_ambient),     MP_ROM_PTR(&pupdevices_ColorSensor_ambient_obj)              },
+    { MP_ROM_QSTR(MP_QSTR_mode_combo),  MP_ROM_PTR(&pupdevices_ColorSensor_mode_combo_obj)           },
     { MP_ROM_QSTR(MP_QSTR_detectable_colors),   MP_ROM_PTR(&pb_ColorSensor_detectable_colors_obj)                    },
 };
 STATIC MP_DEFINE_CONST_DICT(pupdevices_ColorSensor_locals_dict, pupdevices_ColorSensor_locals_dict_table);
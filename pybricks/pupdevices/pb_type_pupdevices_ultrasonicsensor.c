@@ -57,10 +57,18 @@ STATIC mp_obj_t pupdevices_UltrasonicSensor_presence(mp_obj_t self_in) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(pupdevices_UltrasonicSensor_presence_obj, pupdevices_UltrasonicSensor_presence);
 
+// pybricks.pupdevices.UltrasonicSensor.mode_combo
+STATIC mp_obj_t pupdevices_UltrasonicSensor_mode_combo(size_t n_args, const mp_obj_t *args) {
+    pupdevices_UltrasonicSensor_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    return pupdevices__set_mode_combo(self->pbdev, n_args - 1, args + 1);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(pupdevices_UltrasonicSensor_mode_combo_obj, 1, 1 + PBIO_IODEV_MAX_COMBO_VALUES, pupdevices_UltrasonicSensor_mode_combo);
+
 // dir(pybricks.pupdevices.UltrasonicSensor)
 STATIC const mp_rom_map_elem_t pupdevices_UltrasonicSensor_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_distance),     MP_ROM_PTR(&pupdevices_UltrasonicSensor_distance_obj)              },
     { MP_ROM_QSTR(MP_QSTR_presence),     MP_ROM_PTR(&pupdevices_UltrasonicSensor_presence_obj)              },
+    { MP_ROM_QSTR(MP_QSTR_mode_combo),   MP_ROM_PTR(&pupdevices_UltrasonicSensor_mode_combo_obj)            },
     { MP_ROM_QSTR(MP_QSTR_lights),       MP_ROM_ATTRIBUTE_OFFSET(pupdevices_UltrasonicSensor_obj_t, lights) },
 };
 STATIC MP_DEFINE_CONST_DICT(pupdevices_UltrasonicSensor_locals_dict, pupdevices_UltrasonicSensor_locals_dict_table);
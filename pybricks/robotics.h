@@ -14,6 +14,7 @@
 
 
 extern const mp_obj_type_t pb_type_drivebase;
+extern const mp_obj_type_t pb_type_motorgroup;
 
 extern const mp_obj_module_t pb_module_robotics;
 
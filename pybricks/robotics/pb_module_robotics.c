@@ -11,6 +11,7 @@ STATIC const mp_rom_map_elem_t robotics_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),    MP_ROM_QSTR(MP_QSTR_robotics)   },
     #if PYBRICKS_PY_COMMON_MOTORS
     { MP_ROM_QSTR(MP_QSTR_DriveBase),   MP_ROM_PTR(&pb_type_drivebase)  },
+    { MP_ROM_QSTR(MP_QSTR_MotorGroup),  MP_ROM_PTR(&pb_type_motorgroup) },
     #endif
 };
 STATIC MP_DEFINE_CONST_DICT(pb_module_robotics_globals, robotics_globals_table);
@@ -19,6 +19,7 @@
 #include <pybricks/util_mp/pb_kwarg_helper.h>
 #include <pybricks/util_mp/pb_obj_helper.h>
 #include <pybricks/util_pb/pb_error.h>
+#include <pybricks/util_pb/pb_imu.h>
 
 // pybricks.robotics.DriveBase class object
 typedef struct _robotics_DriveBase_obj_t {
@@ -83,6 +84,7 @@ STATIC void wait_for_completion_drivebase(pbio_drivebase_t *db) {
     while (!pbio_control_is_done(&db->control_distance) || !pbio_control_is_done(&db->control_heading)) {
         mp_hal_delay_ms(5);
     }
+    pb_assert_command_error(&db->commands);
 }
 
 // pybricks.robotics.DriveBase.straight
@@ -92,7 +94,7 @@ STATIC mp_obj_t robotics_DriveBase_straight(size_t n_args, const mp_obj_t *pos_a
         PB_ARG_REQUIRED(distance));
 
     mp_int_t distance = pb_obj_get_int(distance_in);
-    pb_assert(pbio_drivebase_straight(self->db, distance, self->straight_speed, self->straight_acceleration));
+    pb_assert_send(&self->db->commands, pbio_drivebase_straight(self->db, distance, self->straight_speed, self->straight_acceleration));
 
     wait_for_completion_drivebase(self->db);
 
@@ -107,7 +109,7 @@ STATIC mp_obj_t robotics_DriveBase_turn(size_t n_args, const mp_obj_t *pos_args,
         PB_ARG_REQUIRED(angle));
 
     mp_int_t angle_val = pb_obj_get_int(angle_in);
-    pb_assert(pbio_drivebase_turn(self->db, angle_val, self->turn_rate, self->turn_acceleration));
+    pb_assert_send(&self->db->commands, pbio_drivebase_turn(self->db, angle_val, self->turn_rate, self->turn_acceleration));
 
     wait_for_completion_drivebase(self->db);
 
@@ -126,7 +128,7 @@ STATIC mp_obj_t robotics_DriveBase_drive(size_t n_args, const mp_obj_t *pos_args
     mp_int_t speed = pb_obj_get_int(speed_in);
     mp_int_t turn_rate = pb_obj_get_int(turn_rate_in);
 
-    pb_assert(pbio_drivebase_drive(self->db, speed, turn_rate));
+    pb_assert_send(&self->db->commands, pbio_drivebase_drive(self->db, speed, turn_rate));
 
     return mp_const_none;
 }
@@ -135,7 +137,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(robotics_DriveBase_drive_obj, 1, robotics_Driv
 // pybricks._common.DriveBase.stop
 STATIC mp_obj_t robotics_DriveBase_stop(mp_obj_t self_in) {
     robotics_DriveBase_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    pb_assert(pbio_drivebase_stop(self->db, PBIO_ACTUATION_COAST));
+    pb_assert_send(&self->db->commands, pbio_drivebase_stop(self->db, PBIO_ACTUATION_COAST));
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_1(robotics_DriveBase_stop_obj, robotics_DriveBase_stop);
@@ -232,6 +234,29 @@ STATIC mp_obj_t robotics_DriveBase_settings(size_t n_args, const mp_obj_t *pos_a
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(robotics_DriveBase_settings_obj, 1, robotics_DriveBase_settings);
 
+#if PYBRICKS_PY_COMMON_IMU
+// pybricks.robotics.DriveBase.use_gyro
+STATIC mp_obj_t robotics_DriveBase_use_gyro(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        robotics_DriveBase_obj_t, self,
+        PB_ARG_REQUIRED(use_gyro));
+
+    pbio_imu_t *imu = NULL;
+    if (mp_obj_is_true(use_gyro_in)) {
+        // Start estimating the heading, if the hub has not done so already
+        pb_imu_dev_t *imu_dev;
+        pb_imu_get_imu(&imu_dev);
+        pb_imu_init(imu_dev);
+        pbio_imu_get_imu(&imu);
+    }
+    pb_assert(pbio_drivebase_set_imu(self->db, imu));
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(robotics_DriveBase_use_gyro_obj, 1, robotics_DriveBase_use_gyro);
+#endif // PYBRICKS_PY_COMMON_IMU
+
 // dir(pybricks.robotics.DriveBase)
 STATIC const mp_rom_map_elem_t robotics_DriveBase_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_straight),         MP_ROM_PTR(&robotics_DriveBase_straight_obj) },
@@ -243,6 +268,9 @@ STATIC const mp_rom_map_elem_t robotics_DriveBase_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_state),            MP_ROM_PTR(&robotics_DriveBase_state_obj)    },
     { MP_ROM_QSTR(MP_QSTR_reset),            MP_ROM_PTR(&robotics_DriveBase_reset_obj)    },
     { MP_ROM_QSTR(MP_QSTR_settings),         MP_ROM_PTR(&robotics_DriveBase_settings_obj) },
+    #if PYBRICKS_PY_COMMON_IMU
+    { MP_ROM_QSTR(MP_QSTR_use_gyro),         MP_ROM_PTR(&robotics_DriveBase_use_gyro_obj) },
+    #endif
     { MP_ROM_QSTR(MP_QSTR_left),             MP_ROM_ATTRIBUTE_OFFSET(robotics_DriveBase_obj_t, left)            },
     { MP_ROM_QSTR(MP_QSTR_right),            MP_ROM_ATTRIBUTE_OFFSET(robotics_DriveBase_obj_t, right)           },
     { MP_ROM_QSTR(MP_QSTR_heading_control),  MP_ROM_ATTRIBUTE_OFFSET(robotics_DriveBase_obj_t, heading_control) },
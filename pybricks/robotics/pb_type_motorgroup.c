@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include "py/mpconfig.h"
+
+#if PYBRICKS_PY_ROBOTICS && PYBRICKS_PY_COMMON_MOTORS
+
+#include <pbio/motor_group.h>
+#include <pbio/motor_process.h>
+
+#include "py/mphal.h"
+#include "py/runtime.h"
+
+#include <pybricks/common.h>
+#include <pybricks/parameters.h>
+
+#include <pybricks/util_mp/pb_kwarg_helper.h>
+#include <pybricks/util_mp/pb_obj_helper.h>
+#include <pybricks/util_pb/pb_error.h>
+
+// pybricks.robotics.MotorGroup class object
+typedef struct _robotics_MotorGroup_obj_t {
+    mp_obj_base_t base;
+    pbio_motor_group_t *group;
+    mp_obj_t motors;
+} robotics_MotorGroup_obj_t;
+
+// pybricks.robotics.MotorGroup.__init__
+STATIC mp_obj_t robotics_MotorGroup_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+
+    mp_arg_check_num(n_args, n_kw, 1, PBIO_MOTOR_GROUP_NUM_SERVOS_MAX, false);
+
+    robotics_MotorGroup_obj_t *self = m_new_obj(robotics_MotorGroup_obj_t);
+    self->base.type = (mp_obj_type_t *)type;
+    self->motors = mp_obj_new_tuple(n_args, args);
+
+    // Pointers to servos
+    pbio_servo_t *servos[PBIO_MOTOR_GROUP_NUM_SERVOS_MAX];
+    for (size_t i = 0; i < n_args; i++) {
+        servos[i] = ((common_Motor_obj_t *)pb_obj_get_base_class_obj(args[i], &pb_type_Motor))->srv;
+    }
+
+    // Create the group. There is only one, so this fails if it is in use.
+    pb_assert(pbio_motor_process_get_motor_group(&self->group));
+    pb_assert(pbio_motor_group_setup(self->group, servos, n_args));
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC void wait_for_completion_motorgroup(pbio_motor_group_t *group) {
+    while (!pbio_motor_group_is_done(group)) {
+        mp_hal_delay_ms(5);
+    }
+    pb_assert_command_error(&group->commands);
+}
+
+// pybricks.robotics.MotorGroup.run_target
+STATIC mp_obj_t robotics_MotorGroup_run_target(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        robotics_MotorGroup_obj_t, self,
+        PB_ARG_REQUIRED(speed),
+        PB_ARG_REQUIRED(target_angles),
+        PB_ARG_DEFAULT_OBJ(then, pb_Stop_HOLD_obj),
+        PB_ARG_DEFAULT_TRUE(wait));
+
+    mp_int_t speed = pb_obj_get_int(speed_in);
+    pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
+
+    // There must be one target for each motor
+    size_t n;
+    mp_obj_t *target_objs;
+    mp_obj_get_array(target_angles_in, &n, &target_objs);
+    if (n != self->group->num_servos) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+    int32_t targets[PBIO_MOTOR_GROUP_NUM_SERVOS_MAX];
+    for (size_t i = 0; i < n; i++) {
+        targets[i] = pb_obj_get_int(target_objs[i]);
+    }
+
+    // All motors start and stop together
+    pb_assert_send(&self->group->commands, pbio_motor_group_run_target(self->group, speed, targets, then));
+
+    if (mp_obj_is_true(wait_in)) {
+        wait_for_completion_motorgroup(self->group);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(robotics_MotorGroup_run_target_obj, 1, robotics_MotorGroup_run_target);
+
+// pybricks.robotics.MotorGroup.stop
+STATIC mp_obj_t robotics_MotorGroup_stop(mp_obj_t self_in) {
+    robotics_MotorGroup_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    pb_assert_send(&self->group->commands, pbio_motor_group_stop(self->group, PBIO_ACTUATION_COAST));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(robotics_MotorGroup_stop_obj, robotics_MotorGroup_stop);
+
+// pybricks.robotics.MotorGroup.done
+STATIC mp_obj_t robotics_MotorGroup_done(mp_obj_t self_in) {
+    robotics_MotorGroup_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    bool done = pbio_motor_group_is_done(self->group);
+    pb_assert_command_error(&self->group->commands);
+    return mp_obj_new_bool(done);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(robotics_MotorGroup_done_obj, robotics_MotorGroup_done);
+
+// dir(pybricks.robotics.MotorGroup)
+STATIC const mp_rom_map_elem_t robotics_MotorGroup_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_run_target), MP_ROM_PTR(&robotics_MotorGroup_run_target_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop),       MP_ROM_PTR(&robotics_MotorGroup_stop_obj)       },
+    { MP_ROM_QSTR(MP_QSTR_done),       MP_ROM_PTR(&robotics_MotorGroup_done_obj)       },
+    { MP_ROM_QSTR(MP_QSTR_motors),     MP_ROM_ATTRIBUTE_OFFSET(robotics_MotorGroup_obj_t, motors) },
+};
+STATIC MP_DEFINE_CONST_DICT(robotics_MotorGroup_locals_dict, robotics_MotorGroup_locals_dict_table);
+
+// type(pybricks.robotics.MotorGroup)
+const mp_obj_type_t pb_type_motorgroup = {
+    { &mp_type_type },
+    .name = MP_QSTR_MotorGroup,
+    .make_new = robotics_MotorGroup_make_new,
+    .locals_dict = (mp_obj_dict_t *)&robotics_MotorGroup_locals_dict,
+};
+
+#endif // PYBRICKS_PY_ROBOTICS && PYBRICKS_PY_COMMON_MOTORS
@@ -218,6 +218,10 @@ void pb_device_set_values(pb_device_t *pbdev, uint8_t mode, int32_t *values, uin
     pb_assert(PBIO_ERROR_NOT_SUPPORTED);
 }
 
+void pb_device_set_mode_combo(pb_device_t *pbdev, const uint8_t *modes, uint8_t num_modes) {
+    pb_assert(PBIO_ERROR_NOT_SUPPORTED);
+}
+
 void pb_device_set_power_supply(pb_device_t *pbdev, int32_t duty) {
     pb_assert(PBIO_ERROR_NOT_SUPPORTED);
 }
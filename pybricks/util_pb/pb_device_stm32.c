@@ -3,6 +3,8 @@
 
 #include <string.h>
 
+#include <contiki.h>
+
 #include <pbdrv/ioport.h>
 #include <pbdrv/motor.h>
 #include <pbio/color.h>
@@ -40,6 +42,33 @@ static void wait(pbio_error_t (*end)(pbio_iodev_t *), void (*cancel)(pbio_iodev_
 }
 
 
+// Maximum time to wait for new data from a device (ms)
+#define DATA_TIMEOUT (500)
+
+// Waits for a sample that is newer than the given one and that was received
+// no earlier than time_start (us)
+static void wait_for_data(pbio_iodev_t *iodev, uint32_t seq, uint32_t time_start) {
+    mp_uint_t wait_start = mp_hal_ticks_ms();
+    uint32_t time;
+
+    while (true) {
+        pbio_error_t err = pbio_iodev_wait_newer_data(iodev, seq);
+        if (err == PBIO_SUCCESS) {
+            pb_assert(pbio_iodev_get_data_seq(iodev, &seq, &time));
+            if ((int32_t)(time - time_start) >= 0) {
+                return;
+            }
+        } else if (err != PBIO_ERROR_AGAIN) {
+            pb_assert(err);
+        }
+
+        if (mp_hal_ticks_ms() - wait_start > DATA_TIMEOUT) {
+            pb_assert(PBIO_ERROR_TIMEDOUT);
+        }
+        MICROPY_EVENT_POLL_HOOK
+    }
+}
+
 // Get the required mode switch time delay for a given sensor type and/or mode
 static uint32_t get_mode_switch_delay(pbio_iodev_type_id_t id, uint8_t mode) {
     switch (id) {
@@ -58,7 +87,8 @@ static uint32_t get_mode_switch_delay(pbio_iodev_type_id_t id, uint8_t mode) {
 static void set_mode(pbio_iodev_t *iodev, uint8_t new_mode) {
     pbio_error_t err;
 
-    if (iodev->mode == new_mode) {
+    // A mode combo also ends if we select one of its modes
+    if (iodev->mode == new_mode && !iodev->num_combo_modes) {
         return;
     }
 
@@ -68,10 +98,13 @@ static void set_mode(pbio_iodev_t *iodev, uint8_t new_mode) {
     pb_assert(err);
     wait(pbio_iodev_set_mode_end, pbio_iodev_set_mode_cancel, iodev);
 
-    // Give some time for the mode to take effect and discard stale data
+    // Discard data that was measured before the mode had taken effect, which
+    // is some time after the first data in the new mode was received
     uint32_t delay = get_mode_switch_delay(iodev->info->type_id, new_mode);
     if (delay > 0) {
-        mp_hal_delay_ms(delay);
+        uint32_t seq, time;
+        pb_assert(pbio_iodev_get_data_seq(iodev, &seq, &time));
+        wait_for_data(iodev, seq, time + delay * 1000);
     }
 }
 
@@ -104,10 +137,13 @@ void pb_device_get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values) {
     uint8_t len;
     pbio_iodev_data_type_t type;
 
-    set_mode(iodev, mode);
-
-    pb_assert(pbio_iodev_get_data(iodev, &data));
-    pb_assert(pbio_iodev_get_data_format(iodev, iodev->mode, &len, &type));
+    // Modes in the mode combo can be read right away. For others, the
+    // device has to switch modes first.
+    if (pbio_iodev_get_combo_data(iodev, mode, &data) != PBIO_SUCCESS) {
+        set_mode(iodev, mode);
+        pb_assert(pbio_iodev_get_data(iodev, &data));
+    }
+    pb_assert(pbio_iodev_get_data_format(iodev, mode, &len, &type));
 
     if (len == 0) {
         pb_assert(PBIO_ERROR_IO);
@@ -178,13 +214,27 @@ void pb_device_set_values(pb_device_t *pbdev, uint8_t mode, int32_t *values, uin
     pb_assert(err);
     wait(pbio_iodev_set_data_end, pbio_iodev_set_data_cancel, iodev);
 
-    // Give some time for the set values to take effect
+    // Give the set values time to take effect, by waiting for the next data
     uint32_t delay = get_mode_switch_delay(iodev->info->type_id, mode);
     if (delay > 0) {
-        mp_hal_delay_ms(delay / 10);
+        uint32_t seq, time;
+        pb_assert(pbio_iodev_get_data_seq(iodev, &seq, &time));
+        wait_for_data(iodev, seq, clock_usecs());
     }
 }
 
+void pb_device_set_mode_combo(pb_device_t *pbdev, const uint8_t *modes, uint8_t num_modes) {
+
+    pbio_iodev_t *iodev = &pbdev->iodev;
+
+    pbio_error_t err;
+    while ((err = pbio_iodev_set_mode_combo_begin(iodev, modes, num_modes)) == PBIO_ERROR_AGAIN) {
+        ;
+    }
+    pb_assert(err);
+    wait(pbio_iodev_set_mode_combo_end, pbio_iodev_set_mode_combo_cancel, iodev);
+}
+
 void pb_device_set_power_supply(pb_device_t *pbdev, int32_t duty) {
     // Bind user input to percentage
     if (duty < 0) {
@@ -2,6 +2,7 @@
 // Copyright (c) 2018-2020 The Pybricks Authors
 
 #include "py/mpconfig.h"
+#include "py/mphal.h"
 #include "py/mperrno.h"
 #include "py/obj.h"
 #include "py/objstr.h"
@@ -55,6 +56,9 @@ void pb_assert(pbio_error_t error) {
         case PBIO_ERROR_CANCELED:
             os_err = MP_ECANCELED;
             break;
+        case PBIO_ERROR_BUSY:
+            os_err = MP_EBUSY;
+            break;
     }
 
     mp_raise_OSError(os_err);
@@ -130,8 +134,27 @@ void pb_assert(pbio_error_t error) {
             args[0] = MP_OBJ_NEW_SMALL_INT(MP_ECANCELED);
             args[1] = MP_OBJ_NEW_QSTR(qstr_from_str(pbio_error_str(error)));
             break;
+        case PBIO_ERROR_BUSY:
+            args[0] = MP_OBJ_NEW_SMALL_INT(MP_EBUSY);
+            args[1] = MP_OBJ_NEW_QSTR(qstr_from_str(pbio_error_str(error)));
+            break;
     }
 
     nlr_raise(mp_obj_new_exception_args(&mp_type_OSError, 2, args));
     #endif // MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE
 }
+
+/**
+ * Gives the motor process time to apply the commands that were sent.
+ */
+void pb_wait_for_command_queue(void) {
+    mp_hal_delay_ms(1);
+}
+
+/**
+ * Raises an exception if a command that was sent to *queue* failed when the
+ * motor process applied it. Each failure is raised only once.
+ */
+void pb_assert_command_error(pbio_command_queue_t *queue) {
+    pb_assert(pbio_command_queue_take_error(queue));
+}
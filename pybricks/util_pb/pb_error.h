@@ -4,8 +4,27 @@
 #ifndef _PYBRICKS_EXTMOD_PBERROR_H_
 #define _PYBRICKS_EXTMOD_PBERROR_H_
 
+#include <pbio/command.h>
 #include <pbio/error.h>
 
 void pb_assert(pbio_error_t error);
+void pb_wait_for_command_queue(void);
+void pb_assert_command_error(pbio_command_queue_t *queue);
+
+/**
+ * Like pb_assert(), but calls *send* again while it returns *PBIO_ERROR_AGAIN*.
+ * This is for pbio functions that queue a command for the motor process, which
+ * applies the queued commands on its next update. This does not wait for that,
+ * so errors of the command are raised by the next call on the same queue, or
+ * when waiting for completion.
+ */
+#define pb_assert_send(queue, send) do { \
+        pbio_error_t _err; \
+        while ((_err = (send)) == PBIO_ERROR_AGAIN) { \
+            pb_wait_for_command_queue(); \
+        } \
+        pb_assert(_err); \
+        pb_assert_command_error(queue); \
+} while (0)
 
 #endif // _PYBRICKS_EXTMOD_PBERROR_H_
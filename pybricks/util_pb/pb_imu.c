@@ -5,27 +5,67 @@
 
 #if PYBRICKS_PY_COMMON && PYBRICKS_PY_COMMON_IMU
 
+#include <string.h>
+
+#include "py/mphal.h"
 #include "py/runtime.h"
 
+#include <contiki.h>
 #include <lsm6ds3tr_c_reg.h>
 
+#include <pbio/config.h>
+#include <pbio/imu.h>
+#include <pbio/motor_process.h>
+
+#include <pybricks/util_pb/pb_error.h>
 #include <pybricks/util_pb/pb_imu.h>
 
+#if !PBIO_CONFIG_IMU
+#error "The IMU module requires PBIO_CONFIG_IMU"
+#endif
+
 #include STM32_HAL_H
 
 #if PYBRICKS_HUB_TECHNICHUB
 #include <stm32l4xx_ll_i2c.h>
 #endif
 
+// The FIFO is read this often (ms)
+#define PB_IMU_DRAIN_INTERVAL (10)
+
+// Maximum time to wait for the first sample after starting (ms)
+#define PB_IMU_START_TIMEOUT (5 * PB_IMU_DRAIN_INTERVAL)
+
+// Output data rate (Hz) and the time between two samples (us)
+#define PB_IMU_SAMPLE_RATE (833)
+#define PB_IMU_SAMPLE_PERIOD (1000000 / PB_IMU_SAMPLE_RATE)
+
+// Each sample in the FIFO is the gyro X, Y, Z followed by the accel X, Y, Z
+#define PB_IMU_SAMPLE_WORDS (6)
+
+// Maximum number of samples read from the FIFO in one I2C transaction
+#define PB_IMU_FIFO_BURST (16)
+
+typedef struct {
+    uint32_t time;
+    int16_t data[PB_IMU_SAMPLE_WORDS];
+} pb_imu_raw_sample_t;
+
 struct _pb_imu_dev_t {
     stmdev_ctx_t ctx;
     float_t gyro_scale; // m/s^2 per device count
     float_t accel_scale; // deg/s per device count
+    pbio_imu_t *fusion; // Attitude and heading estimate
+    pb_imu_raw_sample_t ring[PB_IMU_MAX_SAMPLES];
+    uint32_t head; // Number of samples received
+    uint32_t tail; // Number of samples received before last pb_imu_read_samples()
 };
 
 STATIC pb_imu_dev_t _imu_dev;
 STATIC I2C_HandleTypeDef hi2c;
 
+PROCESS(pb_imu_process, "IMU");
+
 void mod_experimental_IMU_handle_i2c_er_irq(void) {
     HAL_I2C_ER_IRQHandler(&hi2c);
 }
@@ -36,10 +76,12 @@ void mod_experimental_IMU_handle_i2c_ev_irq(void) {
 
 void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c) {
     _imu_dev.ctx.read_write_done = true;
+    process_poll(&pb_imu_process);
 }
 
 void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
     _imu_dev.ctx.read_write_done = true;
+    process_poll(&pb_imu_process);
 }
 
 // REVISIT: if there is ever an error the PT threads will stall since we aren't
@@ -115,9 +157,99 @@ STATIC PT_THREAD(pb_imu_configure(struct pt *pt, pb_imu_dev_t *imu_dev)) {
     /* Gyroscope - filtering chain */
     PT_SPAWN(pt, &child, lsm6ds3tr_c_gy_band_pass_set(&child, ctx, LSM6DS3TR_C_HP_16mHz_LP1_LIGHT));
 
+    /*
+     * Collect all samples in the FIFO, so they can be read in the background
+     */
+    PT_SPAWN(pt, &child, lsm6ds3tr_c_fifo_gy_batch_set(&child, ctx, LSM6DS3TR_C_FIFO_GY_NO_DEC));
+    PT_SPAWN(pt, &child, lsm6ds3tr_c_fifo_xl_batch_set(&child, ctx, LSM6DS3TR_C_FIFO_XL_NO_DEC));
+    PT_SPAWN(pt, &child, lsm6ds3tr_c_fifo_data_rate_set(&child, ctx, LSM6DS3TR_C_FIFO_833Hz));
+    PT_SPAWN(pt, &child, lsm6ds3tr_c_fifo_mode_set(&child, ctx, LSM6DS3TR_C_STREAM_MODE));
+
     PT_END(pt);
 }
 
+// Converts raw data to gyro (deg/s) and accel (m/s^2) values in the hub frame
+STATIC void pb_imu_convert(const int16_t *data, float_t *values, float_t scale) {
+    values[0] = data[0] * scale;
+    values[1] = data[1] * scale;
+    values[2] = data[2] * scale;
+
+    #if PYBRICKS_HUB_PRIMEHUB
+    // Sensor is upside down
+    values[0] = -values[0];
+    values[2] = -values[2];
+    #endif
+}
+
+// Updates the attitude and heading estimate with a new sample
+STATIC void pb_imu_fuse(pb_imu_dev_t *imu_dev, const pb_imu_raw_sample_t *sample) {
+    float_t gyro[3];
+    float_t accel[3];
+    pb_imu_convert(&sample->data[0], gyro, imu_dev->gyro_scale);
+    pb_imu_convert(&sample->data[3], accel, imu_dev->accel_scale);
+    // Only calibrate while the motors are not driving the hub
+    pbio_imu_update(imu_dev->fusion, gyro, accel, pbio_motor_process_is_idle());
+}
+
+// Moves all samples from the FIFO to the ring buffer, so that reading the IMU
+// never has to wait for I2C transactions. Each sample also goes into the
+// attitude and heading estimate, so it is updated at the full data rate.
+PROCESS_THREAD(pb_imu_process, ev, data) {
+    static struct etimer timer;
+    static struct pt child;
+    static pb_imu_dev_t *imu_dev = &_imu_dev;
+    static int16_t fifo[PB_IMU_FIFO_BURST * PB_IMU_SAMPLE_WORDS];
+    static uint16_t level;
+    static uint16_t pattern;
+    static uint32_t time;
+    static uint32_t remaining;
+    static uint32_t count;
+
+    PROCESS_BEGIN();
+
+    etimer_set(&timer, clock_from_msec(PB_IMU_DRAIN_INTERVAL));
+
+    while (true) {
+        // Don't wait for the timer event, which may have been handled while
+        // waiting for the I2C bus
+        PROCESS_WAIT_UNTIL(etimer_expired(&timer));
+        etimer_reset(&timer);
+
+        // Number of unread words and the position of the next one in a sample
+        PROCESS_PT_SPAWN(&child, lsm6ds3tr_c_fifo_data_level_get(&child, &imu_dev->ctx, &level));
+        PROCESS_PT_SPAWN(&child, lsm6ds3tr_c_fifo_pattern_get(&child, &imu_dev->ctx, &pattern));
+        time = clock_usecs();
+
+        // Skip the rest of an incomplete sample, which can happen if the FIFO
+        // overflowed because it was not read in time
+        if (pattern != 0) {
+            if (level < PB_IMU_SAMPLE_WORDS - pattern) {
+                continue;
+            }
+            PROCESS_PT_SPAWN(&child, lsm6ds3tr_c_fifo_raw_data_get(&child, &imu_dev->ctx, (uint8_t *)fifo, (PB_IMU_SAMPLE_WORDS - pattern) * 2));
+            level -= PB_IMU_SAMPLE_WORDS - pattern;
+        }
+
+        // The last sample was taken just now, and the others one period apart
+        remaining = level / PB_IMU_SAMPLE_WORDS;
+        while (remaining > 0) {
+            count = MIN(remaining, PB_IMU_FIFO_BURST);
+            PROCESS_PT_SPAWN(&child, lsm6ds3tr_c_fifo_raw_data_get(&child, &imu_dev->ctx, (uint8_t *)fifo, count * PB_IMU_SAMPLE_WORDS * 2));
+
+            for (uint32_t i = 0; i < count; i++) {
+                pb_imu_raw_sample_t *sample = &imu_dev->ring[imu_dev->head % PB_IMU_MAX_SAMPLES];
+                remaining--;
+                sample->time = time - remaining * PB_IMU_SAMPLE_PERIOD;
+                memcpy(sample->data, &fifo[i * PB_IMU_SAMPLE_WORDS], sizeof(sample->data));
+                pb_imu_fuse(imu_dev, sample);
+                imu_dev->head++;
+            }
+        }
+    }
+
+    PROCESS_END();
+}
+
 void pb_imu_get_imu(pb_imu_dev_t **imu_dev) {
     *imu_dev = &_imu_dev;
 }
@@ -152,6 +284,11 @@ void pb_imu_init(pb_imu_dev_t *imu_dev) {
         }
     }
 
+    // The I2C bus belongs to the background process once it is started
+    if (process_is_running(&pb_imu_process)) {
+        return;
+    }
+
     PT_INIT(&pt);
     while (PT_SCHEDULE(pb_imu_configure(&pt, imu_dev))) {
         nlr_buf_t nlr;
@@ -163,58 +300,53 @@ void pb_imu_init(pb_imu_dev_t *imu_dev) {
             nlr_jump(nlr.ret_val);
         }
     }
-}
 
-void pb_imu_accel_read(pb_imu_dev_t *imu_dev, float_t *values) {
-    struct pt pt;
-    int16_t data[3];
-
-    PT_INIT(&pt);
-    while (PT_SCHEDULE(lsm6ds3tr_c_acceleration_raw_get(&pt, &imu_dev->ctx, (uint8_t *)data))) {
-        nlr_buf_t nlr;
-        if (nlr_push(&nlr) == 0) {
-            MICROPY_EVENT_POLL_HOOK
-            nlr_pop();
-        } else {
+    imu_dev->head = imu_dev->tail = 0;
+    pbio_imu_get_imu(&imu_dev->fusion);
+    pbio_imu_reset(imu_dev->fusion, 1.0f / PB_IMU_SAMPLE_RATE);
+    process_start(&pb_imu_process, NULL);
+
+    // Wait for the first sample, so there is always a latest one to read
+    mp_uint_t start = mp_hal_ticks_ms();
+    while (imu_dev->head == 0) {
+        if (mp_hal_ticks_ms() - start > PB_IMU_START_TIMEOUT) {
+            // Start over on the next attempt
+            process_exit(&pb_imu_process);
             HAL_I2C_Master_Abort_IT(&hi2c, LSM6DS3TR_C_I2C_ADD_L);
-            nlr_jump(nlr.ret_val);
+            pb_assert(PBIO_ERROR_TIMEDOUT);
         }
+        MICROPY_EVENT_POLL_HOOK
     }
-    values[0] = data[0] * imu_dev->accel_scale;
-    values[1] = data[1] * imu_dev->accel_scale;
-    values[2] = data[2] * imu_dev->accel_scale;
+}
 
-    #if PYBRICKS_HUB_PRIMEHUB
-    // Sensor is upside down
-    values[0] = -values[0];
-    values[2] = -values[2];
-    #endif
+STATIC const pb_imu_raw_sample_t *pb_imu_get_latest(pb_imu_dev_t *imu_dev) {
+    return &imu_dev->ring[(imu_dev->head - 1) % PB_IMU_MAX_SAMPLES];
+}
+
+void pb_imu_accel_read(pb_imu_dev_t *imu_dev, float_t *values) {
+    pb_imu_convert(&pb_imu_get_latest(imu_dev)->data[3], values, imu_dev->accel_scale);
 }
 
 void pb_imu_gyro_read(pb_imu_dev_t *imu_dev, float_t *values) {
-    struct pt pt;
-    int16_t data[3];
+    pb_imu_convert(&pb_imu_get_latest(imu_dev)->data[0], values, imu_dev->gyro_scale);
+}
 
-    PT_INIT(&pt);
-    while (PT_SCHEDULE(lsm6ds3tr_c_angular_rate_raw_get(&pt, &imu_dev->ctx, (uint8_t *)data))) {
-        nlr_buf_t nlr;
-        if (nlr_push(&nlr) == 0) {
-            MICROPY_EVENT_POLL_HOOK
-            nlr_pop();
-        } else {
-            HAL_I2C_Master_Abort_IT(&hi2c, LSM6DS3TR_C_I2C_ADD_L);
-            nlr_jump(nlr.ret_val);
-        }
+size_t pb_imu_read_samples(pb_imu_dev_t *imu_dev, pb_imu_sample_t *samples, size_t max) {
+    // Older samples have been overwritten
+    if (imu_dev->head - imu_dev->tail > PB_IMU_MAX_SAMPLES) {
+        imu_dev->tail = imu_dev->head - PB_IMU_MAX_SAMPLES;
     }
-    values[0] = data[0] * imu_dev->gyro_scale;
-    values[1] = data[1] * imu_dev->gyro_scale;
-    values[2] = data[2] * imu_dev->gyro_scale;
 
-    #if PYBRICKS_HUB_PRIMEHUB
-    // Sensor is upside down
-    values[0] = -values[0];
-    values[2] = -values[2];
-    #endif
+    size_t count = 0;
+    while (imu_dev->tail != imu_dev->head && count < max) {
+        const pb_imu_raw_sample_t *raw = &imu_dev->ring[imu_dev->tail % PB_IMU_MAX_SAMPLES];
+        samples[count].time = raw->time;
+        pb_imu_convert(&raw->data[0], samples[count].gyro, imu_dev->gyro_scale);
+        pb_imu_convert(&raw->data[3], samples[count].accel, imu_dev->accel_scale);
+        imu_dev->tail++;
+        count++;
+    }
+    return count;
 }
 
 #endif // PYBRICKS_PY_COMMON && PYBRICKS_PY_COMMON_IMU
@@ -6,10 +6,23 @@
 
 #if PYBRICKS_PY_COMMON && PYBRICKS_PY_COMMON_IMU
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "py/obj.h"
 
+// Maximum number of samples that pb_imu_read_samples() can return. This many
+// samples are kept in a ring buffer, so it must be a power of 2.
+#define PB_IMU_MAX_SAMPLES (64)
+
 typedef struct _pb_imu_dev_t pb_imu_dev_t;
 
+typedef struct {
+    uint32_t time; // us
+    float_t gyro[3]; // deg/s
+    float_t accel[3]; // m/s^2
+} pb_imu_sample_t;
+
 void pb_imu_get_imu(pb_imu_dev_t **imu_dev);
 
 void pb_imu_init(pb_imu_dev_t *imu_dev);
@@ -18,6 +31,8 @@ void pb_imu_accel_read(pb_imu_dev_t *imu_dev, float_t *values);
 
 void pb_imu_gyro_read(pb_imu_dev_t *imu_dev, float_t *values);
 
+size_t pb_imu_read_samples(pb_imu_dev_t *imu_dev, pb_imu_sample_t *samples, size_t max);
+
 #endif // PYBRICKS_PY_COMMON && PYBRICKS_PY_COMMON_IMU
 
 #endif // _PB_IMU_H_
@@ -5,7 +5,9 @@
 
 import os
 import argparse
+import struct
 import subprocess
+import zlib
 from pathlib import Path
 
 
@@ -13,6 +15,10 @@ BUILD_DIR = "build"
 TMP_PY_SCRIPT = "_tmp.py"
 TMP_MPY_SCRIPT = "_tmp.mpy"
 
+# Chunked program download, see get_user_program() in bricks/stm32/main.c
+DOWNLOAD_MAGIC = b"PBDL"
+DOWNLOAD_CHUNK_SIZE = 128
+
 
 def make_build_dir():
     # Create build folder if it does not exist
@@ -60,6 +66,24 @@ def mpy_bytes_from_str(mpy_cross, string):
     return mpy_bytes_from_file(mpy_cross, py_path)
 
 
+def download_header_frame(data):
+    """Frame that starts or resumes the chunked download of data."""
+    header = struct.pack("<II", len(data), zlib.crc32(data))
+    return b"H" + header + struct.pack("<I", zlib.crc32(header))
+
+
+def download_data_frame(data, index):
+    """Frame with chunk number index of data."""
+    start = index * DOWNLOAD_CHUNK_SIZE
+    chunk = struct.pack("<H", index) + data[start : start + DOWNLOAD_CHUNK_SIZE]
+    return b"D" + chunk + struct.pack("<I", zlib.crc32(chunk))
+
+
+def download_status_frame():
+    """Frame that asks the hub which chunks it still needs."""
+    return b"S" + DOWNLOAD_MAGIC
+
+
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(
         description="Convert Python scripts or commands to .mpy bytes."
@@ -0,0 +1,233 @@
+#!/usr/bin/env python3
+
+# SPDX-License-Identifier: MIT
+# Copyright (c) 2020 The Pybricks Authors
+
+"""Generates lib/pbio/platform/motors/observer_settings.h.
+
+The observer model of each motor is derived here from its physical model, so
+that the firmware only has to multiply and add on each control loop update.
+Run this script again after changing any of the motor constants below.
+
+Rate dynamics of each motor (rate w in counts/s, torque tau in Nm):
+
+    k_1 * dw/dt = -k_2 * w + tau / k_0
+
+This is discretized with a zero order hold on the torque to get phi and gam.
+"""
+
+import argparse
+import math
+from collections import namedtuple
+from pathlib import Path
+
+OUTPUT = (
+    Path(__file__).parent.parent
+    / "lib"
+    / "pbio"
+    / "platform"
+    / "motors"
+    / "observer_settings.h"
+)
+
+# Physical model of a motor.
+#
+# name:     Suffix of the generated settings_observer_<name> table.
+# guard:    Preprocessor condition under which the motor is supported.
+# k_0:      Torque (Nm) per volt.
+# k_1:      Inertia term.
+# k_2:      Back EMF and damping term.
+# f_low:    Coulomb friction torque (Nm).
+# obs_gain: Observer feedback gain, or None if the motor has no observer model.
+Motor = namedtuple("Motor", ["name", "guard", "k_0", "k_1", "k_2", "f_low", "obs_gain"])
+
+EV3 = "PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO || PBDRV_CONFIG_COUNTER_NXT"
+LPF2 = "PBDRV_CONFIG_IOPORT_LPF2 || PBDRV_CONFIG_COUNTER_TEST"
+MOVEHUB = "(" + LPF2 + ") && PBDRV_CONFIG_COUNTER_STM32F0_GPIO_QUAD_ENC"
+
+MOTORS = [
+    Motor(
+        "ev3_m",
+        EV3,
+        0.02222706190764267,
+        0.000204397590361446,
+        0.00262048192771084,
+        0.009158620689655174,
+        None,
+    ),
+    Motor(
+        "ev3_l",
+        EV3,
+        0.049886243386243395,
+        0.000433486238532110,
+        0.00412844036697248,
+        0.00823809523809524,
+        None,
+    ),
+    Motor(
+        "technic_m_angular",
+        LPF2,
+        0.02258435646747968,
+        0.000267785410941794,
+        0.00643543836108826,
+        0.01218641268292683,
+        0.002,
+    ),
+    Motor(
+        "technic_l_angular",
+        LPF2,
+        0.052359221241860474,
+        0.000337807915176920,
+        0.00666198910636721,
+        0.011619602790697674,
+        0.004,
+    ),
+    Motor(
+        "interactive",
+        LPF2,
+        0.01500933205496964,
+        0.000275066965901687,
+        0.00539346991964092,
+        0.005613422818791947,
+        0.002,
+    ),
+    Motor(
+        "movehub",
+        MOVEHUB,
+        0.02120903269295585,
+        0.000260968229954614,
+        0.00372811757078020,
+        0.012417391304347828,
+        0.002,
+    ),
+    Motor(
+        "technic_l",
+        LPF2,
+        0.029291367521367528,
+        0.000269922879177378,
+        0.00428449014567267,
+        0.013215000000000001,
+        0.002,
+    ),
+    Motor(
+        "technic_xl",
+        LPF2,
+        0.025904742547425474,
+        0.000283410138248848,
+        0.00429409300377042,
+        0.006446341463414635,
+        0.002,
+    ),
+]
+
+HEADER = """\
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2018-2020 The Pybricks Authors
+
+// This file is generated by tools/observer-settings.py. Do not edit.
+// Loop time: {loop_time} ms
+
+#include <pbio/observer.h>
+"""
+
+TABLE = """
+#if {guard}
+
+static const pbio_observer_settings_t settings_observer_{name} = {{
+    .phi_01 = PBIO_OBSERVER_COEF({phi_01}),
+    .phi_11 = PBIO_OBSERVER_COEF({phi_11}),
+    .gam_0 = PBIO_OBSERVER_COEF({gam_0}),
+    .gam_1 = PBIO_OBSERVER_COEF({gam_1}),
+    .k_0 = PBIO_OBSERVER_COEF({k_0}),
+    .f_low = PBIO_OBSERVER_COEF({f_low}),
+    .obs_gain = PBIO_OBSERVER_COEF({obs_gain}),
+    .ff_friction = {ff_friction},
+    .ff_rate = PBIO_OBSERVER_COEF({ff_rate}),
+    .ff_acceleration = PBIO_OBSERVER_COEF({ff_acceleration}),
+    .duty_per_torque = PBIO_OBSERVER_COEF({duty_per_torque}),
+}};
+
+#endif // {guard}
+"""
+
+
+def coefficients(motor, loop_time):
+    """Derives the observer coefficients of a motor.
+
+    Parameters
+    ----------
+    motor : Motor
+        Physical model of the motor.
+    loop_time : float
+        Control loop time in seconds.
+
+    Returns
+    -------
+    dict
+        Coefficients of the pbio_observer_settings_t table.
+    """
+    coef = {
+        "name": motor.name,
+        "guard": motor.guard,
+        "k_0": motor.k_0,
+        "f_low": motor.f_low,
+        # Torques are in micronewtons in the feedforward model.
+        "ff_friction": int(motor.f_low * 1000000),
+        "ff_rate": motor.k_0 * motor.k_2 * 1000000,
+        "ff_acceleration": motor.k_0 * motor.k_1 * 1000000,
+        # Duty (0--10000) times mV per micronewton
+        "duty_per_torque": 10 / motor.k_0,
+    }
+
+    if motor.obs_gain is None:
+        coef.update(phi_01=0, phi_11=0, gam_0=0, gam_1=0, obs_gain=0)
+        return coef
+
+    a = motor.k_2 / motor.k_1
+    b = 1 / (motor.k_0 * motor.k_1)
+    phi_11 = math.exp(-a * loop_time)
+    phi_01 = (1 - phi_11) / a
+
+    coef.update(
+        phi_01=phi_01,
+        phi_11=phi_11,
+        gam_0=b * (loop_time - phi_01) / a,
+        gam_1=b * phi_01,
+        obs_gain=motor.obs_gain,
+    )
+    return coef
+
+
+def format_value(value):
+    if isinstance(value, int):
+        return str(value)
+    return "{:.15g}".format(value)
+
+
+def generate(loop_time_ms):
+    """Returns the contents of the generated header."""
+    text = HEADER.format(loop_time=loop_time_ms)
+    for motor in MOTORS:
+        coef = coefficients(motor, loop_time_ms / 1000)
+        text += TABLE.format(
+            **{k: v if k in ("name", "guard") else format_value(v) for k, v in coef.items()}
+        )
+    return text
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "--loop-time",
+        type=int,
+        default=5,
+        help="control loop time in ms (PBIO_CONTROL_LOOP_TIME_MS)",
+    )
+    parser.add_argument("--output", type=Path, default=OUTPUT, help="output file")
+    args = parser.parse_args()
+
+    args.output.write_text(generate(args.loop_time))
+
+
+if __name__ == "__main__":
+    main()
@@ -4,9 +4,20 @@
 # Copyright (c) 2019-2020 The Pybricks Authors
 
 import argparse
+import functools
+import operator
 import serial
+import struct
 import time
-from mpybytes import mpy_bytes_from_file, mpy_bytes_from_str
+from mpybytes import (
+    DOWNLOAD_CHUNK_SIZE,
+    DOWNLOAD_MAGIC,
+    download_data_frame,
+    download_header_frame,
+    download_status_frame,
+    mpy_bytes_from_file,
+    mpy_bytes_from_str,
+)
 
 
 def send_message(ser, data):
@@ -33,35 +44,134 @@ def send_message(ser, data):
         raise ValueError("Did not receive expected checksum.")
 
 
-def download_and_run(device, mpy_bytes):
-    """Split bytes from an MPY file into chunks and send to the hub."""
+def read_download_status(ser, timeout=0.5):
+    """Read the first missing chunk and the bitmap of received chunks after
+    it from the hub. Returns None if there was no reply in time."""
+    reply = b""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        reply += ser.read(7 - len(reply))
+        if len(reply) == 7:
+            if reply[0] != ord("S"):
+                return None
+            return struct.unpack("<HI", reply[1:])
+        time.sleep(0.01)
+    return None
 
-    # Open serial port
-    ser = serial.Serial(device, baudrate=115200, timeout=0)
 
-    # Get the mpy file size as 4 bytes
-    send_message(ser, len(mpy_bytes).to_bytes(4, byteorder="big"))
+def send_program(ser, mpy_bytes, window=32, retries=10):
+    """Send the program in chunks that the hub checks one by one, sending
+    again only the chunks that the hub did not get."""
+
+    # Select the chunked download instead of sending the program size
+    send_message(ser, DOWNLOAD_MAGIC)
+
+    num_chunks = (len(mpy_bytes) + DOWNLOAD_CHUNK_SIZE - 1) // DOWNLOAD_CHUNK_SIZE
+    request = download_header_frame(mpy_bytes)
+    failures = 0
 
-    # Split binary up in digestable chunks
-    n = 100
-    chunks = [mpy_bytes[i : i + n] for i in range(0, len(mpy_bytes), n)]
+    while True:
+        ser.reset_input_buffer()
+        ser.write(request)
+        status = read_download_status(ser)
+        if status is None:
+            failures += 1
+            if failures > retries:
+                raise OSError("Did not receive download status.")
+            # Ask again. The hub keeps the chunks it has for the same header.
+            request = download_header_frame(mpy_bytes)
+            continue
+        failures = 0
+
+        next_chunk, received = status
+        if next_chunk == num_chunks:
+            # Nothing was sent if the hub already had this program
+            return
+
+        # Send the missing chunks of this window, then ask what is left
+        missing = [
+            next_chunk + i
+            for i in range(min(window, num_chunks - next_chunk))
+            if not received & (1 << i)
+        ]
+        request = b"".join(download_data_frame(mpy_bytes, i) for i in missing)
+        request += download_status_frame()
+
+
+LOG_FRAME_START = 0xA5
+
+
+def read_varint(payload, i):
+    """Read a base-128 varint from payload at i. Returns value and next i."""
+    value = shift = 0
+    while True:
+        b = payload[i]
+        value |= (b & 0x7F) << shift
+        shift += 7
+        i += 1
+        if not b & 0x80:
+            return value, i
 
-    # Send the data
-    for chunk in chunks:
-        send_message(ser, chunk)
 
-    # Give hub time to start program
-    time.sleep(0.2)
+def split_log_frames(data):
+    """Separate binary log frames sent by Logger.drain() from text output.
+
+    Returns the text and the decoded rows. Rows lost on the hub are reported
+    as a row with only the number of lost rows in it.
+    """
+    text = bytearray()
+    rows = []
+    prev = []
+    i = 0
+    while i < len(data):
+        size = data[i + 1] if i + 1 < len(data) else 0
+        end = i + 2 + size
+        if (
+            data[i] != LOG_FRAME_START
+            or end >= len(data)
+            or data[end] != functools.reduce(operator.xor, data[i + 2 : end], 0)
+        ):
+            text.append(data[i])
+            i += 1
+            continue
+
+        # Decode number of lost rows, then the zigzag encoded differences
+        payload = data[i + 2 : end]
+        lost, j = read_varint(payload, 0)
+        if lost:
+            rows.append(["lost", lost])
+        values = []
+        while j < len(payload):
+            zigzag, j = read_varint(payload, j)
+            values.append((zigzag >> 1) ^ -(zigzag & 1))
+        prev = [d + (prev[k] if k < len(prev) else 0) for k, d in enumerate(values)]
+        rows.append(prev)
+        i = end + 1
+
+    return bytes(text), rows
 
-    # Read first part of response
-    data = ser.read_all()
-    printed = 0
 
-    # Read status to see if program started
+def download_and_run(device, mpy_bytes):
+    """Send bytes from an MPY file to the hub and run them."""
+
+    # Open serial port
+    ser = serial.Serial(device, baudrate=115200, timeout=0)
+
+    # Send the program
+    send_program(ser, mpy_bytes)
+
+    # Give hub time to start program. Storing a new program in flash may
+    # take a few seconds.
     RUNNING = b">>>> RUNNING"
     IDLE = b">>>> IDLE"
-    if RUNNING not in data:
-        raise OSError("Failed to run program")
+    data = b""
+    printed = 0
+    deadline = time.monotonic() + 5
+    while RUNNING not in data:
+        if time.monotonic() > deadline:
+            raise OSError("Failed to run program")
+        time.sleep(0.1)
+        data += ser.read_all()
 
     # Read from serial until idle status
     while True:
@@ -69,7 +179,7 @@ def download_and_run(device, mpy_bytes):
         data += ser.read_all()
 
         # Split into lines, printing anything new
-        text = data.decode().split("\r\n")
+        text = split_log_frames(data)[0].decode(errors="ignore").split("\r\n")
         while printed < len(text):
             print(text[printed - 1])
             printed += 1
@@ -79,6 +189,13 @@ def download_and_run(device, mpy_bytes):
         if IDLE in data:
             break
 
+    # Save streamed log rows, if any
+    data, rows = split_log_frames(data)
+    if rows:
+        with open("log_stream.txt", "w") as f:
+            for row in rows:
+                print(*row, sep=",", file=f)
+
     # Save log if detected in output
     start_key = b"PB_OF"
     end_key = b"PB_EOF"